@@ -1,9 +1,10 @@
 #pragma once
 
 #include "DetectionConfiguration.h"
+#include "StaticStringMap.h"
 
-#include <vector>
-#include <string>
+#include <array>
+#include <string_view>
 
 #define SIZE_NORMALIZTION (1500UL)
 #define TIME_NORMALIZATON (1000000000UL)
@@ -45,6 +46,92 @@ enum class ServiceQuality {
     bad
 };
 
-extern std::vector <std::string> MultiConnectionTypeString;
-extern std::vector <std::string> MultiConnectionTypeSybtypeString;
-extern std::vector <std::string> ServiceQualityString;
+// Names of enum values, indexed by the numeric value of the enum (MultiConnectionType starts at 1)
+constexpr std::array<std::string_view, 13> MultiConnectionTypeString =
+{
+    "", "small", "unclassified", "gaming", "streaming_tcp", "streaming_udp", "streaming_video", "browsing",
+    "live_streaming_udp", "upload_tcp", "upload_udp", "untrusted", "undefined"
+};
+constexpr std::array<std::string_view, 5> MultiConnectionSubtypeString =
+{
+    "undefined", "gaming_menu", "gaming_ingame", "gaming_difficult", "lag"
+};
+constexpr std::array<std::string_view, 5> ServiceQualityString =
+{
+    "undefined", "perfect", "good", "ok", "bad"
+};
+
+static_assert( MultiConnectionTypeString.size() == static_cast<size_t>(MultiConnectionType::undefined) + 1 );
+static_assert( MultiConnectionSubtypeString.size() == static_cast<size_t>(MultiConnectionSubtype::lag) + 1 );
+static_assert( ServiceQualityString.size() == static_cast<size_t>(ServiceQuality::bad) + 1 );
+
+namespace detail {
+
+template <typename Enum, std::size_t N, std::size_t First>
+constexpr StaticStringMap<Enum, N - First> make_enum_map( const std::array<std::string_view, N>& names )
+{
+    std::array<typename StaticStringMap<Enum, N - First>::Entry, N - First> entries{};
+    for ( std::size_t i = First; i < N; ++i ) entries[i - First] = { names[i], static_cast<Enum>(i) };
+    return StaticStringMap<Enum, N - First>(entries);
+}
+
+constexpr auto kMultiConnectionTypeMap    = make_enum_map<MultiConnectionType, 13, 1>(MultiConnectionTypeString);
+constexpr auto kMultiConnectionSubtypeMap = make_enum_map<MultiConnectionSubtype, 5, 0>(MultiConnectionSubtypeString);
+constexpr auto kServiceQualityMap         = make_enum_map<ServiceQuality, 5, 0>(ServiceQualityString);
+
+template <typename Enum, std::size_t N>
+constexpr std::string_view enum_name( const std::array<std::string_view, N>& names, Enum value )
+{
+    auto index = static_cast<std::size_t>(value);
+    return (index < N) ? names[index] : std::string_view{};
+}
+
+template <typename Map, std::size_t N>
+constexpr bool round_trips( const Map& map, const std::array<std::string_view, N>& names )
+{
+    for ( const auto& entry : map.entries() )
+    {
+        if ( names[static_cast<std::size_t>(entry.value)] != entry.name ) return false;
+        auto value = entry.value;
+        if ( !map.find(entry.name, &value) || (value != entry.value) ) return false;
+    }
+    return true;
+}
+
+static_assert( round_trips(kMultiConnectionTypeMap, MultiConnectionTypeString) );
+static_assert( round_trips(kMultiConnectionSubtypeMap, MultiConnectionSubtypeString) );
+static_assert( round_trips(kServiceQualityMap, ServiceQualityString) );
+
+} // namespace detail
+
+//! Name of an enum value, or an empty string for values outside the enum
+constexpr std::string_view to_string( MultiConnectionType value )
+{
+    return detail::enum_name( MultiConnectionTypeString, value );
+}
+constexpr std::string_view to_string( MultiConnectionSubtype value )
+{
+    return detail::enum_name( MultiConnectionSubtypeString, value );
+}
+constexpr std::string_view to_string( ServiceQuality value )
+{
+    return detail::enum_name( ServiceQualityString, value );
+}
+
+//! Parse the name of an enum value
+//!
+//! \param name  - the enum value name as returned by to_string
+//! \param value - receives the parsed value on success
+//! \return true on success, false if the name is unknown
+constexpr bool from_string( std::string_view name, MultiConnectionType* value )
+{
+    return detail::kMultiConnectionTypeMap.find( name, value );
+}
+constexpr bool from_string( std::string_view name, MultiConnectionSubtype* value )
+{
+    return detail::kMultiConnectionSubtypeMap.find( name, value );
+}
+constexpr bool from_string( std::string_view name, ServiceQuality* value )
+{
+    return detail::kServiceQualityMap.find( name, value );
+}
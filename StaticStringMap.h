@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+//! Compile-time perfect-hashed map from a fixed set of strings to values.
+//!
+//! The hash mixes the length and four characters of the key with a seed; the seed is searched at
+//! compile time until every key lands in its own slot, so a lookup is one hash, one table load and
+//! one string compare. Construction fails to compile if no collision-free seed is found.
+template <typename Value, std::size_t N>
+class StaticStringMap
+{
+public:
+
+    struct Entry
+    {
+        std::string_view    name;
+        Value               value;
+    };
+
+    static constexpr std::size_t kSlots = [] {
+        std::size_t slots = 4;
+        while ( slots < 2 * N ) slots *= 2;
+        return slots;
+    }();
+
+    static_assert( N < 255, "StaticStringMap is intended for small enum tables" );
+
+    constexpr explicit StaticStringMap( const std::array<Entry, N>& entries ) :
+        entries_(entries), slots_{}, seed_(find_seed(entries))
+    {
+        for ( std::size_t i = 0; i < N; ++i )
+        {
+            slots_[slot_of(seed_, entries_[i].name)] = static_cast<uint8_t>(i + 1);
+        }
+    }
+
+    //! Look up a string
+    //!
+    //! \param name  - the string to seek
+    //! \param value - receives the mapped value if found, untouched otherwise
+    //! \return true if the string is one of the keys
+    constexpr bool find( std::string_view name, Value* value ) const
+    {
+        auto index = slots_[slot_of(seed_, name)];
+        if ( (index == 0) || (entries_[index - 1].name != name) ) return false;
+        *value = entries_[index - 1].value;
+        return true;
+    }
+
+    //! Look up a string, returning fallback if not found
+    constexpr Value find_or( std::string_view name, Value fallback ) const
+    {
+        Value value = fallback;
+        find( name, &value );
+        return value;
+    }
+
+    constexpr const std::array<Entry, N>& entries() const { return entries_; }
+
+private:
+
+    std::array<Entry, N>        entries_;
+    std::array<uint8_t, kSlots> slots_;
+    uint32_t                    seed_;
+
+    static constexpr std::size_t slot_of( uint32_t seed, std::string_view name )
+    {
+        auto size = static_cast<uint32_t>(name.size());
+        uint32_t h = seed ^ (size * 0x9E3779B1u);
+        if ( size != 0 )
+        {
+            h = (h ^ static_cast<uint8_t>(name[0]))            * 0x85EBCA6Bu;
+            h = (h ^ static_cast<uint8_t>(name[size / 2]))     * 0xC2B2AE35u;
+            h = (h ^ static_cast<uint8_t>(name[size - 1]))     * 0x27D4EB2Fu;
+            h = (h ^ static_cast<uint8_t>(name[size > 1 ? size - 2 : 0])) * 0x165667B1u;
+        }
+        return (h ^ (h >> 15)) & (kSlots - 1);
+    }
+
+    static constexpr uint32_t find_seed( const std::array<Entry, N>& entries )
+    {
+        for ( uint32_t seed = 1; seed < 4096; ++seed )
+        {
+            std::array<bool, kSlots> used{};
+            bool collision = false;
+            for ( std::size_t i = 0; (i < N) && !collision; ++i )
+            {
+                auto slot = slot_of(seed, entries[i].name);
+                collision = used[slot];
+                used[slot] = true;
+            }
+            if ( !collision ) return seed;
+        }
+        throw "StaticStringMap: no perfect hash seed found"; // Not a constant expression: fails the build
+    }
+};
@@ -20,10 +20,14 @@
  */
 
 #include "json11.hpp"
+#include <atomic>
 #include <cassert>
+#include <charconv>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <limits>
 
 namespace json11 {
@@ -222,6 +226,104 @@ public:
     JsonNull() : Value({}) {}
 };
 
+/* * * * * * * * * * * * * * * * * * * *
+ * Arena allocation - used by JsonParse::FAST
+ */
+
+/* JsonArena
+ *
+ * Bump allocator for the values of one parse. It counts the values allocated from it and deletes
+ * itself when the last one is released. Allocation happens only on the parsing thread and is not
+ * counted atomically; the count is folded into the atomic reference count when the parse ends.
+ */
+class JsonArena final {
+public:
+    void * allocate(size_t size, size_t align) {
+        size_t offset = (m_used + align - 1) & ~(align - 1);
+        if (m_blocks.empty() || offset + size > block_size) {
+            m_blocks.emplace_back(new char[size > block_size ? size : block_size]);
+            offset = 0;
+        }
+        m_used = offset + size;
+        m_allocations++;
+        return m_blocks.back().get() + offset;
+    }
+
+    // A value allocated from the arena was released
+    void release() {
+        drop(1);
+    }
+
+    // The parse is over: from now on only the values hold the arena
+    void finish_parse() {
+        drop(parse_bias - m_allocations);
+    }
+
+private:
+    // Keeps the arena alive while parsing, even if every value allocated so far has been released
+    static const uint64_t parse_bias = uint64_t(1) << 62;
+    // Blocks stay below the malloc mmap threshold, so they are recycled by the heap between parses
+    static const size_t block_size = 32 * 1024;
+
+    vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_used = 0;
+    uint64_t m_allocations = 0;
+    std::atomic<uint64_t> m_refs { parse_bias };
+
+    void drop(uint64_t count) {
+        if (m_refs.fetch_sub(count, std::memory_order_acq_rel) == count)
+            delete this;
+    }
+};
+
+template <typename T>
+struct JsonArenaAllocator {
+    typedef T value_type;
+
+    JsonArena * arena;
+
+    explicit JsonArenaAllocator(JsonArena * a) : arena(a) {}
+    template <typename U>
+    JsonArenaAllocator(const JsonArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T * allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) { arena->release(); }
+
+    template <typename U>
+    bool operator==(const JsonArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const JsonArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+/* JsonFactory
+ *
+ * Creates the values of one parse, either with make_shared or from an arena.
+ */
+class JsonFactory final {
+public:
+    explicit JsonFactory(bool use_arena)
+        : m_arena(use_arena ? new JsonArena() : nullptr) {}
+
+    ~JsonFactory() {
+        if (m_arena)
+            m_arena->finish_parse();
+    }
+
+    JsonFactory(const JsonFactory &) = delete;
+    JsonFactory & operator=(const JsonFactory &) = delete;
+
+    template <typename V, typename... Args>
+    Json make(Args &&... args) {
+        if (!m_arena)
+            return Json(std::shared_ptr<JsonValue>(make_shared<V>(std::forward<Args>(args)...)));
+        return Json(std::shared_ptr<JsonValue>(
+            std::allocate_shared<V>(JsonArenaAllocator<V>(m_arena), std::forward<Args>(args)...)));
+    }
+
+private:
+    JsonArena * m_arena;
+};
+
 /* * * * * * * * * * * * * * * * * * * *
  * Static globals - static-init-safe
  */
@@ -353,6 +455,8 @@ struct JsonParser final {
     string &err;
     bool failed;
     const JsonParse strategy;
+    JsonFactory factory;
+    vector<Json> elements;  // elements of the arrays being parsed, so each array is allocated once at its final size
 
     /* fail(msg, err_ret = Json())
      *
@@ -375,6 +479,15 @@ struct JsonParser final {
      * Advance until the current character is non-whitespace.
      */
     void consume_whitespace() {
+        // Skip indentation eight spaces at a time
+        static const uint64_t spaces = 0x2020202020202020ull;
+        uint64_t word;
+        while (i + 8 <= str.size()) {
+            std::memcpy(&word, str.data() + i, 8);
+            if (word != spaces)
+                break;
+            i += 8;
+        }
         while (str[i] == ' ' || str[i] == '\r' || str[i] == '\n' || str[i] == '\t')
             i++;
     }
@@ -494,11 +607,15 @@ struct JsonParser final {
             if (in_range(ch, 0, 0x1f))
                 return fail("unescaped " + esc(ch) + " in string", "");
 
-            // The usual case: non-escaped characters
+            // The usual case: non-escaped characters, copied a run at a time
             if (ch != '\\') {
                 encode_utf8(last_escaped_codepoint, out);
                 last_escaped_codepoint = -1;
-                out += ch;
+                size_t start = i - 1;
+                while (i < str.size() && str[i] != '"' && str[i] != '\\'
+                       && static_cast<uint8_t>(str[i]) > 0x1f)
+                    i++;
+                out.append(str, start, i - start);
                 continue;
             }
 
@@ -591,7 +708,9 @@ struct JsonParser final {
 
         if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
                 && (i - start_pos) <= static_cast<size_t>(std::numeric_limits<int>::digits10)) {
-            return std::atoi(str.c_str() + start_pos);
+            int value = 0;
+            std::from_chars(str.data() + start_pos, str.data() + i, value);
+            return factory.make<JsonInt>(value);
         }
 
         // Decimal part
@@ -618,7 +737,7 @@ struct JsonParser final {
                 i++;
         }
 
-        return std::strtod(str.c_str() + start_pos, nullptr);
+        return factory.make<JsonDouble>(std::strtod(str.c_str() + start_pos, nullptr));
     }
 
     /* expect(str, res)
@@ -664,14 +783,18 @@ struct JsonParser final {
         if (ch == 'n')
             return expect("null", Json());
 
-        if (ch == '"')
-            return parse_string();
+        if (ch == '"') {
+            string value = parse_string();
+            if (failed)
+                return Json();
+            return factory.make<JsonString>(move(value));
+        }
 
         if (ch == '{') {
             map<string, Json> data;
             ch = get_next_token();
             if (ch == '}')
-                return data;
+                return factory.make<JsonObject>(move(data));
 
             while (1) {
                 if (ch != '"')
@@ -697,20 +820,21 @@ struct JsonParser final {
 
                 ch = get_next_token();
             }
-            return data;
+            return factory.make<JsonObject>(move(data));
         }
 
         if (ch == '[') {
-            vector<Json> data;
+            const size_t first = elements.size();
             ch = get_next_token();
             if (ch == ']')
-                return data;
+                return factory.make<JsonArray>(vector<Json>());
 
             while (1) {
                 i--;
-                data.push_back(parse_json(depth + 1));
+                Json element = parse_json(depth + 1);
                 if (failed)
                     return Json();
+                elements.push_back(move(element));
 
                 ch = get_next_token();
                 if (ch == ']')
@@ -721,7 +845,10 @@ struct JsonParser final {
                 ch = get_next_token();
                 (void)ch;
             }
-            return data;
+            vector<Json> data(std::make_move_iterator(elements.begin() + first),
+                              std::make_move_iterator(elements.end()));
+            elements.resize(first);
+            return factory.make<JsonArray>(move(data));
         }
 
         return fail("expected value, got " + esc(ch));
@@ -730,7 +857,7 @@ struct JsonParser final {
 }//namespace {
 
 Json Json::parse(const string &in, string &err, JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+    JsonParser parser { in, 0, err, false, strategy, JsonFactory(strategy == JsonParse::FAST), {} };
     Json result = parser.parse_json(0);
 
     // Check for any trailing garbage
@@ -748,7 +875,7 @@ vector<Json> Json::parse_multi(const string &in,
                                std::string::size_type &parser_stop_pos,
                                string &err,
                                JsonParse strategy) {
-    JsonParser parser { in, 0, err, false, strategy };
+    JsonParser parser { in, 0, err, false, strategy, JsonFactory(strategy == JsonParse::FAST), {} };
     parser_stop_pos = 0;
     vector<Json> json_vec;
     while (parser.i != in.size() && !parser.failed) {
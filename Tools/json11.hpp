@@ -70,11 +70,16 @@
 
 namespace json11 {
 
+/* Parse strategies. FAST accepts the same grammar as STANDARD but allocates all values of one parse
+ * from a shared arena that lives as long as any of them. Use it for large documents that are read
+ * once and then dropped: the memory of the values is returned only when the last one is released.
+ */
 enum JsonParse {
-    STANDARD, COMMENTS
+    STANDARD, COMMENTS, FAST
 };
 
 class JsonValue;
+class JsonFactory;
 
 class Json final {
 public:
@@ -205,6 +210,9 @@ public:
     bool has_shape(const shape & types, std::string & err) const;
 
 private:
+    friend class JsonFactory;
+    explicit Json(std::shared_ptr<JsonValue> value) noexcept : m_ptr(std::move(value)) {}
+
     std::shared_ptr<JsonValue> m_ptr;
 };
 
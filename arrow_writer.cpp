@@ -0,0 +1,464 @@
+#include "arrow_writer.h"
+#include "domain_hash.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// The metadata of Arrow messages is a FlatBuffers table; the constants are those of Schema.fbs and Message.fbs
+static const int16_t kMetadataVersionV5 = 4;
+static const uint8_t kHeaderSchema = 1;
+static const uint8_t kHeaderDictionaryBatch = 2;
+static const uint8_t kHeaderRecordBatch = 3;
+static const uint8_t kTypeInt = 2;
+static const uint8_t kTypeUtf8 = 5;
+static const uint32_t kContinuation = 0xFFFFFFFF;
+
+//! Dictionary ids of the columns
+enum DictionaryId : int64_t { kDomainDictionary, kProtocolDictionary, kCategoryDictionary, kSubtypeDictionary };
+
+static const std::array<std::string_view, 2> kProtocolNames = { "udp", "tcp" };
+
+static_assert( int(ProtocolType::UDP) == 0 && int(ProtocolType::TCP) == 1, "the protocol dictionary is indexed by ProtocolType" );
+
+//! Size of a buffer padded to 8 bytes, the alignment of the buffers of a message body
+static size_t padded( size_t size )
+{
+    return (size + 7) & ~size_t( 7 );
+}
+
+namespace {
+
+//! Builds FlatBuffers back to front the way the FlatBuffers library does, children before their parent so
+//! that every offset points forward; only what the Arrow metadata needs. The position of an object is the
+//! size of the buffer, counted from its end, once the object is written.
+class FlatBuilder
+{
+public:
+
+    //! A pair of 64-bit integers: the FieldNode and Buffer structs of the Arrow metadata
+    using Pair = std::array<int64_t, 2>;
+
+    FlatBuilder() : buffer_( 1024 ), head_( buffer_.size() ) {}
+
+    uint32_t size() const { return uint32_t( buffer_.size() - head_ ); }
+
+    template <typename T>
+    void push( T value )
+    {
+        reserve( sizeof(T) );
+        head_ -= sizeof( T );
+        std::memcpy( &buffer_[head_], &value, sizeof(T) );
+    }
+
+    //! Pad with zeros so that the size is a multiple of alignment once bytes more are written
+    void align( size_t alignment, size_t bytes = 0 )
+    {
+        while ( (size() + bytes) % alignment != 0 ) push<uint8_t>( 0 );
+    }
+
+    uint32_t create_string( std::string_view text )
+    {
+        align( 4, text.size() + 1 );
+        push<uint8_t>( 0 );
+        reserve( text.size() );
+        head_ -= text.size();
+        std::memcpy( &buffer_[head_], text.data(), text.size() );
+        push<uint32_t>( uint32_t(text.size()) );
+        return size();
+    }
+
+    //! Vector of tables
+    uint32_t create_vector( const std::vector<uint32_t>& positions )
+    {
+        align( 4, positions.size() * 4 );
+        for ( auto i = positions.size(); i-- > 0; ) push<uint32_t>( offset_to(positions[i]) );
+        push<uint32_t>( uint32_t(positions.size()) );
+        return size();
+    }
+
+    //! Vector of FieldNode or Buffer structs
+    uint32_t create_vector( const std::vector<Pair>& pairs )
+    {
+        align( 8, pairs.size() * sizeof(Pair) );
+        for ( auto i = pairs.size(); i-- > 0; )
+        {
+            push<int64_t>( pairs[i][1] );
+            push<int64_t>( pairs[i][0] );
+        }
+        push<uint32_t>( uint32_t(pairs.size()) );
+        return size();
+    }
+
+    void start_table()
+    {
+        fields_ = 0;
+        table_start_ = size();
+    }
+
+    template <typename T>
+    void add_field( int id, T value )
+    {
+        align( sizeof(T) );
+        push<T>( value );
+        add_position( id );
+    }
+
+    void add_offset( int id, uint32_t position )
+    {
+        push<uint32_t>( offset_to(position) );
+        add_position( id );
+    }
+
+    //! Write the vtable of the table started, placed right before it
+    uint32_t end_table()
+    {
+        align( 4 );
+        push<int32_t>( 0 );
+        auto table = size();
+
+        std::array<uint16_t, 2 + kMaxFields> vtable{};
+        int count = 0;
+        for ( int i = 0; i < fields_; ++i )
+        {
+            vtable[2 + field_ids_[i]] = uint16_t( table - field_positions_[i] );
+            count = std::max( count, field_ids_[i] + 1 );
+        }
+        vtable[0] = uint16_t( (2 + count) * sizeof(uint16_t) );
+        vtable[1] = uint16_t( table - table_start_ );
+        for ( auto i = 2 + count; i-- > 0; ) push<uint16_t>( vtable[i] );
+
+        // The table starts with the distance back to its vtable
+        auto distance = int32_t( size() - table );
+        std::memcpy( &buffer_[buffer_.size() - table], &distance, sizeof(distance) );
+        return table;
+    }
+
+    //! Write the offset of the root table; the size of the result is a multiple of 8
+    std::string_view finish( uint32_t root )
+    {
+        align( 8, 4 );
+        push<uint32_t>( offset_to(root) );
+        return std::string_view( &buffer_[head_], size() );
+    }
+
+private:
+
+    static const int kMaxFields = 8;
+
+    std::vector<char>   buffer_;
+    size_t              head_;              //!< start of the bytes written
+    uint32_t            table_start_ = 0;
+    int                 fields_ = 0;
+    int                 field_ids_[kMaxFields];
+    uint32_t            field_positions_[kMaxFields];
+
+    void reserve( size_t bytes )
+    {
+        if ( head_ >= bytes ) return;
+        auto used = size();
+        std::vector<char> grown( std::max(2 * buffer_.size(), used + bytes) );
+        std::memcpy( grown.data() + grown.size() - used, buffer_.data() + head_, used );
+        head_ = grown.size() - used;
+        buffer_.swap( grown );
+    }
+
+    //! Value of an offset to an object, written next
+    uint32_t offset_to( uint32_t position )
+    {
+        align( 4 );
+        return size() + sizeof(uint32_t) - position;
+    }
+
+    void add_position( int id )
+    {
+        field_ids_[fields_] = id;
+        field_positions_[fields_] = size();
+        ++fields_;
+    }
+};
+
+//! Layout of a message body: the nodes, one per column, and their buffers, each at a multiple of 8 bytes
+struct BodyLayout
+{
+    std::vector<FlatBuilder::Pair>  nodes;
+    std::vector<FlatBuilder::Pair>  buffers;
+    size_t                          size = 0;
+
+    void add_node( size_t length ) { nodes.push_back( { int64_t(length), 0 } ); }
+
+    //! Add a buffer and return its offset in the body
+    size_t add_buffer( size_t bytes )
+    {
+        buffers.push_back( { int64_t(size), int64_t(bytes) } );
+        auto offset = size;
+        size += padded( bytes );
+        return offset;
+    }
+};
+
+} // namespace
+
+//! Write a RecordBatch table
+static uint32_t create_record_batch( FlatBuilder& builder, size_t length, const BodyLayout& layout )
+{
+    auto nodes = builder.create_vector( layout.nodes );
+    auto buffers = builder.create_vector( layout.buffers );
+    builder.start_table();
+    builder.add_field<int64_t>( 0, int64_t(length) );
+    builder.add_offset( 1, nodes );
+    builder.add_offset( 2, buffers );
+    return builder.end_table();
+}
+
+//! Write an Int table
+static uint32_t create_int_type( FlatBuilder& builder, int bit_width, bool is_signed )
+{
+    builder.start_table();
+    builder.add_field<int32_t>( 0, bit_width );
+    builder.add_field<uint8_t>( 1, is_signed );
+    return builder.end_table();
+}
+
+//! Write a non nullable Field table of a column; a dictionary encoded column has a dictionary id and an index width
+static uint32_t create_field( FlatBuilder& builder, std::string_view name, int64_t dictionary_id, int bit_width )
+{
+    auto name_position = builder.create_string( name );
+    auto children = builder.create_vector( std::vector<uint32_t>() );
+    uint32_t type;
+    uint32_t dictionary = 0;
+    if ( dictionary_id >= 0 )
+    {
+        builder.start_table();
+        type = builder.end_table();
+
+        auto index_type = create_int_type( builder, bit_width, true );
+        builder.start_table();
+        builder.add_field<int64_t>( 0, dictionary_id );
+        builder.add_offset( 1, index_type );
+        dictionary = builder.end_table();
+    }
+    else type = create_int_type( builder, bit_width, false );
+
+    builder.start_table();
+    builder.add_offset( 0, name_position );
+    builder.add_offset( 3, type );
+    if ( dictionary != 0 ) builder.add_offset( 4, dictionary );
+    builder.add_offset( 5, children );
+    builder.add_field<uint8_t>( 2, (dictionary != 0) ? kTypeUtf8 : kTypeInt );
+    return builder.end_table();
+}
+
+//! Append the encapsulation and the metadata of a message; its body follows
+static void append_message( FlatBuilder& builder, uint8_t header_type, uint32_t header, size_t body_size, std::string* output )
+{
+    builder.start_table();
+    builder.add_field<int64_t>( 3, int64_t(body_size) );
+    builder.add_offset( 2, header );
+    builder.add_field<int16_t>( 0, kMetadataVersionV5 );
+    builder.add_field<uint8_t>( 1, header_type );
+    auto metadata = builder.finish( builder.end_table() );
+
+    auto metadata_size = uint32_t( metadata.size() );
+    output->append( reinterpret_cast<const char*>(&kContinuation), sizeof(kContinuation) );
+    output->append( reinterpret_cast<const char*>(&metadata_size), sizeof(metadata_size) );
+    output->append( metadata.data(), metadata.size() );
+}
+
+//! Append a buffer of a message body, padded
+static void append_buffer( const void* data, size_t size, std::string* output )
+{
+    output->append( static_cast<const char*>(data), size );
+    output->append( padded(size) - size, '\0' );
+}
+
+//! Append a dictionary batch of strings
+//!
+//! \param offsets - of the strings in names, one more than the strings, from 0
+//! \param names   - the strings, concatenated
+static void append_dictionary( int64_t id, bool delta, const std::vector<int32_t>& offsets, std::string_view names, std::string* output )
+{
+    BodyLayout layout;
+    layout.add_node( offsets.size() - 1 );
+    layout.add_buffer( 0 );
+    layout.add_buffer( offsets.size() * sizeof(int32_t) );
+    layout.add_buffer( names.size() );
+
+    FlatBuilder builder;
+    auto data = create_record_batch( builder, offsets.size() - 1, layout );
+    builder.start_table();
+    builder.add_field<int64_t>( 0, id );
+    builder.add_offset( 1, data );
+    builder.add_field<uint8_t>( 2, delta );
+    append_message( builder, kHeaderDictionaryBatch, builder.end_table(), layout.size, output );
+
+    append_buffer( offsets.data(), offsets.size() * sizeof(int32_t), output );
+    append_buffer( names.data(), names.size(), output );
+}
+
+//! Append the dictionary of the names of an enum
+template <size_t N>
+static void append_enum_dictionary( int64_t id, const std::array<std::string_view, N>& names, std::string* output )
+{
+    std::vector<int32_t> offsets( 1, 0 );
+    std::string text;
+    for ( auto name : names )
+    {
+        text += name;
+        offsets.push_back( int32_t(text.size()) );
+    }
+    append_dictionary( id, false, offsets, text, output );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+ArrowWriter::ArrowWriter()
+    : offsets_( 1, 0 )
+    , slots_( 1024, Slot{ 0, 0 } )
+{
+}
+
+//! Append a record batch to a stream
+void ArrowWriter::write_batch( const DomainTree::Query* queries, const MultiConnectionType* categories, const MultiConnectionSubtype* subtypes,
+                               size_t count, std::string* output )
+{
+    BodyLayout layout;
+    size_t columns[5];
+    const size_t widths[5] = { sizeof(int32_t), sizeof(uint16_t), sizeof(int8_t), sizeof(int8_t), sizeof(int8_t) };
+    for ( size_t i = 0; i < 5; ++i )
+    {
+        layout.add_node( count );
+        layout.add_buffer( 0 );
+        columns[i] = layout.add_buffer( count * widths[i] );
+    }
+
+    // Columns in place: the indices, the ports and the enum values; the padding stays zero
+    body_.assign( layout.size, '\0' );
+    auto* domains = &body_[columns[0]];
+    auto* ports = &body_[columns[1]];
+    auto mask = slots_.size() - 1;
+    for ( size_t first = 0; first < count; first += kLookupGroup )
+    {
+        // The slot, then the offsets and the name it points to are fetched for all the rows of the group before
+        // any is compared; the table may change while the names of the group are added, so the slots read
+        // beforehand are only hints for the prefetches
+        auto size = std::min( kLookupGroup, count - first );
+        uint64_t hashes[kLookupGroup];
+        for ( size_t i = 0; i < size; ++i )
+        {
+            hashes[i] = hash_string( queries[first + i].domain );
+            __builtin_prefetch( &slots_[hashes[i] & mask] );
+        }
+        uint32_t candidates[kLookupGroup];
+        for ( size_t i = 0; i < size; ++i )
+        {
+            candidates[i] = slots_[hashes[i] & mask].index;
+            if ( candidates[i] != 0 ) __builtin_prefetch( &offsets_[candidates[i] - 1] );
+        }
+        for ( size_t i = 0; i < size; ++i )
+        {
+            if ( candidates[i] != 0 ) __builtin_prefetch( &names_[offsets_[candidates[i] - 1]] );
+        }
+
+        for ( size_t i = 0; i < size; ++i )
+        {
+            const auto& query = queries[first + i];
+            auto row = first + i;
+            auto index = int32_t( find_or_add(query.domain, hashes[i]) );
+            mask = slots_.size() - 1;
+            std::memcpy( domains + row * sizeof(index), &index, sizeof(index) );
+            std::memcpy( ports + row * sizeof(uint16_t), &query.port, sizeof(uint16_t) );
+            body_[columns[2] + row] = char( query.protocol_type );
+            body_[columns[3] + row] = char( categories[row] );
+            body_[columns[4] + row] = char( (subtypes != nullptr) ? subtypes[row] : MultiConnectionSubtype::undefined );
+        }
+    }
+
+    if ( !started_ ) write_schema( output );
+    write_domains( output );
+
+    FlatBuilder builder;
+    append_message( builder, kHeaderRecordBatch, create_record_batch(builder, count, layout), layout.size, output );
+    output->append( body_ );
+}
+
+//! Append the end of the stream
+void ArrowWriter::finish( std::string* output )
+{
+    if ( !started_ )
+    {
+        write_schema( output );
+        write_domains( output );
+    }
+    const uint32_t end[2] = { kContinuation, 0 };
+    output->append( reinterpret_cast<const char*>(end), sizeof(end) );
+}
+
+//! Index of a name in the dictionary, added if new
+uint32_t ArrowWriter::find_or_add( std::string_view name, uint64_t hash )
+{
+    auto mask = slots_.size() - 1;
+    auto tag = uint32_t( hash >> 32 );
+    auto slot = hash & mask;
+    for ( ; slots_[slot].index != 0; slot = (slot + 1) & mask )
+    {
+        if ( (slots_[slot].tag == tag) && (this->name(slots_[slot].index - 1) == name) ) return slots_[slot].index - 1;
+    }
+
+    auto index = uint32_t( domains() );
+    names_.append( name.data(), name.size() );
+    offsets_.push_back( names_.size() );
+    slots_[slot] = Slot{ tag, index + 1 };
+    if ( 2 * domains() > slots_.size() ) grow();
+    return index;
+}
+
+//! Double the hash table
+void ArrowWriter::grow()
+{
+    std::vector<Slot> slots( 2 * slots_.size(), Slot{ 0, 0 } );
+    auto mask = slots.size() - 1;
+    for ( const auto& old : slots_ )
+    {
+        if ( old.index == 0 ) continue;
+        auto slot = hash_string( name(old.index - 1) ) & mask;
+        while ( slots[slot].index != 0 ) slot = (slot + 1) & mask;
+        slots[slot] = old;
+    }
+    slots_.swap( slots );
+}
+
+//! Append the schema and the enum dictionaries
+void ArrowWriter::write_schema( std::string* output )
+{
+    FlatBuilder builder;
+    std::vector<uint32_t> fields;
+    fields.push_back( create_field(builder, "domain", kDomainDictionary, 32) );
+    fields.push_back( create_field(builder, "port", -1, 16) );
+    fields.push_back( create_field(builder, "protocol", kProtocolDictionary, 8) );
+    fields.push_back( create_field(builder, "category", kCategoryDictionary, 8) );
+    fields.push_back( create_field(builder, "subtype", kSubtypeDictionary, 8) );
+    auto field_vector = builder.create_vector( fields );
+    builder.start_table();
+    builder.add_offset( 1, field_vector );
+    append_message( builder, kHeaderSchema, builder.end_table(), 0, output );
+
+    append_enum_dictionary( kProtocolDictionary, kProtocolNames, output );
+    append_enum_dictionary( kCategoryDictionary, MultiConnectionTypeString, output );
+    append_enum_dictionary( kSubtypeDictionary, MultiConnectionSubtypeString, output );
+}
+
+//! Append the names added since the last call
+void ArrowWriter::write_domains( std::string* output )
+{
+    if ( started_ && (names_written_ == domains()) ) return;
+
+    auto base = offsets_[names_written_];
+    delta_offsets_.clear();
+    for ( auto i = names_written_; i <= domains(); ++i ) delta_offsets_.push_back( int32_t(offsets_[i] - base) );
+    append_dictionary( kDomainDictionary, started_, delta_offsets_,
+                       std::string_view( names_ ).substr( base, offsets_[domains()] - base ), output );
+    names_written_ = domains();
+    started_ = true;
+}
@@ -0,0 +1,89 @@
+#ifndef DOMAINDB_ARROW_WRITER_H
+#define DOMAINDB_ARROW_WRITER_H
+
+#include "domain_tree.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Writes classification results in the Arrow IPC streaming format, for analytics tools to read with
+//! pyarrow.ipc.open_stream, polars.read_ipc_stream and the like. The columns, none nullable, are:
+//!
+//!     domain      dictionary<int32, utf8>     the name as queried
+//!     port        uint16
+//!     protocol    dictionary<int8, utf8>      "udp" or "tcp", the index is the value of ProtocolType
+//!     category    dictionary<int8, utf8>      the index is the value of MultiConnectionType
+//!     subtype     dictionary<int8, utf8>      the index is the value of MultiConnectionSubtype
+//!
+//! The stream starts with the schema and the dictionaries of the enums. Each batch of results is a record
+//! batch, preceded by a delta of the domain dictionary with the names it has that no batch had before, so
+//! each distinct name is written once. The columns are laid out directly in a buffer that is reused from
+//! batch to batch: writing a row allocates nothing, only a name seen for the first time is copied into
+//! the dictionary.
+class ArrowWriter
+{
+public:
+
+    ArrowWriter();
+
+    //! Append a record batch to a stream, preceded by the schema on the first call
+    //!
+    //! \param queries    - the lookups
+    //! \param categories - their results
+    //! \param subtypes   - their subtypes, nullptr for MultiConnectionSubtype::undefined
+    //! \param count      - number of rows, at most INT32_MAX
+    //! \param output     - receives the messages
+    void write_batch( const DomainTree::Query* queries, const MultiConnectionType* categories, const MultiConnectionSubtype* subtypes,
+                      size_t count, std::string* output );
+
+    //! Append the end of the stream, preceded by the schema if no batch was written
+    void finish( std::string* output );
+
+    //! Number of distinct domain names written
+    size_t domains() const { return offsets_.size() - 1; }
+
+private:
+
+    //! Entry of the hash table of the names
+    struct Slot
+    {
+        uint32_t    tag;        //!< high half of the hash of the name
+        uint32_t    index;      //!< 1 + the index of the name, 0 if the slot is free
+    };
+
+    //! Rows looked up together, their memory prefetched stage by stage
+    static const size_t kLookupGroup = 16;
+
+    std::vector<size_t>     offsets_;           //!< of the names in names_, one more than the names
+    std::string             names_;             //!< the domain dictionary, concatenated
+    std::vector<Slot>       slots_;             //!< hash table of the names, open addressing
+    size_t                  names_written_ = 0; //!< names already in the stream
+    bool                    started_ = false;   //!< the schema is written
+    std::string             body_;              //!< body of the record batch being written
+    std::vector<int32_t>    delta_offsets_;     //!< offsets of the names of a dictionary delta
+
+    //! Index of a name in the dictionary, added if new
+    uint32_t find_or_add( std::string_view name, uint64_t hash );
+
+    //! Name of the dictionary
+    std::string_view name( uint32_t index ) const
+    {
+        return std::string_view( names_ ).substr( offsets_[index], offsets_[index + 1] - offsets_[index] );
+    }
+
+    //! Double the hash table
+    void grow();
+
+    //! Append the schema and the enum dictionaries
+    void write_schema( std::string* output );
+
+    //! Append the names added since the last call: the whole domain dictionary after the schema, then deltas
+    void write_domains( std::string* output );
+};
+
+#endif //DOMAINDB_ARROW_WRITER_H
@@ -0,0 +1,206 @@
+#include "bulk_classifier.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+//! Separators of the fields of a record
+static const char kSeparators[] = "\t,";
+
+//! True if a field is a name in any case
+static bool equal_ignoring_case( std::string_view field, std::string_view name )
+{
+    if ( field.size() != name.size() ) return false;
+    for ( size_t i = 0; i < field.size(); ++i )
+    {
+        if ( (field[i] | 0x20) != name[i] ) return false;
+    }
+    return true;
+}
+
+//! Next field of a record: the text up to the separator or the end of the line
+static std::string_view next_field( std::string_view* rest, char separator )
+{
+    auto pos = rest->find( separator );
+    auto field = rest->substr( 0, pos );
+    rest->remove_prefix( (pos == std::string_view::npos) ? rest->size() : pos + 1 );
+    return field;
+}
+
+BulkClassifier::BulkClassifier( const DomainTree& domain_tree, const Options& options )
+    : domain_tree_( domain_tree )
+    , options_( options )
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Classify text in memory
+bool BulkClassifier::run( std::string_view input, const Formatter& formatter, const Writer& writer, Stats* stats ) const
+{
+    auto start = Clock::now();
+    Stats totals;
+    ThreadPool pool( options_.threads );
+    auto max_in_flight = (options_.chunks_in_flight > 0) ? options_.chunks_in_flight : 2 * pool.size();
+    auto chunk_bytes = std::max<size_t>( options_.chunk_bytes, 1 );
+
+    // Chunks in input order; the front one is written as soon as it is done
+    std::deque<std::future<std::unique_ptr<Chunk>>> pending;
+    bool writing = true;
+    auto write_front = [&]()
+    {
+        auto chunk = pending.front().get();
+        pending.pop_front();
+        writing = writing && writer( *chunk );
+
+        totals.bytes += chunk->text.size();
+        totals.lines += chunk->lines.size();
+        totals.invalid_lines += chunk->lines.size() - chunk->queries.size();
+        totals.classified += size_t( chunk->categories.size() -
+                                     std::count(chunk->categories.begin(), chunk->categories.end(), MultiConnectionType::unclassified) );
+        ++totals.chunks;
+    };
+
+    for ( size_t offset = 0, index = 0; writing && (offset < input.size()); ++index )
+    {
+        // Up to the end of the line that the chunk size reaches into
+        auto end = std::min( offset + chunk_bytes, input.size() );
+        auto newline = input.find( '\n', end - 1 );
+        end = (newline == std::string_view::npos) ? input.size() : newline + 1;
+
+        auto chunk = std::make_unique<Chunk>();
+        chunk->index = index;
+        chunk->text = input.substr( offset, end - offset );
+        offset = end;
+        pending.push_back( pool.submit([this, &formatter, chunk = std::move(chunk)]() mutable
+        {
+            classify( chunk.get() );
+            if ( formatter ) formatter( chunk.get() );
+            return std::move( chunk );
+        }) );
+
+        if ( pending.size() >= max_in_flight ) write_front();
+    }
+    while ( !pending.empty() ) write_front();
+
+    totals.time = std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - start );
+    if ( stats != nullptr ) *stats = totals;
+    return writing;
+}
+
+//! Classify a file, mapped into memory
+bool BulkClassifier::run_file( const std::string& filename, const Formatter& formatter, const Writer& writer, Stats* stats,
+                               std::string* error ) const
+{
+    int fd = open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    struct stat file_stat;
+    if ( (fd < 0) || (fstat(fd, &file_stat) != 0) )
+    {
+        if ( error != nullptr ) *error = "cannot open " + filename + ": " + std::strerror( errno );
+        if ( fd >= 0 ) close( fd );
+        return false;
+    }
+    auto size = size_t( file_stat.st_size );
+    if ( size == 0 )
+    {
+        close( fd );
+        return run( std::string_view(), formatter, writer, stats );
+    }
+
+    auto address = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( address == MAP_FAILED )
+    {
+        if ( error != nullptr ) *error = "cannot map " + filename + ": " + std::strerror( errno );
+        return false;
+    }
+    // Each thread reads its chunk from start to end
+    madvise( address, size, MADV_SEQUENTIAL );
+
+    bool written = run( std::string_view(static_cast<const char*>(address), size), formatter, writer, stats );
+    munmap( address, size );
+    if ( !written && (error != nullptr) && error->empty() ) *error = "writing stopped"; // Unless the writer said why
+    return written;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Split a chunk into lines, parse and classify them
+void BulkClassifier::classify( Chunk* chunk ) const
+{
+    for ( auto text = chunk->text; !text.empty(); )
+    {
+        auto end = text.find( '\n' );
+        auto line = text.substr( 0, end );
+        text.remove_prefix( (end == std::string_view::npos) ? text.size() : end + 1 );
+        if ( !line.empty() && (line.back() == '\r') ) line.remove_suffix( 1 );
+
+        DomainTree::Query query;
+        if ( parse_line(line, &query) )
+        {
+            chunk->lines.push_back( Line{ line, uint32_t(chunk->queries.size()) } );
+            chunk->queries.push_back( query );
+        }
+        else chunk->lines.push_back( Line{ line, kInvalid } );
+    }
+
+    chunk->categories.resize( chunk->queries.size() );
+    domain_tree_.match_domains( chunk->queries.data(), chunk->queries.size(), chunk->categories.data() );
+}
+
+//! Parse one record
+bool BulkClassifier::parse_line( std::string_view line, DomainTree::Query* query )
+{
+    auto pos = line.find_first_of( kSeparators );
+    if ( pos == std::string_view::npos ) return false;
+    auto separator = line[pos];
+
+    auto rest = line;
+    query->domain = next_field( &rest, separator );
+    auto port_field = next_field( &rest, separator );
+    auto protocol_field = next_field( &rest, separator );
+
+    unsigned port = 0;
+    auto parsed = std::from_chars( port_field.data(), port_field.data() + port_field.size(), port );
+    if ( port_field.empty() || (parsed.ptr != port_field.data() + port_field.size()) || (parsed.ec != std::errc()) || (port > UINT16_MAX) )
+    {
+        return false;
+    }
+    query->port = uint16_t( port );
+
+    if ( equal_ignoring_case(protocol_field, "tcp") || (protocol_field == "6") ) query->protocol_type = ProtocolType::TCP;
+    else if ( equal_ignoring_case(protocol_field, "udp") || (protocol_field == "17") ) query->protocol_type = ProtocolType::UDP;
+    else return false;
+    return true;
+}
+
+//! Formatter of text output
+void BulkClassifier::format_text( Chunk* chunk )
+{
+    auto& output = chunk->output;
+    output.clear();
+    output.reserve( chunk->text.size() + chunk->queries.size() * 16 );
+    for ( const auto& line : chunk->lines )
+    {
+        output.append( line.text.data(), line.text.size() );
+        if ( line.query != kInvalid )
+        {
+            output += line.text[line.text.find_first_of( kSeparators )];
+            output += to_string( chunk->categories[line.query] );
+        }
+        output += '\n';
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef DOMAINDB_BULK_CLASSIFIER_H
+#define DOMAINDB_BULK_CLASSIFIER_H
+
+#include "domain_tree.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Classifies large text files of flow records, one record per line: domain, port and protocol separated
+//! by tabs or commas, such as "www.example.com,443,tcp". The protocol is tcp or udp in any case, or the IP
+//! protocol number 6 or 17. Fields are not quoted; a line ending in "\r\n" is accepted.
+//!
+//! The input is split into chunks of whole lines that threads of a pool parse, classify with
+//! DomainTree::match_domains and format in parallel, each into its own buffer. The chunks are handed to
+//! the writer in input order as they complete, with a bounded number in flight, so the output keeps the
+//! order of the input whatever the number of threads.
+class BulkClassifier
+{
+public:
+
+    struct Options
+    {
+        unsigned    threads = 0;                //!< classifying threads, 0 for one per hardware thread
+        size_t      chunk_bytes = 4 << 20;      //!< approximate size of a chunk, extended to the end of its last line
+        size_t      chunks_in_flight = 0;       //!< chunks classified or waiting for the writer, 0 for twice the threads
+    };
+
+    //! Index of the query of a line that is not a valid record
+    static const uint32_t kInvalid = UINT32_MAX;
+
+    //! One line of a chunk, without its line end
+    struct Line
+    {
+        std::string_view    text;
+        uint32_t            query;      //!< index in Chunk::queries and Chunk::categories, kInvalid if not a record
+    };
+
+    //! A chunk of the input with its classification
+    struct Chunk
+    {
+        size_t                              index = 0;      //!< of the chunk in the input, from 0
+        std::string_view                    text;           //!< the lines, with their line ends
+        std::vector<Line>                   lines;
+        std::vector<DomainTree::Query>      queries;        //!< of the valid lines, pointing into text
+        std::vector<MultiConnectionType>    categories;     //!< of the queries
+        std::string                         output;         //!< written by the formatter
+    };
+
+    //! Fills Chunk::output of a classified chunk; called on the classifying threads
+    using Formatter = std::function<void( Chunk* chunk )>;
+
+    //! Writes a formatted chunk; called on the calling thread in input order. Returns false to stop.
+    using Writer = std::function<bool( const Chunk& chunk )>;
+
+    struct Stats
+    {
+        size_t                      bytes = 0;          //!< input bytes
+        size_t                      lines = 0;
+        size_t                      invalid_lines = 0;  //!< lines that are not records, empty lines included
+        size_t                      classified = 0;     //!< records classified other than unclassified
+        size_t                      chunks = 0;
+        std::chrono::nanoseconds    time{0};            //!< from the start of the split to the last write
+    };
+
+    //! Create a classifier
+    //!
+    //! \param domain_tree - the database; lookups only, it may be shared with other readers
+    //! \param options     - classifier options
+    BulkClassifier( const DomainTree& domain_tree, const Options& options );
+
+    //! Classify text in memory
+    //!
+    //! \param input     - the records
+    //! \param formatter - formats each chunk, may be empty to leave the output empty
+    //! \param writer    - writes each chunk
+    //! \param stats     - receives the counters, may be nullptr
+    //! \return false if the writer stopped
+    bool run( std::string_view input, const Formatter& formatter, const Writer& writer, Stats* stats ) const;
+
+    //! Classify a file, mapped into memory
+    //!
+    //! \param filename  - path and name of the file
+    //! \param formatter - formats each chunk, may be empty to leave the output empty
+    //! \param writer    - writes each chunk
+    //! \param stats     - receives the counters, may be nullptr
+    //! \param error     - receives a description of the problem on failure; a reason the writer put there
+    //!                    when it stopped is kept
+    //! \return true on success
+    bool run_file( const std::string& filename, const Formatter& formatter, const Writer& writer, Stats* stats,
+                   std::string* error ) const;
+
+    //! Parse one record
+    //!
+    //! \param line  - the line, without its line end
+    //! \param query - receives the fields; the domain points into the line
+    //! \return false if the line is not a valid record
+    static bool parse_line( std::string_view line, DomainTree::Query* query );
+
+    //! Formatter of text output: each record followed by the separator of its fields and the category name,
+    //! such as "www.example.com,443,tcp,browsing"; a line that is not a record is copied unchanged
+    static void format_text( Chunk* chunk );
+
+private:
+
+    const DomainTree&   domain_tree_;
+    const Options       options_;
+
+    //! Split a chunk into lines, parse and classify them
+    void classify( Chunk* chunk ) const;
+};
+
+#endif //DOMAINDB_BULK_CLASSIFIER_H
@@ -0,0 +1,406 @@
+#include "compiled_db.h"
+#include "domain_hash.h"
+#include "idn.h"
+#include <cctype>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DOMAINDB_X86
+#endif
+
+static const char kMagic[8] = { 'D', 'O', 'M', 'A', 'I', 'N', 'D', 'B' };
+
+//! Entries with fewer port ranges are scanned without AVX2, which only pays off from a few ranges on
+static const uint32_t kMinSimdRanges = 4;
+
+//! Round a size up to a multiple of 8
+static uint64_t align8( uint64_t size )
+{
+    return (size + 7) & ~uint64_t(7);
+}
+
+//! Round a size up to a multiple of 64, a cache line
+static uint64_t align64( uint64_t size )
+{
+    return (size + 63) & ~uint64_t(63);
+}
+
+//! True if the region of a size at an offset ends at or before end, without overflow
+static bool inside( uint64_t offset, uint64_t size, uint64_t end )
+{
+    return (offset <= end) && (size <= end - offset);
+}
+
+//! True if the processor has AVX2
+static bool cpu_has_avx2()
+{
+#ifdef DOMAINDB_X86
+    static const bool has_avx2 = __builtin_cpu_supports( "avx2" );
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+//! Index of the first range that contains a port, count or more if none
+static uint32_t find_range( const uint16_t* first_ports, const uint16_t* last_ports, uint32_t count, uint16_t port )
+{
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        if ( (port >= first_ports[i]) && (port <= last_ports[i]) ) return i;
+    }
+    return count;
+}
+
+#ifdef DOMAINDB_X86
+//! find_range() 16 ranges at a time. Reads up to 15 elements past the last range, which may match: the
+//! result is then above count, meaning none.
+__attribute__(( target("avx2") ))
+static uint32_t find_range_avx2( const uint16_t* first_ports, const uint16_t* last_ports, uint32_t count, uint16_t port )
+{
+    // There is no unsigned 16 bit compare: first <= port is max(first, port) == port, and port <= last is
+    // min(last, port) == port
+    auto ports = _mm256_set1_epi16( short(port) );
+    for ( uint32_t i = 0; i < count; i += 16 )
+    {
+        auto first = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(first_ports + i) );
+        auto last = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(last_ports + i) );
+        auto in_range = _mm256_and_si256( _mm256_cmpeq_epi16(_mm256_max_epu16(first, ports), ports),
+                                          _mm256_cmpeq_epi16(_mm256_min_epu16(last, ports), ports) );
+        auto mask = uint32_t( _mm256_movemask_epi8(in_range) ); // 2 bits per range
+        if ( mask != 0 ) return i + unsigned( __builtin_ctz(mask) ) / 2;
+    }
+    return count;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Compile a database to an image
+std::vector<char> CompiledDb::compile( const DomainTree& domain_tree )
+{
+    //! The arrays of a PortBlock while the image is compiled
+    struct PortArrays
+    {
+        std::vector<uint16_t>   first_ports;
+        std::vector<uint16_t>   last_ports;
+        std::vector<uint8_t>    categories;
+    };
+
+    std::vector<Entry> entries;
+    PortArrays port_arrays[2];
+    std::string names;
+
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& ports )
+    {
+        Entry entry{};
+        entry.hash = hash_string( domain_name );
+        entry.name_offset = uint32_t( names.size() );
+        entry.name_size = uint32_t( domain_name.size() );
+        names += domain_name;
+
+        for ( auto protocol_type : { ProtocolType::UDP, ProtocolType::TCP } )
+        {
+            auto protocol = int( protocol_type );
+            auto& arrays = port_arrays[protocol];
+            entry.ranges[protocol] = uint32_t( arrays.categories.size() );
+            for ( const auto& port_range : (protocol_type == ProtocolType::UDP) ? ports.udp : ports.tcp )
+            {
+                if ( port_range.category == DomainTree::kUnclassified ) continue; // Never matches
+                arrays.first_ports.push_back( port_range.first_port );
+                arrays.last_ports.push_back( port_range.last_port );
+                arrays.categories.push_back( uint8_t(port_range.category) );
+                entry.categories[protocol] |= MatchResult::mask_of( port_range.category );
+            }
+            entry.range_counts[protocol] = uint32_t( arrays.categories.size() ) - entry.ranges[protocol];
+        }
+        entries.push_back( entry );
+    } );
+
+    // At most half of the slots are used, so that probe sequences stay short
+    uint64_t slots = 16;
+    while ( slots < 2 * entries.size() ) slots *= 2;
+
+    Header header{};
+    std::memcpy( header.magic, kMagic, sizeof kMagic );
+    header.version = kVersion;
+    header.domain_count = uint32_t( entries.size() );
+    header.fingerprint = domain_tree.fingerprint();
+    header.slot_mask = slots - 1;
+    header.slots_offset = align8( sizeof(Header) );
+    header.entries_offset = align8( header.slots_offset + slots * sizeof(uint32_t) );
+    auto offset = header.entries_offset + entries.size() * sizeof(Entry);
+    for ( int protocol = 0; protocol < 2; ++protocol )
+    {
+        auto& block = header.ports[protocol];
+        block.range_count = port_arrays[protocol].categories.size();
+        block.first_ports_offset = align64( offset );
+        block.last_ports_offset = align64( block.first_ports_offset + (block.range_count + kRangePadding) * sizeof(uint16_t) );
+        block.categories_offset = align64( block.last_ports_offset + (block.range_count + kRangePadding) * sizeof(uint16_t) );
+        offset = block.categories_offset + block.range_count;
+    }
+    header.names_offset = align8( offset );
+    header.names_size = names.size();
+    auto public_suffixes = (domain_tree.public_suffixes() != nullptr) ? domain_tree.public_suffixes()->image() : std::string_view();
+    header.public_suffixes_offset = align8( header.names_offset + names.size() );
+    header.public_suffixes_size = public_suffixes.size();
+    header.image_size = align8( header.public_suffixes_offset + public_suffixes.size() );
+
+    std::vector<char> image( header.image_size, 0 );
+    auto slot_table = reinterpret_cast<uint32_t*>( image.data() + header.slots_offset );
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+        auto slot = entries[i].hash & header.slot_mask;
+        while ( slot_table[slot] != 0 ) slot = (slot + 1) & header.slot_mask;
+        slot_table[slot] = uint32_t( i + 1 );
+    }
+
+    std::memcpy( image.data(), &header, sizeof header );
+    std::memcpy( image.data() + header.entries_offset, entries.data(), entries.size() * sizeof(Entry) );
+    for ( int protocol = 0; protocol < 2; ++protocol )
+    {
+        const auto& block = header.ports[protocol];
+        const auto& arrays = port_arrays[protocol];
+        std::memcpy( image.data() + block.first_ports_offset, arrays.first_ports.data(), arrays.first_ports.size() * sizeof(uint16_t) );
+        std::memcpy( image.data() + block.last_ports_offset, arrays.last_ports.data(), arrays.last_ports.size() * sizeof(uint16_t) );
+        std::memcpy( image.data() + block.categories_offset, arrays.categories.data(), arrays.categories.size() );
+    }
+    std::memcpy( image.data() + header.names_offset, names.data(), names.size() );
+    std::memcpy( image.data() + header.public_suffixes_offset, public_suffixes.data(), public_suffixes.size() );
+
+    return image;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Use an image in place
+bool CompiledDb::attach( const void* image, size_t size )
+{
+    *this = CompiledDb();
+
+    auto base = static_cast<const char*>( image );
+    if ( (size < sizeof(Header)) || ((reinterpret_cast<uintptr_t>(base) & 7) != 0) ) return false;
+    auto header = reinterpret_cast<const Header*>( base );
+
+    // Every table must lie inside the image, so that a damaged image cannot make lookups read outside it. The
+    // counts are bounded by the image size before they are multiplied and the regions are checked without sums
+    // that could wrap.
+    if ( (std::memcmp(header->magic, kMagic, sizeof kMagic) != 0) || (header->version != kVersion) ) return false;
+    auto image_size = header->image_size;
+    if ( (image_size > size) || (header->slot_mask >= image_size) || (header->domain_count >= image_size) ) return false;
+    auto slots = header->slot_mask + 1;
+    if ( ((slots & header->slot_mask) != 0) || (slots <= header->domain_count) ) return false;
+    auto entries_size = uint64_t( header->domain_count ) * sizeof(Entry);
+    if ( (header->slots_offset < sizeof(Header)) || (header->slots_offset % 8 != 0) || (header->entries_offset % 8 != 0) ||
+         (header->public_suffixes_offset % 8 != 0) ||
+         !inside(header->slots_offset, slots * sizeof(uint32_t), header->entries_offset) ||
+         !inside(header->entries_offset, entries_size, header->names_offset) ||
+         !inside(header->names_offset, header->names_size, header->public_suffixes_offset) ||
+         !inside(header->public_suffixes_offset, header->public_suffixes_size, image_size) )
+    {
+        return false;
+    }
+    auto entries_end = header->entries_offset + entries_size;
+    for ( const auto& block : header->ports )
+    {
+        // The arrays lie between the entries and the names
+        if ( block.range_count > header->names_offset ) return false;
+        auto ports_size = (block.range_count + kRangePadding) * sizeof(uint16_t);
+        if ( (block.first_ports_offset % 2 != 0) || (block.last_ports_offset % 2 != 0) ||
+             (block.first_ports_offset < entries_end) || !inside(block.first_ports_offset, ports_size, header->names_offset) ||
+             (block.last_ports_offset < entries_end) || !inside(block.last_ports_offset, ports_size, header->names_offset) ||
+             (block.categories_offset < entries_end) || !inside(block.categories_offset, block.range_count, header->names_offset) )
+        {
+            return false;
+        }
+    }
+
+    // A probe sequence ends at an empty slot, so there must be one
+    auto slot_table = reinterpret_cast<const uint32_t*>( base + header->slots_offset );
+    uint64_t used_slots = 0;
+    for ( uint64_t slot = 0; slot < slots; ++slot )
+    {
+        if ( slot_table[slot] > header->domain_count ) return false;
+        used_slots += (slot_table[slot] != 0);
+    }
+    if ( used_slots == slots ) return false;
+
+    auto entries = reinterpret_cast<const Entry*>( base + header->entries_offset );
+    for ( uint32_t i = 0; i < header->domain_count; ++i )
+    {
+        const auto& entry = entries[i];
+        if ( uint64_t(entry.name_offset) + entry.name_size > header->names_size ) return false;
+        for ( int protocol = 0; protocol < 2; ++protocol )
+        {
+            if ( uint64_t(entry.ranges[protocol]) + entry.range_counts[protocol] > header->ports[protocol].range_count ) return false;
+        }
+    }
+
+    Ports ports[2];
+    for ( int protocol = 0; protocol < 2; ++protocol )
+    {
+        const auto& block = header->ports[protocol];
+        ports[protocol].first_ports = reinterpret_cast<const uint16_t*>( base + block.first_ports_offset );
+        ports[protocol].last_ports = reinterpret_cast<const uint16_t*>( base + block.last_ports_offset );
+        ports[protocol].categories = reinterpret_cast<const uint8_t*>( base + block.categories_offset );
+        for ( uint64_t i = 0; i < block.range_count; ++i )
+        {
+            auto category = ports[protocol].categories[i];
+            if ( (category >= MultiConnectionTypeString.size()) || (category == uint8_t(DomainTree::kUnclassified)) ||
+                 (ports[protocol].first_ports[i] > ports[protocol].last_ports[i]) )
+            {
+                return false;
+            }
+        }
+    }
+
+    PublicSuffixList public_suffixes;
+    if ( (header->public_suffixes_size != 0) &&
+         !public_suffixes.attach(base + header->public_suffixes_offset, header->public_suffixes_size) ) return false;
+
+    header_ = header;
+    slots_ = slot_table;
+    entries_ = entries;
+    ports_[0] = ports[0];
+    ports_[1] = ports[1];
+    names_ = base + header->names_offset;
+    public_suffixes_ = public_suffixes;
+    simd_ = cpu_has_avx2();
+    return true;
+}
+
+//! Enable or disable the AVX2 scan of port ranges
+void CompiledDb::use_simd( bool enabled )
+{
+    simd_ = enabled && cpu_has_avx2();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Find a domain using inexact match
+MultiConnectionType CompiledDb::match_domain( std::string_view domain_name, uint16_t port, ProtocolType protocol_type ) const
+{
+    MultiConnectionType category = DomainTree::kUnclassified;
+    domain_name = Idn::normalize( domain_name );
+
+    if ( !domain_name.empty() && std::isdigit(domain_name[0]) ) // Exact search for IP address
+    {
+        category = find_domain_exact( domain_name, port, protocol_type, nullptr );
+    }
+    else for ( auto shortest = public_suffixes_.shortest_lookup_suffix( domain_name );
+               (domain_name.size() >= shortest) && (category == DomainTree::kUnclassified); ) // Inexact search for general domain
+    {
+        category = find_domain_exact( domain_name, port, protocol_type, nullptr );
+        DomainTree::remove_token( &domain_name );
+    }
+
+    if ( category == DomainTree::kUnclassified ) // Try to find the port in entries with empty domain
+    {
+        category = find_domain_exact( "", port, protocol_type, nullptr );
+    }
+
+    return category;
+}
+
+//! Classify a domain in a single traversal
+CompiledDb::MatchResult CompiledDb::classify_domain( std::string_view domain_name, uint16_t port, ProtocolType protocol_type ) const
+{
+    MatchResult result;
+    domain_name = Idn::normalize( domain_name );
+    auto shortest = public_suffixes_.shortest_lookup_suffix( domain_name );
+
+    if ( !domain_name.empty() && std::isdigit(domain_name[0]) ) // Exact search for IP address
+    {
+        result.category = find_domain_exact( domain_name, port, protocol_type, &result.categories );
+        if ( result.category != DomainTree::kUnclassified ) result.depth = 0;
+    }
+    else for ( uint8_t depth = 0; domain_name.size() >= shortest; ++depth ) // Inexact search, walks the whole suffix path
+    {
+        auto category = find_domain_exact( domain_name, port, protocol_type, &result.categories );
+        if ( (category != DomainTree::kUnclassified) && (result.category == DomainTree::kUnclassified) )
+        {
+            result.category = category;
+            result.depth = depth;
+        }
+        DomainTree::remove_token( &domain_name );
+    }
+
+    if ( result.category == DomainTree::kUnclassified ) // Try to find the port in entries with empty domain
+    {
+        result.category = find_domain_exact( "", port, protocol_type, nullptr );
+        if ( result.category != DomainTree::kUnclassified ) result.categories |= MatchResult::mask_of(result.category);
+    }
+
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Find the entry of a domain using exact match
+const CompiledDb::Entry* CompiledDb::find_entry( std::string_view domain_name ) const
+{
+    if ( header_ == nullptr ) return nullptr;
+
+    auto hash = hash_string( domain_name );
+    for ( auto slot = hash & header_->slot_mask; slots_[slot] != 0; slot = (slot + 1) & header_->slot_mask )
+    {
+        const auto& entry = entries_[slots_[slot] - 1];
+        if ( (entry.hash == hash) && (std::string_view(names_ + entry.name_offset, entry.name_size) == domain_name) )
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+//! Get the service type of a port of a domain using exact match, and collect the categories of all its ranges
+MultiConnectionType CompiledDb::find_domain_exact( std::string_view domain_name, uint16_t port, ProtocolType protocol_type,
+                                                   DomainTree::CategoryMask* categories ) const
+{
+    auto protocol = unsigned( protocol_type );
+    auto entry = find_entry( domain_name );
+    if ( (entry == nullptr) || (protocol > 1) ) return DomainTree::kUnclassified;
+    if ( categories != nullptr ) *categories |= entry->categories[protocol];
+
+    const auto& ports = ports_[protocol];
+    auto first = entry->ranges[protocol];
+    auto count = entry->range_counts[protocol];
+#ifdef DOMAINDB_X86
+    auto index = (simd_ && (count >= kMinSimdRanges)) ? find_range_avx2( ports.first_ports + first, ports.last_ports + first, count, port )
+                                                      : find_range( ports.first_ports + first, ports.last_ports + first, count, port );
+#else
+    auto index = find_range( ports.first_ports + first, ports.last_ports + first, count, port );
+#endif
+    return (index < count) ? MultiConnectionType( ports.categories[first + index] ) : DomainTree::kUnclassified;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Number of domains in the database
+size_t CompiledDb::size() const
+{
+    return (header_ != nullptr) ? header_->domain_count : 0;
+}
+
+//! DomainTree::fingerprint() of the compiled database
+uint64_t CompiledDb::fingerprint() const
+{
+    return (header_ != nullptr) ? header_->fingerprint : 0;
+}
+
+//! Size of the image in bytes
+size_t CompiledDb::image_size() const
+{
+    return (header_ != nullptr) ? header_->image_size : 0;
+}
@@ -0,0 +1,145 @@
+#ifndef DOMAINDB_COMPILED_DB_H
+#define DOMAINDB_COMPILED_DB_H
+
+#include "domain_tree.h"
+#include "public_suffix_list.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Read-only flat image of a DomainTree.
+//!
+//! The image is one contiguous block without pointers: an open addressing table of entries, the port ranges
+//! of all entries and the domain names, all addressed by offsets from the start of the image. It can be
+//! written to a file or a shared memory segment and used in place by any number of processes.
+//!
+//! A lookup reads the ranges of one protocol only, so the ranges are stored per protocol as a structure of
+//! arrays: first ports, last ports and categories, each contiguous and 64 byte aligned in the image. Ranges
+//! without a category never match and are left out. Entries with many ranges are scanned 16 ranges per
+//! compare with AVX2 when the processor has it.
+//! Lookups return the same results as the DomainTree the image was compiled from, whose public suffix list,
+//! if any, is part of the image.
+class CompiledDb
+{
+public:
+
+    using MatchResult = DomainTree::MatchResult;
+
+    //! Compile a database to an image
+    //!
+    //! \param domain_tree - the database
+    //! \return the image
+    static std::vector<char> compile( const DomainTree& domain_tree );
+
+    //! Create an empty database, see attach()
+    CompiledDb() = default;
+
+    //! Use an image in place. The image must stay mapped and unchanged while the object is used.
+    //!
+    //! \param image - start of the image, aligned to 8 bytes
+    //! \param size  - size of the image in bytes
+    //! \return true if the image is valid, false otherwise; the object is then empty
+    bool attach( const void* image, size_t size );
+
+    //! True if an image is attached
+    bool valid() const { return header_ != nullptr; }
+
+    //! Enable or disable the AVX2 scan of port ranges, enabled by default when the processor has AVX2.
+    //! For benchmarks and tests: the results are the same either way.
+    //!
+    //! \param enabled - true to use AVX2 if the processor has it
+    void use_simd( bool enabled );
+
+    //! Find a domain using inexact match, see DomainTree::match_domain
+    MultiConnectionType match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! Classify a domain in a single traversal, see DomainTree::classify_domain
+    MatchResult classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! Number of domains in the database
+    size_t size() const;
+
+    //! DomainTree::fingerprint() of the compiled database
+    uint64_t fingerprint() const;
+
+    //! Size of the image in bytes
+    size_t image_size() const;
+
+private:
+
+    static const uint32_t kVersion = 3;
+
+    //! Zero elements after each array of ports, so that a 16 lane load starting at any range stays in the image
+    static const size_t kRangePadding = 16;
+
+    //! The port ranges of all entries for one protocol, each array 64 byte aligned
+    struct PortBlock
+    {
+        uint64_t    range_count;
+        uint64_t    first_ports_offset; //!< uint16_t first_port[range_count + kRangePadding]
+        uint64_t    last_ports_offset;  //!< uint16_t last_port[range_count + kRangePadding]
+        uint64_t    categories_offset;  //!< uint8_t category[range_count], never kUnclassified
+    };
+
+    struct Header
+    {
+        char        magic[8];           //!< "DOMAINDB"
+        uint32_t    version;            //!< kVersion
+        uint32_t    domain_count;
+        uint64_t    image_size;
+        uint64_t    fingerprint;
+        uint64_t    slot_mask;          //!< number of slots - 1, a power of two - 1
+        uint64_t    slots_offset;       //!< uint32_t slot[slot_mask + 1]: entry index + 1, 0 for an empty slot
+        uint64_t    entries_offset;     //!< Entry entry[domain_count]
+        uint64_t    names_offset;       //!< domain names, not terminated
+        uint64_t    names_size;
+        uint64_t    public_suffixes_offset; //!< the compiled PublicSuffixList of the database, if it has one
+        uint64_t    public_suffixes_size;   //!< 0 if the database has no public suffix list
+        PortBlock   ports[2];           //!< by ProtocolType
+    };
+
+    struct Entry
+    {
+        uint64_t    hash;               //!< hash_string of the name
+        uint32_t    name_offset;        //!< from names_offset
+        uint32_t    name_size;
+        uint32_t    ranges[2];          //!< first range in ports[protocol], by ProtocolType
+        uint32_t    range_counts[2];    //!< number of ranges, by ProtocolType
+        uint16_t    categories[2];      //!< CategoryMask of all ranges, by ProtocolType
+        uint32_t    padding;
+    };
+
+    static_assert( sizeof(Header) == 152, "the image layout must not depend on the compiler" );
+    static_assert( sizeof(Entry) == 40, "the image layout must not depend on the compiler" );
+
+    //! The arrays of a PortBlock
+    struct Ports
+    {
+        const uint16_t* first_ports = nullptr;
+        const uint16_t* last_ports = nullptr;
+        const uint8_t*  categories = nullptr;
+    };
+
+    const Header*   header_ = nullptr;
+    const uint32_t* slots_ = nullptr;
+    const Entry*    entries_ = nullptr;
+    Ports           ports_[2];          //!< by ProtocolType
+    const char*     names_ = nullptr;
+    PublicSuffixList public_suffixes_;  //!< lookups stop at the registrable domain, empty to probe every suffix
+    bool            simd_ = false;      //!< scan port ranges with AVX2
+
+    //! Find the entry of a domain using exact match
+    const Entry* find_entry( std::string_view domain ) const;
+
+    //! Get the service type of a port of a domain using exact match, and collect the categories of all its ranges
+    //!
+    //! \param categories - receives the categories of all port ranges of the protocol ORed in, may be nullptr
+    MultiConnectionType find_domain_exact( std::string_view domain, uint16_t port, ProtocolType protocol_type,
+                                           DomainTree::CategoryMask* categories ) const;
+};
+
+#endif //DOMAINDB_COMPILED_DB_H
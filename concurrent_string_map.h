@@ -0,0 +1,278 @@
+#ifndef DOMAINDB_CONCURRENT_STRING_MAP_H
+#define DOMAINDB_CONCURRENT_STRING_MAP_H
+
+#include "epoch.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Hash map from strings to immutable values with lock-free readers and a single writer.
+//!
+//! Readers must hold an Epoch::Guard for as long as they use a pointer returned by find() or for_each().
+//! Values are never modified after they are published: the writer replaces a value as a whole and the
+//! old one is retired to the Epoch. Calls to the writer methods must be serialized by the owner.
+template <typename Value>
+class ConcurrentStringMap
+{
+    struct Node;
+
+public:
+
+    //! Create an empty map
+    //!
+    //! \param expected_size - number of keys to reserve buckets for
+    explicit ConcurrentStringMap( size_t expected_size = 0 )
+    {
+        size_t buckets = kMinBuckets;
+        while ( buckets < expected_size ) buckets *= 2;
+        buckets_.store( new Buckets(buckets), std::memory_order_release );
+    }
+
+    ~ConcurrentStringMap()
+    {
+        auto buckets = buckets_.load( std::memory_order_acquire );
+        for ( size_t i = 0; i <= buckets->mask; ++i )
+        {
+            for ( auto node = buckets->heads[i].load(); node != nullptr; )
+            {
+                auto next = node->next.load();
+                delete node->value.load();
+                delete node;
+                node = next;
+            }
+        }
+        delete buckets;
+    }
+
+    ConcurrentStringMap( const ConcurrentStringMap& ) = delete;
+    ConcurrentStringMap& operator=( const ConcurrentStringMap& ) = delete;
+
+    //! Find a value by key. Reader: the caller must hold an Epoch::Guard.
+    //!
+    //! \param key - key to seek
+    //! \return the value or nullptr if the key is not in the map
+    const Value* find( std::string_view key ) const
+    {
+        auto hash = hash_key( key );
+        auto buckets = buckets_.load( std::memory_order_acquire );
+        for ( auto node = buckets->heads[hash & buckets->mask].load(std::memory_order_acquire);
+              node != nullptr;
+              node = node->next.load(std::memory_order_acquire) )
+        {
+            if ( (node->hash == hash) && (node->key == key) ) return node->value.load( std::memory_order_acquire );
+        }
+        return nullptr;
+    }
+
+    //! find() one step at a time, for lookups that interleave several searches and prefetch the memory of the
+    //! next step of each while the others run. Reader: the caller must hold an Epoch::Guard.
+    class Search
+    {
+    public:
+
+        //! Start a search. The next step reads address().
+        void start( const ConcurrentStringMap& map, std::string_view key )
+        {
+            key_ = key;
+            hash_ = hash_key( key );
+            auto buckets = map.buckets_.load( std::memory_order_acquire );
+            link_ = &buckets->heads[hash_ & buckets->mask];
+            address_ = link_;
+            node_ = nullptr;
+            value_ = nullptr;
+            key_read_ = false;
+        }
+
+        //! Memory the next step reads
+        const void* address() const { return address_; }
+
+        //! Read the head of the chain, a node, or the key of a node with the hash of the key
+        //!
+        //! \return true when the search is over, see value()
+        bool step()
+        {
+            if ( node_ == nullptr ) node_ = link_->load( std::memory_order_acquire );
+            else if ( node_->hash == hash_ )
+            {
+                // A key longer than the string keeps inline is one more read
+                if ( !key_read_ )
+                {
+                    key_read_ = true;
+                    address_ = node_->key.data();
+                    return false;
+                }
+                key_read_ = false;
+                if ( node_->key == key_ )
+                {
+                    value_ = node_->value.load( std::memory_order_acquire );
+                    return true;
+                }
+                node_ = node_->next.load( std::memory_order_acquire );
+            }
+            else node_ = node_->next.load( std::memory_order_acquire );
+            address_ = node_;
+            return node_ == nullptr;
+        }
+
+        //! The value of the key once the search is over, nullptr if the key is not in the map
+        const Value* value() const { return value_; }
+
+    private:
+
+        std::string_view                key_;
+        size_t                          hash_ = 0;
+        const std::atomic<Node*>*       link_ = nullptr;    //!< head of the chain
+        const Node*                     node_ = nullptr;    //!< node the next step reads, nullptr before the head is read
+        const void*                     address_ = nullptr;
+        const Value*                    value_ = nullptr;
+        bool                            key_read_ = false;  //!< the key of node_ is prefetched
+    };
+
+    //! Visit all keys and values. Reader: the caller must hold an Epoch::Guard. Keys inserted or removed
+    //! concurrently may or may not be visited.
+    //!
+    //! \param visit - called as visit(const std::string& key, const Value& value)
+    template <typename Visitor>
+    void for_each( Visitor&& visit ) const
+    {
+        auto buckets = buckets_.load( std::memory_order_acquire );
+        for ( size_t i = 0; i <= buckets->mask; ++i )
+        {
+            for ( auto node = buckets->heads[i].load(std::memory_order_acquire);
+                  node != nullptr;
+                  node = node->next.load(std::memory_order_acquire) )
+            {
+                visit( node->key, *node->value.load(std::memory_order_acquire) );
+            }
+        }
+    }
+
+    //! Number of keys in the map
+    size_t size() const { return size_.load( std::memory_order_relaxed ); }
+
+    //! Insert a key or replace its value. Writer.
+    //!
+    //! \param key   - key to insert
+    //! \param value - new value of the key, published to readers
+    void assign( std::string_view key, std::unique_ptr<const Value> value )
+    {
+        auto hash = hash_key( key );
+        auto buckets = buckets_.load( std::memory_order_relaxed );
+        auto& head = buckets->heads[hash & buckets->mask];
+
+        for ( auto node = head.load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed) )
+        {
+            if ( (node->hash == hash) && (node->key == key) )
+            {
+                Epoch::instance().retire( node->value.exchange(value.release(), std::memory_order_acq_rel) );
+                return;
+            }
+        }
+
+        auto node = new Node( key, hash, value.release() );
+        node->next.store( head.load(std::memory_order_relaxed), std::memory_order_relaxed );
+        head.store( node, std::memory_order_release );
+
+        if ( size_.fetch_add(1, std::memory_order_relaxed) + 1 > buckets->mask + 1 ) grow();
+    }
+
+    //! Remove a key. Writer.
+    //!
+    //! \param key - key to remove
+    //! \return true if the key was in the map
+    bool erase( std::string_view key )
+    {
+        auto hash = hash_key( key );
+        auto buckets = buckets_.load( std::memory_order_relaxed );
+        auto link = &buckets->heads[hash & buckets->mask];
+
+        for ( auto node = link->load(std::memory_order_relaxed); node != nullptr; node = link->load(std::memory_order_relaxed) )
+        {
+            if ( (node->hash == hash) && (node->key == key) )
+            {
+                link->store( node->next.load(std::memory_order_relaxed), std::memory_order_release );
+                size_.fetch_sub( 1, std::memory_order_relaxed );
+                Epoch::instance().retire( node->value.load(std::memory_order_relaxed) );
+                Epoch::instance().retire( node );
+                return true;
+            }
+            link = &node->next;
+        }
+        return false;
+    }
+
+private:
+
+    static const size_t kMinBuckets = 16;
+
+    struct Node
+    {
+        const std::string           key;
+        const size_t                hash;
+        std::atomic<const Value*>   value;
+        std::atomic<Node*>          next{nullptr};
+
+        Node( std::string_view node_key, size_t node_hash, const Value* node_value ) :
+            key(node_key), hash(node_hash), value(node_value) {}
+    };
+
+    struct Buckets
+    {
+        const size_t                            mask;
+        std::unique_ptr<std::atomic<Node*>[]>   heads;
+
+        explicit Buckets( size_t count ) : mask(count - 1), heads(new std::atomic<Node*>[count])
+        {
+            for ( size_t i = 0; i < count; ++i ) heads[i].store( nullptr, std::memory_order_relaxed );
+        }
+    };
+
+    std::atomic<Buckets*>   buckets_{nullptr};
+    std::atomic<size_t>     size_{0};
+
+    static size_t hash_key( std::string_view key ) { return std::hash<std::string_view>{}( key ); }
+
+    //! Double the number of buckets. Readers may still walk the old chains, so the nodes are copied
+    //! into the new buckets and the old nodes are retired together with the old bucket array.
+    void grow()
+    {
+        auto old_buckets = buckets_.load( std::memory_order_relaxed );
+        auto new_buckets = new Buckets( 2 * (old_buckets->mask + 1) );
+
+        for ( size_t i = 0; i <= old_buckets->mask; ++i )
+        {
+            for ( auto node = old_buckets->heads[i].load(std::memory_order_relaxed); node != nullptr;
+                  node = node->next.load(std::memory_order_relaxed) )
+            {
+                auto copy = new Node( node->key, node->hash, node->value.load(std::memory_order_relaxed) );
+                auto& head = new_buckets->heads[node->hash & new_buckets->mask];
+                copy->next.store( head.load(std::memory_order_relaxed), std::memory_order_relaxed );
+                head.store( copy, std::memory_order_relaxed );
+            }
+        }
+
+        buckets_.store( new_buckets, std::memory_order_release );
+        Epoch::instance().retire( old_buckets, []( void* p )
+        {
+            auto buckets = static_cast<Buckets*>(p);
+            for ( size_t i = 0; i <= buckets->mask; ++i )
+            {
+                for ( auto node = buckets->heads[i].load(); node != nullptr; )
+                {
+                    auto next = node->next.load();
+                    delete node; // Values moved to the new nodes
+                    node = next;
+                }
+            }
+            delete buckets;
+        } );
+    }
+};
+
+#endif //DOMAINDB_CONCURRENT_STRING_MAP_H
@@ -0,0 +1,193 @@
+#include "decompressor.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef DOMAINDB_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DOMAINDB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+//! Detect the format of a file from its first bytes
+Decompressor::Format Decompressor::detect( const char* data, size_t size )
+{
+    static const unsigned char kGzipMagic[] = { 0x1f, 0x8b };
+    static const unsigned char kZstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    if ( (size >= sizeof kGzipMagic) && (std::memcmp(data, kGzipMagic, sizeof kGzipMagic) == 0) ) return Format::gzip;
+    if ( (size >= sizeof kZstdMagic) && (std::memcmp(data, kZstdMagic, sizeof kZstdMagic) == 0) ) return Format::zstd;
+    return Format::none;
+}
+
+//! Name of a format
+const char* Decompressor::name( Format format )
+{
+    switch ( format )
+    {
+        case Format::gzip:  return "gzip";
+        case Format::zstd:  return "zstd";
+        default:            return "none";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef DOMAINDB_HAVE_ZLIB
+
+//! gzip decompression with zlib
+class GzipDecompressor : public Decompressor
+{
+public:
+
+    GzipDecompressor()
+    {
+        std::memset( &stream_, 0, sizeof stream_ );
+        initialized_ = (inflateInit2( &stream_, 16 + MAX_WBITS ) == Z_OK); // 16: gzip format only
+    }
+
+    ~GzipDecompressor() override
+    {
+        if ( initialized_ ) inflateEnd( &stream_ );
+    }
+
+    bool decompress( const char** input, size_t* input_size, char** output, size_t* output_size,
+                     std::string* error ) override
+    {
+        if ( !initialized_ )
+        {
+            *error = "cannot initialize zlib";
+            return false;
+        }
+
+        while ( *output_size > 0 )
+        {
+            if ( at_end_ )
+            {
+                if ( *input_size == 0 ) break;
+                inflateReset( &stream_ ); // The next member of a concatenated file
+                at_end_ = false;
+            }
+
+            stream_.next_in = reinterpret_cast<Bytef*>( const_cast<char*>(*input) );
+            stream_.avail_in = unsigned( std::min<size_t>(*input_size, UINT_MAX) );
+            stream_.next_out = reinterpret_cast<Bytef*>( *output );
+            stream_.avail_out = unsigned( std::min<size_t>(*output_size, UINT_MAX) );
+            auto result = inflate( &stream_, Z_NO_FLUSH );
+
+            auto consumed = size_t( reinterpret_cast<const char*>(stream_.next_in) - *input );
+            auto written = size_t( reinterpret_cast<char*>(stream_.next_out) - *output );
+            *input += consumed;
+            *input_size -= consumed;
+            *output += written;
+            *output_size -= written;
+
+            if ( result == Z_STREAM_END ) at_end_ = true;
+            else if ( result == Z_BUF_ERROR ) break; // Needs more input
+            else if ( result != Z_OK )
+            {
+                *error = std::string( "corrupt gzip data: " ) + ((stream_.msg != nullptr) ? stream_.msg : "inflate failed");
+                return false;
+            }
+            if ( (consumed == 0) && (written == 0) ) break;
+        }
+        return true;
+    }
+
+    bool at_end() const override { return at_end_; }
+
+private:
+
+    z_stream    stream_;
+    bool        initialized_ = false;
+    bool        at_end_ = false;
+};
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef DOMAINDB_HAVE_ZSTD
+
+//! zstd decompression with libzstd
+class ZstdDecompressor : public Decompressor
+{
+public:
+
+    ZstdDecompressor() :
+        context_(ZSTD_createDCtx())
+    {
+    }
+
+    ~ZstdDecompressor() override
+    {
+        ZSTD_freeDCtx( context_ );
+    }
+
+    bool decompress( const char** input, size_t* input_size, char** output, size_t* output_size,
+                     std::string* error ) override
+    {
+        if ( context_ == nullptr )
+        {
+            *error = "cannot initialize zstd";
+            return false;
+        }
+
+        // zstd may hold decompressed bytes that did not fit the output: call it until it makes no progress
+        while ( *output_size > 0 )
+        {
+            ZSTD_inBuffer in = { *input, *input_size, 0 };
+            ZSTD_outBuffer out = { *output, *output_size, 0 };
+            auto result = ZSTD_decompressStream( context_, &out, &in );
+            if ( ZSTD_isError(result) )
+            {
+                *error = std::string( "corrupt zstd data: " ) + ZSTD_getErrorName( result );
+                return false;
+            }
+
+            *input += in.pos;
+            *input_size -= in.pos;
+            *output += out.pos;
+            *output_size -= out.pos;
+            if ( (in.pos == 0) && (out.pos == 0) ) break; // Past the end of a frame zstd asks for the next one
+            at_end_ = (result == 0);
+        }
+        return true;
+    }
+
+    bool at_end() const override { return at_end_; }
+
+private:
+
+    ZSTD_DCtx*  context_;
+    bool        at_end_ = false;
+};
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Create a decompressor
+std::unique_ptr<Decompressor> Decompressor::create( Format format, std::string* error )
+{
+    switch ( format )
+    {
+#ifdef DOMAINDB_HAVE_ZLIB
+        case Format::gzip:  return std::unique_ptr<Decompressor>( new GzipDecompressor() );
+#endif
+#ifdef DOMAINDB_HAVE_ZSTD
+        case Format::zstd:  return std::unique_ptr<Decompressor>( new ZstdDecompressor() );
+#endif
+        default:            break;
+    }
+
+    *error = std::string( "this build cannot decompress " ) + name( format ) + " files";
+    return nullptr;
+}
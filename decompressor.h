@@ -0,0 +1,62 @@
+#ifndef DOMAINDB_DECOMPRESSOR_H
+#define DOMAINDB_DECOMPRESSOR_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Streaming decompression of a gzip or zstd file, fed with the compressed bytes as they are read.
+//!
+//! gzip needs zlib and zstd needs libzstd at build time; create() reports a format this build does not
+//! support. Concatenated gzip members and zstd frames are decompressed as one stream, as gunzip and
+//! zstd -d do.
+class Decompressor
+{
+public:
+
+    enum class Format
+    {
+        none,
+        gzip,
+        zstd
+    };
+
+    //! Detect the format of a file from its first bytes
+    //!
+    //! \param data - the first bytes of the file
+    //! \param size - number of bytes, at least 4 to detect a compressed format
+    //! \return the format, none if the file is not compressed
+    static Format detect( const char* data, size_t size );
+
+    //! Name of a format, such as "gzip"
+    static const char* name( Format format );
+
+    //! Create a decompressor
+    //!
+    //! \param format - format of the data, not none
+    //! \param error  - receives a description of the problem on failure
+    //! \return the decompressor, nullptr if the format is not supported by this build
+    static std::unique_ptr<Decompressor> create( Format format, std::string* error );
+
+    virtual ~Decompressor() = default;
+
+    //! Decompress as much of the input as fits into the output
+    //!
+    //! \param input       - the compressed bytes available; advanced past the bytes consumed
+    //! \param input_size  - number of bytes available; reduced by the bytes consumed
+    //! \param output      - where to write; advanced past the bytes written
+    //! \param output_size - room at output; reduced by the bytes written
+    //! \param error       - receives a description of the problem on failure
+    //! \return false if the compressed data is corrupt
+    virtual bool decompress( const char** input, size_t* input_size, char** output, size_t* output_size,
+                             std::string* error ) = 0;
+
+    //! True if the stream so far ends at the end of a gzip member or a zstd frame, so that the file may end here
+    virtual bool at_end() const = 0;
+};
+
+#endif //DOMAINDB_DECOMPRESSOR_H
@@ -0,0 +1,190 @@
+#include "domain_delta.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <unordered_set>
+
+using namespace json11;
+
+static const char* const kDeltaFormat = "domaindb-delta";
+static const int kDeltaVersion = 1;
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Format a fingerprint as 16 hex digits
+static std::string fingerprint_to_string( uint64_t fingerprint )
+{
+    char buf[20];
+    snprintf( buf, sizeof buf, "%016" PRIx64, fingerprint );
+    return buf;
+}
+
+//! Parse a fingerprint of 16 hex digits
+static bool fingerprint_from_json( const Json& json, uint64_t* fingerprint )
+{
+    const auto& text = json.string_value();
+    if ( text.size() != 16 ) return false;
+    if ( text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos ) return false;
+    *fingerprint = std::stoull( text, nullptr, 16 );
+    return true;
+}
+
+//! Parse the port ranges of one protocol: [[first_port, last_port, "category"], ...]
+static bool port_ranges_from_json( const Json& json, std::vector<DomainTree::PortRange>* port_ranges )
+{
+    if ( !json.is_array() ) return false;
+    for ( const auto& range_json : json.array_items() )
+    {
+        const auto& items = range_json.array_items();
+        if ( (items.size() != 3) || !items[0].is_number() || !items[1].is_number() || !items[2].is_string() ) return false;
+
+        auto first_port = items[0].int_value();
+        auto last_port = items[1].int_value();
+        MultiConnectionType category;
+        if ( (first_port < 0) || (last_port > 0xFFFF) || (first_port > last_port) ) return false;
+        if ( !from_string(items[2].string_value(), &category) ) return false;
+
+        port_ranges->emplace_back( uint16_t(first_port), uint16_t(last_port), category );
+    }
+    return true;
+}
+
+//! Append the port ranges of one protocol in json format
+static void dump_port_ranges( const std::vector<DomainTree::PortRange>& port_ranges, std::string* out )
+{
+    *out += '[';
+    for ( size_t i = 0; i < port_ranges.size(); ++i )
+    {
+        const auto& port_range = port_ranges[i];
+        if ( i != 0 ) *out += ',';
+        *out += '[' + std::to_string(port_range.first_port) + ',' + std::to_string(port_range.last_port) + ",\"";
+        *out += to_string( port_range.category );
+        *out += "\"]";
+    }
+    *out += ']';
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Compute the changes that turn one database into another
+DomainDelta DomainDelta::diff( const DomainTree& from, const DomainTree& to )
+{
+    DomainDelta delta;
+    delta.base_fingerprint = from.fingerprint();
+    delta.target_fingerprint = to.fingerprint();
+
+    DomainTree::DomainPorts old_ports;
+    to.for_each_domain( [&]( const Domain& domain_name, const DomainTree::DomainPorts& new_ports )
+    {
+        if ( !from.find_domain_ports(domain_name, &old_ports) || (old_ports != new_ports) )
+        {
+            delta.changed.push_back( Change{domain_name, new_ports} );
+        }
+    } );
+    from.for_each_domain( [&]( const Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        if ( !to.find_domain_ports(domain_name, &old_ports) ) delta.removed.push_back( domain_name );
+    } );
+
+    // Deterministic output for identical inputs
+    std::sort( delta.removed.begin(), delta.removed.end() );
+    std::sort( delta.changed.begin(), delta.changed.end(),
+               []( const Change& a, const Change& b ) { return a.domain < b.domain; } );
+
+    return delta;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Parse a delta from its json text
+bool DomainDelta::parse( const std::string& text, DomainDelta* delta, std::string* error )
+{
+    std::string parse_error;
+    auto json = Json::parse( text, parse_error );
+    if ( !parse_error.empty() )
+    {
+        *error = "delta parse error: " + parse_error;
+        return false;
+    }
+
+    if ( (json["format"].string_value() != kDeltaFormat) || (json["version"].int_value() != kDeltaVersion) )
+    {
+        *error = "not a domaindb-delta version 1 file";
+        return false;
+    }
+
+    DomainDelta result;
+    if ( !fingerprint_from_json(json["base"], &result.base_fingerprint) ||
+         !fingerprint_from_json(json["target"], &result.target_fingerprint) )
+    {
+        *error = "bad base or target fingerprint";
+        return false;
+    }
+
+    std::unordered_set<std::string> domains;
+    for ( const auto& domain_json : json["remove"].array_items() )
+    {
+        if ( !domain_json.is_string() || !domains.insert(domain_json.string_value()).second )
+        {
+            *error = "bad or duplicate domain in remove: " + domain_json.dump();
+            return false;
+        }
+        result.removed.push_back( domain_json.string_value() );
+    }
+
+    for ( const auto& change_json : json["set"].array_items() )
+    {
+        const auto& items = change_json.array_items();
+        Change change;
+        if ( (items.size() != 3) || !items[0].is_string() || !domains.insert(items[0].string_value()).second ||
+             !port_ranges_from_json(items[1], &change.ports.tcp) || !port_ranges_from_json(items[2], &change.ports.udp) )
+        {
+            *error = "bad or duplicate domain in set: " + change_json.dump();
+            return false;
+        }
+        change.domain = items[0].string_value();
+        result.changed.push_back( std::move(change) );
+    }
+
+    *delta = std::move( result );
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Serialize the delta to its json text
+std::string DomainDelta::dump() const
+{
+    std::string out = "{\"format\":\"" + std::string(kDeltaFormat) + "\",\"version\":" + std::to_string(kDeltaVersion) +
+                      ",\"base\":\"" + fingerprint_to_string(base_fingerprint) +
+                      "\",\"target\":\"" + fingerprint_to_string(target_fingerprint) + "\",\n\"remove\":[";
+
+    for ( size_t i = 0; i < removed.size(); ++i )
+    {
+        out += (i == 0) ? "\n" : ",\n";
+        Json(removed[i]).dump( out );
+    }
+
+    out += "],\n\"set\":[";
+    for ( size_t i = 0; i < changed.size(); ++i )
+    {
+        out += (i == 0) ? "\n[" : ",\n[";
+        Json(changed[i].domain).dump( out );
+        out += ',';
+        dump_port_ranges( changed[i].ports.tcp, &out );
+        out += ',';
+        dump_port_ranges( changed[i].ports.udp, &out );
+        out += ']';
+    }
+    out += "]}\n";
+
+    return out;
+}
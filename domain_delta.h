@@ -0,0 +1,62 @@
+#ifndef DOMAINDB_DOMAIN_DELTA_H
+#define DOMAINDB_DOMAIN_DELTA_H
+
+#include "domain_tree.h"
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! The changes between two versions of the database, applied with DomainTree::apply_delta.
+//! The delta file has the following json format:
+//! { "format" : "domaindb-delta", "version" : 1,
+//!   "base" : "fingerprint of the old database", "target" : "fingerprint of the new database",
+//!   "remove" : [ "domain_name", ... ],
+//!   "set" : [ ["domain_name", [tcp_ranges], [udp_ranges]], ... ] }
+//! Each ranges array lists the ranges of the domain in match order as [first_port, last_port, "category"],
+//! where category is the name of a MultiConnectionType value. Fingerprints are 16 hex digits.
+//! A "set" entry replaces all port ranges of the domain, adding the domain if it does not exist.
+class DomainDelta
+{
+public:
+
+    using Domain = DomainTree::Domain;
+
+    struct Change
+    {
+        Domain                      domain;
+        DomainTree::DomainPorts     ports;
+    };
+
+    uint64_t                base_fingerprint = 0;   //!< DomainTree::fingerprint() of the old database
+    uint64_t                target_fingerprint = 0; //!< DomainTree::fingerprint() of the new database
+    std::vector<Domain>     removed;                //!< domains to remove
+    std::vector<Change>     changed;                //!< domains to add or replace
+
+public:
+
+    //! Compute the changes that turn one database into another
+    //!
+    //! \param from - the old database
+    //! \param to   - the new database
+    //! \return the delta
+    static DomainDelta diff( const DomainTree& from, const DomainTree& to );
+
+    //! Parse a delta from its json text
+    //!
+    //! \param text  - the delta file content
+    //! \param delta - receives the parsed delta
+    //! \param error - receives a description of the problem on failure
+    //! \return true on success, false on failure
+    static bool parse( const std::string& text, DomainDelta* delta, std::string* error );
+
+    //! Serialize the delta to its json text
+    std::string dump() const;
+
+    //! True if the delta changes nothing
+    bool empty() const { return removed.empty() && changed.empty(); }
+};
+
+#endif //DOMAINDB_DOMAIN_DELTA_H
@@ -0,0 +1,65 @@
+#include "domain_filter.h"
+#include "domain_hash.h"
+
+//! Create an empty filter
+DomainFilter::DomainFilter( size_t capacity ) :
+    capacity_(capacity)
+{
+    size_t blocks = 1;
+    while ( blocks * sizeof(Block) * 8 < capacity * kBitsPerKey ) blocks *= 2;
+
+    block_mask_ = blocks - 1;
+    blocks_.reset( new Block[blocks] );
+    for ( size_t i = 0; i < blocks; ++i )
+    {
+        for ( auto& word : blocks_[i].words ) word.store( 0, std::memory_order_relaxed );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Add a name
+void DomainFilter::add( std::string_view name, Kind kind )
+{
+    auto hash = hash_string( name );
+    auto& block = blocks_[hash & block_mask_];
+    auto positions = bit_positions( hash, kind );
+    for ( unsigned i = 0; i < kBitsPerName; ++i, positions >>= 9 )
+    {
+        block.words[(positions >> 6) & 7].fetch_or( uint64_t(1) << (positions & 63), std::memory_order_relaxed );
+    }
+
+    if ( kind == Kind::key ) keys_.fetch_add( 1, std::memory_order_relaxed );
+}
+
+//! Probe a name by its hash
+DomainFilter::Probe DomainFilter::probe( uint64_t name_hash ) const
+{
+    const auto& block = blocks_[name_hash & block_mask_];
+    return Probe{ test(block, name_hash, Kind::key), test(block, name_hash, Kind::suffix) };
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Positions of the bits of a name of a kind in its block
+uint64_t DomainFilter::bit_positions( uint64_t hash, Kind kind )
+{
+    // The block is selected by the low bits of the hash; remix so that the positions are independent of them
+    return hash_mix( hash ^ ((kind == Kind::key) ? 0x6A09E667F3BCC908ull : 0xBB67AE8584CAA73Bull) );
+}
+
+//! True if all bits of a name of a kind are set in a block
+bool DomainFilter::test( const Block& block, uint64_t hash, Kind kind )
+{
+    auto positions = bit_positions( hash, kind );
+    for ( unsigned i = 0; i < kBitsPerName; ++i, positions >>= 9 )
+    {
+        auto word = block.words[(positions >> 6) & 7].load( std::memory_order_relaxed );
+        if ( ((word >> (positions & 63)) & 1) == 0 ) return false;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef DOMAINDB_DOMAIN_FILTER_H
+#define DOMAINDB_DOMAIN_FILTER_H
+
+#include "domain_hash.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Blocked Bloom filter over domain names, used to skip domain table probes for names that are not in the table.
+//!
+//! Every name is added as one of two kinds: a key of the table, or a suffix of a key. A probe answers both
+//! questions at once from one 64 byte block, so each name costs a single cache line. Like any Bloom filter it
+//! may answer "maybe" for a name that was never added, but never "no" for one that was.
+//!
+//! Names can be added while readers probe: the bits are atomic and only ever set. Names are never removed;
+//! the owner rebuilds the filter when it fills up.
+class DomainFilter
+{
+public:
+
+    enum class Kind : uint8_t
+    {
+        key,    //!< the name is a key of the table
+        suffix, //!< the name is a suffix of a key of the table
+    };
+
+    //! Answer of a probe; either may be a false positive
+    struct Probe
+    {
+        bool    key;    //!< the name may be a key
+        bool    suffix; //!< the name may be a suffix of a key
+    };
+
+    //! Create an empty filter
+    //!
+    //! \param capacity - number of keys to size the filter for, at about 1% false positives
+    explicit DomainFilter( size_t capacity );
+
+    DomainFilter( const DomainFilter& ) = delete;
+    DomainFilter& operator=( const DomainFilter& ) = delete;
+
+    //! Number of keys the filter was sized for
+    size_t capacity() const { return capacity_; }
+
+    //! Number of keys added
+    size_t keys() const { return keys_.load( std::memory_order_relaxed ); }
+
+    //! Memory used by the filter bits in bytes
+    size_t memory_usage() const { return (block_mask_ + 1) * sizeof(Block); }
+
+    //! Add a name. Writer: calls must be serialized by the owner.
+    //!
+    //! \param name - the name to add
+    //! \param kind - what the name is
+    void add( std::string_view name, Kind kind );
+
+    //! Probe a name. Reader: safe concurrently with add().
+    //!
+    //! \param name - the name to probe
+    //! \return whether the name may be a key and whether it may be a suffix of a key
+    Probe probe( std::string_view name ) const { return probe( hash(name) ); }
+
+    //! Hash of a name, for lookups that prefetch the block of a name before they probe it
+    static uint64_t hash( std::string_view name ) { return hash_string( name ); }
+
+    //! Prefetch the block of a name into the cache
+    //!
+    //! \param name_hash - hash() of the name
+    void prefetch( uint64_t name_hash ) const { __builtin_prefetch( &blocks_[name_hash & block_mask_] ); }
+
+    //! Probe a name by its hash(). Reader: safe concurrently with add().
+    Probe probe( uint64_t name_hash ) const;
+
+private:
+
+    static const unsigned kBitsPerKey = 16;
+    static const unsigned kBitsPerName = 6;
+
+    struct alignas(64) Block
+    {
+        std::atomic<uint64_t>   words[8];
+    };
+
+    const size_t                capacity_;
+    size_t                      block_mask_;
+    std::unique_ptr<Block[]>    blocks_;
+    std::atomic<size_t>         keys_{0};
+
+    //! Positions of the kBitsPerName bits of a name of a kind in its block, 9 bits each
+    static uint64_t bit_positions( uint64_t hash, Kind kind );
+
+    //! True if all bits of a name of a kind are set in a block
+    static bool test( const Block& block, uint64_t hash, Kind kind );
+};
+
+#endif //DOMAINDB_DOMAIN_FILTER_H
@@ -0,0 +1,55 @@
+#ifndef DOMAINDB_DOMAIN_HASH_H
+#define DOMAINDB_DOMAIN_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Stable 64-bit hashing of domain names and database contents. Unlike std::hash the results are the
+//! same in every build on every little-endian platform, so they can be stored in files and compared
+//! between machines.
+
+//! Finalization mix of a 64-bit value (the MurmurHash3 fmix64 step)
+inline uint64_t hash_mix( uint64_t value )
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+//! Combine a hash with another 64-bit value; the result depends on the order of combination
+inline uint64_t hash_combine( uint64_t hash, uint64_t value )
+{
+    return hash_mix( hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2)) );
+}
+
+//! Hash a string, reading it eight bytes at a time
+inline uint64_t hash_string( std::string_view text, uint64_t seed = 0 )
+{
+    uint64_t hash = seed ^ (text.size() * 0x9E3779B97F4A7C15ull);
+    const char* data = text.data();
+    size_t size = text.size();
+
+    while ( size >= 8 )
+    {
+        uint64_t word;
+        std::memcpy( &word, data, 8 );
+        hash = (hash ^ hash_mix(word)) * 0x87C37B91114253D5ull;
+        hash ^= hash >> 29;
+        data += 8;
+        size -= 8;
+    }
+
+    uint64_t tail = 0;
+    std::memcpy( &tail, data, size );
+    return hash_mix( hash ^ tail );
+}
+
+#endif //DOMAINDB_DOMAIN_HASH_H
@@ -0,0 +1,181 @@
+#include "domain_index.h"
+#include <algorithm>
+#include <utility>
+
+//! Compare two names read backwards, bytes as unsigned like std::string does
+static bool reversed_less( std::string_view a, std::string_view b )
+{
+    return std::lexicographical_compare( a.rbegin(), a.rend(), b.rbegin(), b.rend(),
+                                         []( char x, char y ) { return uint8_t(x) < uint8_t(y); } );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Build the index of a database
+DomainIndex::DomainIndex( const DomainTree& domain_tree ) :
+    fingerprint_(domain_tree.fingerprint()) // Read first: an update during the build makes the index stale
+{
+    // The names read backwards with their number in visit order, and the ranges flattened: domain d in visit
+    // order has tcp ranges [range_ends[2 * d], range_ends[2 * d + 1]) and udp ranges up to range_ends[2 * d + 2]
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    std::vector<PortRange> ranges;
+    std::vector<uint32_t> range_ends( 1, 0 );
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& ports )
+    {
+        keys.emplace_back( std::string(domain_name.rbegin(), domain_name.rend()), uint32_t(keys.size()) );
+        ranges.insert( ranges.end(), ports.tcp.begin(), ports.tcp.end() );
+        range_ends.push_back( uint32_t(ranges.size()) );
+        ranges.insert( ranges.end(), ports.udp.begin(), ports.udp.end() );
+        range_ends.push_back( uint32_t(ranges.size()) );
+    } );
+    std::sort( keys.begin(), keys.end() );
+
+    name_offsets_.reserve( keys.size() + 1 );
+    name_offsets_.push_back( 0 );
+    for ( const auto& key : keys )
+    {
+        names_.append( key.first.rbegin(), key.first.rend() );
+        name_offsets_.push_back( uint32_t(names_.size()) );
+    }
+
+    // Visit the indexed ranges in index order, with the segment tree nodes covering each range, found bottom-up:
+    // node 1 is the root, kLeaves + port a leaf
+    auto for_each_claim = [&]( auto&& visit )
+    {
+        for ( uint32_t domain = 0; domain < keys.size(); ++domain )
+        {
+            auto first_range = 2 * keys[domain].second;
+            for ( size_t protocol = 0; protocol < 2; ++protocol )
+            {
+                auto protocol_range = first_range + ((protocol == size_t(ProtocolType::TCP)) ? 0 : 1);
+                for ( auto range = range_ends[protocol_range]; range < range_ends[protocol_range + 1]; ++range )
+                {
+                    const auto& port_range = ranges[range];
+                    if ( port_range.category == DomainTree::kUnclassified ) continue;
+
+                    for ( auto first = kLeaves + port_range.first_port, last = kLeaves + port_range.last_port + 1;
+                          first < last; first >>= 1, last >>= 1 )
+                    {
+                        if ( first & 1 ) visit( protocol, first++, Claim{domain, port_range} );
+                        if ( last & 1 ) visit( protocol, --last, Claim{domain, port_range} );
+                    }
+                }
+            }
+        }
+    };
+
+    // Counting sort of the claims by node: count, turn the counts into offsets, place
+    for ( auto& offsets : offsets_ ) offsets.assign( 2 * kLeaves + 1, 0 );
+    for_each_claim( [&]( size_t protocol, size_t node, const Claim& ) { ++offsets_[protocol][node + 1]; } );
+    std::vector<uint32_t> next[2];
+    for ( size_t protocol = 0; protocol < 2; ++protocol )
+    {
+        auto& offsets = offsets_[protocol];
+        for ( size_t node = 1; node < offsets.size(); ++node ) offsets[node] += offsets[node - 1];
+        claims_[protocol].resize( offsets.back(), Claim{0, PortRange(DomainTree::kUnclassified)} );
+        next[protocol].assign( offsets.begin(), offsets.end() - 1 );
+    }
+    for_each_claim( [&]( size_t protocol, size_t node, const Claim& claim )
+    {
+        claims_[protocol][next[protocol][node]++] = claim;
+
+        auto& domains = by_category_[size_t(claim.range.category)];
+        if ( domains.empty() || (domains.back() != claim.domain) ) domains.push_back( claim.domain );
+    } );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Find the numbers of the domains under a domain name
+void DomainIndex::suffix_ranges( std::string_view suffix, uint32_t ranges[2][2] ) const
+{
+    auto count = uint32_t( size() );
+    if ( suffix.empty() || (suffix == "*") )
+    {
+        ranges[0][0] = 0;
+        ranges[0][1] = count;
+        ranges[1][0] = ranges[1][1] = count;
+        return;
+    }
+
+    bool subdomains_only = (suffix.substr(0, 2) == "*.");
+    if ( subdomains_only ) suffix.remove_prefix( 2 );
+
+    // The domain itself
+    auto self = lower_bound( suffix );
+    ranges[0][0] = self;
+    ranges[0][1] = (!subdomains_only && (self < count) && (name(self) == suffix)) ? self + 1 : self;
+
+    // Names ending with ".suffix" read backwards start with "xiffus." and sort before "xiffus/"
+    std::string key = "." + std::string(suffix);
+    ranges[1][0] = lower_bound( key );
+    key[0] = '.' + 1;
+    ranges[1][1] = lower_bound( key );
+}
+
+//! Find the first domain whose name read backwards is not less than a key read backwards
+uint32_t DomainIndex::lower_bound( std::string_view key ) const
+{
+    uint32_t first = 0;
+    for ( auto count = uint32_t(size()); count > 0; )
+    {
+        auto half = count / 2;
+        if ( reversed_less(name(first + half), key) )
+        {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else count = half;
+    }
+    return first;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Names of the domains with a port range of a category
+std::vector<std::string> DomainIndex::domains_of_category( MultiConnectionType category ) const
+{
+    std::vector<std::string> names;
+    find_category( category, [&]( std::string_view domain_name ) { names.emplace_back( domain_name ); } );
+    return names;
+}
+
+//! Names of the domains with a port range containing a port
+std::vector<std::string> DomainIndex::domains_on_port( uint16_t port, ProtocolType protocol_type, bool include_all_ports ) const
+{
+    std::vector<std::string> names;
+    find_port( port, protocol_type, include_all_ports, [&]( std::string_view domain_name, const PortRange& )
+    {
+        names.emplace_back( domain_name );
+    } );
+
+    std::sort( names.begin(), names.end() );
+    names.erase( std::unique(names.begin(), names.end()), names.end() );
+    return names;
+}
+
+//! Names of the domains under a domain name
+std::vector<std::string> DomainIndex::domains_under( std::string_view suffix ) const
+{
+    std::vector<std::string> names;
+    find_suffix( suffix, [&]( std::string_view domain_name ) { names.emplace_back( domain_name ); } );
+    return names;
+}
+
+//! Memory used by the index in bytes
+size_t DomainIndex::memory_usage() const
+{
+    size_t bytes = names_.capacity() + name_offsets_.capacity() * sizeof(uint32_t);
+    for ( const auto& domains : by_category_ ) bytes += domains.capacity() * sizeof(uint32_t);
+    for ( size_t protocol = 0; protocol < 2; ++protocol )
+    {
+        bytes += offsets_[protocol].capacity() * sizeof(uint32_t) + claims_[protocol].capacity() * sizeof(Claim);
+    }
+    return bytes;
+}
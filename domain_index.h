@@ -0,0 +1,142 @@
+#ifndef DOMAINDB_DOMAIN_INDEX_H
+#define DOMAINDB_DOMAIN_INDEX_H
+
+#include "domain_tree.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Reverse queries over a database: the domains of a category, the port ranges containing a port and the
+//! domains under a domain name, answered from secondary indexes instead of probing with match_domain.
+//!
+//! The domains are numbered in the order of their names read backwards, so that all domains under a name
+//! are consecutive and found with two binary searches. Each category has a posting list of the numbers of
+//! the domains having a port range of that category. The port ranges of each protocol are kept in a segment
+//! tree over the 65536 ports: a range is stored in the O(log 65536) nodes that cover it exactly, so a port
+//! query reads the 17 nodes on the path from the port's leaf to the root. Ranges covering every port, such
+//! as those of domains listed without ports, are all in the root and can be skipped cheaply.
+//!
+//! The index is a snapshot: it does not follow later updates of the database. It remembers the
+//! DomainTree::fingerprint() it was built from, so current() tells when it needs to be rebuilt.
+class DomainIndex
+{
+public:
+
+    using PortRange = DomainTree::PortRange;
+
+    //! Build the index of a database
+    //!
+    //! \param domain_tree - the database
+    explicit DomainIndex( const DomainTree& domain_tree );
+
+    //! Visit the domains with a port range of a category, for either protocol, in index order
+    //!
+    //! \param category - the category
+    //! \param visit    - called as visit(std::string_view domain)
+    template <typename Visitor>
+    void find_category( MultiConnectionType category, Visitor&& visit ) const
+    {
+        if ( size_t(category) >= kCategoryCount ) return;
+        for ( auto domain : by_category_[size_t(category)] ) visit( name(domain) );
+    }
+
+    //! Visit the port ranges containing a port, in no particular order. A domain is visited once for each of
+    //! its ranges containing the port; ranges with kUnclassified category are not indexed.
+    //!
+    //! \param port              - the port
+    //! \param protocol_type     - UDP or TCP
+    //! \param include_all_ports - visit ranges covering every port as well
+    //! \param visit             - called as visit(std::string_view domain, const PortRange& range)
+    template <typename Visitor>
+    void find_port( uint16_t port, ProtocolType protocol_type, bool include_all_ports, Visitor&& visit ) const
+    {
+        auto protocol = size_t( protocol_type );
+        if ( protocol >= 2 ) return;
+
+        const auto& offsets = offsets_[protocol];
+        const auto& claims = claims_[protocol];
+        for ( size_t node = kLeaves + port; node >= (include_all_ports ? 1 : 2); node >>= 1 )
+        {
+            for ( auto i = offsets[node]; i < offsets[node + 1]; ++i ) visit( name(claims[i].domain), claims[i].range );
+        }
+    }
+
+    //! Visit the domains under a domain name, in index order. "akamai.net" matches akamai.net itself and
+    //! every domain ending with .akamai.net; "*.akamai.net" matches only the latter. "" and "*" match all
+    //! domains.
+    //!
+    //! \param suffix - the domain name, optionally preceded by "*."
+    //! \param visit  - called as visit(std::string_view domain)
+    template <typename Visitor>
+    void find_suffix( std::string_view suffix, Visitor&& visit ) const
+    {
+        uint32_t ranges[2][2];
+        suffix_ranges( suffix, ranges );
+        for ( const auto& range : ranges )
+        {
+            for ( auto domain = range[0]; domain < range[1]; ++domain ) visit( name(domain) );
+        }
+    }
+
+    //! Names of the domains with a port range of a category, see find_category()
+    std::vector<std::string> domains_of_category( MultiConnectionType category ) const;
+
+    //! Names of the domains with a port range containing a port, sorted, each once, see find_port()
+    std::vector<std::string> domains_on_port( uint16_t port, ProtocolType protocol_type, bool include_all_ports ) const;
+
+    //! Names of the domains under a domain name, see find_suffix()
+    std::vector<std::string> domains_under( std::string_view suffix ) const;
+
+    //! True if the database has not changed since the index was built
+    bool current( const DomainTree& domain_tree ) const { return domain_tree.fingerprint() == fingerprint_; }
+
+    //! DomainTree::fingerprint() of the database the index was built from
+    uint64_t fingerprint() const { return fingerprint_; }
+
+    //! Number of domains in the index
+    size_t size() const { return name_offsets_.size() - 1; }
+
+    //! Memory used by the index in bytes
+    size_t memory_usage() const;
+
+private:
+
+    static const size_t kLeaves = DomainTree::kPortCount;
+    static const size_t kCategoryCount = MultiConnectionTypeString.size();
+
+    //! A port range of a domain
+    struct Claim
+    {
+        uint32_t    domain;     //!< number of the domain
+        PortRange   range;
+    };
+
+    uint64_t                fingerprint_;
+    std::string             names_;                         //!< all domain names in index order, not terminated
+    std::vector<uint32_t>   name_offsets_;                  //!< start of every name in names_, and the end of the last one
+    std::vector<uint32_t>   by_category_[kCategoryCount];   //!< by category: numbers of the domains, ascending
+    std::vector<uint32_t>   offsets_[2];                    //!< by protocol: claims of segment tree node n are claims_[offsets_[n] .. offsets_[n + 1])
+    std::vector<Claim>      claims_[2];                     //!< by protocol, grouped by node
+
+    //! Name of a domain by its number
+    std::string_view name( uint32_t domain ) const
+    {
+        return std::string_view( names_.data() + name_offsets_[domain], name_offsets_[domain + 1] - name_offsets_[domain] );
+    }
+
+    //! Find the numbers of the domains under a domain name, see find_suffix()
+    //!
+    //! \param suffix - the domain name, optionally preceded by "*."
+    //! \param ranges - receives two ranges [first, end) of domain numbers
+    void suffix_ranges( std::string_view suffix, uint32_t ranges[2][2] ) const;
+
+    //! Find the first domain whose name read backwards is not less than a key read backwards
+    uint32_t lower_bound( std::string_view key ) const;
+};
+
+#endif //DOMAINDB_DOMAIN_INDEX_H
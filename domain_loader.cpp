@@ -0,0 +1,47 @@
+#include "domain_loader.h"
+#include <algorithm>
+
+//! Start the background threads
+DomainLoader::DomainLoader( const Options& options ) :
+    options_(options),
+    pool_(std::max(1u, options.threads))
+{
+}
+
+//! Load a database file in the background
+std::future<DomainLoader::Snapshot> DomainLoader::load( const std::string& db_filename, DomainTree::ProgressCallback progress )
+{
+    return pool_.submit( [db_filename, progress, public_suffixes = options_.public_suffixes]() -> Snapshot
+    {
+        return std::make_shared<const DomainTree>( db_filename, progress, public_suffixes );
+    } );
+}
+
+//! Load a database file in the background and make it current if it loads successfully
+std::future<bool> DomainLoader::reload( const std::string& db_filename, DomainTree::ProgressCallback progress )
+{
+    auto sequence = ++reloads_started_;
+    return pool_.submit( [this, db_filename, progress, sequence]()
+    {
+        auto domain_tree = std::make_shared<const DomainTree>( db_filename, progress, options_.public_suffixes );
+        const auto& report = domain_tree->load_report();
+        if ( !report.error.empty() || ((report.rejected_count != 0) && !options_.accept_rejected) ) return false;
+
+        // The replaced database, unless a lookup still holds it, is freed after the lock is released
+        Snapshot replaced;
+        std::lock_guard<std::mutex> lock( publish_mutex_ );
+        if ( sequence < reload_published_ ) return false; // A later reload finished first
+        reload_published_ = sequence;
+        replaced = std::atomic_exchange( &current_, Snapshot(domain_tree) );
+        return true;
+    } );
+}
+
+//! Make a database current
+void DomainLoader::set_current( Snapshot domain_tree )
+{
+    Snapshot replaced;
+    std::lock_guard<std::mutex> lock( publish_mutex_ );
+    reload_published_ = reloads_started_.load();
+    replaced = std::atomic_exchange( &current_, std::move(domain_tree) );
+}
@@ -0,0 +1,86 @@
+#ifndef DOMAINDB_DOMAIN_LOADER_H
+#define DOMAINDB_DOMAIN_LOADER_H
+
+#include "domain_tree.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Loads databases on background threads and holds the current one.
+//!
+//! A service can accept traffic at once: it classifies against the current database, the last one that
+//! loaded successfully, while reload() builds a new one. The new database replaces the current one only
+//! when it is complete; a database that fails to load is dropped and the current one stays.
+class DomainLoader
+{
+public:
+
+    using Snapshot = std::shared_ptr<const DomainTree>;
+
+    struct Options
+    {
+        unsigned    threads = 1;            //!< background threads, the number of files that can load at once
+        bool        accept_rejected = true; //!< make a database current even if some of its entries were rejected
+
+        //! Public suffix list of the databases, may be nullptr, see DomainTree::DomainTree
+        std::shared_ptr<const PublicSuffixList> public_suffixes;
+    };
+
+    //! Start the background threads
+    //!
+    //! \param options - loader options
+    explicit DomainLoader( const Options& options );
+    DomainLoader() : DomainLoader( Options() ) {}
+
+    //! Wait for the loads in progress
+    ~DomainLoader() = default;
+
+    DomainLoader( const DomainLoader& ) = delete;
+    DomainLoader& operator=( const DomainLoader& ) = delete;
+
+    //! Load a database file in the background
+    //!
+    //! \param db_filename - path and name of the database file
+    //! \param progress    - receives the load progress on the loading thread, may be empty
+    //! \return future of the database; see its load_report() for the outcome
+    std::future<Snapshot> load( const std::string& db_filename, DomainTree::ProgressCallback progress = nullptr );
+
+    //! Load a database file in the background and make it current if it loads successfully. When reloads
+    //! overlap, the one started last wins.
+    //!
+    //! \param db_filename - path and name of the database file
+    //! \param progress    - receives the load progress on the loading thread, may be empty
+    //! \return future of true if the database became current
+    std::future<bool> reload( const std::string& db_filename, DomainTree::ProgressCallback progress = nullptr );
+
+    //! The current database, nullptr before the first successful reload. Take one snapshot per batch of
+    //! lookups rather than one per lookup: the snapshot stays valid while it is held, even after a reload.
+    Snapshot current() const { return std::atomic_load( &current_ ); }
+
+    //! Make a database current, such as one loaded by the caller before starting
+    //!
+    //! \param domain_tree - the new current database
+    void set_current( Snapshot domain_tree );
+
+private:
+
+    const Options           options_;
+    Snapshot                current_;
+
+    //! Sequence numbers of the reloads: started, and the last one that became current
+    std::atomic<uint64_t>   reloads_started_{0};
+    uint64_t                reload_published_ = 0;
+    std::mutex              publish_mutex_;
+
+    //! Last member: it is destroyed first, waiting for the loads that use the members above
+    ThreadPool              pool_;
+};
+
+#endif //DOMAINDB_DOMAIN_LOADER_H
@@ -3,8 +3,12 @@
 //
 
 #include "domain_tree.h"
-#include <fstream>
-#include <iostream>
+#include "domain_delta.h"
+#include "domain_hash.h"
+#include "idn.h"
+#include "lookup_stats.h"
+#include "record_splitter.h"
+#include <algorithm>
 
 using namespace json11;
 
@@ -13,18 +17,131 @@ using namespace json11;
 //////////////////////////////////////////////////////////////////////////
 
 //! Read database from a file to RAM
-DomainTree::DomainTree( const std::string& db_filename )
+DomainTree::DomainTree( const std::string& db_filename, const ProgressCallback& progress,
+                        std::shared_ptr<const PublicSuffixList> public_suffixes ) :
+    public_suffixes_(std::move(public_suffixes))
 {
-    std::string parse_error;
-    std::cout << "DomainDb::DomainDb reading and parsing json" << std::endl;
-    auto json = Json::parse( read_db_file(db_filename), parse_error );
-    std::cout << "DomainDb::DomainDb reading and parsing done" << std::endl;
+    using Clock = std::chrono::steady_clock;
+    auto& report = load_report_;
+    if ( progress ) progress_ = &progress;
+
+    set_load_stage( LoadProgress::Stage::reading );
+    auto start = Clock::now();
+    FileReader reader;
+    std::string read_error;
+    if ( !reader.open(db_filename, &read_error) )
+    {
+        report.error = read_error;
+        set_load_stage( LoadProgress::Stage::done );
+        return;
+    }
+    report.file_bytes = reader.file_size();
+    load_progress_.file_bytes = reader.file_size();
+
+    // The entries are parsed while the rest of the file is read, so parse_time includes waiting for the reader
+    set_load_stage( LoadProgress::Stage::parsing );
+    ServiceBatches services;
+    bool split_ok = parse_db_batches( reader, &services );
+    bool read_ok = reader.finish( &read_error );
+    report.read_time = reader.read_time();
+    report.read_method = reader.method();
+    if ( !read_ok )
+    {
+        report.parse_time = Clock::now() - start;
+        report.error = read_error;
+        set_load_stage( LoadProgress::Stage::done );
+        return;
+    }
+    std::string_view text( reader.data(), reader.size() );
+
+    if ( !split_ok )
+    {
+        // An unusual layout or invalid json: parse the whole document to report the error exactly as before
+        std::string parse_error;
+        auto json = Json::parse( std::string(text), parse_error, JsonParse::FAST );
+        if ( !parse_error.empty() )
+        {
+            report.parse_time = Clock::now() - start;
+            report.error = "json parse error: " + parse_error;
+            set_load_stage( LoadProgress::Stage::done );
+            return;
+        }
+        services.clear();
+        for ( const auto& service : json.object_items() ) services[service.first].push_back( service.second );
+        if ( !json.is_object() )
+        {
+            reject( "the database is not a json object" );
+            add_rejected( "", nullptr );
+        }
+    }
+    report.parse_time = Clock::now() - start;
+
+    for ( const auto& service : services )
+    {
+        for ( const auto& batch : service.second ) load_progress_.entries_total += batch.array_items().size();
+    }
+    set_load_stage( LoadProgress::Stage::filling );
+    start = Clock::now();
+    report.ok = fill( services ) && (report.rejected_count == 0);
+    report.fill_time = Clock::now() - start;
+
+    report.domains = size();
+    report.memory_bytes = memory_usage();
+    locate_rejected( text );
+    set_load_stage( LoadProgress::Stage::done );
+}
+
+DomainTree::~DomainTree()
+{
+    delete filter_.load( std::memory_order_acquire );
+    delete empty_domain_ports_.load( std::memory_order_acquire );
+}
 
-    if ( !fill(json) )
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Visit the suffixes of a name that may be keys of the domain table, longest first
+template <typename Visitor>
+void DomainTree::visit_suffixes( std::string_view domain_name, size_t shortest, Visitor&& visit ) const
+{
+    std::array<uint16_t, kMaxFilterSuffixes> offsets;
+    size_t count = 0;
+    bool filtered = filter_enabled_.load( std::memory_order_relaxed ) && (domain_name.size() <= 0xFFFF);
+
+    for ( auto name = domain_name; filtered && (name.size() >= shortest); remove_token(&name) )
+    {
+        if ( count == kMaxFilterSuffixes ) filtered = false;
+        else offsets[count++] = uint16_t( name.data() - domain_name.data() );
+    }
+
+    if ( !filtered ) // Probe every suffix
+    {
+        for ( uint8_t depth = 0; domain_name.size() >= shortest; ++depth )
+        {
+            if ( visit(domain_name, depth) ) return;
+            remove_token( &domain_name );
+        }
+        return;
+    }
+
+    // Check the suffixes from the shortest: once a suffix is not a suffix of any key, no longer one can be a key
+    const auto filter = filter_.load( std::memory_order_acquire );
+    size_t first = count;
+    uint32_t keys = 0;
+    while ( first > 0 )
+    {
+        auto probe = filter->probe( domain_name.substr(offsets[first - 1]) );
+        if ( probe.key ) keys |= uint32_t(1) << (first - 1);
+        if ( !probe.suffix ) break;
+        --first;
+    }
+
+    for ( ; keys != 0; keys &= keys - 1 )
     {
-        std::cout << "database error: " << parse_error << std::endl;
+        auto depth = unsigned( __builtin_ctz(keys) );
+        if ( visit(domain_name.substr(offsets[depth]), uint8_t(depth)) ) return;
     }
-    std::cout << "DomainDb::DomainDb filling database done" << std::endl;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -32,25 +149,57 @@ DomainTree::DomainTree( const std::string& db_filename )
 //////////////////////////////////////////////////////////////////////////
 
 //! Find a domain in the tree using inexact match: uses minimum number of trailing name tokens
-MultiConnectionType DomainTree::match_domain( Domain domain_name, uint16_t port, ProtocolType protocol_type ) const
+MultiConnectionType DomainTree::match_domain( Domain domain, uint16_t port, ProtocolType protocol_type ) const
 {
     MultiConnectionType category = kUnclassified;
+    std::string_view domain_name = Idn::normalize( domain );
+    Epoch::Guard guard;
+    DOMAINDB_STATS( auto stats_start = LookupStats::start(); unsigned probes = 0; unsigned walked = 1; bool fallback = false; )
 
     if ( !domain_name.empty() && std::isdigit(domain_name[0]) ) // Exact search for IP address
     {
-        category = find_domain_exact(domain_name, port, protocol_type);
+        if ( may_be_key(domain_name) )
+        {
+            category = find_domain_exact(domain_name, port, protocol_type);
+            DOMAINDB_STATS( ++probes; )
+        }
     }
-    else while ( !domain_name.empty() && (category == kUnclassified) ) // Inexact search for general domain
+    else // Inexact search for general domain
     {
-        category = find_domain_exact(domain_name, port, protocol_type);
-        remove_token( &domain_name );
+        auto shortest = shortest_suffix( domain_name );
+        DOMAINDB_STATS( unsigned matched = 0; )
+        NegativeCache::Key key;
+        bool cached = negative_cache_key( domain_name, shortest, protocol_type, &key );
+        if ( cached && negative_cache_.contains(key, port) ) // No suffix of the parent matches, only the name can
+        {
+            if ( may_be_key(domain_name) )
+            {
+                category = find_domain_exact(domain_name, port, protocol_type);
+                DOMAINDB_STATS( ++probes; matched = 1; )
+            }
+        }
+        else
+        {
+            // The ports around this one that no suffix of the parent classifies, recorded if the walk misses
+            PortRange unclassified( kUnclassified );
+            visit_suffixes( domain_name, shortest, [&]( std::string_view name, uint8_t depth )
+            {
+                category = find_domain_exact(name, port, protocol_type, (cached && (depth > 0)) ? &unclassified : nullptr);
+                DOMAINDB_STATS( ++probes; matched = depth + 1u; )
+                return category != kUnclassified;
+            } );
+            if ( cached && (category == kUnclassified) ) negative_cache_.insert( key, unclassified.first_port, unclassified.last_port );
+        }
+        DOMAINDB_STATS( walked = (category != kUnclassified) ? matched : suffix_count(domain_name, shortest); )
     }
 
     if ( category == kUnclassified ) // Try to find the port in entries with empty domain
     {
-        category = find_domain_exact("", port, protocol_type);
+        category = find_empty_domain(port, protocol_type);
+        DOMAINDB_STATS( ++probes; fallback = (category != kUnclassified); )
     }
 
+    DOMAINDB_STATS( LookupStats::record( category, probes, walked, fallback, stats_start ); )
     return category;
 }
 
@@ -58,8 +207,302 @@ MultiConnectionType DomainTree::match_domain( Domain domain_name, uint16_t port,
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+//! State of one lookup of match_domains: the steps of match_domain, each of which reads the memory that the
+//! previous one prefetched
+struct DomainTree::InterleavedLookup
+{
+    enum class Stage : uint8_t
+    {
+        filter, //!< probe the filter blocks of the suffixes
+        table,  //!< read the next node of the table search
+        entry,  //!< read the entry found by the table search
+        ports,  //!< read the port range at range
+        done
+    };
+
+    Stage                                       stage = Stage::done;
+    size_t                                      index = 0;          //!< of the query
+    std::string_view                            name;
+    uint16_t                                    port = 0;
+    ProtocolType                                protocol_type = ProtocolType::UDP;
+    MultiConnectionType                         category = kUnclassified;
+    size_t                                      count = 0;          //!< suffixes that may be probed
+    std::array<uint16_t, kMaxFilterSuffixes>    offsets;            //!< of the suffixes that may be probed, longest first
+    std::array<uint64_t, kMaxFilterSuffixes>    filter_hashes;      //!< DomainFilter::hash() of the suffixes
+    uint32_t                                    keys = 0;           //!< suffixes left to search in the table, by index of offsets
+    ConcurrentStringMap<DomainEntry>::Search    search;
+    const DomainEntry*                          domain_entry = nullptr;
+    unsigned                                    depth = 0;          //!< of the suffix searched, by index of offsets
+    DomainEntry::PortList::const_iterator       range;
+    DomainEntry::PortList::const_iterator       ranges_end;
+    bool                                        cached = false;     //!< a miss is recorded in the negative cache
+    NegativeCache::Key                          cache_key;
+    PortRange                                   unclassified{ kUnclassified };  //!< see match_domain
+    DOMAINDB_STATS( uint64_t stats_start = 0; unsigned probes = 0; unsigned suffixes = 0; )
+
+    //! Start a lookup, prefetching the memory of its first step
+    //!
+    //! \param tree        - the database
+    //! \param filter      - the domain filter, nullptr if it is off
+    //! \param query       - the lookup
+    //! \param query_index - index of the query
+    //! \return false if the lookup cannot be split in steps: a name that is not ASCII or has more suffixes than
+    //!         the filter checks. Otherwise the lookup is done or at its first step.
+    bool start( const DomainTree& tree, const DomainFilter* filter, const Query& query, size_t query_index )
+    {
+        // Names that are not ASCII are normalized in a cache of the thread that the other lookups could evict
+        if ( !Idn::is_ascii(query.domain) || (query.domain.size() > 0xFFFF) ) return false;
+        index = query_index;
+        name = query.domain;
+        port = query.port;
+        protocol_type = query.protocol_type;
+        category = kUnclassified;
+        count = 0;
+        keys = 0;
+        cached = false;
+        unclassified = PortRange( kUnclassified );
+        DOMAINDB_STATS( stats_start = LookupStats::start(); probes = 0; suffixes = 1; )
+
+        if ( !name.empty() && std::isdigit(name[0]) ) offsets[count++] = 0; // Exact search for IP address
+        else
+        {
+            auto shortest = tree.shortest_suffix( name );
+            for ( auto suffix = name; suffix.size() >= shortest; remove_token(&suffix) )
+            {
+                if ( count == kMaxFilterSuffixes ) return false;
+                offsets[count++] = uint16_t( suffix.data() - name.data() );
+            }
+            DOMAINDB_STATS( suffixes = unsigned( count ); )
+
+            // As match_domain: under a parent in the negative cache only the name itself is searched
+            cached = tree.negative_cache_key( name, shortest, protocol_type, &cache_key );
+            if ( cached && tree.negative_cache_.contains(cache_key, port) )
+            {
+                count = 1;
+                cached = false;
+            }
+        }
+
+        if ( filter == nullptr )
+        {
+            keys = uint32_t( (uint64_t(1) << count) - 1 );
+            next_key( tree );
+            return true;
+        }
+        if ( count == 0 )
+        {
+            finish( tree );
+            return true;
+        }
+
+        // The blocks of all suffixes at once: the walk of the filter usually reads several
+        for ( size_t i = 0; i < count; ++i )
+        {
+            filter_hashes[i] = DomainFilter::hash( name.substr(offsets[i]) );
+            filter->prefetch( filter_hashes[i] );
+        }
+        stage = Stage::filter;
+        return true;
+    }
+
+    //! Run the next step
+    //!
+    //! \return true when the lookup is done, false when it waits for memory it prefetched
+    bool step( const DomainTree& tree, const DomainFilter* filter )
+    {
+        switch ( stage )
+        {
+            case Stage::filter:
+            {
+                // As visit_suffixes: from the shortest suffix, until one is not a suffix of any key
+                for ( auto first = count; first > 0; --first )
+                {
+                    auto probe = filter->probe( filter_hashes[first - 1] );
+                    if ( probe.key ) keys |= uint32_t(1) << (first - 1);
+                    if ( !probe.suffix ) break;
+                }
+                next_key( tree );
+                break;
+            }
+            case Stage::table:
+            {
+                if ( !search.step() ) __builtin_prefetch( search.address() );
+                else if ( (domain_entry = search.value()) != nullptr )
+                {
+                    __builtin_prefetch( domain_entry );
+                    stage = Stage::entry;
+                }
+                else next_key( tree );
+                break;
+            }
+            case Stage::entry:
+            {
+                auto port_list = domain_entry->ports( protocol_type );
+                if ( (port_list == nullptr) || port_list->empty() )
+                {
+                    next_key( tree );
+                    break;
+                }
+                range = port_list->begin();
+                ranges_end = port_list->end();
+                __builtin_prefetch( &*range );
+                stage = Stage::ports;
+                break;
+            }
+            case Stage::ports:
+            {
+                // As find_domain_exact: the first range of the port that has a category
+                if ( range->in_range(port) && (range->category != kUnclassified) )
+                {
+                    category = range->category;
+                    finish( tree );
+                }
+                else
+                {
+                    if ( cached && (depth > 0) ) narrow_unclassified( *range, port, &unclassified );
+                    if ( ++range == ranges_end ) next_key( tree );
+                    else __builtin_prefetch( &*range );
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        return stage == Stage::done;
+    }
+
+private:
+
+    //! Start the table search of the longest suffix left, or finish without a match
+    void next_key( const DomainTree& tree )
+    {
+        if ( keys == 0 )
+        {
+            finish( tree );
+            return;
+        }
+        depth = unsigned( __builtin_ctz(keys) );
+        keys &= keys - 1;
+        search.start( tree.domain_table_, name.substr(offsets[depth]) );
+        __builtin_prefetch( search.address() );
+        stage = Stage::table;
+        DOMAINDB_STATS( ++probes; )
+    }
+
+    //! Fall back to the entry with the empty domain if no domain matched
+    void finish( const DomainTree& tree )
+    {
+        DOMAINDB_STATS( bool fallback = false; unsigned walked = (category != kUnclassified) ? depth + 1 : suffixes; )
+        if ( cached && (category == kUnclassified) ) tree.negative_cache_.insert( cache_key, unclassified.first_port, unclassified.last_port );
+        if ( category == kUnclassified )
+        {
+            category = tree.find_empty_domain( port, protocol_type );
+            DOMAINDB_STATS( ++probes; fallback = (category != kUnclassified); )
+        }
+        DOMAINDB_STATS( LookupStats::record( category, probes, walked, fallback, stats_start ); )
+        stage = Stage::done;
+    }
+};
+
+//! Look up a batch of domains, with the results of match_domain
+void DomainTree::match_domains( const Query* queries, size_t count, MultiConnectionType* categories ) const
+{
+    Epoch::Guard guard;
+    const DomainFilter* filter = filter_enabled_.load( std::memory_order_relaxed ) ? filter_.load( std::memory_order_acquire ) : nullptr;
+
+    // Start the next query that is not done at once in a slot of the group
+    size_t next = 0;
+    auto refill = [&]( InterleavedLookup& lookup )
+    {
+        while ( next < count )
+        {
+            auto index = next++;
+            const auto& query = queries[index];
+            if ( !lookup.start(*this, filter, query, index) )
+            {
+                categories[index] = match_domain( Domain(query.domain), query.port, query.protocol_type );
+            }
+            else if ( lookup.stage == InterleavedLookup::Stage::done ) categories[index] = lookup.category;
+            else return true;
+        }
+        lookup.stage = InterleavedLookup::Stage::done;
+        return false;
+    };
+
+    InterleavedLookup lookups[kInterleavedLookups];
+    size_t active = 0;
+    for ( auto& lookup : lookups ) active += refill( lookup );
+
+    // Round robin over the group: each step reads what the lookup prefetched a round ago
+    while ( active > 0 )
+    {
+        for ( auto& lookup : lookups )
+        {
+            if ( (lookup.stage == InterleavedLookup::Stage::done) || !lookup.step(*this, filter) ) continue;
+            categories[lookup.index] = lookup.category;
+            active -= !refill( lookup );
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Classify a domain in a single traversal
+DomainTree::MatchResult DomainTree::classify_domain( Domain domain, uint16_t port, ProtocolType protocol_type ) const
+{
+    MatchResult result;
+    std::string_view domain_name = Idn::normalize( domain );
+    Epoch::Guard guard;
+    DOMAINDB_STATS( auto stats_start = LookupStats::start(); unsigned probes = 0; unsigned walked = 1; )
+
+    if ( !domain_name.empty() && std::isdigit(domain_name[0]) ) // Exact search for IP address
+    {
+        if ( may_be_key(domain_name) )
+        {
+            result.category = collect_domain_exact(domain_name, port, protocol_type, &result.categories);
+            if ( result.category != kUnclassified ) result.depth = 0;
+            DOMAINDB_STATS( ++probes; )
+        }
+    }
+    else
+    {
+        // Inexact search, walks the whole suffix path
+        auto shortest = shortest_suffix( domain_name );
+        visit_suffixes( domain_name, shortest, [&]( std::string_view name, uint8_t depth )
+        {
+            DOMAINDB_STATS( ++probes; )
+            auto category = collect_domain_exact(name, port, protocol_type, &result.categories);
+            if ( (category != kUnclassified) && (result.category == kUnclassified) )
+            {
+                result.category = category;
+                result.depth = depth;
+            }
+            return false;
+        } );
+        DOMAINDB_STATS( walked = (result.depth != kNoDomainMatch) ? result.depth + 1u : suffix_count(domain_name, shortest); )
+    }
+
+    if ( result.category == kUnclassified ) // Try to find the port in entries with empty domain
+    {
+        result.category = find_empty_domain(port, protocol_type);
+        if ( result.category != kUnclassified ) result.categories |= MatchResult::mask_of(result.category);
+        DOMAINDB_STATS( ++probes; )
+    }
+
+    DOMAINDB_STATS( LookupStats::record( result.category, probes, walked, result.depth == kNoDomainMatch &&
+                                         result.category != kUnclassified, stats_start ); )
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
 //! Find a domain in the tree using exact match and get the service type for the given protocol and port
-MultiConnectionType DomainTree::find_domain_exact( const Domain& domain_name, uint16_t port, ProtocolType protocol_type ) const
+MultiConnectionType DomainTree::find_domain_exact( std::string_view domain_name, uint16_t port, ProtocolType protocol_type,
+                                                   PortRange* unclassified ) const
 {
     MultiConnectionType service_type = kUnclassified;
 
@@ -73,6 +516,31 @@ MultiConnectionType DomainTree::find_domain_exact( const Domain& domain_name, ui
                 service_type = port_range.category;
                 break;
             }
+            if ( unclassified != nullptr ) narrow_unclassified( port_range, port, unclassified );
+        }
+    }
+
+    return service_type;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Find a domain using exact match, get the service type for the port and collect all categories of the protocol
+MultiConnectionType DomainTree::collect_domain_exact( std::string_view domain_name, uint16_t port, ProtocolType protocol_type,
+                                                      CategoryMask* categories ) const
+{
+    MultiConnectionType service_type = kUnclassified;
+
+    auto port_list = select_ports_table( domain_name, protocol_type );
+    if ( port_list != nullptr )
+    {
+        for ( const auto& port_range : *port_list )
+        {
+            if ( port_range.category == kUnclassified ) continue;
+            *categories |= MatchResult::mask_of(port_range.category);
+            if ( (service_type == kUnclassified) && port_range.in_range(port) ) service_type = port_range.category;
         }
     }
 
@@ -83,15 +551,19 @@ MultiConnectionType DomainTree::find_domain_exact( const Domain& domain_name, ui
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+//! Legacy database category names and the connection types they map to
+//! (names of MultiConnectionType values are accepted as well)
+static constexpr StaticStringMap<MultiConnectionType, 3> kCategoryTypes( {{
+    { "streaming",                  MultiConnectionType::streaming_video },
+    { "downloading or streaming",   MultiConnectionType::streaming_video },
+    { "live_streaming",             MultiConnectionType::live_streaming_udp },
+}} );
+
 //! Convert the category string to connection type
-MultiConnectionType DomainTree::category_to_type( const Category& category )
+MultiConnectionType DomainTree::category_to_type( std::string_view category )
 {
     MultiConnectionType type = kUnclassified;
-    if ( category == "streaming" ) type = MultiConnectionType::streaming_video;
-    else if ( category == "downloading or streaming" ) type = MultiConnectionType::streaming_video;
-    else if ( category == "live_streaming" ) type = MultiConnectionType::live_streaming_udp;
-    else if ( category == "browsing" ) type = MultiConnectionType::browsing;
-    else if ( category == "gaming" ) type = MultiConnectionType::gaming;
+    if ( !kCategoryTypes.find(category, &type) ) from_string( category, &type );
 
     return type;
 }
@@ -100,20 +572,33 @@ MultiConnectionType DomainTree::category_to_type( const Category& category )
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
+//! True if a domain may not be added because it is a public suffix
+bool DomainTree::public_suffix( std::string_view domain_name ) const
+{
+    return public_suffixes_ && !domain_name.empty() && !std::isdigit( domain_name[0] ) &&
+           public_suffixes_->is_public_suffix( domain_name );
+}
+
 //! Select port_table_tcp_ or port_table_udp_ of a domain for a given protocol type
-DomainTree::DomainEntry::PortList* DomainTree::select_ports_table( const Domain& domain_name,  ProtocolType protocol ) const
+const DomainTree::DomainEntry::PortList* DomainTree::select_ports_table( std::string_view domain_name, ProtocolType protocol ) const
 {
     auto domain_entry = domain_table_.find(domain_name);
-    if ( domain_entry == domain_table_.end() ) return nullptr;
+    if ( domain_entry == nullptr ) return nullptr;
+
+    return domain_entry->ports(protocol);
+}
 
-    std::list<PortRange>* ports_table;
+//! Select port_table_tcp or port_table_udp for a given protocol type
+const DomainTree::DomainEntry::PortList* DomainTree::DomainEntry::ports( ProtocolType protocol ) const
+{
+    const PortList* ports_table;
     switch( protocol )
     {
         case ProtocolType::UDP:
-            ports_table = const_cast<DomainEntry::PortList*>(&domain_entry->second.port_table_udp);
+            ports_table = &port_table_udp;
             break;
         case ProtocolType::TCP:
-            ports_table = const_cast<DomainEntry::PortList*>(&domain_entry->second.port_table_tcp);
+            ports_table = &port_table_tcp;
             break;
         default:
             ports_table = nullptr;
@@ -127,16 +612,360 @@ DomainTree::DomainEntry::PortList* DomainTree::select_ports_table( const Domain&
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-//! Fill database with domains and ports and their categories
-bool DomainTree::fill( const Json& domain_json )
+//! Copy the entry of a domain for modification by a writer
+std::unique_ptr<DomainTree::DomainEntry> DomainTree::copy_entry( const Domain& domain_name ) const
 {
-    if ( !domain_json.is_object() ) return false;
-    const auto& service_json = domain_json.object_items();
+    auto domain_entry = domain_table_.find(domain_name); // The writer needs no guard: it is the only one retiring entries
+    return (domain_entry != nullptr) ? std::make_unique<DomainEntry>(*domain_entry) : std::make_unique<DomainEntry>();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Add a domain with a category for all ports of both protocols
+bool DomainTree::add_domain( const Domain& name, MultiConnectionType service_type )
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name; // Stored in the canonical form
+
+    if ( public_suffix(domain_name) ) return false;
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    if ( domain_table_.find(domain_name) != nullptr ) return false;
 
+    PortRange full_range(service_type);
+    publish_entry( domain_name, std::make_unique<DomainEntry>(&full_range, &full_range) );
+    return true;
+}
+
+//! Append a port range to a domain, creating the domain if needed
+bool DomainTree::add_port_range( const Domain& name, ProtocolType protocol_type, const PortRange& port_range )
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name;
+
+    if ( public_suffix(domain_name) ) return false;
+    if ( port_range.first_port > port_range.last_port ) return false;
+
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    auto domain_entry = copy_entry( domain_name );
+    auto port_list = domain_entry->ports( protocol_type );
+    if ( port_list == nullptr ) return false;
+
+    port_list->push_back( port_range );
+    publish_entry( domain_name, std::move(domain_entry) );
+    return true;
+}
+
+//! Replace all port ranges of a domain for one protocol
+bool DomainTree::set_port_ranges( const Domain& name, ProtocolType protocol_type, const std::vector<PortRange>& port_ranges )
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name;
+
+    if ( public_suffix(domain_name) ) return false;
+    for ( const auto& port_range : port_ranges )
+    {
+        if ( port_range.first_port > port_range.last_port ) return false;
+    }
+
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    auto domain_entry = copy_entry( domain_name );
+    auto port_list = domain_entry->ports( protocol_type );
+    if ( port_list == nullptr ) return false;
+
+    port_list->assign( port_ranges.begin(), port_ranges.end() );
+    publish_entry( domain_name, std::move(domain_entry) );
+    return true;
+}
+
+//! Replace all port ranges of a domain for both protocols
+bool DomainTree::replace_domain( const Domain& name, const DomainPorts& ports )
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name;
+
+    if ( public_suffix(domain_name) ) return false;
+    for ( const auto* port_ranges : { &ports.tcp, &ports.udp } )
+    {
+        for ( const auto& port_range : *port_ranges )
+        {
+            if ( port_range.first_port > port_range.last_port ) return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    publish_entry( domain_name, std::make_unique<DomainEntry>(ports) );
+    return true;
+}
+
+//! Remove a domain with all its port ranges
+bool DomainTree::remove_domain( const Domain& name )
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name;
+
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    return erase_entry( domain_name );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Publish a new entry of a domain, replacing the current one
+void DomainTree::publish_entry( const Domain& domain_name, std::unique_ptr<DomainEntry> domain_entry )
+{
+    if ( domain_entry->empty() )
+    {
+        erase_entry( domain_name );
+        return;
+    }
+
+    auto fingerprint = fingerprint_.load( std::memory_order_relaxed );
+    auto old_entry = domain_table_.find( domain_name );
+    if ( old_entry != nullptr ) fingerprint ^= entry_fingerprint( domain_name, *old_entry );
+    else add_to_filter( domain_name ); // Before the entry is published, so readers that find it pass the filter
+    fingerprint ^= entry_fingerprint( domain_name, *domain_entry );
+
+    if ( domain_name.empty() ) update_empty_domain_ports( domain_entry.get() );
+    domain_table_.assign( domain_name, std::move(domain_entry) );
+    fingerprint_.store( fingerprint, std::memory_order_release );
+    generation_.fetch_add( 1, std::memory_order_release );
+}
+
+//! Rebuild empty_domain_ports_ after the entry with the empty domain changed
+void DomainTree::update_empty_domain_ports( const DomainEntry* domain_entry )
+{
+    std::unique_ptr<PortCategories> ports;
+    if ( domain_entry != nullptr )
+    {
+        ports = std::make_unique<PortCategories>();
+        for ( auto protocol : { ProtocolType::UDP, ProtocolType::TCP } )
+        {
+            // The first range with a category wins, as in find_domain_exact
+            auto& categories = ports->categories[size_t(protocol)];
+            categories.fill( uint8_t(kUnclassified) );
+            for ( const auto& port_range : *domain_entry->ports(protocol) )
+            {
+                if ( port_range.category == kUnclassified ) continue;
+                for ( size_t port = port_range.first_port; port <= port_range.last_port; ++port )
+                {
+                    if ( categories[port] == uint8_t(kUnclassified) ) categories[port] = uint8_t(port_range.category);
+                }
+            }
+        }
+    }
+
+    Epoch::instance().retire( empty_domain_ports_.exchange(ports.release(), std::memory_order_acq_rel) );
+}
+
+//! Add a new domain and its suffixes to the filter, replacing the filter by a larger one when it is full
+void DomainTree::add_to_filter( std::string_view domain_name )
+{
+    auto filter = filter_.load( std::memory_order_relaxed );
+    if ( filter->keys() >= filter->capacity() )
+    {
+        // Removed domains stay in the old filter; the new one holds only the live ones
+        auto new_filter = new DomainFilter( std::max(2 * domain_table_.size(), kMinFilterCapacity) );
+        domain_table_.for_each( [&]( const std::string& key, const DomainEntry& )
+        {
+            add_to_filter( new_filter, key );
+        } );
+
+        filter_.store( new_filter, std::memory_order_release );
+        Epoch::instance().retire( filter );
+        filter = new_filter;
+    }
+
+    add_to_filter( filter, domain_name );
+}
+
+//! Add a domain and its suffixes to a filter
+void DomainTree::add_to_filter( DomainFilter* filter, std::string_view domain_name )
+{
+    filter->add( domain_name, DomainFilter::Kind::key );
+    for ( remove_token(&domain_name); !domain_name.empty(); remove_token(&domain_name) )
+    {
+        filter->add( domain_name, DomainFilter::Kind::suffix );
+    }
+}
+
+//! Remove the entry of a domain
+bool DomainTree::erase_entry( const Domain& domain_name )
+{
+    auto old_entry = domain_table_.find( domain_name );
+    if ( old_entry == nullptr ) return false;
+
+    auto fingerprint = fingerprint_.load( std::memory_order_relaxed ) ^ entry_fingerprint( domain_name, *old_entry );
+    if ( domain_name.empty() ) update_empty_domain_ports( nullptr );
+    domain_table_.erase( domain_name );
+    fingerprint_.store( fingerprint, std::memory_order_release );
+    generation_.fetch_add( 1, std::memory_order_release );
+    return true;
+}
+
+//! Stable hash of one domain entry
+uint64_t DomainTree::entry_fingerprint( std::string_view domain_name, const DomainEntry& domain_entry )
+{
+    auto hash = hash_string( domain_name );
+    for ( const auto* port_list : { &domain_entry.port_table_tcp, &domain_entry.port_table_udp } )
+    {
+        hash = hash_combine( hash, port_list->size() );
+        for ( const auto& port_range : *port_list )
+        {
+            hash = hash_combine( hash, (uint64_t(port_range.first_port) << 32) | (uint64_t(port_range.last_port) << 16) |
+                                       uint64_t(port_range.category) );
+        }
+    }
+    return hash;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Apply a delta produced by DomainDelta::diff
+bool DomainTree::apply_delta( const DomainDelta& delta )
+{
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    auto fingerprint = fingerprint_.load( std::memory_order_relaxed );
+    if ( fingerprint != delta.base_fingerprint ) return false;
+
+    // Names are keys in the canonical form, as for the other updates; a delta written by hand may have others
+    auto canonical = []( const Domain& name )
+    {
+        Domain ascii;
+        return Idn::to_ascii( name, &ascii ) ? ascii : name;
+    };
+    std::vector<Domain> removed;
+    std::vector<Domain> changed;
+    removed.reserve( delta.removed.size() );
+    changed.reserve( delta.changed.size() );
+    for ( const auto& domain_name : delta.removed ) removed.push_back( canonical(domain_name) );
+    for ( const auto& change : delta.changed ) changed.push_back( canonical(change.domain) );
+
+    // Verify the outcome before touching the table, so that a mismatching delta, or one that sets a public
+    // suffix, leaves it unchanged
+    std::vector<std::unique_ptr<DomainEntry>> new_entries;
+    new_entries.reserve( delta.changed.size() );
+    for ( const auto& domain_name : removed )
+    {
+        auto old_entry = domain_table_.find( domain_name );
+        if ( old_entry == nullptr ) return false;
+        fingerprint ^= entry_fingerprint( domain_name, *old_entry );
+    }
+    for ( size_t i = 0; i < changed.size(); ++i )
+    {
+        if ( public_suffix(changed[i]) ) return false;
+        auto old_entry = domain_table_.find( changed[i] );
+        if ( old_entry != nullptr ) fingerprint ^= entry_fingerprint( changed[i], *old_entry );
+        new_entries.push_back( std::make_unique<DomainEntry>(delta.changed[i].ports) );
+        if ( !new_entries.back()->empty() ) fingerprint ^= entry_fingerprint( changed[i], *new_entries.back() );
+    }
+    if ( fingerprint != delta.target_fingerprint ) return false;
+
+    for ( const auto& domain_name : removed ) erase_entry( domain_name );
+    for ( size_t i = 0; i < changed.size(); ++i ) publish_entry( changed[i], std::move(new_entries[i]) );
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Get the port ranges of a domain using exact match
+bool DomainTree::find_domain_ports( const Domain& name, DomainPorts* ports ) const
+{
+    Domain ascii;
+    const auto& domain_name = Idn::to_ascii( name, &ascii ) ? ascii : name;
+
+    Epoch::Guard guard;
+    auto domain_entry = domain_table_.find( domain_name );
+    if ( domain_entry == nullptr ) return false;
+
+    ports->tcp.assign( domain_entry->port_table_tcp.begin(), domain_entry->port_table_tcp.end() );
+    ports->udp.assign( domain_entry->port_table_udp.begin(), domain_entry->port_table_udp.end() );
+    return true;
+}
+
+//! Visit all domains of the database
+void DomainTree::for_each_domain( const std::function<void(const Domain&, const DomainPorts&)>& visit ) const
+{
+    Epoch::Guard guard;
+    DomainPorts ports;
+    domain_table_.for_each( [&]( const std::string& domain_name, const DomainEntry& domain_entry )
+    {
+        ports.tcp.assign( domain_entry.port_table_tcp.begin(), domain_entry.port_table_tcp.end() );
+        ports.udp.assign( domain_entry.port_table_udp.begin(), domain_entry.port_table_udp.end() );
+        visit( domain_name, ports );
+    } );
+}
+
+//! Estimate of the memory used by the domain table in bytes
+size_t DomainTree::memory_usage() const
+{
+    // Per domain: the map node with its key, the entry, and a list node per port range
+    static const size_t kNodeOverhead = 4 * sizeof(void*);
+    static const size_t kListNodeSize = sizeof(PortRange) + 2 * sizeof(void*);
+
+    Epoch::Guard guard;
+    size_t bytes = 0;
+    domain_table_.for_each( [&]( const std::string& domain_name, const DomainEntry& domain_entry )
+    {
+        bytes += kNodeOverhead + sizeof(std::string) + sizeof(DomainEntry);
+        if ( domain_name.size() >= sizeof(std::string) ) bytes += domain_name.size() + 1;
+        bytes += (domain_entry.port_table_tcp.size() + domain_entry.port_table_udp.size()) * kListNodeSize;
+    } );
+    return bytes + filter_.load( std::memory_order_acquire )->memory_usage() + negative_cache_.memory_usage();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Parse the database file while it is read, a batch of entries at a time
+bool DomainTree::parse_db_batches( FileReader& reader, ServiceBatches* services )
+{
+    std::vector<Json>* batches = nullptr;
+    std::string parse_error;
+    std::string batch_text;
+
+    auto on_service = [&]( std::string_view key )
+    {
+        auto name = Json::parse( std::string(key), parse_error, JsonParse::FAST );
+        if ( !parse_error.empty() ) return false;
+
+        // A repeated key replaces the earlier service, as it does in a json object
+        batches = &(*services)[name.string_value()];
+        batches->clear();
+        return true;
+    };
+
+    auto on_batch = [&]( std::string_view entries )
+    {
+        batch_text.assign( 1, '[' );
+        batch_text.append( entries );
+        batch_text.push_back( ']' );
+        batches->push_back( Json::parse(batch_text, parse_error, JsonParse::FAST) );
+        return parse_error.empty();
+    };
+
+    return RecordSplitter( reader, kParseBatchBytes ).split( on_service, on_batch );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Fill database with domains and ports and their categories
+bool DomainTree::fill( const ServiceBatches& services )
+{
     bool result = true;
-    for ( auto service_it = service_json.cbegin(); (service_it!=service_json.cend()) && result; ++service_it )
+    for ( auto service_it = services.cbegin(); service_it!=services.cend(); ++service_it )
     {
-        result = parse_service_json( service_it->second, category_to_type(service_it->first) );
+        result &= parse_service_json( service_it->first, service_it->second, category_to_type(service_it->first) );
     }
 
     return result;
@@ -147,16 +976,31 @@ bool DomainTree::fill( const Json& domain_json )
 //////////////////////////////////////////////////////////////////////////
 
 //! Parse json definition of one service type
-bool DomainTree::parse_service_json( const Json& service_json, MultiConnectionType service_type )
+bool DomainTree::parse_service_json( const std::string& service_name, const std::vector<Json>& batches,
+                                     MultiConnectionType service_type )
 {
-    if ( service_type == kUnclassified ) return false;
-    if ( !service_json.is_array() ) return false;
-    const auto& domain_json = service_json.array_items();
+    bool arrays = std::all_of( batches.begin(), batches.end(), []( const Json& batch ) { return batch.is_array(); } );
+    if ( (service_type == kUnclassified) || !arrays )
+    {
+        reject( (service_type == kUnclassified) ? "unknown service type" : "the service is not a json array" );
+        add_rejected( service_name, nullptr );
+        for ( const auto& batch : batches ) load_progress_.entries_done += batch.array_items().size();
+        return false;
+    }
 
     bool result = true;
-    for ( auto domain_it = domain_json.cbegin(); (domain_it!=domain_json.cend()) && result; ++domain_it )
+    for ( const auto& batch : batches )
     {
-        result = parse_domain_json( *domain_it, service_type );
+        for ( const auto& domain_json : batch.array_items() )
+        {
+            reject_reason_ = nullptr;
+            if ( !parse_domain_json(domain_json, service_type) )
+            {
+                add_rejected( service_name, &domain_json );
+                result = false;
+            }
+            count_loaded_entry();
+        }
     }
 
     return result;
@@ -169,14 +1013,16 @@ bool DomainTree::parse_service_json( const Json& service_json, MultiConnectionTy
 //! Parse a single domain json entry
 bool DomainTree::parse_domain_json( const Json& ports_json, MultiConnectionType service_type )
 {
-    if ( !ports_json.is_array() ) return false;
+    if ( !ports_json.is_array() ) return reject( "the entry is not a json array" );
     const auto& protocol_items = ports_json.array_items();
     auto num_of_items = protocol_items.size();
-    if ( (num_of_items!=1) && (num_of_items!=2) ) return false;
+    if ( (num_of_items!=1) && (num_of_items!=2) ) return reject( "the entry must have one or two items" );
     const auto& domain_name_json = protocol_items[0];
-    if ( !domain_name_json.is_string() ) return false;
+    if ( !domain_name_json.is_string() ) return reject( "the domain name is not a string" );
 
-    return parse_port_json( domain_name_json.string_value(),
+    Domain ascii;
+    const auto& domain_name = domain_name_json.string_value();
+    return parse_port_json( Idn::to_ascii(domain_name, &ascii) ? ascii : domain_name,
                               (num_of_items == 1) ? nullptr : &protocol_items[1],
                               service_type );
 }
@@ -188,43 +1034,47 @@ bool DomainTree::parse_domain_json( const Json& ports_json, MultiConnectionType
 //! Parse port json array
 bool DomainTree::parse_port_json( const Domain& domain_name, const Json* ports_json, MultiConnectionType service_type )
 {
-    bool result = true;
+    if ( public_suffix(domain_name) ) return reject( "the domain is a public suffix" );
 
+    bool result = true;
     bool ports_empty = (ports_json == nullptr);
+    size_t form = 6;
 
     if ( !ports_empty ) // Not form (6) - see parse_domain_json above
     {
-        if ( !ports_json->is_array() ) return false;
+        if ( !ports_json->is_array() ) return reject( "the ports are not a json array" );
         const auto& ports_items = ports_json->array_items();
         ports_empty = ports_items.empty(); // Form (4)
+        form = 4;
 
         if ( !ports_empty ) // Not form (4)
         {
-            if ( ports_items.size() != 2 ) return false;
+            if ( ports_items.size() != 2 ) return reject( "the ports must be [tcp_ports_range, udp_ports_range]" );
             const auto& tcp_ports_json = ports_items[0];
             const auto& udp_ports_json = ports_items[1];
-            if ( !tcp_ports_json.is_array() || !udp_ports_json.is_array() ) return false;
+            if ( !tcp_ports_json.is_array() || !udp_ports_json.is_array() ) return reject( "a port range is not a json array" );
             const auto& udp_ports = udp_ports_json.array_items();
             const auto& tcp_ports = tcp_ports_json.array_items();
             ports_empty = (tcp_ports.empty() && udp_ports.empty()); // Form (5)
+            form = ports_empty ? 5 : udp_ports.empty() ? 2 : tcp_ports.empty() ? 3 : 1;
 
             if ( !ports_empty ) // Forms (1), (2) or (3)
             {
-                if (domain_table_.count(domain_name) == 0) domain_table_.emplace(domain_name, DomainEntry{});
-                result = parse_protocol_ports_json(domain_name, ProtocolType::TCP, tcp_ports, service_type) &&
-                         parse_protocol_ports_json(domain_name, ProtocolType::UDP, udp_ports, service_type);
+                std::lock_guard<std::mutex> lock( update_mutex_ );
+                auto domain_entry = copy_entry( domain_name );
+                result = parse_protocol_ports_json(&domain_entry->port_table_tcp, tcp_ports_json, service_type) &&
+                         parse_protocol_ports_json(&domain_entry->port_table_udp, udp_ports_json, service_type);
+                if ( result ) publish_entry( domain_name, std::move(domain_entry) );
             }
         }
     }
 
     if ( ports_empty ) // Forms (4) or (5) or (6)
     {
-        PortRange full_range(service_type);
-        const auto& domain_it = domain_table_.find( domain_name );
-        if ( domain_it != domain_table_.end() ) result = false;
-        else domain_table_.emplace( domain_name, DomainEntry{&full_range, &full_range} );
+        result = add_domain( domain_name, service_type ) || reject( "the domain is already defined" );
     }
 
+    if ( result ) ++load_report_.entries_per_form[form - 1];
     return result;
 }
 
@@ -232,25 +1082,26 @@ bool DomainTree::parse_port_json( const Domain& domain_name, const Json* ports_j
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-//! Fill database with parameters for a given set of ports, providing a certain service type (stream, gaming, etc...)
-bool DomainTree::parse_protocol_ports_json( const Domain&       domain_name,
-                                            ProtocolType        protocol_type,
-                                            const json11::Json& ports_json,
-                                            MultiConnectionType service_type )
+//! Parse the port range of one protocol, providing a certain service type (stream, gaming, etc...)
+bool DomainTree::parse_protocol_ports_json( DomainEntry::PortList* port_list,
+                                            const json11::Json&    ports_json,
+                                            MultiConnectionType    service_type )
 {
-    if ( !ports_json.is_array() ) return false;
+    if ( !ports_json.is_array() ) return reject( "a port range is not a json array" );
     const auto& port_items = ports_json.array_items();
     PortRange port_range(kUnclassified);
     if ( !port_items.empty() )
     {
-        if ( (port_items.size() != 2) || !port_items[0].is_number() || !port_items[1].is_number() ) return false;
+        if ( (port_items.size() != 2) || !port_items[0].is_number() || !port_items[1].is_number() )
+        {
+            return reject( "a port range must be [first_port, last_port]" );
+        }
         port_range = PortRange{  static_cast<uint16_t>(port_items[0].number_value()),
                                  static_cast<uint16_t>(port_items[1].number_value()),
                                  service_type };
-        if ( port_range.first_port > port_range.last_port ) return false;
+        if ( port_range.first_port > port_range.last_port ) return reject( "first_port is above last_port" );
     }
 
-    auto port_list = select_ports_table( domain_name, protocol_type );
     port_list->push_back( port_range );
 
     return true;
@@ -260,12 +1111,62 @@ bool DomainTree::parse_protocol_ports_json( const Domain&       domain_name,
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
 
-//! Read database from a file to string
-std::string DomainTree::read_db_file( const std::string& db_filename )
+//! Move the load to a new stage and report it
+void DomainTree::set_load_stage( LoadProgress::Stage stage )
 {
-    std::string str;
-    std::ifstream ifs(db_filename);
-    std::getline(ifs, str, (char)ifs.eof() );
+    load_progress_.stage = stage;
+    if ( progress_ != nullptr ) (*progress_)( load_progress_ );
+    if ( stage == LoadProgress::Stage::done ) progress_ = nullptr; // The callback may not outlive the constructor
+}
 
-    return str;
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Add a rejected entry to load_report_
+void DomainTree::add_rejected( const std::string& service_name, const Json* entry_json )
+{
+    static const size_t kMaxEntryText = 200;
+
+    auto& report = load_report_;
+    ++report.rejected_count;
+    if ( report.rejected.size() >= LoadReport::kMaxRejected ) return;
+
+    std::string entry;
+    if ( entry_json != nullptr )
+    {
+        entry = entry_json->dump();
+        if ( entry.size() > kMaxEntryText ) entry.replace( kMaxEntryText, std::string::npos, "..." );
+    }
+    report.rejected.push_back( LoadReport::Rejected{service_name, std::move(entry), 0,
+                                                    (reject_reason_ != nullptr) ? reject_reason_ : "invalid entry"} );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Find the approximate lines of the rejected entries in the database text
+void DomainTree::locate_rejected( std::string_view text )
+{
+    // Searching is done only for the few rejected entries, so loading a valid file costs nothing.
+    // An entry is located by its service key and then by its first string, normally the domain name.
+    for ( auto& rejected : load_report_.rejected )
+    {
+        auto pos = text.find( Json(rejected.service).dump() );
+        if ( pos == std::string_view::npos ) continue;
+
+        if ( !rejected.entry.empty() )
+        {
+            auto name_begin = rejected.entry.find( '"' );
+            auto name_end = (name_begin == std::string::npos) ? name_begin : rejected.entry.find( '"', name_begin + 1 );
+            if ( name_end != std::string::npos )
+            {
+                auto name_pos = text.find( rejected.entry.substr(name_begin, name_end + 1 - name_begin), pos );
+                if ( name_pos != std::string_view::npos ) pos = name_pos;
+            }
+        }
+
+        rejected.line = 1 + size_t( std::count(text.begin(), text.begin() + pos, '\n') );
+    }
 }
@@ -6,11 +6,28 @@
 #define DOMAINDB_DOMAIN_TREE_H
 
 #include"Defines.h"
+#include "concurrent_string_map.h"
+#include "domain_filter.h"
+#include "negative_cache.h"
+#include "file_reader.h"
+#include "public_suffix_list.h"
 #include "Tools/json11.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 #include <list>
+#include <map>
+#include <vector>
 #include <iostream>
+#include <string>
+#include <string_view>
+
+class DomainDelta;
 
 //////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////
@@ -19,6 +36,8 @@
 //! Reads service information from a data file in json format and provides access to it.
 //! The data file has the following format:
 //! { "service_type" : service domains, ... }
+//! where service_type is either the name of a MultiConnectionType value (see to_string in Defines.h)
+//! or one of the legacy category names "streaming", "downloading or streaming", "live_streaming".
 //! Each domain will follow one of these forms:
 //! (1) ["domain_name", [[tcp_ports_range],[udp_ports_range]]]    - domain and udp and tcp ports
 //! (2) ["domain_name", [[tcp_ports_range],[]]]                   - domain and tcp ports
@@ -26,6 +45,12 @@
 //! (4) ["domain_name", []]                                       - domain without ports
 //! (5) ["domain_name", [[],[]]]                                  - domain without ports
 //! (6) ["domain_name"]                                           - domain without ports
+//!
+//! Internationalized domain names are stored and looked up in their ASCII form, see Idn: "bücher.example"
+//! in the file or in a lookup is the same domain as "xn--bcher-kva.example".
+//!
+//! Lookups never take locks and may run concurrently with one another and with incremental updates
+//! (add_domain, add_port_range, set_port_ranges, remove_domain), which are serialized among themselves.
 class DomainTree
 {
 public:
@@ -34,13 +59,126 @@ public:
 
     static const auto kUnclassified = MultiConnectionType::unclassified;
 
+    //! Bitmask of connection types: bit (1 << type) is set for every type in the set
+    using CategoryMask = uint16_t;
+
+    //! Depth reported when no domain entry matched (category comes from the empty domain entry, if any)
+    static const uint8_t kNoDomainMatch = 0xFF;
+
+    //! Number of port values of a protocol
+    static const size_t kPortCount = size_t(std::numeric_limits<uint16_t>::max()) + 1;
+
+    //! A range of ports and the category assigned to it
+    struct PortRange
+    {
+        uint16_t                first_port;
+        uint16_t                last_port;
+        MultiConnectionType     category;
+
+        PortRange(MultiConnectionType service_type) :
+            first_port(0), last_port(std::numeric_limits<uint16_t>::max()), category(service_type) {}
+
+        PortRange( uint16_t first, uint16_t last, MultiConnectionType service_type) :
+                first_port(first), last_port(last), category(service_type) {}
+
+        bool in_range( uint16_t port ) const { return ((port >= first_port) && (port <= last_port)); }
+
+        bool operator==( const PortRange& other ) const
+        {
+            return (first_port == other.first_port) && (last_port == other.last_port) && (category == other.category);
+        }
+        bool operator!=( const PortRange& other ) const { return !(*this == other); }
+    };
+
+    //! All port ranges of one domain, in match order
+    struct DomainPorts
+    {
+        std::vector<PortRange>  tcp;
+        std::vector<PortRange>  udp;
+
+        bool operator==( const DomainPorts& other ) const { return (tcp == other.tcp) && (udp == other.udp); }
+        bool operator!=( const DomainPorts& other ) const { return !(*this == other); }
+    };
+
+    //! Outcome of loading the database file
+    struct LoadReport
+    {
+        //! A domain entry or service that was skipped
+        struct Rejected
+        {
+            std::string     service;    //!< service type name the entry is listed under
+            std::string     entry;      //!< the entry in json format, shortened, empty if the whole service was skipped
+            size_t          line;       //!< approximate line of the entry in the file, 1 based, 0 if unknown
+            std::string     reason;     //!< why it was rejected
+        };
+
+        //! Maximum number of rejected entries kept in rejected; rejected_count counts all of them
+        static const size_t kMaxRejected = 1000;
+
+        bool                        ok = false;             //!< the file was read and parsed and no entry was rejected
+        std::string                 error;                  //!< read or json parse error, empty if none
+        std::string                 read_method;            //!< how the file was read, see FileReader::method()
+        std::chrono::nanoseconds    read_time{0};           //!< time to read the file
+        std::chrono::nanoseconds    parse_time{0};          //!< time to parse the json, overlapping read_time
+        std::chrono::nanoseconds    fill_time{0};           //!< time to build the domain table
+        size_t                      file_bytes = 0;         //!< size of the database file
+        size_t                      domains = 0;            //!< domains in the table after the load
+        size_t                      memory_bytes = 0;       //!< estimated memory used by the table
+        std::array<size_t, 6>       entries_per_form{};     //!< accepted entries of forms (1) to (6), at index form - 1
+        size_t                      rejected_count = 0;     //!< number of rejected entries and services
+        std::vector<Rejected>       rejected;               //!< the first kMaxRejected rejected entries
+    };
+
+    //! Progress of the load done by the constructor
+    struct LoadProgress
+    {
+        enum class Stage { reading, parsing, filling, done };
+
+        Stage       stage = Stage::reading;
+        size_t      file_bytes = 0;     //!< size of the database file, known from the parsing stage on
+        size_t      entries_total = 0;  //!< domain entries in the file, known from the filling stage on
+        size_t      entries_done = 0;   //!< domain entries added or rejected so far
+    };
+
+    //! Receives the load progress on the loading thread: at the start of every stage and every
+    //! kProgressInterval entries while filling
+    using ProgressCallback = std::function<void(const LoadProgress&)>;
+    static const size_t kProgressInterval = 65536;
+
+    //! Full classification result of a single lookup
+    struct MatchResult
+    {
+        MultiConnectionType category   = kUnclassified;  //!< winning category, the same as match_domain returns
+        CategoryMask        categories = 0;              //!< all categories of the matching domain entries
+        uint8_t             depth      = kNoDomainMatch; //!< number of leading tokens removed before the match
+
+        static constexpr CategoryMask mask_of( MultiConnectionType type ) { return CategoryMask(1u << unsigned(type)); }
+        bool has( MultiConnectionType type ) const { return (categories & mask_of(type)) != 0; }
+    };
+
 public:
 
-    //! Read database from a file to RAM
+    //! Read database from a file to RAM. Invalid entries are skipped and reported in load_report(),
+    //! nothing is written to the console.
+    //!
+    //! With a public suffix list, lookups stop at the registrable domain of a name instead of probing its
+    //! public suffixes, and entries for public suffixes, such as "com" or "co.uk", are rejected: they would
+    //! classify every domain under them. IP addresses and the empty domain are not affected.
     //!
-    //! \param db_filename  - path and name of the database file
+    //! \param db_filename     - path and name of the database file, json or json compressed with gzip or zstd
+    //! \param progress        - receives the load progress, may be empty
+    //! \param public_suffixes - the public suffix list, may be nullptr
     //! \throws
-    explicit DomainTree( const std::string& db_filename );
+    explicit DomainTree( const std::string& db_filename, const ProgressCallback& progress = nullptr,
+                         std::shared_ptr<const PublicSuffixList> public_suffixes = nullptr );
+
+    ~DomainTree();
+
+    DomainTree( const DomainTree& ) = delete;
+    DomainTree& operator=( const DomainTree& ) = delete;
+
+    //! Timing, size and rejected entries of the load done by the constructor
+    const LoadReport& load_report() const { return load_report_; }
 
     //! Find a domain in the tree using inexact match: uses minimum number of trailing name tokens
     //! to get a valid category value. If an IP address is provided as domain name - leading character is numeric -
@@ -52,27 +190,129 @@ public:
     //! \return domain category or kUnclassified if domain not found
     MultiConnectionType match_domain( Domain domain, uint16_t port, ProtocolType protocol ) const;
 
-private:
+    //! One lookup of a batch, see match_domains
+    struct Query
+    {
+        std::string_view    domain;
+        uint16_t            port;
+        ProtocolType        protocol_type;
+    };
 
-    using Category = std::string;
-    using Token = std::string;
+    //! Look up a batch of domains, with the results of match_domain. On tables much larger than the caches it
+    //! is several times faster per lookup than match_domain: a group of lookups is in flight at once, and each
+    //! lookup prefetches the memory of its next step (filter block, bucket, table node, entry, port range) and
+    //! yields to the next lookup of the group, so that their cache misses overlap instead of adding up.
+    //!
+    //! \param queries    - the lookups
+    //! \param count      - number of lookups
+    //! \param categories - receives the category of each lookup
+    void match_domains( const Query* queries, size_t count, MultiConnectionType* categories ) const;
+
+    //! Classify a domain in a single traversal: finds the same winning category as match_domain and also
+    //! collects the categories of every domain entry on the suffix path, for any port of the protocol, so
+    //! a host serving e.g. both gaming and streaming on different ports is reported as both.
+    //!
+    //! \param domain     -  domain name to seek
+    //! \param port       -  communication port to seek
+    //! \protocol         - type of communication protocol
+    //! \return the winning category, the mask of all matching categories and the match depth
+    MatchResult classify_domain( Domain domain, uint16_t port, ProtocolType protocol ) const;
 
-    static const char kDelimiter = '.';
+    //! Add a domain with a category for all ports of both protocols, like forms (4), (5) and (6) of the data file
+    //!
+    //! \param domain_name  - name of the domain
+    //! \param service_type - the service type
+    //! \return true on success, false if the domain already exists or is a public suffix
+    bool add_domain( const Domain& domain_name, MultiConnectionType service_type );
 
-    struct PortRange
+    //! Append a port range to a domain, creating the domain if needed, like forms (1), (2) and (3) of the data file
+    //!
+    //! \param domain_name   - name of the domain
+    //! \param protocol_type - protocol type: UDP or TCP
+    //! \param port_range    - the ports and their service type
+    //! \return true on success, false if the range is invalid or the domain is a public suffix
+    bool add_port_range( const Domain& domain_name, ProtocolType protocol_type, const PortRange& port_range );
+
+    //! Replace all port ranges of a domain for one protocol. A domain left without any port range is removed.
+    //!
+    //! \param domain_name   - name of the domain
+    //! \param protocol_type - protocol type: UDP or TCP
+    //! \param port_ranges   - the new port ranges in match order
+    //! \return true on success, false if a range is invalid or the domain is a public suffix
+    bool set_port_ranges( const Domain& domain_name, ProtocolType protocol_type, const std::vector<PortRange>& port_ranges );
+
+    //! Remove a domain with all its port ranges
+    //!
+    //! \param domain_name - name of the domain
+    //! \return true on success, false if the domain does not exist
+    bool remove_domain( const Domain& domain_name );
+
+    //! Replace all port ranges of a domain for both protocols. A domain left without any port range is removed.
+    //!
+    //! \param domain_name - name of the domain
+    //! \param ports       - the new port ranges
+    //! \return true on success, false if a range is invalid or the domain is a public suffix
+    bool replace_domain( const Domain& domain_name, const DomainPorts& ports );
+
+    //! Apply a delta produced by DomainDelta::diff. The delta is verified against the database fingerprint
+    //! before and after the change and is applied only if both match. Takes time proportional to the delta.
+    //! Lookups running meanwhile see each domain either before or after its change.
+    //!
+    //! \param delta - the changes to apply
+    //! \return true on success, false if the delta does not apply to this database or sets a public suffix
+    bool apply_delta( const DomainDelta& delta );
+
+    //! Get the port ranges of a domain using exact match
+    //!
+    //! \param domain_name - name of the domain
+    //! \param ports       - receives the port ranges
+    //! \return true if the domain exists
+    bool find_domain_ports( const Domain& domain_name, DomainPorts* ports ) const;
+
+    //! Visit all domains of the database. Domains updated concurrently may or may not be visited.
+    //!
+    //! \param visit - called for every domain with its name and its port ranges
+    void for_each_domain( const std::function<void(const Domain&, const DomainPorts&)>& visit ) const;
+
+    //! Remove the leading token from a string, ie www.google.com -> google.com -> com.
+    //! Lookups probe the suffixes of a name produced by repeated calls.
+    static void remove_token( std::string_view* domain )
     {
-        uint16_t                first_port;
-        uint16_t                last_port;
-        MultiConnectionType     category;
+        auto pos = domain->find(kDelimiter);
+        if (pos != std::string::npos) domain->remove_prefix(pos+1);
+        else *domain = std::string_view{};
+    }
 
-        PortRange(MultiConnectionType service_type) :
-            first_port(0), last_port(std::numeric_limits<uint16_t>::max()), category(service_type) {}
+    //! Number of domains in the database
+    size_t size() const { return domain_table_.size(); }
 
-        PortRange( uint16_t first, uint16_t last, MultiConnectionType service_type) :
-                first_port(first), last_port(last), category(service_type) {}
+    //! Estimate of the memory used by the domain table, its filter and its negative cache in bytes
+    size_t memory_usage() const;
 
-        bool in_range( uint16_t port ) const { return ((port >= first_port) && (port <= last_port)); }
-    };
+    //! Turn the domain filter pre-check of the lookups on or off. It is on by default; lookups return the
+    //! same results either way, so turning it off is only useful to measure it.
+    //!
+    //! \param enabled - true to check the filter before probing the domain table
+    void use_filter( bool enabled ) { filter_enabled_.store( enabled, std::memory_order_relaxed ); }
+
+    //! Turn the negative cache of match_domain and match_domains on or off, see negative_cache_. It is on by
+    //! default; lookups return the same results either way.
+    //!
+    //! \param enabled - true to look up and record the suffixes under which lookups miss
+    void use_negative_cache( bool enabled ) { negative_cache_enabled_.store( enabled, std::memory_order_relaxed ); }
+
+    //! The public suffix list given to the constructor, nullptr if none
+    const PublicSuffixList* public_suffixes() const { return public_suffixes_.get(); }
+
+    //! Order independent hash of the whole database content, maintained on every update. Databases with the
+    //! same domains and port ranges have the same fingerprint on all little-endian machines.
+    uint64_t fingerprint() const { return fingerprint_.load( std::memory_order_acquire ); }
+
+private:
+
+    using Token = std::string;
+
+    static const char kDelimiter = '.';
 
     struct DomainEntry
     {
@@ -86,53 +326,261 @@ private:
             if ( port_tcp ) port_table_tcp.push_back(*port_tcp);
             if ( port_udp ) port_table_udp.push_back(*port_udp);
         }
+        explicit DomainEntry(const DomainPorts& ports) :
+            port_table_tcp(ports.tcp.begin(), ports.tcp.end()), port_table_udp(ports.udp.begin(), ports.udp.end()) {}
+
+        bool empty() const { return port_table_tcp.empty() && port_table_udp.empty(); }
+
+        //! Select port_table_tcp or port_table_udp for a given protocol type, nullptr if illegal protocol
+        const PortList* ports( ProtocolType protocol_type ) const;
+        PortList* ports( ProtocolType protocol_type )
+        {
+            return const_cast<PortList*>( static_cast<const DomainEntry*>(this)->ports(protocol_type) );
+        }
     };
 
-    std::unordered_map<Domain, DomainEntry> domain_table_;
+    //! Published entries are immutable: updates copy an entry, change the copy and replace the original
+    ConcurrentStringMap<DomainEntry> domain_table_;
+
+    //! Serializes writers of domain_table_
+    std::mutex update_mutex_;
+
+    //! XOR of entry_fingerprint of all entries
+    std::atomic<uint64_t> fingerprint_{0};
+
+    //! Filter of all domains as keys and all their remove_token suffixes as suffixes. Lookups walk the
+    //! suffixes of a name from the shortest and stop at the first one that is not a suffix of any key,
+    //! so for most unknown names only one or two filter blocks are read and the table is never probed.
+    //! Replaced by a larger one when it fills up, the old one is retired to the Epoch.
+    std::atomic<DomainFilter*> filter_{new DomainFilter(kMinFilterCapacity)};
+    std::atomic<bool> filter_enabled_{true};
+
+    //! Capacity of the first filter, in domains
+    static const size_t kMinFilterCapacity = 1024;
+
+    //! Longest suffix chain checked with the filter; longer names are looked up without it
+    static const size_t kMaxFilterSuffixes = 32;
+
+    //! Incremented after every change of the domain table, so that negative_cache_ entries recorded before
+    //! the change are not hits
+    std::atomic<uint32_t> generation_{0};
+
+    //! The suffixes under which lookups miss: a name whose parent, the name without its first label, is in
+    //! the cache is looked up as the name alone, so the random names of a parent zone cost one probe after
+    //! the first miss instead of a walk of all the suffixes of the zone
+    mutable NegativeCache negative_cache_{kNegativeCacheEntries};
+    std::atomic<bool> negative_cache_enabled_{true};
+
+    //! Entries of the negative cache, of 64 bytes each
+    static const size_t kNegativeCacheEntries = 4096;
+
+    //! Lookups stop at the registrable domain of this list, nullptr to probe every suffix
+    const std::shared_ptr<const PublicSuffixList> public_suffixes_;
+
+    //! Category of every port of the entry with the empty domain
+    struct PortCategories
+    {
+        std::array<uint8_t, kPortCount> categories[2];  //!< MultiConnectionType by port, indexed by int(ProtocolType)
+    };
+
+    //! The ports of the entry with the empty domain, which lookups fall back to when no domain matches,
+    //! so that the fallback is one array index. nullptr if there is no such entry. Rebuilt by the writer
+    //! when the entry changes, the old one is retired to the Epoch.
+    std::atomic<const PortCategories*> empty_domain_ports_{nullptr};
+
+    LoadReport load_report_;
+
+    //! Progress reporting, used by the constructor only
+    const ProgressCallback* progress_ = nullptr;
+    LoadProgress load_progress_;
+
+    //! Why the last parse function failed, see reject()
+    const char* reject_reason_ = nullptr;
 
 private:
 
+    //! State of one lookup of match_domains
+    struct InterleavedLookup;
+
+    //! Lookups of match_domains in flight at once
+    static const size_t kInterleavedLookups = 32;
+
     //! Find a domain in the tree using exact match and get the service type for the given protocol and port
     //!
+    //! \param domain       -  domain name to seek
+    //! \param port         -  communication port to seek
+    //! \protocol           - type of communication protocol
+    //! \param unclassified - if not nullptr and the port has no category, narrowed to the ports around it that
+    //!                       no range of the domain gives a category, see narrow_unclassified()
+    //! \return domain category or kUnclassified if domain not found
+    MultiConnectionType find_domain_exact( std::string_view domain, uint16_t port, ProtocolType protocol,
+                                           PortRange* unclassified = nullptr ) const;
+
+    //! Narrow an interval of ports without a category around a port to exclude a port range
+    //!
+    //! \param port_range   - a range that does not give the port a category
+    //! \param port         - the port
+    //! \param unclassified - the interval, containing the port
+    static void narrow_unclassified( const PortRange& port_range, uint16_t port, PortRange* unclassified )
+    {
+        if ( port_range.category == kUnclassified ) return;
+        if ( port_range.last_port < port ) unclassified->first_port = std::max<uint16_t>( unclassified->first_port, port_range.last_port + 1 );
+        else if ( port_range.first_port > port ) unclassified->last_port = std::min<uint16_t>( unclassified->last_port, port_range.first_port - 1 );
+    }
+
+    //! Key of the negative cache for the parent of a name, see negative_cache_
+    //!
+    //! \param name          - the name, not an IP address
+    //! \param shortest      - size of the shortest suffix of the name that lookups probe
+    //! \param protocol_type - the protocol of the lookup
+    //! \param key           - receives the key
+    //! \return false if the cache is off or the parent is not cached: it is too long or shorter than shortest
+    bool negative_cache_key( std::string_view name, size_t shortest, ProtocolType protocol_type, NegativeCache::Key* key ) const
+    {
+        if ( !negative_cache_enabled_.load(std::memory_order_relaxed) ) return false;
+        auto parent = name;
+        remove_token( &parent );
+        if ( (parent.size() < shortest) || (parent.size() > NegativeCache::kMaxName) || (size_t(protocol_type) >= 2) ) return false;
+        *key = NegativeCache::key( parent, protocol_type, uint16_t(shortest), generation_.load(std::memory_order_acquire) );
+        return true;
+    }
+
+    //! Find a domain in the tree using exact match, get the service type for the given port and collect
+    //! the categories of all port ranges of the protocol
+    //!
     //! \param domain     -  domain name to seek
     //! \param port       -  communication port to seek
     //! \protocol         - type of communication protocol
+    //! \param categories - receives the categories of all port ranges of the domain, ORed in
     //! \return domain category or kUnclassified if domain not found
-    MultiConnectionType find_domain_exact( const Domain& domain, uint16_t port, ProtocolType protocol ) const;
+    MultiConnectionType collect_domain_exact( std::string_view domain, uint16_t port, ProtocolType protocol,
+                                              CategoryMask* categories ) const;
 
-    //! Remove the leading token from a string, ie www.google.com -> google.com -> com
-    static void remove_token( Domain* domain )
+    //! Get the service type of a port from the entry with the empty domain. Reader: the caller must hold
+    //! an Epoch::Guard.
+    //!
+    //! \param port          - communication port to seek
+    //! \param protocol_type - type of communication protocol
+    //! \return the category, kUnclassified if there is no entry with the empty domain or it has no such port
+    MultiConnectionType find_empty_domain( uint16_t port, ProtocolType protocol_type ) const
     {
-        auto pos = domain->find(kDelimiter);
-        if (pos != std::string::npos) *domain = domain->substr(pos+1);
-        else domain->clear();
+        auto ports = empty_domain_ports_.load( std::memory_order_acquire );
+        auto protocol = size_t( protocol_type );
+        if ( (ports == nullptr) || (protocol >= 2) ) return kUnclassified;
+        return MultiConnectionType( ports->categories[protocol][port] );
+    }
+
+    //! True if a name may be a key of the domain table: false only if the filter is on and rejects it.
+    //! Reader: the caller must hold an Epoch::Guard.
+    bool may_be_key( std::string_view name ) const
+    {
+        return !filter_enabled_.load( std::memory_order_relaxed ) || filter_.load( std::memory_order_acquire )->probe( name ).key;
     }
 
+    //! Size of the shortest suffix of a name that lookups probe, see PublicSuffixList::shortest_lookup_suffix()
+    size_t shortest_suffix( std::string_view name ) const
+    {
+        return public_suffixes_ ? public_suffixes_->shortest_lookup_suffix( name ) : 1;
+    }
+
+    //! Number of remove_token suffixes of a name down to a shortest size, the name included
+    static unsigned suffix_count( std::string_view name, size_t shortest )
+    {
+        unsigned count = 0;
+        for ( ; name.size() >= shortest; remove_token(&name) ) ++count;
+        return count;
+    }
+
+    //! True if a domain may not be added because it is a public suffix; IP addresses and the empty domain may
+    bool public_suffix( std::string_view domain_name ) const;
+
+    //! Rebuild empty_domain_ports_ after the entry with the empty domain changed. Writer.
+    //!
+    //! \param domain_entry - the new entry, nullptr if it was removed
+    void update_empty_domain_ports( const DomainEntry* domain_entry );
+
+    //! Visit the remove_token suffixes of a name that may be keys of the domain table, longest first.
+    //! Suffixes rejected by the filter are skipped. Reader: the caller must hold an Epoch::Guard.
+    //!
+    //! \param domain   - the domain name
+    //! \param shortest - size of the shortest suffix to visit, see shortest_suffix()
+    //! \param visit    - called as visit(std::string_view suffix, uint8_t depth), where depth is the number of
+    //!                   tokens removed from the name; returns true to stop the walk
+    template <typename Visitor>
+    void visit_suffixes( std::string_view domain, size_t shortest, Visitor&& visit ) const;
+
+    //! Add a new domain and its suffixes to the filter, replacing the filter by a larger one when it is
+    //! full. Writer.
+    //!
+    //! \param domain_name - the new domain
+    void add_to_filter( std::string_view domain_name );
+
+    //! Add a domain and its suffixes to a filter
+    static void add_to_filter( DomainFilter* filter, std::string_view domain_name );
+
     //! Convert the category string to connection type
     //!
-    //! \param category - the category string
-    //! \return the corresponding connection type
-    static MultiConnectionType category_to_type( const Category& category );
+    //! \param category - the category string: a legacy category name or the name of a MultiConnectionType value
+    //! \return the corresponding connection type or kUnclassified if the name is unknown
+    static MultiConnectionType category_to_type( std::string_view category );
 
-    //! Select port_table_tcp_ or port_table_udp_ of a domain for a given protocol type
+    //! Select port_table_tcp_ or port_table_udp_ of a domain for a given protocol type.
+    //! The caller must hold an Epoch::Guard while using the table.
     //!
     //! \param domain_name   - name of the domain
     //! \param protocol_type - UDP or TCP protocol
-    //! \return pointer to selected table or nullptr if illegal protocol
-    DomainEntry::PortList* select_ports_table( const Domain& domain_name,  ProtocolType protocol_type ) const;
+    //! \return pointer to selected table or nullptr if domain not found or illegal protocol
+    const DomainEntry::PortList* select_ports_table( std::string_view domain_name,  ProtocolType protocol_type ) const;
+
+    //! Copy the entry of a domain for modification by a writer
+    //!
+    //! \param domain_name - name of the domain
+    //! \return a copy of the current entry or a new empty entry if the domain does not exist
+    std::unique_ptr<DomainEntry> copy_entry( const Domain& domain_name ) const;
+
+    //! Publish a new entry of a domain, replacing the current one. update_mutex_ must be held.
+    //!
+    //! \param domain_name  - name of the domain
+    //! \param domain_entry - the new entry; an empty entry removes the domain
+    void publish_entry( const Domain& domain_name, std::unique_ptr<DomainEntry> domain_entry );
+
+    //! Remove the entry of a domain. update_mutex_ must be held.
+    //!
+    //! \param domain_name - name of the domain
+    //! \return true if the domain existed
+    bool erase_entry( const Domain& domain_name );
+
+    //! Stable hash of one domain entry, see fingerprint()
+    static uint64_t entry_fingerprint( std::string_view domain_name, const DomainEntry& domain_entry );
+
+    //! The services of the database file by name, each with its domain entries in one or more json arrays
+    using ServiceBatches = std::map<std::string, std::vector<json11::Json>>;
+
+    //! Approximate size of the batches of entries parsed while the database file is read
+    static const size_t kParseBatchBytes = 1 << 20;
 
-    //! Fill database with domains and ports and their categories
+    //! Parse the database file while it is read, a batch of entries at a time
     //!
-    //! \param json   - description of database in json format
+    //! \param reader   - reader of the database file, open
+    //! \param services - receives the services
+    //! \return false if the file does not have the layout of the database or is not valid json
+    static bool parse_db_batches( FileReader& reader, ServiceBatches* services );
+
+    //! Fill database with domains and ports and their categories. Invalid entries are skipped and recorded
+    //! in load_report_.
+    //!
+    //! \param services - the services of the database file
     //! \return true if parameters are valid, false if not
-    bool fill( const json11::Json& json );
+    bool fill( const ServiceBatches& services );
 
     //! Parse json definition of one service type
     //!
-    //! \param service_json - descriptor of a service
+    //! \param service_name - name of the service type in the file
+    //! \param batches      - arrays of the domain entries of the service
     //! \param service_type - the service type
-    //! \return true on success, false on failure
-    bool parse_service_json( const json11::Json& service_json, MultiConnectionType service_type );
+    //! \return true on success, false if the service or any of its entries was rejected
+    bool parse_service_json( const std::string& service_name, const std::vector<json11::Json>& batches,
+                             MultiConnectionType service_type );
 
     //! Parse a single domain json entry
     //!
@@ -149,24 +597,45 @@ private:
     //! \return true on success, false on failure
     bool parse_port_json( const Domain& domain_name, const json11::Json* ports_json, MultiConnectionType service_type );
 
-    //! Fill database with parameters for a given set of ports, providing a certain service type (stream, gaming, etc...)
+    //! Parse the port range of one protocol, providing a certain service type (stream, gaming, etc...)
     //!
-    //! \param domain_name  - name of the domain
-    //! \param protocol_type- protocol type: UDP or TCP
-    //! \param ports_json   - descriptor of all ports for a given domain
+    //! \param port_list    - port table of the protocol to append the range to
+    //! \param ports_json   - descriptor of the port range of a given domain
     //! \param service_type - the service type
     //! \return true on success, false on failure
-    bool parse_protocol_ports_json( const Domain&       domain_name,
-                                    ProtocolType        protocol_type,
-                                    const json11::Json& ports_json,
-                                    MultiConnectionType service_type );
+    bool parse_protocol_ports_json( DomainEntry::PortList* port_list,
+                                    const json11::Json&    ports_json,
+                                    MultiConnectionType    service_type );
+
+    //! Move the load to a new stage and report it
+    void set_load_stage( LoadProgress::Stage stage );
 
-    //! Read database from a file to string
+    //! Count a processed domain entry, reporting the progress every kProgressInterval entries
+    void count_loaded_entry()
+    {
+        if ( (++load_progress_.entries_done % kProgressInterval == 0) && (progress_ != nullptr) ) (*progress_)( load_progress_ );
+    }
+
+    //! Record why parsing failed
     //!
-    //! \param db_filename  - path and name of the database file
-    //! \param return the content of the file in a string
-    //! \throws
-    static std::string read_db_file( const std::string& db_filename );
+    //! \param reason - static description of the problem
+    //! \return false, for use in return statements of the parse functions
+    bool reject( const char* reason )
+    {
+        reject_reason_ = reason;
+        return false;
+    }
+
+    //! Add a rejected entry to load_report_
+    //!
+    //! \param service_name - name of the service type in the file
+    //! \param entry_json   - the rejected entry, nullptr if the whole service was rejected
+    void add_rejected( const std::string& service_name, const json11::Json* entry_json );
+
+    //! Find the approximate lines of the rejected entries in the database text
+    //!
+    //! \param text - the database file content
+    void locate_rejected( std::string_view text );
 };
 
 
@@ -0,0 +1,364 @@
+#include "domaindb.h"
+#include "compiled_db.h"
+#include "epoch.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert( DOMAINDB_UDP == int(ProtocolType::UDP) && DOMAINDB_TCP == int(ProtocolType::TCP), "protocols of the C interface" );
+static_assert( DOMAINDB_SMALL == int(MultiConnectionType::small) && DOMAINDB_UNCLASSIFIED == int(MultiConnectionType::unclassified) &&
+               DOMAINDB_GAMING == int(MultiConnectionType::gaming) && DOMAINDB_STREAMING_TCP == int(MultiConnectionType::streaming_tcp) &&
+               DOMAINDB_STREAMING_UDP == int(MultiConnectionType::streaming_udp) &&
+               DOMAINDB_STREAMING_VIDEO == int(MultiConnectionType::streaming_video) &&
+               DOMAINDB_BROWSING == int(MultiConnectionType::browsing) &&
+               DOMAINDB_LIVE_STREAMING_UDP == int(MultiConnectionType::live_streaming_udp) &&
+               DOMAINDB_UPLOAD_TCP == int(MultiConnectionType::upload_tcp) && DOMAINDB_UPLOAD_UDP == int(MultiConnectionType::upload_udp) &&
+               DOMAINDB_UNTRUSTED == int(MultiConnectionType::untrusted) && DOMAINDB_UNDEFINED == int(MultiConnectionType::undefined) &&
+               DOMAINDB_NO_DOMAIN_MATCH == DomainTree::kNoDomainMatch, "categories of the C interface" );
+
+//! Magic at the start of a CompiledDb image, see compiled_db.cpp
+static const char kImageMagic[8] = { 'D', 'O', 'M', 'A', 'I', 'N', 'D', 'B' };
+
+//! A handle of the C interface
+struct domaindb
+{
+    //! One snapshot of a handle: a CompiledDb over an image that it owns, has mapped or was given
+    struct Snapshot
+    {
+        std::vector<char>   compiled;           //!< image compiled from a json database, if it was
+        void*               mapped = nullptr;   //!< image mapped from a file, if it was
+        size_t              mapped_size = 0;
+        const char*         image = nullptr;
+        size_t              image_size = 0;
+        CompiledDb          db;
+
+        Snapshot() = default;
+        Snapshot( const Snapshot& ) = delete;
+        Snapshot& operator=( const Snapshot& ) = delete;
+
+        ~Snapshot()
+        {
+            if ( mapped != nullptr ) munmap( mapped, mapped_size );
+        }
+    };
+
+    //! Lookup counters of one CPU, in a cache line of their own so that lookups on other CPUs do not
+    //! contend for it, nor for the snapshot pointer every lookup reads
+    struct alignas(64) CpuCounters
+    {
+        std::atomic<uint64_t>   lookups{0};
+        std::atomic<uint64_t>   classified{0};
+    };
+
+    std::atomic<Snapshot*>          snapshot{nullptr};
+    std::atomic<uint64_t>           generation{0};
+    size_t                          cpu_count;
+    std::unique_ptr<CpuCounters[]>  counters;       //!< by CPU, counted by lookups through a const handle
+
+    domaindb() : cpu_count( size_t(std::max(sysconf(_SC_NPROCESSORS_CONF), 1L)) ), counters( new CpuCounters[cpu_count] ) {}
+
+    ~domaindb()
+    {
+        delete snapshot.load( std::memory_order_acquire );
+    }
+
+    //! Count lookups on the counters of the calling CPU
+    void count( uint64_t lookups, uint64_t classified ) const
+    {
+        auto cpu = sched_getcpu();
+        auto& local = counters[(cpu >= 0) ? size_t(cpu) % cpu_count : 0];
+        local.lookups.fetch_add( lookups, std::memory_order_relaxed );
+        local.classified.fetch_add( classified, std::memory_order_relaxed );
+    }
+};
+
+//! Write an error description to the buffer of the caller
+static int fail( char* error, size_t error_size, const std::string& message )
+{
+    if ( (error != nullptr) && (error_size > 0) ) std::snprintf( error, error_size, "%s", message.c_str() );
+    return -1;
+}
+
+//! Snapshot of an image in memory of the caller
+static std::unique_ptr<domaindb::Snapshot> image_snapshot( const void* image, size_t size, std::string* error )
+{
+    auto snapshot = std::make_unique<domaindb::Snapshot>();
+    if ( (image == nullptr) || !snapshot->db.attach(image, size) )
+    {
+        *error = "not a valid database image";
+        return nullptr;
+    }
+    snapshot->image = static_cast<const char*>( image );
+    snapshot->image_size = size;
+    return snapshot;
+}
+
+//! Snapshot of a file: an image file is mapped, a json database is loaded and compiled
+static std::unique_ptr<domaindb::Snapshot> file_snapshot( const char* path, std::string* error )
+{
+    if ( path == nullptr )
+    {
+        *error = "no path";
+        return nullptr;
+    }
+
+    char magic[sizeof kImageMagic] = {};
+    int fd = open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        *error = std::string( "cannot open " ) + path + ": " + std::strerror( errno );
+        return nullptr;
+    }
+    struct stat file_stat;
+    bool image_file = (fstat(fd, &file_stat) == 0) && (pread(fd, magic, sizeof magic, 0) == ssize_t(sizeof magic)) &&
+                      (std::memcmp(magic, kImageMagic, sizeof magic) == 0);
+    auto snapshot = std::make_unique<domaindb::Snapshot>();
+    if ( image_file )
+    {
+        auto address = mmap( nullptr, size_t(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0 );
+        close( fd );
+        if ( address == MAP_FAILED )
+        {
+            *error = std::string( "cannot map " ) + path + ": " + std::strerror( errno );
+            return nullptr;
+        }
+        snapshot->mapped = address;
+        snapshot->mapped_size = size_t( file_stat.st_size );
+        snapshot->image = static_cast<const char*>( address );
+        snapshot->image_size = snapshot->mapped_size;
+    }
+    else
+    {
+        close( fd );
+        DomainTree domain_tree( path );
+        if ( !domain_tree.load_report().error.empty() )
+        {
+            *error = std::string( path ) + ": " + domain_tree.load_report().error;
+            return nullptr;
+        }
+        snapshot->compiled = CompiledDb::compile( domain_tree );
+        snapshot->image = snapshot->compiled.data();
+        snapshot->image_size = snapshot->compiled.size();
+    }
+
+    if ( !snapshot->db.attach(snapshot->image, snapshot->image_size) )
+    {
+        *error = std::string( path ) + " is not a valid database image";
+        return nullptr;
+    }
+    return snapshot;
+}
+
+//! Open a handle with a first snapshot
+static domaindb* open_snapshot( std::unique_ptr<domaindb::Snapshot> snapshot )
+{
+    if ( !snapshot ) return nullptr;
+    auto db = new domaindb;
+    db->snapshot.store( snapshot.release(), std::memory_order_release );
+    db->generation.store( 1, std::memory_order_relaxed );
+    return db;
+}
+
+//! Install a new snapshot in a handle; the old one is deleted once no lookup uses it
+static int swap_snapshot( domaindb* db, std::unique_ptr<domaindb::Snapshot> snapshot )
+{
+    if ( !snapshot ) return -1;
+    Epoch::instance().retire( db->snapshot.exchange(snapshot.release(), std::memory_order_acq_rel) );
+    db->generation.fetch_add( 1, std::memory_order_relaxed );
+    Epoch::instance().reclaim();
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+domaindb* domaindb_open_file( const char* path, char* error, size_t error_size )
+{
+    try
+    {
+        std::string message;
+        auto db = open_snapshot( file_snapshot(path, &message) );
+        if ( db == nullptr ) fail( error, error_size, message );
+        return db;
+    }
+    catch ( const std::exception& exception )
+    {
+        fail( error, error_size, exception.what() );
+        return nullptr;
+    }
+}
+
+domaindb* domaindb_open_image( const void* image, size_t size, char* error, size_t error_size )
+{
+    try
+    {
+        std::string message;
+        auto db = open_snapshot( image_snapshot(image, size, &message) );
+        if ( db == nullptr ) fail( error, error_size, message );
+        return db;
+    }
+    catch ( const std::exception& exception )
+    {
+        fail( error, error_size, exception.what() );
+        return nullptr;
+    }
+}
+
+int domaindb_swap_file( domaindb* db, const char* path, char* error, size_t error_size )
+{
+    if ( db == nullptr ) return fail( error, error_size, "no database" );
+    try
+    {
+        std::string message;
+        auto snapshot = file_snapshot( path, &message );
+        return snapshot ? swap_snapshot( db, std::move(snapshot) ) : fail( error, error_size, message );
+    }
+    catch ( const std::exception& exception )
+    {
+        return fail( error, error_size, exception.what() );
+    }
+}
+
+int domaindb_swap_image( domaindb* db, const void* image, size_t size, char* error, size_t error_size )
+{
+    if ( db == nullptr ) return fail( error, error_size, "no database" );
+    try
+    {
+        std::string message;
+        auto snapshot = image_snapshot( image, size, &message );
+        return snapshot ? swap_snapshot( db, std::move(snapshot) ) : fail( error, error_size, message );
+    }
+    catch ( const std::exception& exception )
+    {
+        return fail( error, error_size, exception.what() );
+    }
+}
+
+int domaindb_save_image( const domaindb* db, const char* path, char* error, size_t error_size )
+{
+    if ( (db == nullptr) || (path == nullptr) ) return fail( error, error_size, "no database or path" );
+    try
+    {
+        Epoch::Guard guard;
+        auto snapshot = db->snapshot.load( std::memory_order_acquire );
+        auto file = std::fopen( path, "wb" );
+        if ( file == nullptr ) return fail( error, error_size, std::string("cannot create ") + path + ": " + std::strerror(errno) );
+        bool written = (std::fwrite(snapshot->image, 1, snapshot->image_size, file) == snapshot->image_size);
+        written = (std::fclose(file) == 0) && written;
+        return written ? 0 : fail( error, error_size, std::string("cannot write ") + path );
+    }
+    catch ( const std::exception& exception )
+    {
+        return fail( error, error_size, exception.what() );
+    }
+}
+
+void domaindb_close( domaindb* db )
+{
+    delete db;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+uint8_t domaindb_lookup( const domaindb* db, const char* name, size_t name_size, uint16_t port, uint8_t protocol )
+{
+    domaindb_query query{ name, name_size, port, protocol };
+    uint8_t category = DOMAINDB_UNCLASSIFIED;
+    domaindb_lookup_batch( db, &query, 1, &category );
+    return category;
+}
+
+size_t domaindb_lookup_batch( const domaindb* db, const domaindb_query* queries, size_t count, uint8_t* categories )
+{
+    if ( (db == nullptr) || (queries == nullptr) || (categories == nullptr) ) return 0;
+    try
+    {
+        size_t classified = 0;
+        Epoch::Guard guard;
+        const auto& compiled_db = db->snapshot.load( std::memory_order_acquire )->db;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const auto& query = queries[i];
+            auto category = DomainTree::kUnclassified;
+            if ( ((query.name != nullptr) || (query.name_size == 0)) && (query.protocol <= DOMAINDB_TCP) )
+            {
+                category = compiled_db.match_domain( std::string_view(query.name, query.name_size), query.port, ProtocolType(query.protocol) );
+            }
+            categories[i] = uint8_t( category );
+            classified += (category != DomainTree::kUnclassified);
+        }
+
+        db->count( count, classified );
+        return classified;
+    }
+    catch ( ... ) // No reader slot for this thread, see Epoch::kMaxReaders
+    {
+        std::memset( categories, DOMAINDB_UNCLASSIFIED, count );
+        return 0;
+    }
+}
+
+int domaindb_classify( const domaindb* db, const char* name, size_t name_size, uint16_t port, uint8_t protocol,
+                       domaindb_result* result )
+{
+    if ( (db == nullptr) || ((name == nullptr) && (name_size != 0)) || (protocol > DOMAINDB_TCP) || (result == nullptr) ) return -1;
+    try
+    {
+        Epoch::Guard guard;
+        auto match = db->snapshot.load( std::memory_order_acquire )->db.classify_domain( std::string_view(name, name_size), port,
+                                                                                          ProtocolType(protocol) );
+        result->category = uint8_t( match.category );
+        result->depth = match.depth;
+        result->categories = match.categories;
+
+        db->count( 1, match.category != DomainTree::kUnclassified );
+        return 0;
+    }
+    catch ( ... )
+    {
+        return -1;
+    }
+}
+
+int domaindb_get_stats( const domaindb* db, domaindb_stats* stats )
+{
+    if ( (db == nullptr) || (stats == nullptr) ) return -1;
+    try
+    {
+        Epoch::Guard guard;
+        auto snapshot = db->snapshot.load( std::memory_order_acquire );
+        stats->lookups = 0;
+        stats->classified = 0;
+        for ( size_t cpu = 0; cpu < db->cpu_count; ++cpu )
+        {
+            stats->lookups += db->counters[cpu].lookups.load( std::memory_order_relaxed );
+            stats->classified += db->counters[cpu].classified.load( std::memory_order_relaxed );
+        }
+        stats->generation = db->generation.load( std::memory_order_relaxed );
+        stats->domains = snapshot->db.size();
+        stats->image_size = snapshot->image_size;
+        return 0;
+    }
+    catch ( ... )
+    {
+        return -1;
+    }
+}
+
+const char* domaindb_category_name( uint8_t category )
+{
+    // The names are literals, so they are terminated
+    return (category < MultiConnectionTypeString.size()) ? MultiConnectionTypeString[category].data() : "";
+}
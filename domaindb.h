@@ -0,0 +1,126 @@
+#ifndef DOMAINDB_H
+#define DOMAINDB_H
+
+/*
+ * C interface of the domain database, for data planes that cannot link C++ (DPDK or VPP graph nodes).
+ *
+ * A handle holds one snapshot of the database at a time, a CompiledDb image: compiled from a json database
+ * file, mapped from an image file, or an image in memory the caller mapped. Lookups run on any number of
+ * threads without locks and may overlap a swap to a new snapshot, which is released once no lookup uses it.
+ * Names are (pointer, size) pairs and need not be terminated. No C++ exception leaves the library, and
+ * lookups of ASCII names allocate nothing.
+ *
+ * Functions that can fail return 0 on success and -1 on failure, with a description of the problem written
+ * to the error buffer of the caller when one is given.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define DOMAINDB_API __attribute__((visibility("default")))
+#else
+#define DOMAINDB_API
+#endif
+
+/* Incremented on incompatible changes of this interface */
+#define DOMAINDB_ABI_VERSION 1
+
+/* Protocols, the values of ProtocolType */
+#define DOMAINDB_UDP 0
+#define DOMAINDB_TCP 1
+
+/* Categories, the values of MultiConnectionType */
+#define DOMAINDB_SMALL              1
+#define DOMAINDB_UNCLASSIFIED       2
+#define DOMAINDB_GAMING             3
+#define DOMAINDB_STREAMING_TCP      4
+#define DOMAINDB_STREAMING_UDP      5
+#define DOMAINDB_STREAMING_VIDEO    6
+#define DOMAINDB_BROWSING           7
+#define DOMAINDB_LIVE_STREAMING_UDP 8
+#define DOMAINDB_UPLOAD_TCP         9
+#define DOMAINDB_UPLOAD_UDP         10
+#define DOMAINDB_UNTRUSTED          11
+#define DOMAINDB_UNDEFINED          12
+
+/* Depth of a classification that matched no domain entry */
+#define DOMAINDB_NO_DOMAIN_MATCH    0xFF
+
+typedef struct domaindb domaindb;
+
+/* One lookup of a batch */
+typedef struct domaindb_query
+{
+    const char* name;           /* domain name or IP address, not necessarily terminated */
+    size_t      name_size;
+    uint16_t    port;
+    uint8_t     protocol;       /* DOMAINDB_UDP or DOMAINDB_TCP */
+} domaindb_query;
+
+/* Full classification of one lookup, see domaindb_classify */
+typedef struct domaindb_result
+{
+    uint8_t     category;       /* the category domaindb_lookup returns */
+    uint8_t     depth;          /* leading labels removed before the match, DOMAINDB_NO_DOMAIN_MATCH if none */
+    uint16_t    categories;     /* bit (1 << category) for every category of the matching entries */
+} domaindb_result;
+
+typedef struct domaindb_stats
+{
+    uint64_t    lookups;        /* lookups since the handle was opened */
+    uint64_t    classified;     /* lookups that returned a category other than DOMAINDB_UNCLASSIFIED */
+    uint64_t    generation;     /* snapshots installed: 1 after open, incremented by every swap */
+    uint64_t    domains;        /* domains in the current snapshot */
+    uint64_t    image_size;     /* size of the current snapshot in bytes */
+} domaindb_stats;
+
+/* Open a database file: a CompiledDb image file, which is mapped, or a json database, which is loaded and
+ * compiled. Entries of a json database that are rejected are skipped.
+ * Returns the handle, NULL on failure. */
+DOMAINDB_API domaindb* domaindb_open_file( const char* path, char* error, size_t error_size );
+
+/* Open a CompiledDb image in memory, used in place: it must stay mapped and unchanged until it is swapped
+ * out and no lookup uses it any more, at the latest until domaindb_close. The image must be 8 byte aligned.
+ * Returns the handle, NULL on failure. */
+DOMAINDB_API domaindb* domaindb_open_image( const void* image, size_t size, char* error, size_t error_size );
+
+/* Replace the snapshot of a handle, as domaindb_open_file or domaindb_open_image would open it. Lookups
+ * running meanwhile finish on the old snapshot. Swaps of one handle must not run concurrently. */
+DOMAINDB_API int domaindb_swap_file( domaindb* db, const char* path, char* error, size_t error_size );
+DOMAINDB_API int domaindb_swap_image( domaindb* db, const void* image, size_t size, char* error, size_t error_size );
+
+/* Write the current snapshot to an image file that domaindb_open_file maps */
+DOMAINDB_API int domaindb_save_image( const domaindb* db, const char* path, char* error, size_t error_size );
+
+/* Close a handle. No lookup may use it any more. */
+DOMAINDB_API void domaindb_close( domaindb* db );
+
+/* Category of a domain name or IP address, see DomainTree::match_domain; DOMAINDB_UNCLASSIFIED on any
+ * invalid argument */
+DOMAINDB_API uint8_t domaindb_lookup( const domaindb* db, const char* name, size_t name_size, uint16_t port, uint8_t protocol );
+
+/* Look up count queries and write their categories to categories[0..count). Cheaper per lookup than
+ * domaindb_lookup: the snapshot and the counters are taken once per batch.
+ * Returns the number of queries classified as something other than DOMAINDB_UNCLASSIFIED. */
+DOMAINDB_API size_t domaindb_lookup_batch( const domaindb* db, const domaindb_query* queries, size_t count, uint8_t* categories );
+
+/* Full classification of a domain name or IP address, see DomainTree::classify_domain */
+DOMAINDB_API int domaindb_classify( const domaindb* db, const char* name, size_t name_size, uint16_t port, uint8_t protocol,
+                                    domaindb_result* result );
+
+/* Counters and size of a handle */
+DOMAINDB_API int domaindb_get_stats( const domaindb* db, domaindb_stats* stats );
+
+/* Name of a category, such as "gaming"; an empty string for an unknown value. The string is static. */
+DOMAINDB_API const char* domaindb_category_name( uint8_t category );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DOMAINDB_H */
@@ -0,0 +1,575 @@
+#include "compiled_db.h"
+#include "domain_tree.h"
+#include "domain_index.h"
+#include "replicated_db.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace json11;
+
+//! Benchmarks of the database code on synthetic or real database files:
+//!     domaindb-bench generate <db.json> <number of domains>  - write a synthetic database
+//!     domaindb-bench json <db.json>                          - json parse throughput, STANDARD vs FAST
+//!     domaindb-bench miss <db.json> <number of lookups> [public_suffix_list.dat]
+//!                                                            - lookups of unknown names, without and with the filter,
+//!                                                              optionally stopping at the registrable domain
+//!     domaindb-bench ports <db.json> <number of lookups>     - IP address lookups falling back to the empty domain,
+//!                                                              and DomainIndex port queries
+//!     domaindb-bench ranges <db.json> <number of lookups>    - port scan of entries with 1, 8 and 64 ranges: DomainTree,
+//!                                                              CompiledDb without and with AVX2; db.json is overwritten
+//!     domaindb-bench numa <db.json> <number of lookups>      - lookups on all CPUs in a ReplicatedDb with normal pages,
+//!                                                              huge pages and huge pages replicated per NUMA node
+//!     domaindb-bench batch <db.json> <number of lookups>     - DomainTree::match_domain one by one against
+//!                                                              match_domains in batches, for known and unknown names
+//!     domaindb-bench negative <db.json> <number of lookups>  - lookups of random names under a few parent zones of the
+//!                                                              database, without and with the negative cache
+
+using Clock = std::chrono::steady_clock;
+
+//! Seconds elapsed since start
+static double seconds_since( Clock::time_point start )
+{
+    return std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+//! Random lowercase label of 3 to 12 characters
+static std::string random_label( std::mt19937_64& random )
+{
+    static const char kLetters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::string label( 3 + random() % 10, ' ' );
+    for ( auto& ch : label ) ch = kLetters[random() % 36];
+    return label;
+}
+
+//! Write a synthetic database with the given number of domain entries in all six forms
+static int generate( const std::string& filename, size_t domains )
+{
+    static const char* const kCategories[] = { "streaming", "gaming", "browsing", "live_streaming", "upload_udp" };
+    static const char* const kTlds[] = { "com", "net", "org", "io", "co.uk", "de" };
+
+    std::mt19937_64 random( 2019 );
+    std::ofstream out( filename );
+    out << "{\n";
+    for ( size_t c = 0; c < 5; ++c )
+    {
+        out << (c ? ",\n" : "") << "    \"" << kCategories[c] << "\": [\n";
+        for ( size_t d = c; d < domains; d += 5 )
+        {
+            std::string name = random_label(random) + "." + kTlds[random() % 6];
+            if ( random() % 2 ) name = random_label(random) + "." + name;
+            auto first = random() % 60000;
+            auto last = first + random() % 5000;
+            std::string range = "[" + std::to_string(first) + ", " + std::to_string(last) + "]";
+
+            out << "        [\"" << name << "\"";
+            switch ( random() % 6 )
+            {
+                case 0: out << ", [" << range << ", " << range << "]"; break;
+                case 1: out << ", [" << range << ", []]"; break;
+                case 2: out << ", [[], " << range << "]"; break;
+                case 3: out << ", []"; break;
+                case 4: out << ", [[], []]"; break;
+                default: break;
+            }
+            out << "]" << ((d + 5 < domains) ? ",\n" : "\n");
+        }
+        out << "    ]";
+    }
+    out << "\n}\n";
+
+    return out.flush() ? 0 : 1;
+}
+
+//! Compare json parse throughput of the STANDARD and FAST strategies
+static int bench_json( const std::string& filename )
+{
+    std::ifstream in( filename );
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    const auto text = buffer.str();
+    const double megabytes = text.size() / 1e6;
+
+    // Alternate the strategies so that both see the same heap state; report the best of three rounds
+    double best_parse[2] = { 1e9, 1e9 };
+    double best_free[2] = { 1e9, 1e9 };
+    for ( int round = 0; round < 3; ++round )
+    {
+        for ( auto strategy : { JsonParse::STANDARD, JsonParse::FAST } )
+        {
+            std::string error;
+            auto start = Clock::now();
+            auto json = Json::parse( text, error, strategy );
+            auto parse_time = seconds_since( start );
+            if ( !error.empty() )
+            {
+                std::cerr << filename << ": " << error << std::endl;
+                return 1;
+            }
+
+            start = Clock::now();
+            json = Json();
+            auto free_time = seconds_since( start );
+
+            auto index = (strategy == JsonParse::FAST) ? 1 : 0;
+            best_parse[index] = std::min( best_parse[index], parse_time );
+            best_free[index] = std::min( best_free[index], free_time );
+        }
+    }
+
+    for ( int index = 0; index < 2; ++index )
+    {
+        std::cout << (index ? "FAST    " : "STANDARD") << "  " << megabytes << " MB  parse " << best_parse[index]
+                  << " s (" << megabytes / best_parse[index] << " MB/s)  free " << best_free[index] << " s" << std::endl;
+    }
+
+    return 0;
+}
+
+//! Compare lookups of names that are not in the database without and with the domain filter
+static int bench_miss( const std::string& filename, size_t lookups, const std::string& public_suffix_filename )
+{
+    std::shared_ptr<const PublicSuffixList> public_suffixes;
+    if ( !public_suffix_filename.empty() )
+    {
+        std::string error;
+        public_suffixes = PublicSuffixList::load( public_suffix_filename, &error );
+        if ( !public_suffixes )
+        {
+            std::cerr << public_suffix_filename << ": " << error << std::endl;
+            return 1;
+        }
+    }
+
+    DomainTree domain_tree( filename, nullptr, public_suffixes );
+    const auto& report = domain_tree.load_report();
+    if ( !report.error.empty() )
+    {
+        std::cerr << filename << ": " << report.error << std::endl;
+        return 1;
+    }
+
+    // Unknown names under the top level domains of the database, with one to three random labels
+    std::vector<std::string> tlds;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        auto pos = domain_name.rfind( '.' );
+        if ( (pos != std::string::npos) && (tlds.size() < 64) &&
+             (std::find(tlds.begin(), tlds.end(), domain_name.substr(pos + 1)) == tlds.end()) )
+        {
+            tlds.push_back( domain_name.substr(pos + 1) );
+        }
+    } );
+    if ( tlds.empty() ) tlds.push_back( "com" );
+
+    std::mt19937_64 random( 2020 );
+    std::vector<std::string> names( lookups );
+    for ( auto& name : names )
+    {
+        name = tlds[random() % tlds.size()];
+        for ( auto labels = 1 + random() % 3; labels > 0; --labels ) name = random_label(random) + "." + name;
+    }
+
+    double best[2] = { 1e9, 1e9 };
+    std::vector<MultiConnectionType> results[2];
+    for ( int round = 0; round < 3; ++round )
+    {
+        for ( int filtered = 0; filtered < 2; ++filtered )
+        {
+            domain_tree.use_filter( filtered != 0 );
+            results[filtered].clear();
+            results[filtered].reserve( lookups );
+
+            auto start = Clock::now();
+            for ( size_t i = 0; i < lookups; ++i )
+            {
+                results[filtered].push_back( domain_tree.match_domain(names[i], uint16_t(i), ProtocolType(i & 1)) );
+            }
+            best[filtered] = std::min( best[filtered], seconds_since(start) );
+        }
+    }
+
+    if ( results[0] != results[1] )
+    {
+        std::cerr << "results differ with and without the filter" << std::endl;
+        return 1;
+    }
+
+    auto unclassified = size_t( std::count(results[0].begin(), results[0].end(), MultiConnectionType::unclassified) );
+    std::cout << domain_tree.size() << " domains, " << lookups << " unknown names, " << unclassified
+              << " unclassified";
+    if ( public_suffixes ) std::cout << ", " << public_suffixes->size() << " public suffix rules";
+    std::cout << std::endl;
+    for ( int filtered = 0; filtered < 2; ++filtered )
+    {
+        std::cout << (filtered ? "filter   " : "no filter") << "  " << 1e9 * best[filtered] / lookups << " ns/lookup"
+                  << std::endl;
+    }
+
+    return 0;
+}
+
+//! Time lookups of IP addresses, which fall back to the entry with the empty domain, and port queries
+static int bench_ports( const std::string& filename, size_t lookups )
+{
+    DomainTree domain_tree( filename );
+    const auto& report = domain_tree.load_report();
+    if ( !report.error.empty() )
+    {
+        std::cerr << filename << ": " << report.error << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 random( 2021 );
+    std::vector<std::string> addresses( lookups );
+    for ( auto& address : addresses )
+    {
+        address = "10." + std::to_string(random() % 256) + "." + std::to_string(random() % 256) + "." +
+                  std::to_string(random() % 256);
+    }
+
+    double best = 1e9;
+    size_t classified = 0;
+    for ( int round = 0; round < 3; ++round )
+    {
+        classified = 0;
+        auto start = Clock::now();
+        for ( size_t i = 0; i < lookups; ++i )
+        {
+            auto category = domain_tree.match_domain( addresses[i], uint16_t(random()), ProtocolType(i & 1) );
+            classified += (category != MultiConnectionType::unclassified);
+        }
+        best = std::min( best, seconds_since(start) );
+    }
+    std::cout << lookups << " IP addresses, " << classified << " classified by the empty domain: "
+              << 1e9 * best / lookups << " ns/lookup" << std::endl;
+
+    auto start = Clock::now();
+    DomainIndex domain_index( domain_tree );
+    std::cout << "index of " << domain_index.size() << " domains built in " << 1e3 * seconds_since(start)
+              << " ms, " << domain_index.memory_usage() / 1024 << " KB" << std::endl;
+
+    // A query may visit every domain, so fewer are run
+    auto queries = std::min<size_t>( lookups, 10000 );
+    for ( bool include_all_ports : { false, true } )
+    {
+        size_t claims = 0;
+        start = Clock::now();
+        for ( size_t i = 0; i < queries; ++i )
+        {
+            domain_index.find_port( uint16_t(random()), ProtocolType(i & 1), include_all_ports,
+                                    [&]( std::string_view name, const DomainIndex::PortRange& ) { claims += !name.empty(); } );
+        }
+        std::cout << (include_all_ports ? "all ranges      " : "specific ranges ") << 1e6 * seconds_since(start) / queries
+                  << " us/query, " << double(claims) / queries << " ranges/query" << std::endl;
+    }
+
+    return 0;
+}
+
+//! Time lookups of an entry with 1, 8 and 64 port ranges, half of the ports in no range
+static int bench_ranges( const std::string& filename, size_t lookups )
+{
+    static const char kAddress[] = "10.1.2.3";
+
+    std::mt19937_64 random( 2022 );
+    std::vector<uint16_t> ports( lookups );
+    for ( auto& port : ports ) port = uint16_t( random() );
+
+    for ( size_t range_count : { 1, 8, 64 } )
+    {
+        // Ranges of equal width with gaps of the same width; forms (1) append one range per protocol
+        {
+            std::ofstream out( filename, std::ios::trunc );
+            out << "{ \"gaming\": [\n";
+            auto width = DomainTree::kPortCount / range_count;
+            for ( size_t i = 0; i < range_count; ++i )
+            {
+                auto range = "[" + std::to_string( i * width ) + ", " + std::to_string( i * width + width / 2 - 1 ) + "]";
+                out << (i ? ",\n" : "") << "    [\"" << kAddress << "\", [" << range << ", " << range << "]]";
+            }
+            out << "\n] }\n";
+            if ( !out.flush() )
+            {
+                std::cerr << "cannot write " << filename << std::endl;
+                return 1;
+            }
+        }
+
+        DomainTree domain_tree( filename );
+        auto image = CompiledDb::compile( domain_tree );
+        CompiledDb compiled_db;
+        if ( !domain_tree.load_report().error.empty() || !compiled_db.attach(image.data(), image.size()) )
+        {
+            std::cerr << filename << ": cannot load the database" << std::endl;
+            return 1;
+        }
+
+        // The best of three rounds of each engine; every engine must classify the same lookups
+        auto time_lookups = [&]( auto&& match_domain, size_t* classified )
+        {
+            double best = 1e9;
+            for ( int round = 0; round < 3; ++round )
+            {
+                *classified = 0;
+                auto start = Clock::now();
+                for ( size_t i = 0; i < lookups; ++i )
+                {
+                    *classified += (match_domain(ports[i], ProtocolType(i & 1)) != MultiConnectionType::unclassified);
+                }
+                best = std::min( best, seconds_since(start) );
+            }
+            return 1e9 * best / lookups;
+        };
+
+        size_t classified[3];
+        auto tree_ns = time_lookups( [&]( uint16_t port, ProtocolType protocol ) { return domain_tree.match_domain(kAddress, port, protocol); }, &classified[0] );
+        compiled_db.use_simd( false );
+        auto scalar_ns = time_lookups( [&]( uint16_t port, ProtocolType protocol ) { return compiled_db.match_domain(kAddress, port, protocol); }, &classified[1] );
+        compiled_db.use_simd( true );
+        auto simd_ns = time_lookups( [&]( uint16_t port, ProtocolType protocol ) { return compiled_db.match_domain(kAddress, port, protocol); }, &classified[2] );
+        if ( (classified[0] != classified[1]) || (classified[0] != classified[2]) )
+        {
+            std::cerr << "results differ between the engines" << std::endl;
+            return 1;
+        }
+
+        std::cout << range_count << " ranges: DomainTree " << tree_ns << " ns/lookup, CompiledDb " << scalar_ns
+                  << " ns/lookup, with AVX2 " << simd_ns << " ns/lookup" << std::endl;
+    }
+
+    return 0;
+}
+
+//! Time lookups on all CPUs in the placements of ReplicatedDb and show the node that served them
+static int bench_numa( const std::string& filename, size_t lookups )
+{
+    static const char* const kPageModes[] = { "normal pages", "transparent huge pages", "huge pages" };
+
+    DomainTree domain_tree( filename );
+    if ( !domain_tree.load_report().error.empty() )
+    {
+        std::cerr << filename << ": " << domain_tree.load_report().error << std::endl;
+        return 1;
+    }
+    auto image = CompiledDb::compile( domain_tree );
+
+    // Names of the database with a random label in front, so that lookups walk a few suffixes
+    std::vector<std::string> names;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        names.push_back( domain_name );
+    } );
+    std::mt19937_64 random( 2023 );
+    std::vector<std::string> queries( std::min<size_t>(lookups, 1 << 20) );
+    for ( auto& query : queries ) query = random_label( random ) + "." + (names.empty() ? "com" : names[random() % names.size()]);
+
+    auto threads = std::max( 1u, std::thread::hardware_concurrency() );
+    for ( int placement = 0; placement < 3; ++placement )
+    {
+        ReplicatedDb::Options options;
+        options.huge_pages = (placement > 0);
+        options.replicate = (placement == 2);
+        std::string error;
+        auto db = ReplicatedDb::create( std::string_view(image.data(), image.size()), options, &error );
+        if ( !db )
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        std::vector<std::thread> workers;
+        auto start = Clock::now();
+        for ( unsigned thread = 0; thread < threads; ++thread )
+        {
+            workers.emplace_back( [&, thread]()
+            {
+                for ( size_t i = thread; i < lookups; i += threads )
+                {
+                    db->match_domain( queries[i % queries.size()], uint16_t(i), ProtocolType(i & 1) );
+                }
+            } );
+        }
+        for ( auto& worker : workers ) worker.join();
+        auto seconds = seconds_since( start );
+
+        std::cout << db->replica_count() << (db->replica_count() == 1 ? " image, " : " images, ")
+                  << kPageModes[int(db->page_mode())] << ": " << lookups / seconds / 1e6 << " M lookups/s on " << threads
+                  << " threads, lookups per node:";
+        for ( auto node_lookups : db->lookups_per_node() ) std::cout << ' ' << node_lookups;
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+//! Compare single lookups with interleaved batch lookups, on names under known domains and on unknown names
+static int bench_batch( const std::string& filename, size_t lookups )
+{
+    static const size_t kBatchSize = 256;
+
+    DomainTree domain_tree( filename );
+    if ( !domain_tree.load_report().error.empty() )
+    {
+        std::cerr << filename << ": " << domain_tree.load_report().error << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        names.push_back( domain_name );
+    } );
+    if ( names.empty() ) names.push_back( "com" );
+
+    std::mt19937_64 random( 2024 );
+    for ( int known = 1; known >= 0; --known )
+    {
+        // A random label in front of a domain of the database, or of a random name under its top level domain
+        std::vector<std::string> queries( lookups );
+        for ( auto& query : queries )
+        {
+            const auto& name = names[random() % names.size()];
+            auto pos = name.rfind( '.' );
+            query = random_label( random ) + "." +
+                    (known ? name : random_label(random) + "." + ((pos == std::string::npos) ? name : name.substr(pos + 1)));
+        }
+        std::vector<DomainTree::Query> batch( lookups );
+        for ( size_t i = 0; i < lookups; ++i ) batch[i] = DomainTree::Query{ queries[i], uint16_t(i), ProtocolType(i & 1) };
+
+        double best[2] = { 1e9, 1e9 };
+        std::vector<MultiConnectionType> results[2];
+        for ( int round = 0; round < 3; ++round )
+        {
+            results[0].assign( lookups, MultiConnectionType::undefined );
+            auto start = Clock::now();
+            for ( size_t i = 0; i < lookups; ++i ) results[0][i] = domain_tree.match_domain( queries[i], uint16_t(i), ProtocolType(i & 1) );
+            best[0] = std::min( best[0], seconds_since(start) );
+
+            results[1].assign( lookups, MultiConnectionType::undefined );
+            start = Clock::now();
+            for ( size_t i = 0; i < lookups; i += kBatchSize )
+            {
+                domain_tree.match_domains( &batch[i], std::min(kBatchSize, lookups - i), &results[1][i] );
+            }
+            best[1] = std::min( best[1], seconds_since(start) );
+        }
+        if ( results[0] != results[1] )
+        {
+            std::cerr << "results differ between single and batch lookups" << std::endl;
+            return 1;
+        }
+
+        auto unclassified = size_t( std::count(results[0].begin(), results[0].end(), MultiConnectionType::unclassified) );
+        std::cout << domain_tree.size() << " domains, " << lookups << (known ? " names under known domains, " : " unknown names, ")
+                  << unclassified << " unclassified: match_domain " << 1e9 * best[0] / lookups << " ns/lookup, match_domains "
+                  << 1e9 * best[1] / lookups << " ns/lookup" << std::endl;
+    }
+
+    return 0;
+}
+
+//! Lookups of random names under a few parent zones of the database, without and with the negative cache
+static int bench_negative( const std::string& filename, size_t lookups )
+{
+    static const size_t kZones = 64;
+    static const size_t kBatchSize = 256;
+    static const uint16_t kPorts[] = { 53, 80, 443, 8080 };
+
+    DomainTree domain_tree( filename );
+    if ( !domain_tree.load_report().error.empty() )
+    {
+        std::cerr << filename << ": " << domain_tree.load_report().error << std::endl;
+        return 1;
+    }
+
+    // The parent zones of random domains of the database, with at least two labels
+    std::vector<std::string> names;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        auto pos = domain_name.find( '.' );
+        if ( (pos != std::string::npos) && (domain_name.find('.', pos + 1) != std::string::npos) ) names.push_back( domain_name.substr(pos + 1) );
+    } );
+    if ( names.empty() ) names.push_back( "example.com" );
+
+    std::mt19937_64 random( 2024 );
+    std::vector<std::string> zones( kZones );
+    for ( auto& zone : zones ) zone = names[random() % names.size()];
+
+    std::vector<std::string> queries( lookups );
+    std::vector<DomainTree::Query> batch( lookups );
+    for ( size_t i = 0; i < lookups; ++i )
+    {
+        queries[i] = random_label( random ) + "." + zones[random() % kZones];
+        batch[i] = DomainTree::Query{ queries[i], kPorts[random() % 4], ProtocolType(random() & 1) };
+    }
+
+    double best[2][2] = { { 1e9, 1e9 }, { 1e9, 1e9 } };
+    std::vector<MultiConnectionType> results[2][2];
+    for ( int cached = 0; cached < 2; ++cached )
+    {
+        domain_tree.use_negative_cache( cached != 0 );
+        for ( int round = 0; round < 3; ++round )
+        {
+            results[cached][0].assign( lookups, MultiConnectionType::undefined );
+            auto start = Clock::now();
+            for ( size_t i = 0; i < lookups; ++i )
+            {
+                results[cached][0][i] = domain_tree.match_domain( queries[i], batch[i].port, batch[i].protocol_type );
+            }
+            best[cached][0] = std::min( best[cached][0], seconds_since(start) );
+
+            results[cached][1].assign( lookups, MultiConnectionType::undefined );
+            start = Clock::now();
+            for ( size_t i = 0; i < lookups; i += kBatchSize )
+            {
+                domain_tree.match_domains( &batch[i], std::min(kBatchSize, lookups - i), &results[cached][1][i] );
+            }
+            best[cached][1] = std::min( best[cached][1], seconds_since(start) );
+        }
+    }
+    if ( (results[0][0] != results[0][1]) || (results[0][0] != results[1][0]) || (results[0][0] != results[1][1]) )
+    {
+        std::cerr << "results differ with the negative cache" << std::endl;
+        return 1;
+    }
+
+    auto unclassified = size_t( std::count(results[0][0].begin(), results[0][0].end(), MultiConnectionType::unclassified) );
+    std::cout << domain_tree.size() << " domains, " << lookups << " names under " << kZones << " zones, " << unclassified
+              << " unclassified" << std::endl;
+    for ( int cached = 0; cached < 2; ++cached )
+    {
+        std::cout << (cached ? "with" : "without") << " negative cache: match_domain " << 1e9 * best[cached][0] / lookups
+                  << " ns/lookup, match_domains " << 1e9 * best[cached][1] / lookups << " ns/lookup" << std::endl;
+    }
+
+    return 0;
+}
+
+int main( int argc, char* argv[] )
+{
+    std::string command = (argc > 1) ? argv[1] : "";
+
+    if ( (command == "generate") && (argc == 4) ) return generate( argv[2], std::stoul(argv[3]) );
+    if ( (command == "json") && (argc == 3) ) return bench_json( argv[2] );
+    if ( (command == "miss") && ((argc == 4) || (argc == 5)) ) return bench_miss( argv[2], std::stoul(argv[3]), (argc == 5) ? argv[4] : "" );
+    if ( (command == "ports") && (argc == 4) ) return bench_ports( argv[2], std::stoul(argv[3]) );
+    if ( (command == "ranges") && (argc == 4) ) return bench_ranges( argv[2], std::stoul(argv[3]) );
+    if ( (command == "numa") && (argc == 4) ) return bench_numa( argv[2], std::stoul(argv[3]) );
+    if ( (command == "batch") && (argc == 4) ) return bench_batch( argv[2], std::stoul(argv[3]) );
+    if ( (command == "negative") && (argc == 4) ) return bench_negative( argv[2], std::stoul(argv[3]) );
+
+    std::cerr << "usage: " << argv[0] << " generate <db.json> <number of domains>" << std::endl
+              << "       " << argv[0] << " json <db.json>" << std::endl
+              << "       " << argv[0] << " miss <db.json> <number of lookups> [public_suffix_list.dat]" << std::endl
+              << "       " << argv[0] << " ports <db.json> <number of lookups>" << std::endl
+              << "       " << argv[0] << " ranges <db.json> <number of lookups>" << std::endl
+              << "       " << argv[0] << " numa <db.json> <number of lookups>" << std::endl
+              << "       " << argv[0] << " batch <db.json> <number of lookups>" << std::endl
+              << "       " << argv[0] << " negative <db.json> <number of lookups>" << std::endl;
+    return 2;
+}
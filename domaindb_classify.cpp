@@ -0,0 +1,111 @@
+#include "arrow_writer.h"
+#include "bulk_classifier.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+//! Classify flow records offline, see BulkClassifier:
+//!     domaindb-classify [--arrow] <db.json> <records.csv> [output|-] [threads]
+//! Writes every record followed by its category to the output, stdout by default, in input order; the
+//! counters and the throughput go to stderr. With --arrow the output is an Arrow IPC stream of the records,
+//! see ArrowWriter, and the lines that are not records are left out.
+
+using Clock = std::chrono::steady_clock;
+
+//! Write a whole buffer to a file descriptor
+static bool write_all( int fd, const std::string& data )
+{
+    for ( size_t written = 0; written < data.size(); )
+    {
+        auto result = write( fd, data.data() + written, data.size() - written );
+        if ( result < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        written += size_t( result );
+    }
+    return true;
+}
+
+int main( int argc, char* argv[] )
+{
+    bool arrow = (argc > 1) && (std::string(argv[1]) == "--arrow");
+    if ( arrow )
+    {
+        --argc;
+        ++argv;
+    }
+    if ( (argc < 3) || (argc > 5) )
+    {
+        std::cerr << "usage: " << argv[0] << " [--arrow] <db.json> <records.csv> [output|-] [threads]" << std::endl;
+        return 2;
+    }
+    std::string output_filename = (argc > 3) ? argv[3] : "-";
+
+    auto start = Clock::now();
+    DomainTree domain_tree( argv[1] );
+    if ( !domain_tree.load_report().error.empty() )
+    {
+        std::cerr << argv[1] << ": " << domain_tree.load_report().error << std::endl;
+        return 1;
+    }
+    std::cerr << "loaded " << domain_tree.size() << " domains in " << std::chrono::duration<double>( Clock::now() - start ).count()
+              << " s" << std::endl;
+
+    int fd = (output_filename == "-") ? STDOUT_FILENO : open( output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+    {
+        std::cerr << "cannot create " << output_filename << ": " << std::strerror( errno ) << std::endl;
+        return 1;
+    }
+
+    BulkClassifier::Options options;
+    options.threads = (argc > 4) ? unsigned( std::stoul(argv[4]) ) : 0;
+    BulkClassifier classifier( domain_tree, options );
+    BulkClassifier::Stats stats;
+    std::string error;
+    ArrowWriter arrow_writer;
+    std::string arrow_output;
+    bool written = classifier.run_file( argv[2], arrow ? nullptr : BulkClassifier::format_text, [&]( const BulkClassifier::Chunk& chunk )
+    {
+        const auto* output = &chunk.output;
+        if ( arrow )
+        {
+            arrow_output.clear();
+            arrow_writer.write_batch( chunk.queries.data(), chunk.categories.data(), nullptr, chunk.queries.size(), &arrow_output );
+            output = &arrow_output;
+        }
+        if ( write_all(fd, *output) ) return true;
+        error = "cannot write " + output_filename + ": " + std::strerror( errno );
+        return false;
+    }, &stats, &error );
+    if ( arrow && written )
+    {
+        arrow_output.clear();
+        arrow_writer.finish( &arrow_output );
+        if ( !write_all(fd, arrow_output) )
+        {
+            error = "cannot write " + output_filename + ": " + std::strerror( errno );
+            written = false;
+        }
+    }
+    if ( (fd != STDOUT_FILENO) && (close(fd) != 0) && written )
+    {
+        error = "cannot write " + output_filename + ": " + std::strerror( errno );
+        written = false;
+    }
+    if ( !written )
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    auto seconds = std::chrono::duration<double>( stats.time ).count();
+    std::cerr << stats.lines << " lines, " << stats.invalid_lines << " not records, " << stats.classified << " classified, "
+              << stats.bytes / 1e6 << " MB in " << stats.chunks << " chunks, " << seconds << " s: " << stats.bytes / seconds / 1e9
+              << " GB/s, " << stats.lines / seconds / 1e6 << " M lines/s" << std::endl;
+    return 0;
+}
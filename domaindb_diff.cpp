@@ -0,0 +1,80 @@
+#include "domain_delta.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+//! Report load problems of a database file
+//!
+//! \return false if the file could not be read or parsed; rejected entries are only reported
+static bool check_load( const DomainTree& domain_tree, const char* filename )
+{
+    const auto& report = domain_tree.load_report();
+    for ( const auto& rejected : report.rejected )
+    {
+        std::cerr << filename << ":" << rejected.line << ": " << rejected.service << ": " << rejected.reason
+                  << (rejected.entry.empty() ? "" : " - ") << rejected.entry << std::endl;
+    }
+    if ( report.rejected_count > report.rejected.size() )
+    {
+        std::cerr << filename << ": " << report.rejected_count - report.rejected.size() << " more rejected entries" << std::endl;
+    }
+    if ( report.error.empty() ) return true;
+
+    std::cerr << filename << ": " << report.error << std::endl;
+    return false;
+}
+
+//! Compute the delta between two database files, or apply a delta to a database file to check it:
+//!     domaindb-diff <old db.json> <new db.json> <delta output file>
+//!     domaindb-diff --apply <db.json> <delta file>
+int main( int argc, char* argv[] )
+{
+    if ( argc != 4 )
+    {
+        std::cerr << "usage: " << argv[0] << " <old db.json> <new db.json> <delta output file>" << std::endl
+                  << "       " << argv[0] << " --apply <db.json> <delta file>" << std::endl;
+        return 2;
+    }
+
+    if ( std::string(argv[1]) == "--apply" )
+    {
+        DomainTree domain_tree( argv[2] );
+        if ( !check_load(domain_tree, argv[2]) ) return 1;
+
+        std::ifstream delta_file( argv[3] );
+        std::stringstream text;
+        text << delta_file.rdbuf();
+
+        DomainDelta delta;
+        std::string error;
+        if ( !DomainDelta::parse(text.str(), &delta, &error) )
+        {
+            std::cerr << argv[3] << ": " << error << std::endl;
+            return 1;
+        }
+        if ( !domain_tree.apply_delta(delta) )
+        {
+            std::cerr << argv[3] << ": delta does not apply to " << argv[2] << std::endl;
+            return 1;
+        }
+        std::cerr << "applied " << delta.removed.size() << " removals and " << delta.changed.size() << " changes, "
+                  << domain_tree.size() << " domains" << std::endl;
+        return 0;
+    }
+
+    DomainTree old_tree( argv[1] );
+    DomainTree new_tree( argv[2] );
+    if ( !check_load(old_tree, argv[1]) || !check_load(new_tree, argv[2]) ) return 1;
+    auto delta = DomainDelta::diff( old_tree, new_tree );
+
+    std::ofstream delta_file( argv[3] );
+    delta_file << delta.dump();
+    if ( !delta_file.flush() )
+    {
+        std::cerr << argv[3] << ": write failed" << std::endl;
+        return 1;
+    }
+
+    std::cerr << delta.removed.size() << " removals and " << delta.changed.size() << " changes" << std::endl;
+    return 0;
+}
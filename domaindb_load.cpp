@@ -0,0 +1,134 @@
+#include "lookup_service.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+//! Load generator for domaindb-server:
+//!     domaindb-load <socket path> <db.json> <number of lookups> [batch size] [pipeline depth] [connections]
+//! Looks up the names of the database with a random label in front, in batches of batch size lookups (default
+//! 64) with up to pipeline depth batches in flight (default 4) on each connection (default 1), and reports
+//! lookups per second and the latency of the batches, from sending to receiving the response.
+
+using Clock = std::chrono::steady_clock;
+
+//! Random lowercase label of 3 to 12 characters
+static std::string random_label( std::mt19937_64& random )
+{
+    std::string label( 3 + random() % 10, 'a' );
+    for ( auto& c : label ) c = char( 'a' + random() % 26 );
+    return label;
+}
+
+//! Run the lookups of one connection
+//!
+//! \return the latencies of the batches in microseconds, empty on failure
+static std::vector<double> run_connection( const std::string& socket_path, const std::vector<std::string>& names, size_t batches,
+                                           size_t batch_size, size_t depth, uint64_t seed )
+{
+    std::vector<double> latencies;
+    LookupClient client;
+    std::string error;
+    if ( !client.connect(socket_path, &error) )
+    {
+        std::cerr << error << std::endl;
+        return latencies;
+    }
+
+    std::mt19937_64 random( seed );
+    std::vector<LookupClient::Query> queries( std::max<size_t>(batch_size, std::min<size_t>(batches * batch_size, 1 << 16)) );
+    for ( auto& query : queries )
+    {
+        query.domain = names[random() % names.size()];
+        query.port = uint16_t( random() );
+        query.protocol_type = ProtocolType( random() & 1 );
+    }
+
+    std::vector<Clock::time_point> sent( depth );
+    std::vector<MultiConnectionType> categories;
+    latencies.reserve( batches );
+    size_t next = 0;
+    for ( size_t received = 0; received < batches; ++received )
+    {
+        for ( ; (next < batches) && (next < received + depth); ++next )
+        {
+            auto first = (next * batch_size) % (queries.size() - batch_size + 1);
+            sent[next % depth] = Clock::now();
+            if ( !client.send(uint32_t(next), &queries[first], batch_size, &error) )
+            {
+                std::cerr << error << std::endl;
+                return std::vector<double>();
+            }
+        }
+
+        uint32_t id;
+        if ( !client.receive(&id, &categories, &error) || (id != received) )
+        {
+            std::cerr << (error.empty() ? "a response came out of order" : error) << std::endl;
+            return std::vector<double>();
+        }
+        latencies.push_back( std::chrono::duration<double, std::micro>(Clock::now() - sent[id % depth]).count() );
+    }
+    return latencies;
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( (argc < 4) || (argc > 7) )
+    {
+        std::cerr << "usage: " << argv[0] << " <socket path> <db.json> <number of lookups> [batch size] [pipeline depth] [connections]"
+                  << std::endl;
+        return 2;
+    }
+    std::string socket_path = argv[1];
+    size_t lookups = std::stoul( argv[3] );
+    size_t batch_size = std::max<size_t>( (argc > 4) ? std::stoul( argv[4] ) : 64, 1 );
+    size_t depth = std::max<size_t>( (argc > 5) ? std::stoul( argv[5] ) : 4, 1 );
+    size_t connections = std::max<size_t>( (argc > 6) ? std::stoul( argv[6] ) : 1, 1 );
+
+    DomainTree domain_tree( argv[2] );
+    if ( !domain_tree.load_report().error.empty() )
+    {
+        std::cerr << argv[2] << ": " << domain_tree.load_report().error << std::endl;
+        return 1;
+    }
+
+    // Names of the database with a random label in front, so that lookups walk a few suffixes
+    std::mt19937_64 random( 2023 );
+    std::vector<std::string> names;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& )
+    {
+        if ( domain_name.size() < 240 ) names.push_back( random_label(random) + "." + domain_name );
+    } );
+    if ( names.empty() ) names.push_back( "example.com" );
+
+    size_t batches = std::max<size_t>( lookups / batch_size / connections, 1 );
+    std::vector<std::vector<double>> latencies( connections );
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for ( size_t i = 0; i < connections; ++i )
+    {
+        threads.emplace_back( [&, i]()
+        {
+            latencies[i] = run_connection( socket_path, names, batches, batch_size, depth, 2023 + i );
+        } );
+    }
+    for ( auto& thread : threads ) thread.join();
+    auto seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    std::vector<double> all;
+    for ( const auto& connection_latencies : latencies )
+    {
+        if ( connection_latencies.empty() ) return 1;
+        all.insert( all.end(), connection_latencies.begin(), connection_latencies.end() );
+    }
+    std::sort( all.begin(), all.end() );
+    auto percentile = [&]( double p ) { return all[std::min( all.size() - 1, size_t(p * all.size()) )]; };
+
+    auto total = all.size() * batch_size;
+    std::cout << total << " lookups in " << all.size() << " batches of " << batch_size << ", " << depth << " in flight on "
+              << connections << (connections == 1 ? " connection: " : " connections: ") << total / seconds / 1e6
+              << " M lookups/s, batch latency p50 " << percentile( 0.5 ) << " us, p99 " << percentile( 0.99 ) << " us, max "
+              << all.back() << " us" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "domain_index.h"
+#include <chrono>
+#include <iostream>
+
+//! Reverse queries over a database file, for audits:
+//!     domaindb-query <db.json> category <category>              - domains with a port range of a category
+//!     domaindb-query <db.json> port <tcp|udp> <port> [all]      - port ranges containing a port; "all" includes
+//!                                                                 ranges covering every port
+//!     domaindb-query <db.json> under <domain>                   - the domain and the domains under it;
+//!                                                                 *.domain for the domains under it only
+//! Results go to stdout, one per line; the index build and query times go to stderr.
+
+using Clock = std::chrono::steady_clock;
+
+//! Milliseconds elapsed since start
+static double milliseconds_since( Clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+//! Run a query
+static int query( const DomainIndex& domain_index, int argc, char* argv[] )
+{
+    std::string command = argv[2];
+    size_t results = 0;
+    auto start = Clock::now();
+
+    if ( (command == "category") && (argc == 4) )
+    {
+        MultiConnectionType category;
+        if ( !from_string(argv[3], &category) )
+        {
+            std::cerr << "unknown category " << argv[3] << std::endl;
+            return 2;
+        }
+        domain_index.find_category( category, [&]( std::string_view domain_name )
+        {
+            std::cout << domain_name << '\n';
+            ++results;
+        } );
+    }
+    else if ( (command == "port") && ((argc == 5) || ((argc == 6) && (std::string(argv[5]) == "all"))) )
+    {
+        auto protocol_type = (std::string(argv[3]) == "udp") ? ProtocolType::UDP : ProtocolType::TCP;
+        domain_index.find_port( uint16_t(std::stoul(argv[4])), protocol_type, argc == 6,
+                                [&]( std::string_view domain_name, const DomainIndex::PortRange& port_range )
+        {
+            std::cout << domain_name << ' ' << port_range.first_port << '-' << port_range.last_port << ' '
+                      << to_string( port_range.category ) << '\n';
+            ++results;
+        } );
+    }
+    else if ( (command == "under") && (argc == 4) )
+    {
+        domain_index.find_suffix( argv[3], [&]( std::string_view domain_name )
+        {
+            std::cout << domain_name << '\n';
+            ++results;
+        } );
+    }
+    else return -1;
+
+    std::cout.flush();
+    std::cerr << results << " results in " << milliseconds_since(start) << " ms" << std::endl;
+    return 0;
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( argc >= 4 )
+    {
+        DomainTree domain_tree( argv[1] );
+        const auto& report = domain_tree.load_report();
+        if ( !report.error.empty() )
+        {
+            std::cerr << argv[1] << ": " << report.error << std::endl;
+            return 1;
+        }
+
+        auto start = Clock::now();
+        DomainIndex domain_index( domain_tree );
+        std::cerr << "indexed " << domain_index.size() << " domains in " << milliseconds_since(start) << " ms" << std::endl;
+
+        auto result = query( domain_index, argc, argv );
+        if ( result >= 0 ) return result;
+    }
+
+    std::cerr << "usage: " << argv[0] << " <db.json> category <category>" << std::endl
+              << "       " << argv[0] << " <db.json> port <tcp|udp> <port> [all]" << std::endl
+              << "       " << argv[0] << " <db.json> under <domain>" << std::endl;
+    return 2;
+}
@@ -0,0 +1,65 @@
+#include "lookup_service.h"
+#include <csignal>
+#include <iostream>
+
+//! Serve lookups over a Unix domain socket to tools that cannot link the library, see LookupProtocol:
+//!     domaindb-server <db.json> <socket path> [threads]
+//! SIGHUP reloads the database file, the current database serves until the new one is loaded.
+//! SIGINT and SIGTERM stop the server.
+
+//! Load the database file and make it current
+static bool load( DomainLoader& loader, const std::string& filename )
+{
+    if ( !loader.reload(filename).get() )
+    {
+        std::cerr << filename << ": the database did not load" << std::endl;
+        return false;
+    }
+    auto domain_tree = loader.current();
+    std::cerr << "loaded " << domain_tree->size() << " domains, " << domain_tree->load_report().rejected_count << " rejected entries"
+              << std::endl;
+    return true;
+}
+
+int main( int argc, char* argv[] )
+{
+    if ( (argc != 3) && (argc != 4) )
+    {
+        std::cerr << "usage: " << argv[0] << " <db.json> <socket path> [threads]" << std::endl;
+        return 2;
+    }
+    std::string filename = argv[1];
+
+    // The signals are taken by sigwait below; the threads started from here on inherit the mask
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGHUP );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+
+    DomainLoader loader;
+    if ( !load(loader, filename) ) return 1;
+
+    LookupServer::Options options;
+    options.threads = (argc == 4) ? unsigned( std::stoul(argv[3]) ) : 0;
+    LookupServer server( loader, options );
+    std::string error;
+    if ( !server.start(argv[2], &error) )
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cerr << "listening on " << argv[2] << std::endl;
+
+    for ( int signal = 0; signal != SIGINT && signal != SIGTERM; )
+    {
+        if ( sigwait(&signals, &signal) != 0 ) break;
+        if ( signal == SIGHUP ) load( loader, filename );
+    }
+    server.stop();
+
+    auto stats = server.stats();
+    std::cerr << stats.connections << " connections, " << stats.requests << " requests, " << stats.lookups << " lookups" << std::endl;
+    return 0;
+}
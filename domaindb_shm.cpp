@@ -0,0 +1,86 @@
+#include "shared_db.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+//! Publish a database to shared memory for classifier workers, or look up domains in it like a worker:
+//!     domaindb-shm publish <name> <db.json>                       - compile and publish the next generation
+//!     domaindb-shm lookup <name> <domain> <port> <tcp|udp>        - classify one domain
+//!     domaindb-shm watch <name>                                    - print every new generation
+//!     domaindb-shm unlink <name>                                   - remove the database
+//! Names are POSIX shared memory names such as /domaindb.
+
+//! Compile a database file and publish it
+static int publish( const std::string& name, const std::string& filename )
+{
+    DomainTree domain_tree( filename );
+    const auto& report = domain_tree.load_report();
+    if ( !report.error.empty() )
+    {
+        std::cerr << filename << ": " << report.error << std::endl;
+        return 1;
+    }
+    if ( report.rejected_count != 0 ) std::cerr << filename << ": " << report.rejected_count << " rejected entries" << std::endl;
+
+    uint64_t generation;
+    std::string error;
+    if ( !SharedDb::publish(name, domain_tree, &generation, &error) )
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    std::cerr << "published " << domain_tree.size() << " domains as generation " << generation << " of " << name << std::endl;
+    return 0;
+}
+
+//! Classify one domain in a shared database
+static int lookup( const std::string& name, const std::string& domain, const std::string& port, const std::string& protocol )
+{
+    SharedDb shared_db( name );
+    std::string error;
+    if ( !shared_db.refresh(&error) )
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    auto protocol_type = (protocol == "udp") ? ProtocolType::UDP : ProtocolType::TCP;
+    std::cout << to_string( shared_db.match_domain(domain, uint16_t(std::stoul(port)), protocol_type) )
+              << " (generation " << shared_db.generation() << ", " << shared_db.size() << " domains)" << std::endl;
+    return 0;
+}
+
+//! Print every new generation of a shared database, as a worker would pick it up
+static int watch( const std::string& name )
+{
+    SharedDb shared_db( name );
+    uint64_t generation = 0;
+    for ( ;; )
+    {
+        std::string error;
+        if ( !shared_db.refresh(&error) ) std::cerr << error << std::endl;
+        if ( shared_db.generation() != generation )
+        {
+            generation = shared_db.generation();
+            std::cout << "generation " << generation << ", " << shared_db.size() << " domains" << std::endl;
+        }
+        std::this_thread::sleep_for( std::chrono::seconds(1) );
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    std::string command = (argc > 1) ? argv[1] : "";
+
+    if ( (command == "publish") && (argc == 4) ) return publish( argv[2], argv[3] );
+    if ( (command == "lookup") && (argc == 6) ) return lookup( argv[2], argv[3], argv[4], argv[5] );
+    if ( (command == "watch") && (argc == 3) ) return watch( argv[2] );
+    if ( (command == "unlink") && (argc == 3) ) return SharedDb::unlink( argv[2] ) ? 0 : 1;
+
+    std::cerr << "usage: " << argv[0] << " publish <name> <db.json>" << std::endl
+              << "       " << argv[0] << " lookup <name> <domain> <port> <tcp|udp>" << std::endl
+              << "       " << argv[0] << " watch <name>" << std::endl
+              << "       " << argv[0] << " unlink <name>" << std::endl;
+    return 2;
+}
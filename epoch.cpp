@@ -0,0 +1,150 @@
+#include "epoch.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Reader slot of the calling thread and guard nesting depth
+struct EpochThreadSlot
+{
+    Epoch::ReaderSlot*  slot = nullptr;
+    unsigned            depth = 0;
+
+    ~EpochThreadSlot()
+    {
+        if ( slot != nullptr ) Epoch::instance().release_slot( slot );
+    }
+};
+
+static thread_local EpochThreadSlot thread_slot;
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Enter a read-side critical section
+Epoch::Guard::Guard()
+{
+    if ( thread_slot.depth++ != 0 ) return;
+
+    auto& epoch = Epoch::instance();
+    if ( thread_slot.slot == nullptr ) thread_slot.slot = epoch.acquire_slot();
+
+    // seq_cst: the slot must be visible to writers before any pointer of the structure is read
+    thread_slot.slot->epoch.store( epoch.global_epoch_.load() );
+}
+
+//! Leave a read-side critical section
+Epoch::Guard::~Guard()
+{
+    if ( --thread_slot.depth != 0 ) return;
+    thread_slot.slot->epoch.store( 0, std::memory_order_release );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! The process-wide reclamation domain
+Epoch& Epoch::instance()
+{
+    static Epoch epoch;
+    return epoch;
+}
+
+//! Free what is left at process exit; no readers remain
+Epoch::~Epoch()
+{
+    for ( const auto& retired : retired_ ) retired.deleter( retired.object );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Schedule an unlinked object for deletion with a custom deleter
+void Epoch::retire( void* object, void (*deleter)(void*) )
+{
+    // Readers that enter from now on cannot reach the object: tag it with the epoch before the increment
+    auto epoch = global_epoch_.fetch_add( 1 );
+
+    std::lock_guard<std::mutex> lock( retired_mutex_ );
+    retired_.push_back( Retired{object, deleter, epoch} );
+    if ( retired_.size() >= reclaim_at_ ) reclaim_locked();
+}
+
+//! Delete all retired objects that no reader can reference any more
+void Epoch::reclaim()
+{
+    std::lock_guard<std::mutex> lock( retired_mutex_ );
+    reclaim_locked();
+}
+
+//! Number of retired objects waiting for deletion
+size_t Epoch::pending() const
+{
+    std::lock_guard<std::mutex> lock( retired_mutex_ );
+    return retired_.size();
+}
+
+//! Delete retired objects older than the oldest active reader
+void Epoch::reclaim_locked()
+{
+    auto oldest = std::numeric_limits<uint64_t>::max();
+    auto used = slots_used_.load();
+    for ( size_t i = 0; i < used; ++i )
+    {
+        auto epoch = slots_[i].epoch.load();
+        if ( epoch != 0 ) oldest = std::min( oldest, epoch );
+    }
+
+    auto first_kept = std::partition( retired_.begin(), retired_.end(),
+                                      [oldest]( const Retired& retired ) { return retired.epoch < oldest; } );
+    for ( auto it = retired_.begin(); it != first_kept; ++it ) it->deleter( it->object );
+    retired_.erase( retired_.begin(), first_kept );
+
+    // A long reader keeps what it may reference: reclaim again once the backlog has doubled, so that retire()
+    // stays amortized constant instead of scanning the backlog on every call
+    reclaim_at_ = std::max( kReclaimThreshold, 2 * retired_.size() );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Claim a reader slot for the calling thread
+Epoch::ReaderSlot* Epoch::acquire_slot()
+{
+    // Reuse a slot released by an exited thread first
+    auto used = slots_used_.load();
+    for ( size_t i = 0; i < used; ++i )
+    {
+        bool expected = false;
+        if ( slots_[i].in_use.compare_exchange_strong(expected, true) ) return &slots_[i];
+    }
+
+    while ( true )
+    {
+        auto index = slots_used_.load();
+        if ( index >= kMaxReaders ) throw std::runtime_error( "Epoch: too many reader threads" );
+        bool expected = false;
+        if ( slots_[index].in_use.compare_exchange_strong(expected, true) )
+        {
+            // Publish the slot to reclaim_locked; another thread may have advanced the count already
+            auto count = index;
+            while ( (count <= index) && !slots_used_.compare_exchange_weak(count, index + 1) ) {}
+            return &slots_[index];
+        }
+        slots_used_.compare_exchange_strong( index, index + 1 );
+    }
+}
+
+//! Return a reader slot when its thread exits
+void Epoch::release_slot( ReaderSlot* slot )
+{
+    slot->epoch.store( 0 );
+    slot->in_use.store( false );
+}
@@ -0,0 +1,100 @@
+#ifndef DOMAINDB_EPOCH_H
+#define DOMAINDB_EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Epoch based memory reclamation for structures that are read without locks.
+//!
+//! Readers wrap every traversal in an Epoch::Guard. A writer first unlinks an object so that no new
+//! reader can reach it, then retires it; the object is deleted once every reader that entered before
+//! the unlink has left its guard. Entering a guard costs one store to a per-thread cache line.
+class Epoch
+{
+public:
+
+    //! Maximum number of threads that can hold a guard at the same time
+    static const size_t kMaxReaders = 1024;
+
+    //! Read-side critical section. Guards may be nested.
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+        Guard( const Guard& ) = delete;
+        Guard& operator=( const Guard& ) = delete;
+    };
+
+    //! The process-wide reclamation domain
+    static Epoch& instance();
+
+    //! Schedule an unlinked object for deletion
+    //!
+    //! \param object - object that is no longer reachable by new readers
+    template <typename T>
+    void retire( const T* object )
+    {
+        if ( object != nullptr ) retire( const_cast<T*>(object), [](void* p) { delete static_cast<T*>(p); } );
+    }
+
+    //! Schedule an unlinked object for deletion with a custom deleter
+    void retire( void* object, void (*deleter)(void*) );
+
+    //! Delete all retired objects that no reader can reference any more
+    void reclaim();
+
+    //! Number of retired objects waiting for deletion
+    size_t pending() const;
+
+private:
+
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t>   epoch{0};       //!< epoch the reader entered in, 0 if outside a guard
+        std::atomic<bool>       in_use{false};  //!< slot is owned by a thread
+    };
+
+    struct Retired
+    {
+        void*       object;
+        void        (*deleter)(void*);
+        uint64_t    epoch;
+    };
+
+    //! Retired objects that make retire() reclaim, at least
+    static const size_t kReclaimThreshold = 64;
+
+    alignas(64) std::atomic<uint64_t>   global_epoch_{1};
+    std::atomic<size_t>                 slots_used_{0};
+    ReaderSlot                          slots_[kMaxReaders];
+
+    mutable std::mutex                  retired_mutex_;
+    std::vector<Retired>                retired_;
+    size_t                              reclaim_at_ = kReclaimThreshold;    //!< size of retired_ that makes retire() reclaim
+
+    Epoch() = default;
+    ~Epoch();
+
+    friend class Guard;
+    friend struct EpochThreadSlot;
+
+    //! Claim a reader slot for the calling thread
+    //! \throws std::runtime_error if more than kMaxReaders threads hold slots
+    ReaderSlot* acquire_slot();
+
+    //! Return a reader slot when its thread exits
+    void release_slot( ReaderSlot* slot );
+
+    //! Delete retired objects older than the oldest active reader; retired_mutex_ must be held
+    void reclaim_locked();
+};
+
+#endif //DOMAINDB_EPOCH_H
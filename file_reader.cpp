@@ -0,0 +1,538 @@
+#include "file_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define DOMAINDB_HAVE_IO_URING 1
+#endif
+
+//! Alignment of the buffer and of O_DIRECT reads
+static const size_t kPageSize = 4096;
+
+//! Decompressed content is made available to the caller at least every kPublishBytes
+static const size_t kPublishBytes = 1 << 20;
+
+//! The reserved content address space is made writable kCommitBytes at a time
+static const size_t kCommitBytes = 64 << 20;
+
+//! Round a size up to a multiple of kPageSize
+static size_t round_to_page( size_t size )
+{
+    return (size + kPageSize - 1) & ~(kPageSize - 1);
+}
+
+//! Size of the chunks a file is read in: Options::chunk_size rounded up to whole pages, at least one, so
+//! that every read of O_DIRECT starts on a page and every chunk advances
+static size_t chunk_size_of( size_t chunk_size )
+{
+    return std::max( round_to_page(chunk_size), kPageSize );
+}
+
+//! Describe the last system call error
+static std::string system_error( const std::string& message )
+{
+    return message + ": " + std::strerror( errno );
+}
+
+void FileReader::FreeBuffer::operator()( char* buffer ) const
+{
+    std::free( buffer );
+}
+
+void FileReader::Unmap::operator()( char* address ) const
+{
+    munmap( address, size );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Create a reader
+FileReader::FileReader( const Options& options ) :
+    options_(options)
+{
+}
+
+//! Stop reading and wait for the background threads
+FileReader::~FileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        stop_.store( true, std::memory_order_relaxed );
+    }
+    advanced_.notify_all();
+    if ( thread_.joinable() ) thread_.join();
+    if ( decompress_thread_.joinable() ) decompress_thread_.join();
+    if ( fd_ >= 0 ) close( fd_ );
+}
+
+//! Open a file and start reading it in the background
+bool FileReader::open( const std::string& filename, std::string* error )
+{
+    filename_ = filename;
+
+    fd_ = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd_ < 0 )
+    {
+        *error = system_error( "cannot open " + filename );
+        return false;
+    }
+
+    struct stat file_stat;
+    if ( fstat(fd_, &file_stat) != 0 )
+    {
+        *error = system_error( "cannot stat " + filename );
+        return false;
+    }
+    if ( !S_ISREG(file_stat.st_mode) )
+    {
+        *error = filename + " is not a regular file";
+        return false;
+    }
+    if ( file_stat.st_size == 0 )
+    {
+        *error = filename + " is empty";
+        return false;
+    }
+    file_size_ = size_t( file_stat.st_size );
+
+    char magic[4];
+    auto magic_size = pread( fd_, magic, sizeof magic, 0 );
+    format_ = Decompressor::detect( magic, (magic_size > 0) ? size_t(magic_size) : 0 );
+    if ( format_ != Decompressor::Format::none )
+    {
+        decompressor_ = Decompressor::create( format_, error );
+        if ( !decompressor_ )
+        {
+            *error = filename + ": " + *error;
+            return false;
+        }
+
+        // Reserved address space costs no memory until commit_content() makes it writable
+        auto reserved = round_to_page( std::max(options_.max_content, kPageSize) );
+        auto address = mmap( nullptr, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        if ( address == MAP_FAILED )
+        {
+            *error = system_error( "cannot reserve address space to decompress " + filename );
+            return false;
+        }
+        content_ = std::unique_ptr<char[], Unmap>( static_cast<char*>(address), Unmap{reserved} );
+    }
+
+    // O_DIRECT is refused by some file systems, such as tmpfs; read through the page cache there
+    if ( options_.direct )
+    {
+        auto direct_fd = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT );
+        direct_ = (direct_fd >= 0);
+        if ( direct_ )
+        {
+            close( fd_ );
+            fd_ = direct_fd;
+        }
+    }
+
+    buffer_.reset( static_cast<char*>(std::aligned_alloc(kPageSize, round_to_page(file_size_))) );
+    if ( !buffer_ )
+    {
+        *error = "cannot allocate " + std::to_string(file_size_) + " bytes to read " + filename;
+        return false;
+    }
+
+    posix_fadvise( fd_, 0, 0, POSIX_FADV_SEQUENTIAL );
+    start_ = std::chrono::steady_clock::now();
+    thread_ = std::thread( [this]() { run(); } );
+    if ( compressed() ) decompress_thread_ = std::thread( [this]() { decompress(); } );
+    return true;
+}
+
+//! Wait until bytes of the file are read, or until reading stops
+size_t FileReader::wait_for( size_t bytes )
+{
+    auto ready = ready_.load( std::memory_order_acquire );
+    if ( ready >= bytes ) return ready;
+
+    std::unique_lock<std::mutex> lock( mutex_ );
+    advanced_.wait( lock, [&]() { return done_ || (ready_.load(std::memory_order_acquire) >= bytes); } );
+    return ready_.load( std::memory_order_acquire );
+}
+
+//! Wait until the whole file is read
+bool FileReader::finish( std::string* error )
+{
+    if ( thread_.joinable() ) thread_.join();
+    if ( decompress_thread_.joinable() ) decompress_thread_.join();
+    if ( error_.empty() && (compressed() || (ready_.load() == file_size_)) ) return true;
+
+    *error = error_.empty() ? ("cannot read " + filename_) : error_;
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Body of the background thread
+void FileReader::run()
+{
+    std::string error;
+    std::string method = "io_uring";
+    if ( !options_.io_uring || !read_io_uring(&error) )
+    {
+        method = direct_ ? "pread O_DIRECT" : "pread";
+        read_pread( 0, &error );
+    }
+
+    if ( compressed() ) method = method + ", " + Decompressor::name( format_ );
+    method_ = std::move( method );
+    end( std::move(error) );
+}
+
+//! Body of the decompression thread
+void FileReader::decompress()
+{
+    std::string error;
+    size_t consumed = 0;    // bytes of the file decompressed
+    size_t ready = 0;       // bytes of content decompressed
+    size_t tried = 0;       // bytes of the file read when the decompressor last ran out of input
+
+    for ( bool ended = false; !ended && error.empty(); )
+    {
+        size_t read;
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+            advanced_.wait( lock, [&]() { return read_done_ || stop_.load() || (read_.load() > tried); } );
+            read = read_.load();
+            ended = read_done_;
+        }
+        if ( stop_.load(std::memory_order_relaxed) ) break;
+
+        // Decompress all that was read, publishing the content a step at a time
+        for ( bool progress = true; progress && error.empty(); )
+        {
+            if ( (ready == committed_) && !commit_content(&error) ) break;
+
+            const char* input = buffer_.get() + consumed;
+            size_t input_size = read - consumed;
+            char* output = content_.get() + ready;
+            size_t output_size = std::min( committed_ - ready, kPublishBytes );
+            if ( !decompressor_->decompress(&input, &input_size, &output, &output_size, &error) ) break;
+
+            progress = (read - consumed != input_size) || (output != content_.get() + ready);
+            consumed = read - input_size;
+            if ( output != content_.get() + ready )
+            {
+                ready = size_t( output - content_.get() );
+                std::lock_guard<std::mutex> lock( mutex_ );
+                ready_.store( ready, std::memory_order_release );
+            }
+            if ( progress ) advanced_.notify_all();
+        }
+        tried = read;
+
+        if ( ended && error.empty() && ((consumed < read) || !decompressor_->at_end()) )
+        {
+            error = filename_ + " is truncated: the compressed data ends early";
+        }
+    }
+
+    end_content( ready, std::move(error) );
+}
+
+//! Make more of the reserved content writable
+bool FileReader::commit_content( std::string* error )
+{
+    auto reserved = content_.get_deleter().size;
+    auto committed = std::min( committed_ + kCommitBytes, reserved );
+    if ( committed == committed_ )
+    {
+        *error = filename_ + " decompresses to more than " + std::to_string(reserved) + " bytes";
+        return false;
+    }
+    if ( mprotect(content_.get() + committed_, committed - committed_, PROT_READ | PROT_WRITE) != 0 )
+    {
+        *error = system_error( "cannot allocate memory to decompress " + filename_ );
+        return false;
+    }
+    committed_ = committed;
+    return true;
+}
+
+//! Read with pread from an offset to the end of the file
+void FileReader::read_pread( size_t offset, std::string* error )
+{
+    const auto chunk_size = chunk_size_of( options_.chunk_size );
+    while ( (offset < file_size_) && !stop_.load(std::memory_order_relaxed) )
+    {
+        auto end = std::min( offset + chunk_size, file_size_ );
+        if ( !read_range(offset, end, error) ) return;
+        offset = end;
+        advance( offset );
+    }
+}
+
+//! Read a range of the file with pread
+bool FileReader::read_range( size_t offset, size_t end, std::string* error )
+{
+    while ( offset < end )
+    {
+        // O_DIRECT needs whole pages; the buffer is large enough for the last one
+        auto length = direct_ ? round_to_page( end - offset ) : (end - offset);
+        auto result = pread( fd_, buffer_.get() + offset, length, off_t(offset) );
+        if ( (result < 0) && (errno == EINTR) ) continue;
+        if ( result < 0 )
+        {
+            *error = system_error( "cannot read " + filename_ + " at byte " + std::to_string(offset) );
+            return false;
+        }
+        if ( result == 0 )
+        {
+            *error = filename_ + " is truncated: it ended at byte " + std::to_string(offset) + " of " + std::to_string(file_size_);
+            return false;
+        }
+        offset += size_t( result );
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef DOMAINDB_HAVE_IO_URING
+
+//! A minimal io_uring set up with raw system calls
+struct IoUring
+{
+    int                         fd = -1;
+    void*                       sq_ring = MAP_FAILED;
+    size_t                      sq_ring_size = 0;
+    void*                       cq_ring = MAP_FAILED;
+    size_t                      cq_ring_size = 0;
+    io_uring_sqe*               sqes = static_cast<io_uring_sqe*>( MAP_FAILED );
+    size_t                      sqes_size = 0;
+
+    std::atomic<unsigned>*      sq_tail = nullptr;
+    unsigned                    sq_mask = 0;
+    unsigned*                   sq_array = nullptr;
+    std::atomic<unsigned>*      cq_head = nullptr;
+    std::atomic<unsigned>*      cq_tail = nullptr;
+    unsigned                    cq_mask = 0;
+    io_uring_cqe*               cqes = nullptr;
+
+    //! Create a ring with room for entries submissions
+    bool setup( unsigned entries )
+    {
+        io_uring_params params;
+        std::memset( &params, 0, sizeof params );
+        fd = int( syscall(__NR_io_uring_setup, entries, &params) );
+        if ( fd < 0 ) return false;
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if ( single_mmap ) sq_ring_size = cq_ring_size = std::max( sq_ring_size, cq_ring_size );
+
+        sq_ring = mmap( nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+        if ( sq_ring == MAP_FAILED ) return false;
+        cq_ring = single_mmap ? sq_ring : mmap( nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                fd, IORING_OFF_CQ_RING );
+        if ( cq_ring == MAP_FAILED ) return false;
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>( mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                fd, IORING_OFF_SQES) );
+        if ( sqes == MAP_FAILED ) return false;
+
+        auto sq = static_cast<char*>( sq_ring );
+        auto cq = static_cast<char*>( cq_ring );
+        sq_tail = reinterpret_cast<std::atomic<unsigned>*>( sq + params.sq_off.tail );
+        sq_mask = *reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+        sq_array = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+        cq_head = reinterpret_cast<std::atomic<unsigned>*>( cq + params.cq_off.head );
+        cq_tail = reinterpret_cast<std::atomic<unsigned>*>( cq + params.cq_off.tail );
+        cq_mask = *reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+        cqes = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+        return true;
+    }
+
+    //! Queue a read; the caller keeps the number of reads in flight within the ring size
+    void queue_read( int file, char* buffer, unsigned length, uint64_t offset, uint64_t user_data )
+    {
+        auto tail = sq_tail->load( std::memory_order_relaxed );
+        auto index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        std::memset( &sqe, 0, sizeof sqe );
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = reinterpret_cast<uint64_t>( buffer );
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        sq_tail->store( tail + 1, std::memory_order_release );
+    }
+
+    //! Submit the queued reads and wait for at least one completion
+    int enter( unsigned to_submit )
+    {
+        return int( syscall(__NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) );
+    }
+
+    ~IoUring()
+    {
+        if ( sqes != MAP_FAILED ) munmap( sqes, sqes_size );
+        if ( (cq_ring != MAP_FAILED) && (cq_ring != sq_ring) ) munmap( cq_ring, cq_ring_size );
+        if ( sq_ring != MAP_FAILED ) munmap( sq_ring, sq_ring_size );
+        if ( fd >= 0 ) close( fd );
+    }
+};
+
+static_assert( sizeof(std::atomic<unsigned>) == sizeof(unsigned), "the ring indexes are shared with the kernel" );
+
+//! Read with io_uring
+bool FileReader::read_io_uring( std::string* error )
+{
+    IoUring ring;
+    auto depth = std::max( 1u, options_.queue_depth );
+    if ( !ring.setup(depth) ) return false;
+
+    const auto chunk_size = chunk_size_of( options_.chunk_size );
+    const auto chunks = (file_size_ + chunk_size - 1) / chunk_size;
+    std::vector<bool> complete( chunks, false );
+    size_t next_chunk = 0;
+    size_t complete_prefix = 0;
+    unsigned in_flight = 0;
+    bool any_read = false;
+    bool unsupported = false;
+
+    while ( (complete_prefix < chunks) && error->empty() && !unsupported && !stop_.load(std::memory_order_relaxed) )
+    {
+        unsigned to_submit = 0;
+        for ( ; (in_flight < depth) && (next_chunk < chunks); ++next_chunk, ++in_flight, ++to_submit )
+        {
+            // O_DIRECT needs whole pages; the buffer is large enough for the last one
+            auto offset = next_chunk * chunk_size;
+            auto length = std::min( chunk_size, direct_ ? round_to_page(file_size_ - offset) : (file_size_ - offset) );
+            ring.queue_read( fd_, buffer_.get() + offset, unsigned(length), offset, next_chunk );
+        }
+
+        if ( ring.enter(to_submit) < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            if ( in_flight == to_submit ) in_flight = 0; // Nothing was accepted
+            unsupported = !any_read;
+            if ( !unsupported ) *error = system_error( "io_uring read of " + filename_ + " failed" );
+            break;
+        }
+
+        auto head = ring.cq_head->load( std::memory_order_relaxed );
+        auto tail = ring.cq_tail->load( std::memory_order_acquire );
+        for ( ; head != tail; ++head )
+        {
+            const auto& cqe = ring.cqes[head & ring.cq_mask];
+            auto chunk = size_t( cqe.user_data );
+            auto offset = chunk * chunk_size;
+            auto end = std::min( offset + chunk_size, file_size_ );
+            --in_flight;
+
+            if ( cqe.res < 0 )
+            {
+                // Kernels before 5.6 have io_uring without IORING_OP_READ: read with pread instead
+                unsupported = !any_read && ((cqe.res == -EINVAL) || (cqe.res == -EOPNOTSUPP));
+                errno = -cqe.res;
+                if ( !unsupported && error->empty() )
+                {
+                    *error = system_error( "cannot read " + filename_ + " at byte " + std::to_string(offset) );
+                }
+                continue;
+            }
+
+            // A short read before the end of the range is finished synchronously
+            any_read = true;
+            if ( (offset + size_t(cqe.res) < end) && error->empty() ) read_range( offset + size_t(cqe.res), end, error );
+            complete[chunk] = true;
+        }
+        ring.cq_head->store( head, std::memory_order_release );
+
+        while ( (complete_prefix < chunks) && complete[complete_prefix] ) ++complete_prefix;
+        if ( error->empty() ) advance( std::min(complete_prefix * chunk_size, file_size_) );
+    }
+
+    // Reads still in flight write into buffer_: wait for them before the ring and the buffer go away
+    while ( in_flight > 0 )
+    {
+        if ( (ring.enter(0) < 0) && (errno != EINTR) ) break;
+        auto head = ring.cq_head->load( std::memory_order_relaxed );
+        auto tail = ring.cq_tail->load( std::memory_order_acquire );
+        in_flight -= (tail - head);
+        ring.cq_head->store( tail, std::memory_order_release );
+    }
+
+    return !unsupported;
+}
+
+#else
+
+//! Read with io_uring: not available in this build
+bool FileReader::read_io_uring( std::string* )
+{
+    return false;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Publish the number of bytes read from the start of the file
+void FileReader::advance( size_t read )
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        read_.store( read, std::memory_order_release );
+        if ( !compressed() ) ready_.store( read, std::memory_order_release );
+    }
+    advanced_.notify_all();
+}
+
+//! End reading the file
+void FileReader::end( std::string error )
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( error_.empty() ) error_ = std::move( error );
+        read_done_ = true;
+        if ( !compressed() )
+        {
+            read_time_ = std::chrono::steady_clock::now() - start_;
+            done_ = true;
+        }
+    }
+    advanced_.notify_all();
+}
+
+//! End decompressing
+void FileReader::end_content( size_t ready, std::string error )
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( error_.empty() ) error_ = std::move( error );
+        ready_.store( ready, std::memory_order_release );
+        read_time_ = std::chrono::steady_clock::now() - start_;
+        done_ = true;
+
+        // Reading the rest of a file that cannot be decompressed is useless
+        if ( !error_.empty() ) stop_.store( true, std::memory_order_relaxed );
+    }
+    advanced_.notify_all();
+}
@@ -0,0 +1,178 @@
+#ifndef DOMAINDB_FILE_READER_H
+#define DOMAINDB_FILE_READER_H
+
+#include "decompressor.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Reads a whole file into memory on a background thread, so that the caller can parse the beginning of the
+//! file while the rest is read.
+//!
+//! The file is read with large reads straight into one page aligned buffer of the file size: through
+//! io_uring with several reads in flight where the kernel supports it, otherwise with pread. The bytes
+//! are read as they are; nothing stops at a 0x00 or 0xFF byte. A file that ends before the size it had
+//! when it was opened is reported as truncated.
+//!
+//! A gzip or zstd file is recognized by its first bytes and decompressed on a second thread as it is read;
+//! the content is then the decompressed bytes, which the caller parses while the rest is decompressed.
+//! The content goes to address space reserved up front, so data() does not move as it grows.
+class FileReader
+{
+public:
+
+    struct Options
+    {
+        size_t      chunk_size = 4 << 20;           //!< size of one read, rounded up to a multiple of 4096
+        unsigned    queue_depth = 4;                //!< io_uring reads in flight
+        bool        io_uring = true;                //!< use io_uring if available, otherwise pread
+        bool        direct = false;                 //!< bypass the page cache with O_DIRECT where the file system allows it
+        size_t      max_content = size_t(64) << 30; //!< largest decompressed content, reserved as address space
+    };
+
+    //! Create a reader
+    //!
+    //! \param options - read options
+    explicit FileReader( const Options& options );
+    FileReader() : FileReader( Options() ) {}
+
+    //! Stop reading and wait for the background thread
+    ~FileReader();
+
+    FileReader( const FileReader& ) = delete;
+    FileReader& operator=( const FileReader& ) = delete;
+
+    //! Open a file and start reading it in the background
+    //!
+    //! \param filename - path and name of the file
+    //! \param error    - receives a description of the problem on failure
+    //! \return true if the file is open and reading started, false otherwise
+    bool open( const std::string& filename, std::string* error );
+
+    //! Size of the file when it was opened
+    size_t file_size() const { return file_size_; }
+
+    //! Size of the content: the file size, or the decompressed size once finish() succeeded
+    size_t size() const { return compressed() ? ready_.load() : file_size_; }
+
+    //! True if the file is compressed
+    bool compressed() const { return decompressor_ != nullptr; }
+
+    //! The content. Only the first bytes reported by wait_for() are valid.
+    const char* data() const { return compressed() ? content_.get() : buffer_.get(); }
+
+    //! Wait until bytes of the content are read, or until reading stops
+    //!
+    //! \param bytes - number of bytes from the start of the content
+    //! \return the number of bytes read so far; less than requested only if the read ended or failed
+    size_t wait_for( size_t bytes );
+
+    //! Wait until the whole file is read
+    //!
+    //! \param error - receives a description of the problem on failure
+    //! \return true if the whole file was read, false otherwise
+    bool finish( std::string* error );
+
+    //! Time spent reading, and decompressing if the file is compressed, valid after finish()
+    std::chrono::nanoseconds read_time() const { return read_time_; }
+
+    //! How the file was read: "io_uring", "pread" or "pread O_DIRECT", followed by ", gzip" or ", zstd" for
+    //! a compressed file, valid after finish()
+    const std::string& method() const { return method_; }
+
+private:
+
+    struct FreeBuffer
+    {
+        void operator()( char* buffer ) const;
+    };
+
+    //! Releases the address space reserved for the decompressed content
+    struct Unmap
+    {
+        size_t size;
+        void operator()( char* address ) const;
+    };
+
+    const Options                           options_;
+    std::string                             filename_;
+    int                                     fd_ = -1;
+    bool                                    direct_ = false;
+    size_t                                  file_size_ = 0;
+    std::unique_ptr<char[], FreeBuffer>     buffer_;        //!< the file
+    Decompressor::Format                    format_ = Decompressor::Format::none;
+    std::unique_ptr<Decompressor>           decompressor_;  //!< nullptr if the file is not compressed
+    std::unique_ptr<char[], Unmap>          content_;       //!< the decompressed content
+    size_t                                  committed_ = 0; //!< bytes of content_ made writable
+
+    std::thread                             thread_;
+    std::thread                             decompress_thread_;
+    std::atomic<size_t>                     read_{0};       //!< bytes read from the start of the file
+    std::atomic<size_t>                     ready_{0};      //!< bytes of the content ready
+    std::atomic<bool>                       stop_{false};   //!< set by the destructor to end reading early
+    bool                                    read_done_ = false; //!< reading the file ended, guarded by mutex_
+    bool                                    done_ = false;  //!< reading the content ended, guarded by mutex_
+    std::string                             error_;         //!< why reading failed, guarded by mutex_
+    std::mutex                              mutex_;
+    std::condition_variable                 advanced_;
+
+    std::chrono::steady_clock::time_point   start_;
+    std::chrono::nanoseconds                read_time_{0};
+    std::string                             method_;
+
+    //! Body of the background thread
+    void run();
+
+    //! Body of the decompression thread
+    void decompress();
+
+    //! Make more of the reserved content writable
+    //!
+    //! \param error - receives a description of the problem on failure
+    //! \return false if the content would be larger than Options::max_content or memory is short
+    bool commit_content( std::string* error );
+
+    //! Read with io_uring
+    //!
+    //! \param error - receives a description of the problem if reading failed
+    //! \return false if io_uring is not available here and nothing was read, true if reading ended
+    bool read_io_uring( std::string* error );
+
+    //! Read with pread from an offset to the end of the file
+    //!
+    //! \param error - receives a description of the problem if reading failed
+    void read_pread( size_t offset, std::string* error );
+
+    //! Read a range of the file with pread, used as well to finish a short io_uring read
+    //!
+    //! \param offset - start of the range
+    //! \param end    - end of the range, at most the file size
+    //! \param error  - receives a description of the problem if reading failed
+    //! \return true if the whole range was read
+    bool read_range( size_t offset, size_t end, std::string* error );
+
+    //! Publish the number of bytes read from the start of the file
+    void advance( size_t read );
+
+    //! End reading the file
+    //!
+    //! \param error - why reading failed, empty on success
+    void end( std::string error );
+
+    //! End decompressing
+    //!
+    //! \param ready - bytes of the content decompressed
+    //! \param error - why decompressing failed, empty on success
+    void end_content( size_t ready, std::string error );
+};
+
+#endif //DOMAINDB_FILE_READER_H
@@ -0,0 +1,205 @@
+#include "idn.h"
+#include <functional>
+
+//! Punycode parameters, RFC 3492 section 5
+static const uint32_t kBase = 36;
+static const uint32_t kTMin = 1;
+static const uint32_t kTMax = 26;
+static const uint32_t kSkew = 38;
+static const uint32_t kDamp = 700;
+static const uint32_t kInitialBias = 72;
+static const uint32_t kInitialN = 0x80;
+
+//! Prefix of the labels in ASCII compatible encoding
+static const char kAcePrefix[] = "xn--";
+
+//! Decode one UTF-8 character
+//!
+//! \param text       - the text
+//! \param pos        - position of the character; advanced past it
+//! \param code_point - receives the character
+//! \return false if the text is not valid UTF-8 at pos
+static bool decode_utf8( std::string_view text, size_t* pos, char32_t* code_point )
+{
+    auto byte = uint8_t( text[*pos] );
+    size_t length;
+    char32_t minimum;
+    char32_t value;
+    if ( byte < 0x80 )
+    {
+        *code_point = byte;
+        ++*pos;
+        return true;
+    }
+    else if ( (byte & 0xE0) == 0xC0 ) { length = 2; minimum = 0x80;    value = byte & 0x1F; }
+    else if ( (byte & 0xF0) == 0xE0 ) { length = 3; minimum = 0x800;   value = byte & 0x0F; }
+    else if ( (byte & 0xF8) == 0xF0 ) { length = 4; minimum = 0x10000; value = byte & 0x07; }
+    else return false;
+
+    if ( *pos + length > text.size() ) return false;
+    for ( size_t i = 1; i < length; ++i )
+    {
+        auto next = uint8_t( text[*pos + i] );
+        if ( (next & 0xC0) != 0x80 ) return false;
+        value = (value << 6) | (next & 0x3F);
+    }
+    if ( (value < minimum) || (value > 0x10FFFF) || ((value >= 0xD800) && (value <= 0xDFFF)) ) return false; // Overlong or not a character
+
+    *pos += length;
+    *code_point = value;
+    return true;
+}
+
+//! Punycode bias adaptation, RFC 3492 section 6.1
+static uint32_t adapt( uint32_t delta, uint32_t points, bool first )
+{
+    delta = first ? delta / kDamp : delta / 2;
+    delta += delta / points;
+
+    uint32_t k = 0;
+    for ( ; delta > ((kBase - kTMin) * kTMax) / 2; k += kBase ) delta /= kBase - kTMin;
+    return k + (kBase - kTMin + 1) * delta / (delta + kSkew);
+}
+
+//! Punycode digit: a-z for 0 to 25, 0-9 for 26 to 35
+static char digit( uint32_t value )
+{
+    return char( (value < 26) ? 'a' + value : '0' + (value - 26) );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Convert a name with non-ASCII characters to its canonical form
+bool Idn::to_ascii( std::string_view name, std::string* ascii )
+{
+    if ( is_ascii(name) ) return false;
+
+    std::string result;
+    result.reserve( name.size() + 16 );
+    std::u32string label;
+    bool unicode_label = false;
+
+    // Append the current label: as it is if it is ASCII, otherwise lowercased and encoded
+    auto append_label = [&]()
+    {
+        if ( unicode_label )
+        {
+            for ( auto& code_point : label )
+            {
+                if ( (code_point >= 'A') && (code_point <= 'Z') ) code_point += 'a' - 'A';
+            }
+            result += kAcePrefix;
+            if ( !encode_label(label, &result) ) return false;
+        }
+        else for ( auto code_point : label ) result += char( code_point );
+
+        label.clear();
+        unicode_label = false;
+        return true;
+    };
+
+    for ( size_t pos = 0; pos < name.size(); )
+    {
+        char32_t code_point;
+        if ( !decode_utf8(name, &pos, &code_point) ) return false;
+
+        if ( (code_point == '.') || (code_point == 0x3002) || (code_point == 0xFF0E) || (code_point == 0xFF61) )
+        {
+            if ( !append_label() ) return false;
+            result += '.';
+        }
+        else
+        {
+            unicode_label |= (code_point >= 0x80);
+            label += code_point;
+        }
+    }
+    if ( !append_label() ) return false;
+
+    *ascii = std::move( result );
+    return true;
+}
+
+//! Append the Punycode encoding of a label to a string, RFC 3492 section 6.3
+bool Idn::encode_label( const std::u32string& label, std::string* output )
+{
+    static const uint32_t kMaxDelta = UINT32_MAX;
+
+    uint32_t handled = 0;
+    for ( auto code_point : label )
+    {
+        if ( code_point < 0x80 )
+        {
+            *output += char( code_point );
+            ++handled;
+        }
+    }
+    auto basic = handled;
+    if ( basic > 0 ) *output += '-';
+
+    uint32_t n = kInitialN;
+    uint32_t delta = 0;
+    uint32_t bias = kInitialBias;
+    while ( handled < label.size() )
+    {
+        // The smallest code point not encoded yet
+        uint32_t next = UINT32_MAX;
+        for ( auto code_point : label )
+        {
+            if ( (code_point >= n) && (code_point < next) ) next = code_point;
+        }
+        if ( (next - n) > (kMaxDelta - delta) / (handled + 1) ) return false;
+        delta += (next - n) * (handled + 1);
+        n = next;
+
+        for ( auto code_point : label )
+        {
+            if ( (code_point < n) && (++delta == 0) ) return false;
+            if ( code_point != n ) continue;
+
+            // Encode delta as a variable length integer
+            auto q = delta;
+            for ( auto k = kBase; ; k += kBase )
+            {
+                auto t = (k <= bias) ? kTMin : (k >= bias + kTMax) ? kTMax : k - bias;
+                if ( q < t ) break;
+                *output += digit( t + (q - t) % (kBase - t) );
+                q = (q - t) / (kBase - t);
+            }
+            *output += digit( q );
+
+            bias = adapt( delta, handled + 1, handled == basic );
+            delta = 0;
+            ++handled;
+        }
+        ++delta;
+        ++n;
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! normalize() of a name with non-ASCII characters
+std::string_view Idn::normalize_cached( std::string_view name )
+{
+    //! A name and its canonical form
+    struct Slot
+    {
+        std::string name;
+        std::string canonical;
+    };
+    static thread_local Slot cache[kCacheSlots];
+
+    auto& slot = cache[std::hash<std::string_view>()( name ) % kCacheSlots];
+    if ( slot.name != name )
+    {
+        slot.name.assign( name.data(), name.size() );
+        if ( !to_ascii(name, &slot.canonical) ) slot.canonical = slot.name;
+    }
+    return slot.canonical;
+}
@@ -0,0 +1,84 @@
+#ifndef DOMAINDB_IDN_H
+#define DOMAINDB_IDN_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Canonical form of internationalized domain names.
+//!
+//! The same host arrives as Unicode (HTTP Host headers, logs) and as ASCII compatible encoding (DNS, SNI):
+//! "bücher.example" and "xn--bcher-kva.example". The database and the lookups use the ASCII form: every
+//! label with a non-ASCII character is encoded with Punycode (RFC 3492) and prefixed with "xn--", after its
+//! ASCII letters are lowercased. The ideographic full stops U+3002, U+FF0E and U+FF61 separate labels like
+//! a dot. Other case mapping and Unicode normalization are left to the producer of the name.
+//!
+//! ASCII names, the vast majority, are canonical already and are detected by a scan of 8 bytes at a time.
+//! Names that are not valid UTF-8 are left as they are.
+class Idn
+{
+public:
+
+    //! True if a name has only ASCII characters, and so is canonical
+    static bool is_ascii( std::string_view name )
+    {
+        static const uint64_t kHighBits = 0x8080808080808080ull;
+
+        // OR all bytes together 8 at a time, the last 8 overlapping the previous ones, and test the high bits once
+        auto data = name.data();
+        auto size = name.size();
+        uint64_t bits = 0;
+        if ( size >= 8 )
+        {
+            uint64_t word;
+            for ( size_t i = 0; i + 8 < size; i += 8 )
+            {
+                std::memcpy( &word, data + i, sizeof word );
+                bits |= word;
+            }
+            std::memcpy( &word, data + size - 8, sizeof word );
+            bits |= word;
+        }
+        else for ( size_t i = 0; i < size; ++i ) bits |= uint8_t( data[i] );
+
+        return (bits & kHighBits) == 0;
+    }
+
+    //! Convert a name with non-ASCII characters to its canonical form
+    //!
+    //! \param name  - the domain name, UTF-8
+    //! \param ascii - receives the canonical name on success
+    //! \return true if the name was converted, false if it is ASCII already or is not valid UTF-8
+    static bool to_ascii( std::string_view name, std::string* ascii );
+
+    //! Canonical form of a name for a lookup. Conversions are kept in a small per-thread cache, so a name
+    //! that repeats is converted once.
+    //!
+    //! \param name - the domain name, UTF-8
+    //! \return the name itself if it does not need a conversion, otherwise the canonical name, valid until
+    //!         the next call on the same thread
+    static std::string_view normalize( std::string_view name )
+    {
+        return is_ascii( name ) ? name : normalize_cached( name );
+    }
+
+private:
+
+    //! Number of names in the per-thread cache of normalize()
+    static const size_t kCacheSlots = 256;
+
+    //! normalize() of a name with non-ASCII characters
+    static std::string_view normalize_cached( std::string_view name );
+
+    //! Append the Punycode encoding of a label to a string
+    //!
+    //! \return false if the label is too long to encode
+    static bool encode_label( const std::u32string& label, std::string* output );
+};
+
+#endif //DOMAINDB_IDN_H
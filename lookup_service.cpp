@@ -0,0 +1,492 @@
+#include "lookup_service.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+
+using FrameHeader = LookupProtocol::FrameHeader;
+using QueryHeader = LookupProtocol::QueryHeader;
+
+//! Bytes read from a connection per system call at most
+static const size_t kReadSize = 64 << 10;
+
+//! Bytes read from a connection per wake-up at most, so that a client that never pauses can neither keep the
+//! thread from its other connections nor grow its input past the frames it completes
+static const size_t kMaxReadPerEvent = LookupProtocol::kMaxFrameSize;
+
+//! Events read from epoll per call
+static const int kMaxEvents = 64;
+
+//! Time a thread stops accepting connections when it is out of descriptors or memory, in milliseconds
+static const int kAcceptBackoffMs = 100;
+
+//! Describe the last system call error
+static bool fail( std::string* error, const std::string& message )
+{
+    auto error_text = std::strerror( errno );
+    if ( error != nullptr ) *error = message + ": " + error_text;
+    return false;
+}
+
+//! Address of a Unix domain socket
+static bool socket_address( const std::string& socket_path, sockaddr_un* address, std::string* error )
+{
+    std::memset( address, 0, sizeof *address );
+    address->sun_family = AF_UNIX;
+    if ( socket_path.empty() || (socket_path.size() >= sizeof address->sun_path) )
+    {
+        if ( error != nullptr ) *error = "the socket path is empty or too long: " + socket_path;
+        return false;
+    }
+    std::memcpy( address->sun_path, socket_path.data(), socket_path.size() );
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! A client connection of an event loop thread
+struct LookupServer::Connection
+{
+    int                 fd;
+    uint32_t            events = EPOLLIN;   //!< events the connection is registered for
+    std::vector<char>   input;              //!< received bytes, input_size of them, starting with a frame
+    size_t              input_size = 0;
+    std::vector<char>   output;             //!< responses, written up to output_start
+    size_t              output_start = 0;
+
+    std::vector<DomainTree::Query>      queries;        //!< of the frame being answered
+    std::vector<MultiConnectionType>    categories;
+
+    explicit Connection( int connection_fd ) : fd( connection_fd ) {}
+    ~Connection() { close( fd ); }
+
+    //! Response bytes waiting to be written
+    size_t pending() const { return output.size() - output_start; }
+};
+
+LookupServer::LookupServer( const DomainLoader& loader, const Options& options )
+    : loader_( loader )
+    , options_( options )
+{
+}
+
+LookupServer::~LookupServer()
+{
+    stop();
+}
+
+//! Listen on a socket and start the threads
+bool LookupServer::start( const std::string& socket_path, std::string* error )
+{
+    if ( listen_fd_ >= 0 )
+    {
+        if ( error != nullptr ) *error = "the server is already started";
+        return false;
+    }
+
+    sockaddr_un address;
+    if ( !socket_address(socket_path, &address, error) ) return false;
+    listen_fd_ = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( listen_fd_ < 0 ) return fail( error, "cannot create a socket" );
+    unlink( socket_path.c_str() );
+    if ( (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0) || (listen(listen_fd_, SOMAXCONN) != 0) )
+    {
+        fail( error, "cannot listen on " + socket_path );
+        close( listen_fd_ );
+        listen_fd_ = -1;
+        return false;
+    }
+    socket_path_ = socket_path;
+
+    stop_fd_ = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( stop_fd_ < 0 )
+    {
+        fail( error, "cannot create an eventfd" );
+        stop();
+        return false;
+    }
+
+    auto threads = (options_.threads > 0) ? options_.threads : std::max( 1u, std::thread::hardware_concurrency() );
+    for ( unsigned i = 0; i < threads; ++i ) threads_.emplace_back( &LookupServer::run, this );
+    return true;
+}
+
+//! Close the connections, stop the threads and remove the socket
+void LookupServer::stop()
+{
+    if ( stop_fd_ >= 0 )
+    {
+        uint64_t one = 1;
+        (void)!write( stop_fd_, &one, sizeof one );
+    }
+    for ( auto& thread : threads_ ) thread.join();
+    threads_.clear();
+
+    if ( listen_fd_ >= 0 )
+    {
+        close( listen_fd_ );
+        unlink( socket_path_.c_str() );
+        listen_fd_ = -1;
+    }
+    if ( stop_fd_ >= 0 )
+    {
+        close( stop_fd_ );
+        stop_fd_ = -1;
+    }
+}
+
+//! Counters since the server was created
+LookupServer::Stats LookupServer::stats() const
+{
+    Stats stats;
+    stats.connections = connections_.load( std::memory_order_relaxed );
+    stats.requests = requests_.load( std::memory_order_relaxed );
+    stats.lookups = lookups_.load( std::memory_order_relaxed );
+    return stats;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Event loop of one thread
+void LookupServer::run()
+{
+    int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( epoll_fd < 0 ) return;
+
+    // The threads share the listening socket; EPOLLEXCLUSIVE wakes one of them per connection
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.fd = listen_fd_;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listen_fd_, &event );
+    event.events = EPOLLIN;
+    event.data.fd = stop_fd_;
+    epoll_ctl( epoll_fd, EPOLL_CTL_ADD, stop_fd_, &event );
+
+    // When accept fails for lack of descriptors or memory the connection stays pending and the listening
+    // socket readable: it is left out of the wait for a while instead of waking the thread at once, forever
+    bool listening = true;
+    auto resume_listening = std::chrono::steady_clock::time_point();
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    epoll_event events[kMaxEvents];
+    for ( bool running = true; running; )
+    {
+        int timeout = -1;
+        if ( !listening )
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>( resume_listening - std::chrono::steady_clock::now() ).count();
+            if ( left > 0 ) timeout = int( left );
+            else
+            {
+                event.events = EPOLLIN | EPOLLEXCLUSIVE;
+                event.data.fd = listen_fd_;
+                listening = (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd_, &event) == 0);
+                if ( !listening ) timeout = kAcceptBackoffMs;
+            }
+        }
+
+        auto count = epoll_wait( epoll_fd, events, kMaxEvents, timeout );
+        for ( int i = 0; i < count; ++i )
+        {
+            int fd = events[i].data.fd;
+            if ( fd == stop_fd_ )
+            {
+                running = false;
+                continue;
+            }
+            if ( fd == listen_fd_ )
+            {
+                for ( int connection_fd; (connection_fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0; )
+                {
+                    event.events = EPOLLIN;
+                    event.data.fd = connection_fd;
+                    if ( epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection_fd, &event) != 0 )
+                    {
+                        close( connection_fd );
+                        continue;
+                    }
+                    connections[connection_fd].reset( new Connection(connection_fd) );
+                    connections_.fetch_add( 1, std::memory_order_relaxed );
+                }
+                if ( (errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM) )
+                {
+                    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, listen_fd_, nullptr );
+                    listening = false;
+                    resume_listening = std::chrono::steady_clock::now() + std::chrono::milliseconds( kAcceptBackoffMs );
+                }
+                continue;
+            }
+
+            auto found = connections.find( fd );
+            if ( found == connections.end() ) continue;
+            auto connection = found->second.get();
+            bool open = ((events[i].events & EPOLLERR) == 0);
+
+            // Read what arrived, unless responses are piling up, and answer the complete frames. What is left
+            // past kMaxReadPerEvent is read on the next wake-up, epoll being level triggered.
+            if ( open && ((events[i].events & (EPOLLIN | EPOLLHUP)) != 0) && (connection->pending() < options_.max_pending) )
+            {
+                for ( size_t total = 0; total < kMaxReadPerEvent; )
+                {
+                    if ( connection->input.size() < connection->input_size + kReadSize ) connection->input.resize( connection->input_size + kReadSize );
+                    auto space = connection->input.size() - connection->input_size;
+                    auto received = read( fd, connection->input.data() + connection->input_size, space );
+                    if ( received > 0 )
+                    {
+                        connection->input_size += size_t( received );
+                        total += size_t( received );
+                    }
+                    else if ( (received == 0) || ((errno != EAGAIN) && (errno != EINTR)) ) open = false;
+                    if ( (received <= 0) || (size_t(received) < space) ) break;
+                }
+                open = answer( connection ) && open;
+            }
+
+            // Write the responses; a closed peer still gets the responses to the frames it sent
+            while ( connection->pending() > 0 )
+            {
+                auto sent = send( fd, connection->output.data() + connection->output_start, connection->pending(), MSG_NOSIGNAL );
+                if ( sent > 0 ) connection->output_start += size_t( sent );
+                else
+                {
+                    if ( (sent < 0) && (errno != EAGAIN) && (errno != EINTR) ) open = false;
+                    if ( (sent < 0) && (errno == EINTR) ) continue;
+                    break;
+                }
+            }
+            if ( connection->pending() == 0 )
+            {
+                connection->output.clear();
+                connection->output_start = 0;
+            }
+
+            uint32_t wanted = ((connection->pending() < options_.max_pending) ? uint32_t(EPOLLIN) : 0) |
+                              ((connection->pending() > 0) ? uint32_t(EPOLLOUT) : 0);
+            if ( !open )
+            {
+                epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd, nullptr );
+                connections.erase( found );
+            }
+            else if ( wanted != connection->events )
+            {
+                connection->events = wanted;
+                event.events = wanted;
+                event.data.fd = fd;
+                epoll_ctl( epoll_fd, EPOLL_CTL_MOD, fd, &event );
+            }
+        }
+    }
+
+    connections.clear();
+    close( epoll_fd );
+}
+
+//! Answer the complete frames in the input of a connection
+bool LookupServer::answer( Connection* connection )
+{
+    DomainLoader::Snapshot domain_tree;
+    const char* input = connection->input.data();
+    size_t offset = 0;
+    bool valid = true;
+    uint64_t requests = 0;
+    uint64_t lookups = 0;
+
+    while ( connection->input_size - offset >= sizeof(FrameHeader) )
+    {
+        FrameHeader header;
+        std::memcpy( &header, input + offset, sizeof header );
+        if ( (header.size < sizeof header) || (header.size > LookupProtocol::kMaxFrameSize) ||
+             (header.count > (header.size - sizeof header) / sizeof(QueryHeader)) )
+        {
+            valid = false;
+            break;
+        }
+        if ( connection->input_size - offset < header.size ) break;
+
+        // One snapshot for all the frames that arrived together
+        if ( !domain_tree ) domain_tree = loader_.current();
+
+        auto& queries = connection->queries;
+        queries.clear();
+        const char* query = input + offset + sizeof header;
+        const char* end = input + offset + header.size;
+        for ( uint32_t i = 0; valid && (i < header.count); ++i )
+        {
+            QueryHeader query_header;
+            valid = (size_t(end - query) >= sizeof query_header);
+            if ( !valid ) break;
+            std::memcpy( &query_header, query, sizeof query_header );
+            query += sizeof query_header;
+            valid = (size_t(end - query) >= query_header.name_size);
+
+            // Lookups of a protocol other than UDP and TCP find no port range and are unclassified
+            queries.push_back( DomainTree::Query{ std::string_view(query, query_header.name_size), query_header.port,
+                                                  ProtocolType(query_header.protocol) } );
+            query += query_header.name_size;
+        }
+        if ( !valid || (query != end) )
+        {
+            valid = false;
+            break;
+        }
+
+        auto& categories = connection->categories;
+        categories.assign( queries.size(), MultiConnectionType::unclassified );
+        if ( domain_tree ) domain_tree->match_domains( queries.data(), queries.size(), categories.data() );
+
+        auto response_offset = connection->output.size();
+        connection->output.resize( response_offset + sizeof header + header.count );
+        for ( uint32_t i = 0; i < header.count; ++i ) connection->output[response_offset + sizeof header + i] = char( categories[i] );
+
+        FrameHeader response{ uint32_t(sizeof header + header.count), header.id, header.count };
+        std::memcpy( connection->output.data() + response_offset, &response, sizeof response );
+        offset += header.size;
+        ++requests;
+        lookups += header.count;
+    }
+
+    // Keep the start of the next frame
+    std::memmove( connection->input.data(), input + offset, connection->input_size - offset );
+    connection->input_size -= offset;
+
+    requests_.fetch_add( requests, std::memory_order_relaxed );
+    lookups_.fetch_add( lookups, std::memory_order_relaxed );
+    return valid;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Send all the bytes of a buffer on a blocking socket
+static bool send_all( int fd, const char* data, size_t size, std::string* error )
+{
+    while ( size > 0 )
+    {
+        auto sent = send( fd, data, size, MSG_NOSIGNAL );
+        if ( sent < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return fail( error, "cannot send to the server" );
+        }
+        data += sent;
+        size -= size_t( sent );
+    }
+    return true;
+}
+
+//! Receive a number of bytes from a blocking socket
+static bool receive_all( int fd, char* data, size_t size, std::string* error )
+{
+    while ( size > 0 )
+    {
+        auto received = recv( fd, data, size, 0 );
+        if ( received == 0 )
+        {
+            if ( error != nullptr ) *error = "the server closed the connection";
+            return false;
+        }
+        if ( received < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return fail( error, "cannot receive from the server" );
+        }
+        data += received;
+        size -= size_t( received );
+    }
+    return true;
+}
+
+LookupClient::~LookupClient()
+{
+    if ( fd_ >= 0 ) close( fd_ );
+}
+
+//! Connect to a server
+bool LookupClient::connect( const std::string& socket_path, std::string* error )
+{
+    sockaddr_un address;
+    if ( !socket_address(socket_path, &address, error) ) return false;
+    if ( fd_ >= 0 ) close( fd_ );
+    fd_ = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd_ < 0 ) return fail( error, "cannot create a socket" );
+    if ( ::connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof address) != 0 )
+    {
+        fail( error, "cannot connect to " + socket_path );
+        close( fd_ );
+        fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+//! Send a batch of lookups without waiting for the response
+bool LookupClient::send( uint32_t id, const Query* queries, size_t count, std::string* error )
+{
+    frame_.resize( sizeof(FrameHeader) );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const auto& query = queries[i];
+        if ( query.domain.size() > UINT8_MAX )
+        {
+            if ( error != nullptr ) *error = "the name is longer than 255 bytes: " + std::string( query.domain );
+            return false;
+        }
+        QueryHeader query_header{ query.port, uint8_t(query.protocol_type), uint8_t(query.domain.size()) };
+        auto offset = frame_.size();
+        frame_.resize( offset + sizeof query_header + query.domain.size() );
+        std::memcpy( frame_.data() + offset, &query_header, sizeof query_header );
+        std::memcpy( frame_.data() + offset + sizeof query_header, query.domain.data(), query.domain.size() );
+    }
+    if ( frame_.size() > LookupProtocol::kMaxFrameSize )
+    {
+        if ( error != nullptr ) *error = "the batch is larger than " + std::to_string( LookupProtocol::kMaxFrameSize ) + " bytes";
+        return false;
+    }
+
+    FrameHeader header{ uint32_t(frame_.size()), id, uint32_t(count) };
+    std::memcpy( frame_.data(), &header, sizeof header );
+    return send_all( fd_, frame_.data(), frame_.size(), error );
+}
+
+//! Receive the response to the oldest batch sent
+bool LookupClient::receive( uint32_t* id, std::vector<MultiConnectionType>* categories, std::string* error )
+{
+    FrameHeader header;
+    if ( !receive_all(fd_, reinterpret_cast<char*>(&header), sizeof header, error) ) return false;
+    if ( header.size != sizeof header + size_t(header.count) )
+    {
+        if ( error != nullptr ) *error = "the response is not valid";
+        return false;
+    }
+
+    frame_.resize( header.count );
+    if ( !receive_all(fd_, frame_.data(), frame_.size(), error) ) return false;
+    *id = header.id;
+    categories->resize( header.count );
+    for ( uint32_t i = 0; i < header.count; ++i ) (*categories)[i] = MultiConnectionType( uint8_t(frame_[i]) );
+    return true;
+}
+
+//! Send a batch and receive its response
+bool LookupClient::lookup( const Query* queries, size_t count, std::vector<MultiConnectionType>* categories, std::string* error )
+{
+    auto id = next_id_++;
+    uint32_t response_id;
+    if ( !send(id, queries, count, error) || !receive(&response_id, categories, error) ) return false;
+    if ( response_id == id ) return true;
+
+    if ( error != nullptr ) *error = "the response is to another request";
+    return false;
+}
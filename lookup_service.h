@@ -0,0 +1,180 @@
+#ifndef DOMAINDB_LOOKUP_SERVICE_H
+#define DOMAINDB_LOOKUP_SERVICE_H
+
+#include "domain_loader.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Wire format of the lookup service on a Unix domain socket, in the byte order of the host.
+//!
+//! A request frame is a FrameHeader followed by count queries, each a QueryHeader followed by name_size
+//! bytes of the name. The response frame is a FrameHeader with the id of the request followed by count
+//! categories, one byte each, the values of MultiConnectionType; a query with an unknown protocol is
+//! unclassified. Requests may be pipelined: the server answers the frames of a connection in order. A frame
+//! larger than kMaxFrameSize or whose queries do not fill it exactly closes the connection.
+struct LookupProtocol
+{
+    struct FrameHeader
+    {
+        uint32_t    size;       //!< size of the frame including the header
+        uint32_t    id;         //!< chosen by the client, echoed in the response
+        uint32_t    count;      //!< number of queries or categories
+    };
+
+    struct QueryHeader
+    {
+        uint16_t    port;
+        uint8_t     protocol;   //!< the value of ProtocolType
+        uint8_t     name_size;
+    };
+
+    static_assert( sizeof(FrameHeader) == 12, "the wire format must not depend on the compiler" );
+    static_assert( sizeof(QueryHeader) == 4, "the wire format must not depend on the compiler" );
+
+    static const uint32_t kMaxFrameSize = 1 << 20;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Serves lookups in the current database of a DomainLoader over a Unix domain socket, see LookupProtocol.
+//!
+//! Each thread runs its own epoll loop over the connections it accepted; the threads share the listening
+//! socket. All the frames that arrived on a connection are answered with one snapshot of the database and
+//! written back with as few system calls as possible. A client that does not read its responses stops
+//! being read once Options::max_pending bytes of responses are waiting.
+class LookupServer
+{
+public:
+
+    struct Options
+    {
+        unsigned    threads = 1;                //!< event loop threads, 0 for one per hardware thread
+        size_t      max_pending = 4 << 20;      //!< response bytes waiting on a connection before it is not read
+    };
+
+    struct Stats
+    {
+        uint64_t    connections = 0;    //!< connections accepted
+        uint64_t    requests = 0;       //!< request frames answered
+        uint64_t    lookups = 0;        //!< queries answered
+    };
+
+    //! Create a stopped server
+    //!
+    //! \param loader  - holds the database the lookups use, see DomainLoader::current(); it must outlive the server
+    //! \param options - server options
+    LookupServer( const DomainLoader& loader, const Options& options );
+
+    //! Stop the server
+    ~LookupServer();
+
+    LookupServer( const LookupServer& ) = delete;
+    LookupServer& operator=( const LookupServer& ) = delete;
+
+    //! Listen on a socket and start the threads. An existing file at the path is replaced.
+    //!
+    //! \param socket_path - path of the Unix domain socket
+    //! \param error       - receives a description of the problem on failure
+    //! \return true on success
+    bool start( const std::string& socket_path, std::string* error );
+
+    //! Close the connections, stop the threads and remove the socket
+    void stop();
+
+    //! Counters since the server was created
+    Stats stats() const;
+
+private:
+
+    struct Connection;
+
+    const DomainLoader&         loader_;
+    const Options               options_;
+    std::string                 socket_path_;
+    int                         listen_fd_ = -1;
+    int                         stop_fd_ = -1;      //!< eventfd, readable once the server stops
+    std::vector<std::thread>    threads_;
+
+    std::atomic<uint64_t>       connections_{0};
+    std::atomic<uint64_t>       requests_{0};
+    std::atomic<uint64_t>       lookups_{0};
+
+    //! Event loop of one thread
+    void run();
+
+    //! Answer the complete frames in the input of a connection
+    //!
+    //! \return false if a frame is not valid
+    bool answer( Connection* connection );
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Client of a LookupServer: blocking calls on one connection.
+//!
+//! send() and receive() pipeline requests: send several batches, then receive their responses in order.
+//! Keep the requests in flight to a few MB, the server stops reading a client that does not read.
+class LookupClient
+{
+public:
+
+    struct Query
+    {
+        std::string_view    domain;     //!< at most 255 bytes
+        uint16_t            port;
+        ProtocolType        protocol_type;
+    };
+
+    LookupClient() = default;
+    ~LookupClient();
+
+    LookupClient( const LookupClient& ) = delete;
+    LookupClient& operator=( const LookupClient& ) = delete;
+
+    //! Connect to a server
+    //!
+    //! \param socket_path - path of the Unix domain socket
+    //! \param error       - receives a description of the problem on failure
+    //! \return true on success
+    bool connect( const std::string& socket_path, std::string* error );
+
+    //! Send a batch of lookups without waiting for the response
+    //!
+    //! \param id      - echoed in the response
+    //! \param queries - the lookups; a name longer than 255 bytes fails the batch
+    //! \param count   - number of lookups
+    //! \param error   - receives a description of the problem on failure
+    //! \return true on success
+    bool send( uint32_t id, const Query* queries, size_t count, std::string* error );
+
+    //! Receive the response to the oldest batch sent
+    //!
+    //! \param id         - receives the id of the batch
+    //! \param categories - receives the category of each lookup of the batch
+    //! \param error      - receives a description of the problem on failure
+    //! \return true on success
+    bool receive( uint32_t* id, std::vector<MultiConnectionType>* categories, std::string* error );
+
+    //! Send a batch and receive its response
+    bool lookup( const Query* queries, size_t count, std::vector<MultiConnectionType>* categories, std::string* error );
+
+private:
+
+    int                 fd_ = -1;
+    std::vector<char>   frame_;     //!< buffer of the frames sent and received
+    uint32_t            next_id_ = 0;
+};
+
+#endif //DOMAINDB_LOOKUP_SERVICE_H
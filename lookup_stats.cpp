@@ -0,0 +1,208 @@
+#include "lookup_stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+std::atomic<uint32_t> LookupStats::sample_mask_{1023};
+
+//! Counters of all live threads and the totals of exited ones
+struct LookupStatsRegistry
+{
+    std::mutex                              mutex;
+    std::vector<const void*>                live;
+    LookupStats::Snapshot                   retired;
+};
+
+static LookupStatsRegistry& registry()
+{
+    static LookupStatsRegistry registry;
+    return registry;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Register the counters of a new thread
+LookupStats::Counters::Counters()
+{
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock( stats.mutex );
+    stats.live.push_back( this );
+}
+
+//! Fold the counters of an exiting thread into the retired totals
+LookupStats::Counters::~Counters()
+{
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock( stats.mutex );
+    add_to( &stats.retired );
+    stats.live.erase( std::find(stats.live.begin(), stats.live.end(), this) );
+}
+
+//! Add the counters to a snapshot
+void LookupStats::Counters::add_to( Snapshot* snapshot ) const
+{
+    snapshot->lookups += lookups.load( std::memory_order_relaxed );
+    snapshot->misses += misses.load( std::memory_order_relaxed );
+    snapshot->fallbacks += fallbacks.load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < kCategories; ++i ) snapshot->hits[i] += hits[i].load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < kProbeBuckets; ++i ) snapshot->probes[i] += probes[i].load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < kDepthBuckets; ++i ) snapshot->depths[i] += depths[i].load( std::memory_order_relaxed );
+    snapshot->sampled += sampled.load( std::memory_order_relaxed );
+    snapshot->latency_sum_ns += latency_sum_ns.load( std::memory_order_relaxed );
+    for ( size_t i = 0; i < kLatencyBuckets; ++i ) snapshot->latency[i] += latency[i].load( std::memory_order_relaxed );
+}
+
+//! Counters of the calling thread
+LookupStats::Counters& LookupStats::thread_counters()
+{
+    static thread_local Counters counters;
+    return counters;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Measure the latency of one lookup in every rate lookups of a thread
+void LookupStats::set_sample_rate( uint32_t rate )
+{
+    uint32_t period = 1;
+    while ( (period < rate) && (period < 0x80000000u) ) period *= 2;
+    sample_mask_.store( (rate == 0) ? kNoSampling : period - 1, std::memory_order_relaxed );
+}
+
+//! Merge the counters of all threads
+LookupStats::Snapshot LookupStats::snapshot()
+{
+    auto& stats = registry();
+    std::lock_guard<std::mutex> lock( stats.mutex );
+
+    Snapshot snapshot = stats.retired;
+    for ( auto counters : stats.live ) static_cast<const Counters*>(counters)->add_to( &snapshot );
+    return snapshot;
+}
+
+//! Finish recording a lookup on the calling thread
+void LookupStats::record( MultiConnectionType category, unsigned probes, unsigned depth, bool fallback, uint64_t start_ns )
+{
+    auto& counters = thread_counters();
+    bump( counters.lookups );
+    if ( category == MultiConnectionType::unclassified ) bump( counters.misses );
+    if ( fallback ) bump( counters.fallbacks );
+    bump( counters.hits[std::min(size_t(category), kCategories - 1)] );
+    bump( counters.probes[std::min(probes, kProbeBuckets - 1)] );
+    bump( counters.depths[std::min(depth, kDepthBuckets - 1)] );
+
+    if ( start_ns != 0 )
+    {
+        auto elapsed = now_ns() - start_ns;
+        bump( counters.sampled );
+        bump( counters.latency_sum_ns, elapsed );
+        bump( counters.latency[latency_bucket(elapsed)] );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Latency histogram bucket of a duration
+unsigned LookupStats::latency_bucket( uint64_t ns )
+{
+    if ( ns < (1u << kSubBucketBits) ) return unsigned(ns);
+
+    unsigned top_bit = 63 - __builtin_clzll( ns );
+    if ( top_bit > kMaxLatencyBit ) return kLatencyBuckets - 1;
+
+    unsigned shift = top_bit - kSubBucketBits;
+    unsigned sub_bucket = unsigned(ns >> shift) & ((1u << kSubBucketBits) - 1);
+    return ((shift + 1) << kSubBucketBits) + sub_bucket;
+}
+
+//! Upper bound of a latency histogram bucket in nanoseconds
+uint64_t LookupStats::latency_bucket_limit( unsigned bucket )
+{
+    if ( bucket < (1u << kSubBucketBits) ) return bucket;
+
+    unsigned shift = (bucket >> kSubBucketBits) - 1;
+    uint64_t sub_bucket = bucket & ((1u << kSubBucketBits) - 1);
+    return (((1u << kSubBucketBits) + sub_bucket + 1) << shift) - 1;
+}
+
+//! Latency at a quantile of the sampled lookups
+uint64_t LookupStats::Snapshot::latency_quantile_ns( double quantile ) const
+{
+    if ( sampled == 0 ) return 0;
+
+    auto rank = uint64_t( quantile * double(sampled - 1) ) + 1;
+    uint64_t seen = 0;
+    for ( unsigned bucket = 0; bucket < kLatencyBuckets; ++bucket )
+    {
+        seen += latency[bucket];
+        if ( seen >= rank ) return latency_bucket_limit( bucket );
+    }
+    return latency_bucket_limit( kLatencyBuckets - 1 );
+}
+
+//! Format the snapshot in the Prometheus text exposition format
+std::string LookupStats::Snapshot::prometheus( const std::string& prefix ) const
+{
+    std::string out;
+    auto metric = [&]( const std::string& name, const char* type, const char* help )
+    {
+        out += "# HELP " + prefix + name + " " + help + "\n# TYPE " + prefix + name + " " + type + "\n";
+    };
+
+    metric( "_lookups_total", "counter", "Domain lookups." );
+    out += prefix + "_lookups_total " + std::to_string(lookups) + "\n";
+
+    metric( "_lookup_misses_total", "counter", "Lookups that returned unclassified." );
+    out += prefix + "_lookup_misses_total " + std::to_string(misses) + "\n";
+
+    metric( "_lookup_fallbacks_total", "counter", "Lookups classified by the empty domain entry." );
+    out += prefix + "_lookup_fallbacks_total " + std::to_string(fallbacks) + "\n";
+
+    metric( "_lookup_results_total", "counter", "Lookups per returned category." );
+    for ( size_t i = 1; i < kCategories; ++i )
+    {
+        out += prefix + "_lookup_results_total{category=\"" + std::string(MultiConnectionTypeString[i]) + "\"} " +
+               std::to_string(hits[i]) + "\n";
+    }
+
+    // A histogram of small counts, one bucket per value and the last for all larger ones
+    auto histogram = [&]( const std::string& name, const char* help, const uint64_t* buckets, unsigned count )
+    {
+        metric( name, "histogram", help );
+        uint64_t cumulative = 0;
+        uint64_t sum = 0;
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            cumulative += buckets[i];
+            sum += i * buckets[i];
+            auto bound = (i + 1 < count) ? std::to_string(i) : std::string("+Inf");
+            out += prefix + name + "_bucket{le=\"" + bound + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        out += prefix + name + "_sum " + std::to_string(sum) + "\n";
+        out += prefix + name + "_count " + std::to_string(cumulative) + "\n";
+    };
+    histogram( "_lookup_probes", "Domain table probes per lookup.", probes.data(), kProbeBuckets );
+    histogram( "_lookup_walk_depth", "Suffixes of the name walked per lookup, up to the one that matched.", depths.data(), kDepthBuckets );
+
+    metric( "_lookup_latency_seconds", "summary", "Latency of sampled lookups." );
+    for ( auto quantile : { 0.5, 0.9, 0.99, 0.999 } )
+    {
+        char line[128];
+        snprintf( line, sizeof line, "_lookup_latency_seconds{quantile=\"%g\"} %.9f\n",
+                  quantile, latency_quantile_ns(quantile) * 1e-9 );
+        out += prefix + line;
+    }
+    char sum[64];
+    snprintf( sum, sizeof sum, "%.9f", latency_sum_ns * 1e-9 );
+    out += prefix + "_lookup_latency_seconds_sum " + sum + "\n";
+    out += prefix + "_lookup_latency_seconds_count " + std::to_string(sampled) + "\n";
+
+    return out;
+}
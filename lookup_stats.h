@@ -0,0 +1,158 @@
+#ifndef DOMAINDB_LOOKUP_STATS_H
+#define DOMAINDB_LOOKUP_STATS_H
+
+#include "Defines.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//! Lookup instrumentation is compiled in only when DOMAINDB_ENABLE_STATS is defined (cmake -DDOMAINDB_STATS=ON).
+//! Otherwise DOMAINDB_STATS() statements vanish and lookups pay nothing; the snapshot API stays available and
+//! reports zeros.
+#ifdef DOMAINDB_ENABLE_STATS
+#define DOMAINDB_STATS(...) __VA_ARGS__
+#else
+#define DOMAINDB_STATS(...)
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Counters and latency histogram of domain lookups.
+//!
+//! Every thread counts into its own cache-line aligned block with plain relaxed stores, so recording a lookup
+//! never contends with other threads. snapshot() merges the blocks of all live threads with the totals of
+//! exited ones. Latency is measured only for one lookup in sample_rate, into a log-linear (HDR style)
+//! histogram with 1/16 relative precision.
+class LookupStats
+{
+public:
+
+    //! Number of buckets of the probe count histogram; the last one counts all longer walks
+    static const unsigned kProbeBuckets = 16;
+
+    //! Number of buckets of the walk depth histogram; the last one counts all deeper walks
+    static const unsigned kDepthBuckets = 16;
+
+    //! Latency histogram geometry: 16 linear sub-buckets per power of two nanoseconds, up to 2^41 ns
+    static const unsigned kSubBucketBits = 4;
+    static const unsigned kMaxLatencyBit = 40;
+    static const unsigned kLatencyBuckets = (kMaxLatencyBit - kSubBucketBits + 2) << kSubBucketBits;
+
+    static const size_t kCategories = MultiConnectionTypeString.size();
+
+    //! Merged state of all threads
+    struct Snapshot
+    {
+        uint64_t                                    lookups = 0;        //!< all lookups
+        uint64_t                                    misses = 0;         //!< lookups that returned unclassified
+        uint64_t                                    fallbacks = 0;      //!< lookups classified by the empty domain entry
+        std::array<uint64_t, kCategories>           hits{};             //!< lookups per returned category
+        std::array<uint64_t, kProbeBuckets>         probes{};           //!< lookups per number of domain probes
+        std::array<uint64_t, kDepthBuckets>         depths{};           //!< lookups per number of suffixes walked
+        uint64_t                                    sampled = 0;        //!< lookups with a latency measurement
+        uint64_t                                    latency_sum_ns = 0; //!< total latency of the sampled lookups
+        std::array<uint64_t, kLatencyBuckets>       latency{};          //!< sampled lookups per latency bucket
+
+        //! Latency at a quantile of the sampled lookups
+        //!
+        //! \param quantile - between 0 and 1
+        //! \return latency in nanoseconds, the upper bound of the bucket holding the quantile
+        uint64_t latency_quantile_ns( double quantile ) const;
+
+        //! Format the snapshot in the Prometheus text exposition format
+        //!
+        //! \param prefix - metric name prefix
+        //! \return the metrics text
+        std::string prometheus( const std::string& prefix = "domaindb" ) const;
+    };
+
+    //! True if the instrumentation is compiled in
+    static constexpr bool enabled()
+    {
+#ifdef DOMAINDB_ENABLE_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //! Measure the latency of one lookup in every rate lookups of a thread
+    //!
+    //! \param rate - sampling period, rounded up to a power of two; 0 disables latency sampling
+    static void set_sample_rate( uint32_t rate );
+
+    //! Merge the counters of all threads
+    static Snapshot snapshot();
+
+    //! Start recording a lookup on the calling thread
+    //!
+    //! \return a timestamp if this lookup is sampled for latency, 0 otherwise
+    static uint64_t start()
+    {
+        auto& counters = thread_counters();
+        if ( counters.countdown-- != 0 ) return 0;
+        counters.countdown = sample_mask_.load( std::memory_order_relaxed );
+        return (counters.countdown == kNoSampling) ? 0 : now_ns();
+    }
+
+    //! Finish recording a lookup on the calling thread
+    //!
+    //! \param category - the category returned by the lookup
+    //! \param probes   - number of domain table probes made, the fallback to the empty domain entry included
+    //! \param depth    - number of suffixes of the name walked, longest first: up to the one that matched, or
+    //!                   all of them down to the shortest one looked up if none did. Suffixes skipped by the
+    //!                   filter or the negative cache count, so the depth depends on the name and the
+    //!                   database only.
+    //! \param fallback - the category came from the empty domain entry
+    //! \param start_ns - the value returned by start()
+    static void record( MultiConnectionType category, unsigned probes, unsigned depth, bool fallback, uint64_t start_ns );
+
+private:
+
+    struct alignas(64) Counters
+    {
+        uint32_t                                                countdown = 0;
+        std::atomic<uint64_t>                                   lookups{0};
+        std::atomic<uint64_t>                                   misses{0};
+        std::atomic<uint64_t>                                   fallbacks{0};
+        std::array<std::atomic<uint64_t>, kCategories>          hits{};
+        std::array<std::atomic<uint64_t>, kProbeBuckets>        probes{};
+        std::array<std::atomic<uint64_t>, kDepthBuckets>        depths{};
+        std::atomic<uint64_t>                                   sampled{0};
+        std::atomic<uint64_t>                                   latency_sum_ns{0};
+        std::array<std::atomic<uint64_t>, kLatencyBuckets>      latency{};
+
+        Counters();
+        ~Counters();
+        void add_to( Snapshot* snapshot ) const;
+    };
+
+    static const uint32_t kNoSampling = 0xFFFFFFFF;
+    static std::atomic<uint32_t> sample_mask_;
+
+    static Counters& thread_counters();
+
+    static uint64_t now_ns()
+    {
+        return uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch()).count() );
+    }
+
+    //! Latency histogram bucket of a duration
+    static unsigned latency_bucket( uint64_t ns );
+
+    //! Upper bound of a latency histogram bucket in nanoseconds
+    static uint64_t latency_bucket_limit( unsigned bucket );
+
+    //! Increment a counter owned by the calling thread
+    static void bump( std::atomic<uint64_t>& counter, uint64_t value = 1 )
+    {
+        counter.store( counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed );
+    }
+};
+
+#endif //DOMAINDB_LOOKUP_STATS_H
@@ -1,11 +1,37 @@
 #include <iostream>
 #include <vector>
-#include "domain_tree.h"
+#include "domain_loader.h"
+#include "lookup_stats.h"
 
 int main() {
     std::cout << "Hello, World!" << std::endl;
 
-    DomainTree domain_tree("db.json" );
+    // Load in the background; a service would accept traffic meanwhile
+    DomainLoader loader;
+    auto loading = loader.load( "db.json", []( const DomainTree::LoadProgress& progress )
+    {
+        static const char* const kStages[] = { "reading", "parsing", "filling", "done" };
+        std::cout << "Loading: " << kStages[int(progress.stage)] << ' ' << progress.entries_done << '/'
+                  << progress.entries_total << " entries" << std::endl;
+    } );
+    auto snapshot = loading.get();
+    const auto& domain_tree = *snapshot;
+
+    const auto& report = domain_tree.load_report();
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    std::cout << "Loaded " << report.domains << " domains from " << report.file_bytes << " bytes: read (" << report.read_method << ") "
+              << Milliseconds(report.read_time).count() << " ms, parse " << Milliseconds(report.parse_time).count()
+              << " ms, fill " << Milliseconds(report.fill_time).count() << " ms, about "
+              << report.memory_bytes / 1024 << " KB" << std::endl;
+    std::cout << "Entries per form:";
+    for ( auto count : report.entries_per_form ) std::cout << ' ' << count;
+    std::cout << std::endl;
+    if ( !report.error.empty() ) std::cout << "Database error: " << report.error << std::endl;
+    for ( const auto& rejected : report.rejected )
+    {
+        std::cout << "Rejected at line " << rejected.line << " in " << rejected.service << ": " << rejected.reason
+                  << (rejected.entry.empty() ? "" : " - ") << rejected.entry << std::endl;
+    }
 
     struct Packet
     {
@@ -30,8 +56,19 @@ int main() {
     {
         std::cout << "Category of " << p.domain << " port " << p.port <<
                      " over " << (p.protocol_type==ProtocolType::UDP ? "UDP" : "TCP") << " is " <<
-                     int(domain_tree.match_domain(p.domain, p.port, p.protocol_type)) << std::endl;
+                     to_string(domain_tree.match_domain(p.domain, p.port, p.protocol_type)) << std::endl;
+
+        auto match = domain_tree.classify_domain(p.domain, p.port, p.protocol_type);
+        std::cout << "    depth " << int(match.depth) << ", all categories:";
+        for ( auto type = MultiConnectionType::small; type <= MultiConnectionType::undefined;
+              type = MultiConnectionType(int(type) + 1) )
+        {
+            if ( match.has(type) ) std::cout << ' ' << to_string(type);
+        }
+        std::cout << std::endl;
     }
 
+    if ( LookupStats::enabled() ) std::cout << LookupStats::snapshot().prometheus();
+
     return 0;
 }
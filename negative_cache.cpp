@@ -0,0 +1,40 @@
+#include "negative_cache.h"
+
+NegativeCache::NegativeCache( size_t capacity )
+{
+    size_t entries = 1;
+    while ( entries < capacity ) entries *= 2;
+    mask_ = entries - 1;
+    entries_.reset( new Entry[entries] );
+    tags_.reset( new std::atomic<uint32_t>[entries] );
+    for ( size_t i = 0; i < entries; ++i )
+    {
+        for ( auto& word : entries_[i].words ) word.store( 0, std::memory_order_relaxed );
+        tags_[i].store( 0, std::memory_order_relaxed );
+    }
+}
+
+//! Record that lookups under a suffix miss for an interval of ports
+void NegativeCache::insert( const Key& key, uint16_t first_port, uint16_t last_port )
+{
+    // Admit the suffix on its second miss in a row in this place
+    if ( !is_tagged(key) )
+    {
+        tags_[key.hash & mask_].store( uint32_t(key.hash >> 32), std::memory_order_relaxed );
+        return;
+    }
+
+    auto words = words_of( key );
+    words.ports |= (uint64_t( first_port ) << 16) | last_port;
+    auto& entry = entries_[key.hash & mask_];
+
+    // Take the entry by making its sequence odd; leave it to the thread that holds it
+    auto sequence = entry.words[0].load( std::memory_order_relaxed );
+    if ( ((sequence & 1) != 0) || !entry.words[0].compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire) ) return;
+    std::atomic_thread_fence( std::memory_order_release );
+
+    uint64_t values[3 + kNameWords];
+    std::memcpy( values, &words, sizeof(values) );
+    for ( size_t i = 0; i < 3 + kNameWords; ++i ) entry.words[1 + i].store( values[i], std::memory_order_relaxed );
+    entry.words[0].store( sequence + 2, std::memory_order_release );
+}
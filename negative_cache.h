@@ -0,0 +1,150 @@
+#ifndef DOMAINDB_NEGATIVE_CACHE_H
+#define DOMAINDB_NEGATIVE_CACHE_H
+
+#include "Defines.h"
+#include "domain_hash.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Bounded cache of the suffixes under which lookups miss, for the random names of a few parent zones that
+//! make up much of the unknown traffic. An entry states that for a protocol and an interval of ports, the
+//! suffixes of a name that lookups probe (the name and its remove_token suffixes down to a shortest size)
+//! give no category at one generation of the database. A lookup of a name directly under the suffix then
+//! only has to probe the name itself.
+//!
+//! The cache is a direct-mapped table of one cache line per entry that any thread can read and write
+//! without locks: each entry is a sequence lock over atomic words. A reader that sees an entry being written
+//! misses, and a writer that finds the entry being written by another thread drops its own. Names are
+//! compared in full, so a hit is exact. Entries of older generations are never hits and are overwritten as
+//! new misses come.
+//!
+//! Most unknown suffixes are seen once, so a suffix is admitted on its second miss: each entry has a tag
+//! of the last suffix that missed in its place, and a first miss only writes the tag. The tags also spare
+//! the lookups of those suffixes the probe of the entry.
+class NegativeCache
+{
+public:
+
+    //! Longest suffix cached
+    static const size_t kMaxName = 32;
+
+    //! Create an empty cache
+    //!
+    //! \param capacity - number of entries, rounded up to a power of two
+    explicit NegativeCache( size_t capacity );
+
+    NegativeCache( const NegativeCache& ) = delete;
+    NegativeCache& operator=( const NegativeCache& ) = delete;
+
+    //! Memory used by the entries and their tags in bytes
+    size_t memory_usage() const { return (mask_ + 1) * (sizeof(Entry) + sizeof(std::atomic<uint32_t>)); }
+
+    //! Key of an entry, made by key()
+    struct Key
+    {
+        std::string_view    suffix;         //!< at most kMaxName bytes
+        ProtocolType        protocol_type;
+        uint16_t            shortest;       //!< size of the shortest suffix probed
+        uint32_t            generation;     //!< of the database
+        uint64_t            shape;          //!< the size, protocol and shortest suffix size together
+        uint64_t            hash;           //!< of the suffix and the shape
+    };
+
+    //! Key of a suffix, hashed once for the probe and the insert of a lookup
+    //!
+    //! \param suffix        - at most kMaxName bytes
+    //! \param protocol_type - protocol of the lookups
+    //! \param shortest      - size of the shortest suffix probed
+    //! \param generation    - of the database
+    static Key key( std::string_view suffix, ProtocolType protocol_type, uint16_t shortest, uint32_t generation )
+    {
+        auto shape = uint64_t( suffix.size() ) | (uint64_t( protocol_type ) << 8) | (uint64_t( shortest ) << 16);
+        return Key{ suffix, protocol_type, shortest, generation, shape, hash_string(suffix, shape) };
+    }
+
+    //! True if lookups under a suffix miss for a port. Reader: safe concurrently with insert().
+    bool contains( const Key& key, uint16_t port ) const;
+
+    //! Record that lookups under a suffix miss for an interval of ports, replacing the entry in its place if
+    //! the suffix was the last to miss there. Safe concurrently with contains() and insert().
+    //!
+    //! \param key        - the suffix and the state of the database the lookup saw
+    //! \param first_port - first port of the interval
+    //! \param last_port  - last port of the interval
+    void insert( const Key& key, uint16_t first_port, uint16_t last_port );
+
+private:
+
+    static const size_t kNameWords = kMaxName / 8;
+
+    //! words[0] is the sequence, odd while the entry is written; then the hash of the key, the generation
+    //! and the ports, the size, protocol and shortest suffix size, and the suffix padded with zeros
+    struct alignas(64) Entry
+    {
+        std::atomic<uint64_t>   words[4 + kNameWords];
+    };
+
+    //! The words of an entry but the sequence
+    struct Words
+    {
+        uint64_t    hash;
+        uint64_t    ports;
+        uint64_t    shape;
+        uint64_t    name[kNameWords];
+    };
+    static_assert( sizeof(Words) == (3 + kNameWords) * sizeof(uint64_t), "Words mirrors the words of an entry" );
+
+    size_t                                      mask_;
+    std::unique_ptr<Entry[]>                    entries_;
+    std::unique_ptr<std::atomic<uint32_t>[]>    tags_;      //!< high half of the hash of the last suffix missed
+
+    //! The words of an entry for a key, the ports zero
+    static Words words_of( const Key& key )
+    {
+        Words words{};
+        std::memcpy( words.name, key.suffix.data(), key.suffix.size() );
+        words.shape = key.shape;
+        words.hash = key.hash;
+        words.ports = uint64_t( key.generation ) << 32;
+        return words;
+    }
+
+    //! True if the suffix of a key was the last to miss in its place
+    bool is_tagged( const Key& key ) const
+    {
+        return tags_[key.hash & mask_].load( std::memory_order_relaxed ) == uint32_t( key.hash >> 32 );
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+inline bool NegativeCache::contains( const Key& key, uint16_t port ) const
+{
+    if ( !is_tagged(key) ) return false;
+    auto expected = words_of( key );
+    const auto& entry = entries_[key.hash & mask_];
+
+    auto sequence = entry.words[0].load( std::memory_order_acquire );
+    if ( (sequence & 1) != 0 ) return false;
+    uint64_t words[3 + kNameWords];
+    for ( size_t i = 0; i < 3 + kNameWords; ++i ) words[i] = entry.words[1 + i].load( std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( entry.words[0].load(std::memory_order_relaxed) != sequence ) return false;
+
+    if ( (words[0] != expected.hash) || (words[2] != expected.shape) || ((words[1] >> 32) != key.generation) ) return false;
+    if ( std::memcmp(&words[3], expected.name, sizeof(expected.name)) != 0 ) return false;
+    auto first_port = uint16_t( words[1] >> 16 );
+    auto last_port = uint16_t( words[1] );
+    return (port >= first_port) && (port <= last_port);
+}
+
+#endif //DOMAINDB_NEGATIVE_CACHE_H
@@ -0,0 +1,304 @@
+#include "public_suffix_list.h"
+#include "idn.h"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+static const char kMagic[4] = { 'P', 'S', 'L', '1' };
+
+//! A node of the trie while the list is compiled
+struct BuildNode
+{
+    uint8_t                             flags = 0;
+    std::map<std::string, BuildNode>    children;
+};
+
+//! Hash of a label and the index of its parent node for the hash table of the nodes. Cheaper than
+//! hash_string for the short labels of domain names, and as stable, since it is stored in images.
+static uint64_t label_hash( uint32_t parent, std::string_view label )
+{
+    static const uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+
+    auto data = label.data();
+    auto size = label.size();
+    uint64_t hash = (uint64_t( size ) << 32) | parent;
+    uint64_t word = 0;
+    for ( ; size > 8; data += 8, size -= 8 )
+    {
+        std::memcpy( &word, data, sizeof word );
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 32;
+    }
+
+    // The last 1 to 8 bytes in two overlapping 4 byte reads, or 3 reads of single bytes
+    if ( size >= 4 )
+    {
+        uint32_t first, last;
+        std::memcpy( &first, data, sizeof first );
+        std::memcpy( &last, data + size - 4, sizeof last );
+        word = (uint64_t( first ) << 32) | last;
+    }
+    else if ( size > 0 ) word = (uint64_t( uint8_t(data[0]) ) << 16) | (uint64_t( uint8_t(data[size / 2]) ) << 8) | uint8_t( data[size - 1] );
+    hash = (hash ^ word) * kMultiplier;
+    return hash ^ (hash >> 29);
+}
+
+//! Position of the last '.' before end in a name, npos if there is none. Scans 8 bytes at a time: labels
+//! are read from the end on every lookup, and a byte loop costs more than the trie walk.
+static size_t find_last_dot( std::string_view name, size_t end )
+{
+    static const uint64_t kLowBits = 0x7F7F7F7F7F7F7F7Full;
+    static const uint64_t kDots = 0x2E2E2E2E2E2E2E2Eull;
+
+    for ( ; end >= 8; end -= 8 )
+    {
+        uint64_t word;
+        std::memcpy( &word, name.data() + end - 8, sizeof word );
+        word ^= kDots;
+        auto dots = ~(((word & kLowBits) + kLowBits) | word | kLowBits); // The high bit of every byte that was a dot
+        if ( dots != 0 ) return end - 8 + unsigned( 63 - __builtin_clzll(dots) ) / 8;
+    }
+    while ( end > 0 )
+    {
+        if ( name[--end] == '.' ) return end;
+    }
+    return std::string_view::npos;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Load a list file
+std::shared_ptr<const PublicSuffixList> PublicSuffixList::load( const std::string& filename, std::string* error )
+{
+    std::ifstream file( filename, std::ios::binary );
+    std::stringstream text;
+    if ( !file || !(text << file.rdbuf()) )
+    {
+        *error = "cannot read " + filename;
+        return nullptr;
+    }
+    return parse( text.str(), error );
+}
+
+//! Compile a list from its text
+std::shared_ptr<const PublicSuffixList> PublicSuffixList::parse( std::string_view text, std::string* error )
+{
+    BuildNode root;
+    uint32_t rule_count = 0;
+    size_t line_number = 0;
+    for ( size_t pos = 0; pos < text.size(); ++line_number )
+    {
+        auto end = text.find( '\n', pos );
+        if ( end == std::string_view::npos ) end = text.size();
+        auto line = text.substr( pos, end - pos );
+        pos = end + 1;
+
+        auto rule = line.substr( 0, line.find_first_of(" \t\r") );
+        if ( rule.empty() || (rule.substr(0, 2) == "//") ) continue;
+
+        uint8_t flag = kRule;
+        if ( rule[0] == '!' ) flag = kException;
+        else if ( rule.substr(0, 2) == "*." ) flag = kWildcard;
+        rule.remove_prefix( (flag == kRule) ? 0 : (flag == kException) ? 1 : 2 );
+        std::string ascii;
+        if ( Idn::to_ascii(rule, &ascii) ) rule = ascii;
+
+        // Add the labels from the last one; an exception needs two labels, wildcards are only allowed first
+        bool valid = !rule.empty() && (rule.find('*') == std::string_view::npos) &&
+                     ((flag != kException) || (rule.find('.') != std::string_view::npos));
+        auto node = &root;
+        while ( valid && !rule.empty() )
+        {
+            auto dot = rule.rfind( '.' );
+            auto label = (dot == std::string_view::npos) ? rule : rule.substr( dot + 1 );
+            valid = !label.empty() && (label.size() <= UINT8_MAX) && ((dot == std::string_view::npos) || (dot > 0));
+            node = &node->children[std::string( label )];
+            rule = rule.substr( 0, (dot == std::string_view::npos) ? 0 : dot );
+        }
+        if ( !valid )
+        {
+            *error = "line " + std::to_string( line_number + 1 ) + ": invalid rule " + std::string( line );
+            return nullptr;
+        }
+        node->flags |= flag;
+        ++rule_count;
+    }
+
+    // Number the nodes breadth first, so that every node comes after its parent
+    std::vector<Node> nodes( 1, Node{} );
+    std::vector<const BuildNode*> build_nodes( 1, &root );
+    std::string labels;
+    for ( size_t i = 0; i < build_nodes.size(); ++i )
+    {
+        nodes[i].flags = build_nodes[i]->flags | (build_nodes[i]->children.empty() ? 0 : kParent);
+        for ( const auto& child : build_nodes[i]->children )
+        {
+            Node node{};
+            node.label_offset = uint32_t( labels.size() );
+            node.parent = uint32_t( i );
+            node.label_size = uint8_t( child.first.size() );
+            labels += child.first;
+            nodes.push_back( node );
+            build_nodes.push_back( &child.second );
+        }
+    }
+
+    // Hash table of the nodes by parent and label, at most half full
+    uint32_t slot_count = 2;
+    while ( slot_count < 2 * nodes.size() ) slot_count *= 2;
+    std::vector<uint32_t> slots( slot_count, 0 );
+    for ( uint32_t i = 1; i < nodes.size(); ++i )
+    {
+        auto label = std::string_view( labels ).substr( nodes[i].label_offset, nodes[i].label_size );
+        auto slot = first_slot( nodes[i].parent, label, slot_count );
+        while ( slots[slot] != 0 ) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i;
+    }
+
+    Header header{};
+    std::memcpy( header.magic, kMagic, sizeof kMagic );
+    header.rule_count = rule_count;
+    header.slot_count = slot_count;
+    header.node_count = uint32_t( nodes.size() );
+    header.labels_size = uint32_t( labels.size() );
+
+    auto list = std::make_shared<PublicSuffixList>();
+    list->size_ = sizeof(Header) + slots.size() * sizeof(uint32_t) + nodes.size() * sizeof(Node) + labels.size();
+    list->owned_.resize( (list->size_ + 7) / 8 );
+    auto image = reinterpret_cast<char*>( list->owned_.data() );
+    std::memcpy( image, &header, sizeof header );
+    image += sizeof header;
+    std::memcpy( image, slots.data(), slots.size() * sizeof(uint32_t) );
+    image += slots.size() * sizeof(uint32_t);
+    std::memcpy( image, nodes.data(), nodes.size() * sizeof(Node) );
+    image += nodes.size() * sizeof(Node);
+    std::memcpy( image, labels.data(), labels.size() );
+    return list;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Use a compiled list in place
+bool PublicSuffixList::attach( const void* image, size_t size )
+{
+    *this = PublicSuffixList();
+
+    // Every node and label must lie inside the image, nodes after their parent and the hash table must have
+    // an empty slot, so that a damaged image cannot make lookups read outside it or loop
+    auto base = static_cast<const char*>( image );
+    if ( (size < sizeof(Header)) || ((reinterpret_cast<uintptr_t>(base) & 7) != 0) ) return false;
+    auto header = reinterpret_cast<const Header*>( base );
+    auto image_size = sizeof(Header) + uint64_t(header->slot_count) * sizeof(uint32_t) +
+                      uint64_t(header->node_count) * sizeof(Node) + header->labels_size;
+    if ( (std::memcmp(header->magic, kMagic, sizeof kMagic) != 0) || (header->node_count == 0) ||
+         (header->slot_count < header->node_count) || ((header->slot_count & (header->slot_count - 1)) != 0) ||
+         (image_size > size) )
+    {
+        return false;
+    }
+
+    auto slots = reinterpret_cast<const uint32_t*>( base + sizeof(Header) );
+    bool empty_slot = false;
+    for ( uint32_t i = 0; i < header->slot_count; ++i )
+    {
+        if ( slots[i] >= header->node_count ) return false;
+        empty_slot |= (slots[i] == 0);
+    }
+
+    auto nodes = reinterpret_cast<const Node*>( slots + header->slot_count );
+    for ( uint32_t i = 1; i < header->node_count; ++i )
+    {
+        const auto& node = nodes[i];
+        if ( (uint64_t(node.label_offset) + node.label_size > header->labels_size) || (node.parent >= i) ) return false;
+    }
+    if ( !empty_slot ) return false;
+
+    attached_ = base;
+    size_ = size_t( image_size );
+    return true;
+}
+
+//! Number of rules of the list
+size_t PublicSuffixList::size() const
+{
+    return valid() ? header()->rule_count : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Size in bytes of the public suffix of a name
+size_t PublicSuffixList::public_suffix_size( std::string_view name ) const
+{
+    // Walk the trie from the last label. The rules matched so far end at the end of the name and start at
+    // label_start; a deeper match is a longer rule and prevails, an exception prevails over everything.
+    auto end = name.size();
+    auto dot = find_last_dot( name, end );
+    size_t suffix_size = name.size() - ((dot == std::string_view::npos) ? 0 : dot + 1); // The default rule "*"
+    if ( !valid() ) return suffix_size;
+
+    auto nodes = this->nodes();
+    for ( uint32_t node = 0; (nodes[node].flags & kParent) != 0; )
+    {
+        auto label_start = (dot == std::string_view::npos) ? 0 : dot + 1;
+        auto child = find_child( node, name.substr(label_start, end - label_start) );
+        if ( child == 0 ) break;
+
+        auto flags = nodes[child].flags;
+        if ( (flags & kException) != 0 ) return name.size() - end - 1; // The rule without its first label
+        if ( (flags & kRule) != 0 ) suffix_size = name.size() - label_start;
+        if ( dot == std::string_view::npos ) break;
+
+        // A wildcard rule matches the next label, whatever it is
+        node = child;
+        end = dot;
+        dot = find_last_dot( name, end );
+        if ( (flags & kWildcard) != 0 ) suffix_size = name.size() - ((dot == std::string_view::npos) ? 0 : dot + 1);
+    }
+    return suffix_size;
+}
+
+//! Size in bytes of the shortest suffix of a name that a lookup probes
+size_t PublicSuffixList::shortest_lookup_suffix( std::string_view name ) const
+{
+    if ( !valid() ) return 1;
+
+    auto suffix_size = public_suffix_size( name );
+    if ( suffix_size >= name.size() ) return name.size() + 1;
+
+    // The registrable domain is the public suffix with the label before it
+    auto dot = name.size() - suffix_size - 1;
+    auto previous_dot = find_last_dot( name, dot );
+    return name.size() - ((previous_dot == std::string_view::npos) ? 0 : previous_dot + 1);
+}
+
+//! Slot of the hash table where the search for a child of a node starts
+size_t PublicSuffixList::first_slot( uint32_t parent, std::string_view label, uint32_t slot_count )
+{
+    return size_t( label_hash(parent, label) ) & (slot_count - 1);
+}
+
+//! Find the child of a node with a label
+uint32_t PublicSuffixList::find_child( uint32_t parent, std::string_view label ) const
+{
+    auto header = this->header();
+    auto slots = this->slots();
+    auto nodes = this->nodes();
+    auto labels = this->labels();
+    for ( auto slot = first_slot( parent, label, header->slot_count ); slots[slot] != 0; slot = (slot + 1) & (header->slot_count - 1) )
+    {
+        const auto& node = nodes[slots[slot]];
+        if ( (node.parent == parent) && (node.label_size == label.size()) &&
+             (std::memcmp(labels + node.label_offset, label.data(), label.size()) == 0) )
+        {
+            return slots[slot];
+        }
+    }
+    return 0;
+}
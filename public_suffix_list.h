@@ -0,0 +1,133 @@
+#ifndef DOMAINDB_PUBLIC_SUFFIX_LIST_H
+#define DOMAINDB_PUBLIC_SUFFIX_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! The Public Suffix List (publicsuffix.org) compiled to a trie of labels, read from the last label.
+//!
+//! A public suffix is a name under which anyone can register a domain, such as "com", "co.uk" or
+//! "s3.amazonaws.com"; the registrable domain of a name is its public suffix with one more label. The
+//! rules are those of the list: the longest matching rule wins, "*.ck" makes every label under ck a public
+//! suffix, "!www.ck" is an exception to it, and a name matching no rule has its last label as public suffix.
+//! Internationalized rules are stored in their ASCII form, see Idn.
+//!
+//! The compiled list is one block without pointers: a hash table of the nodes by parent and label, the nodes
+//! and their labels. A lookup reads each label of the name once from the end and finds the next node with
+//! one probe of the table, usually one cache line. It is kept inside CompiledDb images and used there in place.
+class PublicSuffixList
+{
+public:
+
+    //! Load a list file in the format of public_suffix_list.dat
+    //!
+    //! \param filename - path and name of the file
+    //! \param error    - receives a description of the problem on failure
+    //! \return the list, nullptr on failure
+    static std::shared_ptr<const PublicSuffixList> load( const std::string& filename, std::string* error );
+
+    //! Compile a list from its text: one rule per line up to the first white space, "//" comments
+    //!
+    //! \param text  - the list
+    //! \param error - receives a description of the problem on failure
+    //! \return the list, nullptr on failure
+    static std::shared_ptr<const PublicSuffixList> parse( std::string_view text, std::string* error );
+
+    //! Create an empty list, see attach()
+    PublicSuffixList() = default;
+
+    //! Use a compiled list in place. The list must stay mapped and unchanged while the object is used.
+    //!
+    //! \param image - start of the compiled list, aligned to 8 bytes, see image()
+    //! \param size  - size of the compiled list in bytes
+    //! \return true if the list is valid, false otherwise; the object is then empty
+    bool attach( const void* image, size_t size );
+
+    //! True if the list has been compiled or attached
+    bool valid() const { return base() != nullptr; }
+
+    //! The compiled list, see attach()
+    std::string_view image() const { return std::string_view( base(), valid() ? size_ : 0 ); }
+
+    //! Number of rules of the list
+    size_t size() const;
+
+    //! Size in bytes of the public suffix of a name
+    //!
+    //! \param name - a domain name in ASCII form
+    //! \return the size of the suffix made of the labels of the prevailing rule
+    size_t public_suffix_size( std::string_view name ) const;
+
+    //! True if a name is a public suffix
+    bool is_public_suffix( std::string_view name ) const { return public_suffix_size( name ) == name.size(); }
+
+    //! Size in bytes of the shortest suffix of a name that a lookup probes: its registrable domain, or more
+    //! than the size of the name if the name is a public suffix. 1 for an empty list: every suffix is probed.
+    size_t shortest_lookup_suffix( std::string_view name ) const;
+
+private:
+
+    struct Header
+    {
+        char        magic[4];       //!< "PSL1"
+        uint32_t    rule_count;
+        uint32_t    slot_count;     //!< a power of 2, at least twice the number of nodes that have a parent
+        uint32_t    node_count;     //!< node 0 is the root, with an empty label
+        uint32_t    labels_size;    //!< labels follow the nodes, not terminated
+        uint32_t    padding;
+    };
+
+    struct Node
+    {
+        uint32_t    label_offset;   //!< from the start of the labels
+        uint32_t    parent;         //!< index of the parent node, nodes come after their parent
+        uint8_t     label_size;
+        uint8_t     flags;          //!< kRule, kWildcard, kException and kParent
+        uint16_t    padding;
+    };
+
+    static_assert( sizeof(Header) == 24, "the image layout must not depend on the compiler" );
+    static_assert( sizeof(Node) == 12, "the image layout must not depend on the compiler" );
+
+    //! The labels from the root to the node are a rule
+    static const uint8_t kRule = 1;
+    //! "*." followed by the labels from the root to the node is a rule
+    static const uint8_t kWildcard = 2;
+    //! "!" followed by the labels from the root to the node is a rule
+    static const uint8_t kException = 4;
+    //! The node has children
+    static const uint8_t kParent = 8;
+
+    std::vector<uint64_t>   owned_;                 //!< the compiled list if it is not attached, 8 byte aligned
+    const char*             attached_ = nullptr;    //!< the compiled list if it is attached
+    size_t                  size_ = 0;              //!< size of the compiled list in bytes
+
+    //! Start of the compiled list, nullptr if empty
+    const char* base() const
+    {
+        return attached_ ? attached_ : (owned_.empty() ? nullptr : reinterpret_cast<const char*>( owned_.data() ));
+    }
+    const Header* header() const { return reinterpret_cast<const Header*>( base() ); }
+    //! Hash table of the nodes except the root: node indexes, 0 for an empty slot, linear probing
+    const uint32_t* slots() const { return reinterpret_cast<const uint32_t*>( base() + sizeof(Header) ); }
+    const Node* nodes() const { return reinterpret_cast<const Node*>( slots() + header()->slot_count ); }
+    const char* labels() const { return reinterpret_cast<const char*>( nodes() + header()->node_count ); }
+
+    //! Slot of the hash table where the search for a child of a node starts
+    static size_t first_slot( uint32_t parent, std::string_view label, uint32_t slot_count );
+
+    //! Find the child of a node with a label
+    //!
+    //! \return the index of the child, 0 if there is none
+    uint32_t find_child( uint32_t parent, std::string_view label ) const;
+};
+
+#endif //DOMAINDB_PUBLIC_SUFFIX_LIST_H
@@ -0,0 +1,138 @@
+#include "record_splitter.h"
+
+//! Create a splitter of a file being read
+RecordSplitter::RecordSplitter( FileReader& reader, size_t batch_bytes ) :
+    reader_(reader), batch_bytes_(batch_bytes), data_(reader.data())
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Split the file, waiting for the reader as needed
+bool RecordSplitter::split( const ServiceHandler& on_service, const BatchHandler& on_batch )
+{
+    if ( !consume('{') ) return false;
+
+    bool more = !consume( '}' );
+    while ( more )
+    {
+        if ( !split_service(on_service, on_batch) || !next_separator('}', &more) ) return false;
+    }
+
+    // Nothing but whitespace may follow
+    skip_whitespace();
+    return !has( pos_ );
+}
+
+//! Split one service: "service" : [ entry, ... ]
+bool RecordSplitter::split_service( const ServiceHandler& on_service, const BatchHandler& on_batch )
+{
+    skip_whitespace();
+    auto key_begin = pos_;
+    if ( !has(pos_) || (data_[pos_] != '"') || !skip_string() ) return false;
+    if ( !on_service(std::string_view(data_ + key_begin, pos_ - key_begin)) ) return false;
+    if ( !consume(':') || !consume('[') ) return false;
+
+    bool more = !consume( ']' );
+    for ( auto batch_begin = pos_; more; )
+    {
+        skip_whitespace();
+        if ( !skip_value() ) return false;
+        auto entry_end = pos_;
+        if ( !next_separator(']', &more) ) return false;
+
+        if ( !more || (entry_end - batch_begin >= batch_bytes_) )
+        {
+            if ( !on_batch(std::string_view(data_ + batch_begin, entry_end - batch_begin)) ) return false;
+            skip_whitespace();
+            batch_begin = pos_;
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Skip json whitespace
+void RecordSplitter::skip_whitespace()
+{
+    while ( has(pos_) )
+    {
+        auto ch = data_[pos_];
+        if ( (ch != ' ') && (ch != '\n') && (ch != '\t') && (ch != '\r') ) break;
+        ++pos_;
+    }
+}
+
+//! Skip whitespace and consume a character if it is next
+bool RecordSplitter::consume( char ch )
+{
+    skip_whitespace();
+    if ( !has(pos_) || (data_[pos_] != ch) ) return false;
+    ++pos_;
+    return true;
+}
+
+//! Consume the separator after an element of an array or an object
+bool RecordSplitter::next_separator( char close, bool* more )
+{
+    skip_whitespace();
+    if ( !has(pos_) ) return false;
+    auto separator = data_[pos_++];
+    *more = (separator == ',');
+    return *more || (separator == close);
+}
+
+//! Skip a string starting at pos_
+bool RecordSplitter::skip_string()
+{
+    ++pos_; // The opening quote
+    while ( has(pos_) )
+    {
+        auto ch = data_[pos_++];
+        if ( ch == '"' ) return true;
+        if ( ch == '\\' ) ++pos_;
+    }
+    return false;
+}
+
+//! Skip a json value starting at pos_
+bool RecordSplitter::skip_value()
+{
+    if ( !has(pos_) ) return false;
+
+    auto ch = data_[pos_];
+    if ( ch == '"' ) return skip_string();
+
+    if ( (ch == '[') || (ch == '{') )
+    {
+        size_t depth = 0;
+        while ( has(pos_) )
+        {
+            ch = data_[pos_];
+            if ( ch == '"' )
+            {
+                if ( !skip_string() ) return false;
+                continue;
+            }
+            ++pos_;
+            if ( (ch == '[') || (ch == '{') ) ++depth;
+            else if ( ((ch == ']') || (ch == '}')) && (--depth == 0) ) return true;
+        }
+        return false;
+    }
+
+    // A number or a literal: up to the next delimiter
+    auto begin = pos_;
+    while ( has(pos_) )
+    {
+        ch = data_[pos_];
+        if ( (ch == ',') || (ch == ']') || (ch == '}') || (ch == ' ') || (ch == '\n') || (ch == '\t') || (ch == '\r') ) break;
+        ++pos_;
+    }
+    return pos_ != begin;
+}
@@ -0,0 +1,83 @@
+#ifndef DOMAINDB_RECORD_SPLITTER_H
+#define DOMAINDB_RECORD_SPLITTER_H
+
+#include "file_reader.h"
+#include <functional>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Splits a database file into services and batches of domain entries as the file is read, so that each
+//! batch can be parsed while the rest of the file is still being read.
+//!
+//! The file must have the layout of the database, { "service" : [ entry, entry, ... ], ... }. The splitter
+//! checks this outer layout only; it finds where each entry ends but leaves checking the entries to the
+//! json parser.
+class RecordSplitter
+{
+public:
+
+    //! Receives the key of a service, with its quotes; returns false to stop splitting
+    using ServiceHandler = std::function<bool( std::string_view key )>;
+
+    //! Receives consecutive entries of the last service, separated by commas; returns false to stop splitting
+    using BatchHandler = std::function<bool( std::string_view entries )>;
+
+    //! Create a splitter of a file being read
+    //!
+    //! \param reader      - reader of the file, open
+    //! \param batch_bytes - approximate size of a batch of entries
+    RecordSplitter( FileReader& reader, size_t batch_bytes );
+
+    //! Split the file, waiting for the reader as needed
+    //!
+    //! \param on_service - called for every service
+    //! \param on_batch   - called for every batch of entries of the last service
+    //! \return true if the whole file was split, false if it does not have the layout of the database,
+    //!         could not be read or a handler stopped
+    bool split( const ServiceHandler& on_service, const BatchHandler& on_batch );
+
+private:
+
+    FileReader&     reader_;
+    const size_t    batch_bytes_;
+    const char*     data_;
+    size_t          ready_ = 0;
+    size_t          pos_ = 0;
+
+    //! Split one service: "service" : [ entry, ... ]
+    bool split_service( const ServiceHandler& on_service, const BatchHandler& on_batch );
+
+    //! True if the byte at pos is read, waiting for it if needed; false at the end of the file
+    bool has( size_t pos )
+    {
+        if ( pos < ready_ ) return true;
+        ready_ = reader_.wait_for( pos + 1 );
+        return pos < ready_;
+    }
+
+    //! Skip json whitespace
+    void skip_whitespace();
+
+    //! Skip whitespace and consume a character if it is next
+    //!
+    //! \return true if the character was consumed
+    bool consume( char ch );
+
+    //! Consume the separator after an element of an array or an object
+    //!
+    //! \param close - the closing bracket of the array or the object
+    //! \param more  - receives true for a comma, false for the closing bracket
+    //! \return false if neither follows
+    bool next_separator( char close, bool* more );
+
+    //! Skip a string starting at pos_
+    bool skip_string();
+
+    //! Skip a json value starting at pos_, checking only that strings and brackets are closed
+    bool skip_value();
+};
+
+#endif //DOMAINDB_RECORD_SPLITTER_H
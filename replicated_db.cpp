@@ -0,0 +1,183 @@
+#include "replicated_db.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//! Size of the huge pages the images are placed in
+static const size_t kHugePageSize = size_t(2) << 20;
+
+//! Directory of the NUMA topology in sysfs
+static const char kNodeDirectory[] = "/sys/devices/system/node/";
+
+//! Describe the last system call error
+static bool fail( std::string* error, const std::string& message )
+{
+    auto error_text = std::strerror( errno );
+    if ( error != nullptr ) *error = message + ": " + error_text;
+    return false;
+}
+
+//! First line of a text file, empty if it cannot be read
+static std::string read_line( const std::string& filename )
+{
+    std::ifstream file( filename );
+    std::string line;
+    std::getline( file, line );
+    return line;
+}
+
+//! Parse a sysfs list of CPUs or nodes such as "0-3,8-11"
+static std::vector<size_t> parse_list( const std::string& text )
+{
+    std::vector<size_t> items;
+    for ( size_t pos = 0; pos < text.size(); )
+    {
+        auto end = std::min( text.find(',', pos), text.size() );
+        auto item = text.substr( pos, end - pos );
+        pos = end + 1;
+
+        auto dash = item.find( '-' );
+        char* rest = nullptr;
+        auto first = std::strtoul( item.c_str(), &rest, 10 );
+        if ( rest == item.c_str() ) continue;
+        auto last = (dash == std::string::npos) ? first : std::strtoul( item.c_str() + dash + 1, nullptr, 10 );
+        for ( auto i = first; i <= last; ++i ) items.push_back( i );
+    }
+    return items;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Place a compiled image
+std::shared_ptr<const ReplicatedDb> ReplicatedDb::create( std::string_view image, const Options& options, std::string* error )
+{
+    std::shared_ptr<ReplicatedDb> db( new ReplicatedDb() );
+
+    // The node of every CPU; a machine without NUMA information is one node
+    auto cpu_count = sysconf( _SC_NPROCESSORS_CONF );
+    db->cpu_nodes_.assign( size_t( (cpu_count > 0) ? cpu_count : 1 ), 0 );
+    for ( auto node : parse_list(read_line( std::string(kNodeDirectory) + "online" )) )
+    {
+        db->node_count_ = std::max( db->node_count_, node + 1 );
+        for ( auto cpu : parse_list(read_line( std::string(kNodeDirectory) + "node" + std::to_string(node) + "/cpulist" )) )
+        {
+            if ( cpu >= db->cpu_nodes_.size() ) db->cpu_nodes_.resize( cpu + 1, 0 );
+            db->cpu_nodes_[cpu] = uint16_t( node );
+        }
+    }
+
+    db->replicas_.resize( options.replicate ? db->node_count_ : 1 );
+    for ( size_t i = 0; i < db->replicas_.size(); ++i )
+    {
+        if ( !place(image, options, options.replicate ? int(i) : -1, &db->replicas_[i], error) ) return nullptr;
+    }
+
+    db->cpu_replicas_.resize( db->cpu_nodes_.size() );
+    for ( size_t cpu = 0; cpu < db->cpu_nodes_.size(); ++cpu ) db->cpu_replicas_[cpu] = options.replicate ? db->cpu_nodes_[cpu] : 0;
+    db->counters_.reset( new CpuCounter[db->cpu_nodes_.size()] );
+    return db;
+}
+
+//! Map memory for a copy of the image and copy it
+bool ReplicatedDb::place( std::string_view image, const Options& options, int node, Replica* replica, std::string* error )
+{
+    auto size = (std::max<size_t>( image.size(), 1 ) + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+    // Reserved huge pages first; they fail when the system has none
+    void* address = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if ( options.huge_pages )
+    {
+        address = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+        if ( address != MAP_FAILED ) replica->page_mode = PageMode::huge_pages;
+    }
+#endif
+    if ( address == MAP_FAILED )
+    {
+        // Map one huge page more and trim it, so that the image starts on a huge page boundary where
+        // transparent huge pages can back it
+        auto mapped = mmap( nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( mapped == MAP_FAILED ) return fail( error, "cannot map " + std::to_string(size) + " bytes" );
+        auto start = (reinterpret_cast<uintptr_t>(mapped) + kHugePageSize - 1) & ~uintptr_t(kHugePageSize - 1);
+        auto head = start - reinterpret_cast<uintptr_t>(mapped);
+        if ( head != 0 ) munmap( mapped, head );
+        munmap( reinterpret_cast<void*>(start + size), kHugePageSize - head );
+        address = reinterpret_cast<void*>( start );
+#ifdef MADV_HUGEPAGE
+        if ( options.huge_pages && (madvise(address, size, MADV_HUGEPAGE) == 0) ) replica->page_mode = PageMode::transparent_huge_pages;
+#endif
+    }
+    replica->address = address;
+    replica->size = size;
+
+    // Bind the pages to the node before they are touched; without the permission or a kernel with NUMA
+    // support the copy stays where the copying thread allocates it
+    if ( node >= 0 )
+    {
+        static const size_t kMaskBits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask( size_t(node) / kMaskBits + 1, 0 );
+        mask[size_t(node) / kMaskBits] = 1ul << (size_t(node) % kMaskBits);
+        if ( syscall(SYS_mbind, address, size, MPOL_BIND, mask.data(), mask.size() * kMaskBits + 1, 0) == 0 ) replica->node = node;
+    }
+
+    std::memcpy( address, image.data(), image.size() );
+    mprotect( address, size, PROT_READ );
+    if ( !replica->db.attach(address, image.size()) )
+    {
+        if ( error != nullptr ) *error = "the image is not a valid CompiledDb image";
+        return false;
+    }
+    return true;
+}
+
+ReplicatedDb::~ReplicatedDb()
+{
+    for ( auto& replica : replicas_ )
+    {
+        if ( replica.address != nullptr ) munmap( replica.address, replica.size );
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! The CPU the calling thread runs on
+size_t ReplicatedDb::current_cpu() const
+{
+    auto cpu = sched_getcpu();
+    return ((cpu >= 0) && (size_t(cpu) < cpu_nodes_.size())) ? size_t( cpu ) : 0;
+}
+
+//! How the images are backed
+ReplicatedDb::PageMode ReplicatedDb::page_mode() const
+{
+    auto page_mode = PageMode::huge_pages;
+    for ( const auto& replica : replicas_ ) page_mode = std::min( page_mode, replica.page_mode );
+    return page_mode;
+}
+
+//! Memory mapped for all images
+size_t ReplicatedDb::memory_usage() const
+{
+    size_t size = 0;
+    for ( const auto& replica : replicas_ ) size += replica.size;
+    return size;
+}
+
+//! Number of lookups run on the CPUs of each NUMA node
+std::vector<uint64_t> ReplicatedDb::lookups_per_node() const
+{
+    std::vector<uint64_t> lookups( node_count_, 0 );
+    for ( size_t cpu = 0; cpu < cpu_nodes_.size(); ++cpu ) lookups[cpu_nodes_[cpu]] += counters_[cpu].lookups.load( std::memory_order_relaxed );
+    return lookups;
+}
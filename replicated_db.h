@@ -0,0 +1,144 @@
+#ifndef DOMAINDB_REPLICATED_DB_H
+#define DOMAINDB_REPLICATED_DB_H
+
+#include "compiled_db.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! A CompiledDb image placed for lookups from many threads on a large machine.
+//!
+//! The image is copied to memory backed by 2 MB pages, so that a lookup walking a large image needs a few
+//! TLB entries instead of one per 4 KB page: explicit huge pages (MAP_HUGETLB) when the system has reserved
+//! some, otherwise transparent huge pages requested with madvise, otherwise normal pages. The memory is
+//! read-only once the image is copied.
+//!
+//! With replication, every NUMA node gets its own copy, bound to the memory of the node, and a lookup reads
+//! the copy of the node of the CPU it runs on. Lookups are counted per CPU, see lookups_per_node(), which
+//! shows the node that served them.
+//!
+//! The object is an immutable snapshot: lookups may run on any number of threads. Build a new one for a
+//! new database and swap shared pointers, like DomainLoader snapshots.
+class ReplicatedDb
+{
+public:
+
+    using MatchResult = CompiledDb::MatchResult;
+
+    //! How the memory of the images is backed
+    enum class PageMode
+    {
+        normal,                 //!< 4 KB pages
+        transparent_huge_pages, //!< 2 MB pages requested with madvise(MADV_HUGEPAGE), given when the kernel can
+        huge_pages              //!< 2 MB pages reserved with MAP_HUGETLB
+    };
+
+    struct Options
+    {
+        bool    huge_pages = true;  //!< back the images with 2 MB pages when possible
+        bool    replicate = false;  //!< one image per NUMA node instead of one in total
+    };
+
+    //! Place a compiled image
+    //!
+    //! \param image   - a CompiledDb image, see CompiledDb::compile; it is copied
+    //! \param options - placement options
+    //! \param error   - receives a description of the problem on failure
+    //! \return the placed database, nullptr on failure
+    static std::shared_ptr<const ReplicatedDb> create( std::string_view image, const Options& options, std::string* error );
+
+    ~ReplicatedDb();
+
+    ReplicatedDb( const ReplicatedDb& ) = delete;
+    ReplicatedDb& operator=( const ReplicatedDb& ) = delete;
+
+    //! Find a domain using inexact match in the image of the calling CPU's node, see DomainTree::match_domain
+    MultiConnectionType match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+    {
+        return local_db().match_domain( domain, port, protocol_type );
+    }
+
+    //! Classify a domain in the image of the calling CPU's node, see DomainTree::classify_domain
+    MatchResult classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+    {
+        return local_db().classify_domain( domain, port, protocol_type );
+    }
+
+    //! Number of domains in the database
+    size_t size() const { return replicas_.front().db.size(); }
+
+    //! DomainTree::fingerprint() of the database
+    uint64_t fingerprint() const { return replicas_.front().db.fingerprint(); }
+
+    //! Number of images: the number of NUMA nodes with replication, otherwise 1
+    size_t replica_count() const { return replicas_.size(); }
+
+    //! Number of NUMA nodes of the machine, 1 if it has no NUMA information
+    size_t node_count() const { return node_count_; }
+
+    //! How the images are backed; the smallest pages if the images differ
+    PageMode page_mode() const;
+
+    //! Memory mapped for all images, in bytes
+    size_t memory_usage() const;
+
+    //! Number of lookups run on the CPUs of each NUMA node, indexed by node. With replication the node of a
+    //! lookup is also the node whose image served it.
+    std::vector<uint64_t> lookups_per_node() const;
+
+private:
+
+    //! One copy of the image
+    struct Replica
+    {
+        void*       address = nullptr;
+        size_t      size = 0;           //!< size of the mapping
+        PageMode    page_mode = PageMode::normal;
+        int         node = -1;          //!< node the memory is bound to, -1 if it is not bound
+        CompiledDb  db;
+    };
+
+    //! Lookup counter of one CPU, in its own cache line so that CPUs never write the same line
+    struct alignas(64) CpuCounter
+    {
+        std::atomic<uint64_t>   lookups{0};
+    };
+
+    std::vector<Replica>            replicas_;
+    size_t                          node_count_ = 1;
+    std::vector<uint16_t>           cpu_nodes_;     //!< NUMA node of each CPU
+    std::vector<uint16_t>           cpu_replicas_;  //!< replica read by each CPU
+    std::unique_ptr<CpuCounter[]>   counters_;      //!< by CPU
+
+    ReplicatedDb() = default;
+
+    //! The replica of the calling CPU; counts the lookup
+    const CompiledDb& local_db() const
+    {
+        auto cpu = current_cpu();
+        counters_[cpu].lookups.fetch_add( 1, std::memory_order_relaxed );
+        return replicas_[cpu_replicas_[cpu]].db;
+    }
+
+    //! The CPU the calling thread runs on, 0 if it is not known
+    size_t current_cpu() const;
+
+    //! Map memory for a copy of the image and copy it
+    //!
+    //! \param image   - the image
+    //! \param options - placement options
+    //! \param node    - NUMA node to bind the memory to, -1 for none
+    //! \param replica - receives the mapping
+    //! \param error   - receives a description of the problem on failure
+    //! \return true on success
+    static bool place( std::string_view image, const Options& options, int node, Replica* replica, std::string* error );
+};
+
+#endif //DOMAINDB_REPLICATED_DB_H
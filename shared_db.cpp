@@ -0,0 +1,243 @@
+#include "shared_db.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//! The control segment of a shared database
+struct SharedDb::Control
+{
+    char                    magic[8];   //!< "DOMAINDC"
+    uint32_t                version;    //!< kControlVersion
+    uint32_t                padding;
+    std::atomic<uint64_t>   generation; //!< number of the current generation, 0 before the first publish
+};
+
+static_assert( std::atomic<uint64_t>::is_always_lock_free, "the generation is shared between processes" );
+
+static const char kControlMagic[8] = { 'D', 'O', 'M', 'A', 'I', 'N', 'D', 'C' };
+static const uint32_t kControlVersion = 1;
+
+//! Name of the segment of an image generation
+static std::string segment_name( const std::string& name, uint64_t generation )
+{
+    return name + "." + std::to_string( generation );
+}
+
+//! Describe the last system call error
+static bool fail( std::string* error, const std::string& message )
+{
+    auto error_text = std::strerror( errno );
+    if ( error != nullptr ) *error = message + ": " + error_text;
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Publish a database as the next generation
+bool SharedDb::publish( const std::string& name, const DomainTree& domain_tree, uint64_t* generation, std::string* error )
+{
+    auto image = CompiledDb::compile( domain_tree );
+
+    // The control segment is created zero filled, that is with generation 0
+    int control_fd = shm_open( name.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( control_fd < 0 ) return fail( error, "cannot open " + name );
+    struct stat control_stat;
+    if ( (fstat(control_fd, &control_stat) != 0) ||
+         ((size_t(control_stat.st_size) < sizeof(Control)) && (ftruncate(control_fd, sizeof(Control)) != 0)) )
+    {
+        fail( error, "cannot size " + name );
+        close( control_fd );
+        return false;
+    }
+    auto address = mmap( nullptr, sizeof(Control), PROT_READ | PROT_WRITE, MAP_SHARED, control_fd, 0 );
+    close( control_fd );
+    if ( address == MAP_FAILED ) return fail( error, "cannot map " + name );
+    auto control = static_cast<Control*>( address );
+
+    if ( control->version == 0 )
+    {
+        std::memcpy( control->magic, kControlMagic, sizeof kControlMagic );
+        control->version = kControlVersion;
+    }
+    if ( (std::memcmp(control->magic, kControlMagic, sizeof kControlMagic) != 0) || (control->version != kControlVersion) )
+    {
+        munmap( address, sizeof(Control) );
+        errno = EINVAL;
+        return fail( error, name + " is not a domaindb control segment" );
+    }
+
+    // Write the image to a new segment; a segment left by a failed publish is replaced
+    auto next = control->generation.load( std::memory_order_acquire ) + 1;
+    auto segment = segment_name( name, next );
+    shm_unlink( segment.c_str() );
+    int fd = shm_open( segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+    void* image_address = MAP_FAILED;
+    if ( (fd >= 0) && (ftruncate(fd, off_t(image.size())) == 0) )
+    {
+        image_address = mmap( nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    if ( image_address == MAP_FAILED )
+    {
+        fail( error, "cannot create " + segment );
+        if ( fd >= 0 ) close( fd );
+        shm_unlink( segment.c_str() );
+        munmap( address, sizeof(Control) );
+        return false;
+    }
+    close( fd );
+    std::memcpy( image_address, image.data(), image.size() );
+    munmap( image_address, image.size() );
+
+    // Switch the readers, then drop the name of the previous image; its memory lives while it is mapped
+    control->generation.store( next, std::memory_order_release );
+    if ( next > 1 ) shm_unlink( segment_name(name, next - 1).c_str() );
+    munmap( address, sizeof(Control) );
+
+    *generation = next;
+    return true;
+}
+
+//! Remove the control segment and the current image of a database
+bool SharedDb::unlink( const std::string& name )
+{
+    SharedDb reader( name );
+    if ( reader.map_control(nullptr) )
+    {
+        shm_unlink( segment_name(name, reader.control_->generation.load(std::memory_order_acquire)).c_str() );
+    }
+    return shm_unlink( name.c_str() ) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+SharedDb::SharedDb( std::string name ) :
+    name_(std::move(name))
+{
+}
+
+SharedDb::~SharedDb()
+{
+    delete mapping_.load( std::memory_order_acquire );
+    if ( control_ != nullptr ) munmap( const_cast<Control*>(control_), sizeof(Control) );
+}
+
+SharedDb::Mapping::~Mapping()
+{
+    if ( address != nullptr ) munmap( address, size );
+}
+
+//! Map the control segment if it is not mapped yet
+bool SharedDb::map_control( std::string* error )
+{
+    if ( control_ != nullptr ) return true;
+
+    int fd = shm_open( name_.c_str(), O_RDONLY, 0 );
+    if ( fd < 0 ) return fail( error, "cannot open " + name_ );
+    struct stat control_stat;
+    void* address = MAP_FAILED;
+    if ( (fstat(fd, &control_stat) == 0) && (size_t(control_stat.st_size) >= sizeof(Control)) )
+    {
+        address = mmap( nullptr, sizeof(Control), PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+    if ( address == MAP_FAILED ) return fail( error, "cannot map " + name_ );
+
+    auto control = static_cast<const Control*>( address );
+    if ( (std::memcmp(control->magic, kControlMagic, sizeof kControlMagic) != 0) || (control->version != kControlVersion) )
+    {
+        munmap( address, sizeof(Control) );
+        errno = EINVAL;
+        return fail( error, name_ + " is not a domaindb control segment" );
+    }
+
+    control_ = control;
+    return true;
+}
+
+//! Attach to the current generation if it is newer than the attached one
+bool SharedDb::refresh( std::string* error )
+{
+    // Unmap replaced images as soon as no lookup uses them, rather than with the next batch of retired objects
+    Epoch::instance().reclaim();
+
+    auto current = mapping_.load( std::memory_order_relaxed );
+    if ( !map_control(error) ) return false;
+
+    auto generation = control_->generation.load( std::memory_order_acquire );
+    if ( (current != nullptr) && (current->generation == generation) ) return true;
+    if ( generation == 0 )
+    {
+        errno = ENOENT;
+        return fail( error, "nothing is published in " + name_ );
+    }
+
+    // The segment is unlinked if a newer generation was published meanwhile; the next refresh picks that one
+    auto segment = segment_name( name_, generation );
+    int fd = shm_open( segment.c_str(), O_RDONLY, 0 );
+    if ( fd < 0 ) return fail( error, "cannot open " + segment ) || (current != nullptr);
+
+    auto mapping = std::make_unique<Mapping>();
+    mapping->generation = generation;
+    struct stat image_stat;
+    if ( fstat(fd, &image_stat) == 0 )
+    {
+        mapping->size = size_t( image_stat.st_size );
+        auto address = mmap( nullptr, mapping->size, PROT_READ, MAP_SHARED, fd, 0 );
+        if ( address != MAP_FAILED ) mapping->address = address;
+    }
+    close( fd );
+    if ( mapping->address == nullptr ) return fail( error, "cannot map " + segment ) || (current != nullptr);
+    if ( !mapping->db.attach(mapping->address, mapping->size) )
+    {
+        errno = EINVAL;
+        return fail( error, segment + " is not a valid database image" ) || (current != nullptr);
+    }
+
+    mapping_.store( mapping.release(), std::memory_order_release );
+    Epoch::instance().retire( current );
+    Epoch::instance().reclaim();
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Number of the attached generation
+uint64_t SharedDb::generation() const
+{
+    Epoch::Guard guard;
+    auto mapping = mapping_.load( std::memory_order_acquire );
+    return (mapping != nullptr) ? mapping->generation : 0;
+}
+
+//! Find a domain using inexact match
+MultiConnectionType SharedDb::match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+{
+    Epoch::Guard guard;
+    auto mapping = mapping_.load( std::memory_order_acquire );
+    return (mapping != nullptr) ? mapping->db.match_domain( domain, port, protocol_type ) : DomainTree::kUnclassified;
+}
+
+//! Classify a domain in a single traversal
+CompiledDb::MatchResult SharedDb::classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+{
+    Epoch::Guard guard;
+    auto mapping = mapping_.load( std::memory_order_acquire );
+    return (mapping != nullptr) ? mapping->db.classify_domain( domain, port, protocol_type ) : CompiledDb::MatchResult();
+}
+
+//! Number of domains in the attached generation
+size_t SharedDb::size() const
+{
+    Epoch::Guard guard;
+    auto mapping = mapping_.load( std::memory_order_acquire );
+    return (mapping != nullptr) ? mapping->db.size() : 0;
+}
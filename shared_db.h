@@ -0,0 +1,98 @@
+#ifndef DOMAINDB_SHARED_DB_H
+#define DOMAINDB_SHARED_DB_H
+
+#include "compiled_db.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! A CompiledDb image shared by many processes through POSIX shared memory.
+//!
+//! A database named "/domaindb" is published in two kinds of segments:
+//!     /domaindb           - control segment holding the number of the current generation
+//!     /domaindb.<n>       - the CompiledDb image of generation n, written once and never changed
+//! A loader process publishes a new generation by writing its image to a new segment and then storing its
+//! number in the control segment. The previous image is unlinked: processes that mapped it keep it until they
+//! switch, and the memory is freed when the last one unmaps it. All workers map the same pages, so N workers
+//! use the memory of one image.
+//!
+//! A SharedDb object is the read-only view of the database in a worker process. Lookups are lock-free and
+//! may run on any number of threads. refresh() switches to a newer generation: lookups running meanwhile
+//! finish on the old image, which is unmapped once none uses it (see Epoch).
+class SharedDb
+{
+public:
+
+    //! Publish a database as the next generation. Only one process may publish a database at a time.
+    //!
+    //! \param name        - name of the database, a POSIX shared memory name such as "/domaindb"
+    //! \param domain_tree - the database
+    //! \param generation  - receives the number of the published generation
+    //! \param error       - receives a description of the problem on failure
+    //! \return true on success, false on failure
+    static bool publish( const std::string& name, const DomainTree& domain_tree, uint64_t* generation, std::string* error );
+
+    //! Remove the control segment and the current image of a database. Attached readers keep working
+    //! with the image they have.
+    //!
+    //! \param name - name of the database
+    //! \return true if the database existed
+    static bool unlink( const std::string& name );
+
+    //! Create a reader; call refresh() to attach to the current generation
+    //!
+    //! \param name - name of the database
+    explicit SharedDb( std::string name );
+
+    ~SharedDb();
+
+    SharedDb( const SharedDb& ) = delete;
+    SharedDb& operator=( const SharedDb& ) = delete;
+
+    //! Attach to the current generation if it is newer than the attached one. Calls must be serialized;
+    //! lookups may run meanwhile.
+    //!
+    //! \param error - receives a description of the problem on failure
+    //! \return true if a generation is attached, possibly an older one when attaching the newest failed
+    bool refresh( std::string* error = nullptr );
+
+    //! Number of the attached generation, 0 if none
+    uint64_t generation() const;
+
+    //! Find a domain using inexact match, see DomainTree::match_domain. Unclassified if nothing is attached.
+    MultiConnectionType match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! Classify a domain in a single traversal, see DomainTree::classify_domain
+    CompiledDb::MatchResult classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! Number of domains in the attached generation
+    size_t size() const;
+
+private:
+
+    //! One mapped generation
+    struct Mapping
+    {
+        uint64_t    generation = 0;
+        void*       address = nullptr;
+        size_t      size = 0;
+        CompiledDb  db;
+
+        ~Mapping();
+    };
+
+    struct Control;
+
+    const std::string           name_;
+    const Control*              control_ = nullptr;
+    std::atomic<Mapping*>       mapping_{nullptr};
+
+    //! Map the control segment if it is not mapped yet
+    bool map_control( std::string* error );
+};
+
+#endif //DOMAINDB_SHARED_DB_H
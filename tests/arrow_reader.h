@@ -0,0 +1,209 @@
+#ifndef DOMAINDB_ARROW_READER_H
+#define DOMAINDB_ARROW_READER_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Reader of the Arrow IPC streams of ArrowWriter, for the differential tests: the subset of the format the
+//! writer uses (a schema of flat columns, integers or dictionary encoded strings, dictionary batches and
+//! deltas, record batches). It shares no code with the writer and follows the FlatBuffers encoding of
+//! Schema.fbs and Message.fbs field by field, so the two do not agree by sharing a mistake.
+class ArrowReader
+{
+public:
+
+    //! A column; every value is a string, an integer in decimal
+    struct Column
+    {
+        std::string                 name;
+        int                         bit_width = 0;      //!< of the values or the dictionary indices
+        bool                        is_signed = false;
+        int64_t                     dictionary = -1;    //!< id, -1 if the values are integers
+        std::vector<std::string>    values;
+    };
+
+    //! Read a stream
+    //!
+    //! \param stream  - the stream, up to its end marker
+    //! \param columns - receives the columns of all the record batches
+    //! \param error   - receives a description of the problem on failure
+    //! \return true on success
+    static bool read( std::string_view stream, std::vector<Column>* columns, std::string* error )
+    {
+        std::map<int64_t, std::vector<std::string>> dictionaries;
+        bool has_schema = false;
+        for ( size_t position = 0; ; )
+        {
+            if ( position + 8 > stream.size() ) return fail( "the stream ends without its end marker", error );
+            auto metadata_size = load<uint32_t>( stream.data() + position + 4 );
+            if ( load<uint32_t>(stream.data() + position) != 0xFFFFFFFF ) return fail( "no continuation marker", error );
+            if ( metadata_size == 0 ) return (position + 8 == stream.size()) || fail( "data after the end marker", error );
+            if ( (metadata_size % 8 != 0) || (position + 8 + metadata_size > stream.size()) ) return fail( "bad metadata size", error );
+
+            const char* metadata = stream.data() + position + 8;
+            Table message{ metadata + load<uint32_t>(metadata) };
+            auto body_size = size_t( message.scalar<int64_t>(3, 0) );
+            const char* body = metadata + metadata_size;
+            position += 8 + metadata_size + body_size;
+            if ( (message.scalar<int16_t>(0, 0) != 4) || (position > stream.size()) ) return fail( "bad message", error );
+
+            auto header_type = message.scalar<uint8_t>( 1, 0 );
+            auto header = message.table( 2 );
+            if ( header_type == 1 )
+            {
+                auto fields = header.vector( 1 );
+                for ( uint32_t i = 0; i < fields.size; ++i )
+                {
+                    Table field = fields.table( i );
+                    Column column;
+                    column.name = field.string( 0 );
+                    if ( field.scalar<uint8_t>(1, 0) != 0 ) return fail( "a column is nullable", error );
+                    if ( !field.has(5) || (field.vector(5).size != 0) ) return fail( "a column has no children vector", error );
+                    auto type = field.table( 3 );
+                    if ( field.has(4) )
+                    {
+                        if ( field.scalar<uint8_t>(2, 0) != 5 ) return fail( "a dictionary is not of strings", error );
+                        auto dictionary = field.table( 4 );
+                        column.dictionary = dictionary.scalar<int64_t>( 0, 0 );
+                        type = dictionary.table( 1 );
+                    }
+                    else if ( field.scalar<uint8_t>(2, 0) != 2 ) return fail( "a column is not of integers", error );
+                    column.bit_width = type.scalar<int32_t>( 0, 0 );
+                    column.is_signed = type.scalar<uint8_t>( 1, 0 ) != 0;
+                    columns->push_back( column );
+                }
+                has_schema = true;
+            }
+            else if ( !has_schema ) return fail( "a batch comes before the schema", error );
+            else if ( header_type == 2 )
+            {
+                auto data = header.table( 1 );
+                auto& values = dictionaries[header.scalar<int64_t>( 0, 0 )];
+                if ( header.scalar<uint8_t>(2, 0) == 0 ) values.clear();
+                auto length = size_t( data.scalar<int64_t>(0, 0) );
+                auto buffers = data.vector( 2 );
+                if ( buffers.size != 3 ) return fail( "a dictionary batch is not of strings", error );
+                const char* offsets = body + buffers.pair( 1 )[0];
+                const char* bytes = body + buffers.pair( 2 )[0];
+                for ( size_t i = 0; i < length; ++i )
+                {
+                    auto begin = load<int32_t>( offsets + 4 * i );
+                    values.emplace_back( bytes + begin, size_t(load<int32_t>( offsets + 4 * (i + 1) ) - begin) );
+                }
+            }
+            else if ( header_type == 3 )
+            {
+                auto length = size_t( header.scalar<int64_t>(0, 0) );
+                auto nodes = header.vector( 1 );
+                auto buffers = header.vector( 2 );
+                if ( (nodes.size != columns->size()) || (buffers.size != 2 * columns->size()) ) return fail( "bad record batch", error );
+                for ( size_t c = 0; c < columns->size(); ++c )
+                {
+                    auto& column = (*columns)[c];
+                    if ( (size_t(nodes.pair(uint32_t(c))[0]) != length) || (nodes.pair(uint32_t(c))[1] != 0) ) return fail( "bad node", error );
+                    if ( buffers.pair(uint32_t(2 * c + 1))[0] % 8 != 0 ) return fail( "a buffer is not aligned", error );
+                    const char* data = body + buffers.pair( uint32_t(2 * c + 1) )[0];
+                    for ( size_t i = 0; i < length; ++i )
+                    {
+                        auto value = integer( data + i * size_t(column.bit_width / 8), column.bit_width, column.is_signed );
+                        if ( column.dictionary < 0 ) column.values.push_back( std::to_string(value) );
+                        else
+                        {
+                            const auto& values = dictionaries[column.dictionary];
+                            if ( (value < 0) || (value >= int64_t(values.size())) ) return fail( "an index is not in its dictionary", error );
+                            column.values.push_back( values[size_t(value)] );
+                        }
+                    }
+                }
+            }
+            else return fail( "unknown message", error );
+        }
+    }
+
+private:
+
+    template <typename T>
+    static T load( const char* data )
+    {
+        T value;
+        std::memcpy( &value, data, sizeof(T) );
+        return value;
+    }
+
+    static bool fail( const char* problem, std::string* error )
+    {
+        *error = problem;
+        return false;
+    }
+
+    static int64_t integer( const char* data, int bit_width, bool is_signed )
+    {
+        switch ( bit_width )
+        {
+        case 8:     return is_signed ? load<int8_t>( data ) : load<uint8_t>( data );
+        case 16:    return is_signed ? load<int16_t>( data ) : load<uint16_t>( data );
+        case 32:    return is_signed ? load<int32_t>( data ) : load<uint32_t>( data );
+        default:    return load<int64_t>( data );
+        }
+    }
+
+    struct Vector;
+
+    //! A FlatBuffers table: its start holds the signed distance back to its vtable
+    struct Table
+    {
+        const char* start;
+
+        //! The field, nullptr if absent
+        const char* field( int id ) const
+        {
+            const char* vtable = start - load<int32_t>( start );
+            if ( size_t(4 + 2 * id) >= load<uint16_t>(vtable) ) return nullptr;
+            auto offset = load<uint16_t>( vtable + 4 + 2 * id );
+            return (offset == 0) ? nullptr : start + offset;
+        }
+
+        bool has( int id ) const { return field( id ) != nullptr; }
+
+        template <typename T>
+        T scalar( int id, T absent ) const { return has( id ) ? load<T>( field(id) ) : absent; }
+
+        //! The object an offset field points to, forward from the field
+        const char* target( int id ) const { return field( id ) + load<uint32_t>( field(id) ); }
+
+        Table table( int id ) const { return Table{ target(id) }; }
+        Vector vector( int id ) const;
+        std::string string( int id ) const { return std::string( target(id) + 4, load<uint32_t>(target( id )) ); }
+    };
+
+    //! A FlatBuffers vector: its size, then its elements
+    struct Vector
+    {
+        const char* elements;
+        uint32_t    size;
+
+        Table table( uint32_t i ) const { return Table{ elements + 4 * i + load<uint32_t>(elements + 4 * i) }; }
+
+        //! A struct of two longs: FieldNode or Buffer
+        std::array<int64_t, 2> pair( uint32_t i ) const
+        {
+            return { load<int64_t>( elements + 16 * i ), load<int64_t>( elements + 16 * i + 8 ) };
+        }
+    };
+};
+
+inline ArrowReader::Vector ArrowReader::Table::vector( int id ) const
+{
+    return Vector{ target(id) + 4, load<uint32_t>(target( id )) };
+}
+
+#endif //DOMAINDB_ARROW_READER_H
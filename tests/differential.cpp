@@ -0,0 +1,1075 @@
+#include "differential.h"
+#include "arrow_reader.h"
+#include "arrow_writer.h"
+#include "bulk_classifier.h"
+#include "compiled_db.h"
+#include "domaindb.h"
+#include "domain_delta.h"
+#include "domain_index.h"
+#include "idn.h"
+#include "lookup_service.h"
+#include "reference_db.h"
+#include "replicated_db.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+
+#ifdef DOMAINDB_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DOMAINDB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using Json = json11::Json;
+using PortRange = DomainTree::PortRange;
+using MatchResult = DomainTree::MatchResult;
+
+//! A lookup
+struct Query
+{
+    std::string     domain;
+    uint16_t        port;
+    ProtocolType    protocol;
+};
+
+//! Lookups per round of a test case
+static const size_t kQueries = 64;
+
+//! The pieces of the generated names and ports: few, so that names share suffixes and ranges share bounds.
+//! The labels include internationalized ones in both forms and one that is not valid UTF-8.
+static const char* const kLabels[] = { "a", "b", "ab", "www", "cdn", "x-y", "0", "1", "10", "255",
+                                       "b\u00fccher", "B\u00fccher", "xn--bcher-kva", "\u4f8b", "xn--fsq", "ab\u3002cdn", "\xc3" };
+static const uint16_t kPorts[] = { 0, 1, 53, 80, 443, 1023, 1024, 3478, 8080, 65534, 65535 };
+static const char* const kOddNames[] = { ".", "..", "a.", ".a", "a..b", ".1", "1.", "www.", "-" };
+
+//! The service names of the generated databases: all categories, the legacy names and an unknown one
+static const char* const kServices[] = { "small", "unclassified", "gaming", "streaming_tcp", "streaming_udp",
+                                         "streaming_video", "browsing", "live_streaming_udp", "upload_tcp",
+                                         "upload_udp", "untrusted", "undefined", "streaming",
+                                         "downloading or streaming", "live_streaming", "bogus" };
+
+//! One of a few items
+template <typename Item, size_t N>
+static const Item& pick( Choices& choices, const Item (&items)[N] )
+{
+    return items[choices.next( N )];
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! A random port, mostly one of the usual range bounds
+static uint16_t random_port( Choices& choices )
+{
+    return choices.chance( 70 ) ? pick( choices, kPorts ) : uint16_t( choices.next(DomainTree::kPortCount) );
+}
+
+//! A random category, kUnclassified included
+static MultiConnectionType random_category( Choices& choices )
+{
+    return MultiConnectionType( 1 + choices.next(uint32_t(MultiConnectionTypeString.size()) - 1) );
+}
+
+//! A random domain name of up to max_labels labels, an IP address or the empty domain
+static std::string random_name( Choices& choices, uint32_t max_labels )
+{
+    std::string name;
+    if ( choices.chance(3) ) return name;
+
+    bool ip_address = choices.chance( 10 );
+    auto labels = ip_address ? 4 : 1 + choices.next( max_labels );
+    for ( uint32_t label = 0; label < labels; ++label )
+    {
+        if ( label > 0 ) name += '.';
+        name += ip_address ? std::to_string( choices.next(3) * 127 ) : pick( choices, kLabels );
+    }
+    return name;
+}
+
+//! A random port range, sometimes invalid
+static PortRange random_range( Choices& choices, MultiConnectionType category )
+{
+    if ( choices.chance(15) ) return PortRange( category );
+
+    auto first_port = random_port( choices );
+    auto last_port = random_port( choices );
+    if ( (first_port > last_port) && !choices.chance(5) ) std::swap( first_port, last_port );
+    return PortRange( first_port, last_port, category );
+}
+
+//! A random list of port ranges of random categories
+static std::vector<PortRange> random_ranges( Choices& choices )
+{
+    std::vector<PortRange> port_ranges;
+    // Sometimes more ranges than one AVX2 compare of CompiledDb covers
+    for ( auto count = choices.chance(10) ? choices.next(40) : choices.next(4); count > 0; --count )
+    {
+        port_ranges.push_back( random_range(choices, random_category(choices)) );
+    }
+    return port_ranges;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! A random port range of a database entry: [first_port, last_port], [] or an invalid one
+static Json random_range_json( Choices& choices )
+{
+    switch ( choices.next(20) )
+    {
+        case 0:  return Json::array{ int(random_port(choices)) };
+        case 1:  return Json::array{ "80", 80 };
+        case 2:
+        case 3:  return Json::array{};
+        default: break;
+    }
+
+    auto first_port = random_port( choices );
+    auto last_port = random_port( choices );
+    if ( (first_port > last_port) && !choices.chance(10) ) std::swap( first_port, last_port );
+    return Json::array{ int(first_port), int(last_port) };
+}
+
+//! A random database entry of a domain in any of the forms, or an invalid one
+static Json random_entry( Choices& choices, const std::string& domain_name )
+{
+    switch ( choices.next(12) )
+    {
+        case 0:  return Json::array{ domain_name };                                       // (6)
+        case 1:  return Json::array{ domain_name, Json::array{} };                        // (4)
+        case 2:  return Json::array{ domain_name, Json::array{ Json::array{}, Json::array{} } }; // (5)
+        case 3:  break;
+        default: return Json::array{ domain_name, Json::array{ random_range_json(choices), random_range_json(choices) } };
+    }
+
+    switch ( choices.next(7) )
+    {
+        case 0:  return Json( domain_name );
+        case 1:  return Json::array{};
+        case 2:  return Json::array{ domain_name, Json::array{}, Json::array{} };
+        case 3:  return Json::array{ 1 };
+        case 4:  return Json::array{ domain_name, "ports" };
+        case 5:  return Json::array{ domain_name, Json::array{ Json::array{} } };
+        default: return Json::array{ domain_name, Json::array{ 1, Json::array{} } };
+    }
+}
+
+//! A random database in the format of the data file
+//!
+//! \param choices - source of the random choices
+//! \param names   - receives the domain names of the entries
+//! \return the json text
+static std::string random_db( Choices& choices, std::vector<std::string>* names )
+{
+    Json::object services;
+    for ( auto service_count = choices.next(5); service_count > 0; --service_count )
+    {
+        Json::array entries;
+        for ( auto entry_count = choices.next(16); entry_count > 0; --entry_count )
+        {
+            auto domain_name = (!names->empty() && choices.chance(25)) ? (*names)[choices.next(uint32_t(names->size()))]
+                                                                         : random_name( choices, 4 );
+            names->push_back( domain_name );
+            entries.push_back( random_entry(choices, domain_name) );
+        }
+        services[pick( choices, kServices )] = choices.chance( 3 ) ? Json( "domains" ) : Json( entries );
+    }
+    return Json( services ).dump();
+}
+
+//! A random public suffix list in the format of public_suffix_list.dat, with rules made of the same labels as
+//! the domain names: plain rules, wildcards, exceptions, comments and blank lines
+static std::string random_public_suffixes( Choices& choices )
+{
+    std::string text = "// ===BEGIN ICANN DOMAINS===\n";
+    for ( auto rule_count = choices.next(12); rule_count > 0; --rule_count )
+    {
+        std::string rule = pick( choices, kLabels );
+        for ( auto labels = choices.next(3); labels > 0; --labels ) rule = std::string( pick(choices, kLabels) ) + '.' + rule;
+
+        auto kind = choices.next( 10 );
+        if ( kind < 2 ) text += "*." + rule;
+        else if ( kind < 4 ) text += '!' + std::string( pick(choices, kLabels) ) + '.' + rule;
+        else text += rule;
+        text += choices.chance( 20 ) ? " // comment\n" : "\n";
+        if ( choices.chance(10) ) text += "\n";
+    }
+    return text;
+}
+
+//! A random lookup: mostly of a database domain or a name under one, sometimes of an unusual name
+static Query random_query( Choices& choices, const std::vector<std::string>& names )
+{
+    Query query;
+    auto kind = choices.next( 10 );
+    if ( (kind < 6) && !names.empty() )
+    {
+        // A database domain with 0 to 2 labels in front, or with more labels than the filter checks
+        auto labels = (kind == 5) ? 30 + choices.next( 10 ) : choices.next( 3 );
+        for ( ; labels > 0; --labels ) query.domain += std::string( pick(choices, kLabels) ) + '.';
+        query.domain += names[choices.next( uint32_t(names.size()) )];
+    }
+    else if ( kind == 6 ) query.domain = pick( choices, kOddNames );
+    else query.domain = random_name( choices, 5 );
+
+    query.port = random_port( choices );
+    query.protocol = choices.chance( 50 ) ? ProtocolType::TCP : ProtocolType::UDP;
+    return query;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Write a lookup
+static std::ostream& operator<<( std::ostream& out, const Query& query )
+{
+    return out << '"' << query.domain << "\" " << ((query.protocol == ProtocolType::TCP) ? "tcp " : "udp ") << query.port;
+}
+
+//! Write a lookup result
+static std::ostream& operator<<( std::ostream& out, const MatchResult& result )
+{
+    return out << to_string( result.category ) << " categories 0x" << std::hex << result.categories << std::dec
+               << " depth " << int( result.depth );
+}
+
+//! Write a list of names
+static std::ostream& operator<<( std::ostream& out, const std::vector<std::string>& names )
+{
+    out << '[';
+    for ( size_t i = 0; i < names.size(); ++i ) out << ((i > 0) ? ", \"" : "\"") << names[i] << '"';
+    return out << ']';
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Apply a random update to the reference and to the database and compare their outcome
+static size_t random_update( Choices& choices, const std::vector<std::string>& names, ReferenceDb* reference,
+                             DomainTree* domain_tree, std::ostream& failures )
+{
+    auto domain_name = (!names.empty() && choices.chance(70)) ? names[choices.next(uint32_t(names.size()))]
+                                                               : random_name( choices, 3 );
+    auto protocol_type = choices.chance( 50 ) ? ProtocolType::TCP : ProtocolType::UDP;
+    const char* operation;
+    bool expected;
+    bool result;
+
+    switch ( choices.next(5) )
+    {
+        case 0:
+        {
+            auto category = random_category( choices );
+            operation = "add_domain";
+            expected = reference->add_domain( domain_name, category );
+            result = domain_tree->add_domain( domain_name, category );
+            break;
+        }
+        case 1:
+        {
+            auto port_range = random_range( choices, random_category(choices) );
+            operation = "add_port_range";
+            expected = reference->add_port_range( domain_name, protocol_type, port_range );
+            result = domain_tree->add_port_range( domain_name, protocol_type, port_range );
+            break;
+        }
+        case 2:
+        {
+            auto port_ranges = random_ranges( choices );
+            operation = "set_port_ranges";
+            expected = reference->set_port_ranges( domain_name, protocol_type, port_ranges );
+            result = domain_tree->set_port_ranges( domain_name, protocol_type, port_ranges );
+            break;
+        }
+        case 3:
+        {
+            operation = "remove_domain";
+            expected = reference->remove_domain( domain_name );
+            result = domain_tree->remove_domain( domain_name );
+            break;
+        }
+        default:
+        {
+            DomainTree::DomainPorts ports;
+            ports.tcp = random_ranges( choices );
+            ports.udp = random_ranges( choices );
+            operation = "replace_domain";
+            expected = reference->replace_domain( domain_name, ports );
+            result = domain_tree->replace_domain( domain_name, ports );
+            break;
+        }
+    }
+
+    if ( result == expected ) return 0;
+    failures << operation << " \"" << domain_name << "\" returned " << result << ", expected " << expected << '\n';
+    return 1;
+}
+
+//! The domains of a database
+static ReferenceDb::Domains domains_of( const DomainTree& domain_tree )
+{
+    ReferenceDb::Domains domains;
+    domain_tree.for_each_domain( [&]( const DomainTree::Domain& domain_name, const DomainTree::DomainPorts& ports )
+    {
+        domains[domain_name] = ports;
+    } );
+    return domains;
+}
+
+//! Compare the domains and port ranges of the database with the reference
+static size_t check_domains( const ReferenceDb& reference, const DomainTree& domain_tree, std::ostream& failures )
+{
+    auto domains = domains_of( domain_tree );
+    if ( domains == reference.domains() ) return 0;
+
+    std::vector<std::string> differences;
+    for ( const auto& domain : domains )
+    {
+        auto expected = reference.domains().find( domain.first );
+        if ( (expected == reference.domains().end()) || (expected->second != domain.second) ) differences.push_back( domain.first );
+    }
+    for ( const auto& domain : reference.domains() )
+    {
+        if ( domains.count(domain.first) == 0 ) differences.push_back( domain.first );
+    }
+    failures << "DomainTree: the domains " << differences << " differ from the reference\n";
+    return 1;
+}
+
+//! Carry the updates of a database over to the database as loaded with a delta: diff, dump and parse it, apply
+//! it and compare with the reference. Before that, deltas that do not apply must leave the loaded database
+//! unchanged: a wrong base or target fingerprint, and a public suffix as a domain.
+static size_t check_delta( const std::string& db_path, const std::shared_ptr<const PublicSuffixList>& public_suffixes,
+                           const std::vector<std::string>& names, const DomainTree& domain_tree, const ReferenceDb& reference,
+                           std::ostream& failures )
+{
+    DomainTree loaded( db_path, nullptr, public_suffixes );
+    DomainDelta delta;
+    std::string error;
+    if ( !DomainDelta::parse(DomainDelta::diff(loaded, domain_tree).dump(), &delta, &error) )
+    {
+        failures << "DomainDelta: cannot parse a delta it wrote: " << error << '\n';
+        return 1;
+    }
+
+    // A delta written by hand may name domains in Unicode, which must reach the same keys. Names that are not
+    // valid UTF-8 have no canonical form and are left as they are.
+    auto unicode = []( const std::string& name )
+    {
+        auto text = name;
+        for ( auto label : { std::make_pair(std::string("xn--bcher-kva"), std::string("b\u00fccher")),
+                             std::make_pair(std::string("xn--fsq"), std::string("\u4f8b")) } )
+        {
+            for ( auto pos = text.find(label.first); pos != std::string::npos; pos = text.find(label.first, pos) )
+            {
+                text.replace( pos, label.first.size(), label.second );
+            }
+        }
+        std::string ascii;
+        return (Idn::to_ascii(text, &ascii) && (ascii == name)) ? text : name;
+    };
+    for ( auto& domain_name : delta.removed ) domain_name = unicode( domain_name );
+    for ( auto& change : delta.changed ) change.domain = unicode( change.domain );
+
+    std::vector<std::pair<const char*, DomainDelta>> rejected;
+    rejected.emplace_back( "a wrong base fingerprint", delta );
+    rejected.back().second.base_fingerprint ^= 1;
+    rejected.emplace_back( "a wrong target fingerprint", delta );
+    rejected.back().second.target_fingerprint ^= 1;
+
+    // The top level domain of a database domain is a public suffix, unless it is taken for an IP address; the
+    // fingerprints of a delta that adds it come from a database without the list, brought to the loaded one
+    // by a delta
+    std::string suffix;
+    for ( const auto& name : names )
+    {
+        auto dot = name.rfind( '.' );
+        if ( dot == std::string::npos ) continue;
+        if ( !Idn::to_ascii(name.substr(dot + 1), &suffix) ) suffix = name.substr( dot + 1 );
+        if ( !suffix.empty() && !std::isdigit(suffix[0]) ) break;
+        suffix.clear();
+    }
+    if ( public_suffixes && !suffix.empty() && public_suffixes->is_public_suffix(suffix) )
+    {
+        DomainTree unrestricted( db_path );
+        if ( unrestricted.apply_delta(DomainDelta::diff(unrestricted, loaded)) && unrestricted.add_domain(suffix, MultiConnectionType::gaming) )
+        {
+            rejected.emplace_back( "a public suffix", DomainDelta::diff(loaded, unrestricted) );
+        }
+    }
+
+    size_t mismatches = 0;
+    auto domains = domains_of( loaded );
+    auto fingerprint = loaded.fingerprint();
+    for ( const auto& bad : rejected )
+    {
+        if ( loaded.apply_delta(bad.second) || (loaded.fingerprint() != fingerprint) || (domains_of(loaded) != domains) )
+        {
+            failures << "DomainTree::apply_delta: a delta with " << bad.first << " changed the database\n";
+            ++mismatches;
+        }
+    }
+
+    if ( !loaded.apply_delta(delta) || (loaded.fingerprint() != domain_tree.fingerprint()) )
+    {
+        failures << "DomainTree::apply_delta: the delta of the updates does not apply to the database as loaded\n";
+        return mismatches + 1;
+    }
+    return mismatches + check_domains( reference, loaded, failures );
+}
+
+#ifdef DOMAINDB_HAVE_ZLIB
+//! Compress data to one gzip member, empty on failure
+static std::string gzip( const std::string& data )
+{
+    z_stream stream{};
+    if ( deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK ) return std::string();
+
+    std::string compressed( deflateBound(&stream, uLong(data.size())), '\0' );
+    stream.next_in = reinterpret_cast<Bytef*>( const_cast<char*>(data.data()) );
+    stream.avail_in = uInt( data.size() );
+    stream.next_out = reinterpret_cast<Bytef*>( &compressed[0] );
+    stream.avail_out = uInt( compressed.size() );
+    auto result = deflate( &stream, Z_FINISH );
+    compressed.resize( stream.total_out );
+    deflateEnd( &stream );
+    return (result == Z_STREAM_END) ? compressed : std::string();
+}
+#endif
+
+#ifdef DOMAINDB_HAVE_ZSTD
+//! Compress data to one zstd frame, empty on failure
+static std::string zstd( const std::string& data )
+{
+    std::string compressed( ZSTD_compressBound(data.size()), '\0' );
+    auto size = ZSTD_compress( &compressed[0], compressed.size(), data.data(), data.size(), 3 );
+    if ( ZSTD_isError(size) ) return std::string();
+    compressed.resize( size );
+    return compressed;
+}
+#endif
+
+//! Load copies of the database file compressed with each format the build reads, as one member or frame or as
+//! two. They must load as the file itself did; a copy cut short inside its last member or frame must not load.
+static size_t check_compressed( Choices& choices, const std::string& db_text, const std::string& db_path,
+                                const std::shared_ptr<const PublicSuffixList>& public_suffixes, const DomainTree& domain_tree,
+                                std::ostream& failures )
+{
+    std::vector<std::pair<const char*, std::string (*)( const std::string& )>> formats;
+#ifdef DOMAINDB_HAVE_ZLIB
+    formats.emplace_back( "gzip", gzip );
+#endif
+#ifdef DOMAINDB_HAVE_ZSTD
+    formats.emplace_back( "zstd", zstd );
+#endif
+
+    auto write = []( const std::string& path, const char* data, size_t size )
+    {
+        std::ofstream file( path, std::ios::binary | std::ios::trunc );
+        file.write( data, std::streamsize(size) );
+        return bool( file.flush() );
+    };
+
+    size_t mismatches = 0;
+    auto compressed_path = db_path + ".compressed";
+    const auto& report = domain_tree.load_report();
+    auto domains = domains_of( domain_tree );
+    for ( const auto& format : formats )
+    {
+        auto split = choices.chance( 30 ) ? choices.next( uint32_t(db_text.size()) + 1 ) : db_text.size();
+        auto compressed = (split > 0) ? format.second( db_text.substr(0, split) ) : std::string();
+        auto last = (split < db_text.size()) ? format.second( db_text.substr(split) ) : compressed;
+        if ( split < db_text.size() ) compressed += last;
+        if ( (last.size() < 2) || !write(compressed_path, compressed.data(), compressed.size()) )
+        {
+            failures << "cannot write the " << format.first << " copy of " << db_path << '\n';
+            ++mismatches;
+            continue;
+        }
+
+        DomainTree loaded( compressed_path, nullptr, public_suffixes );
+        const auto& loaded_report = loaded.load_report();
+        if ( (loaded_report.error != report.error) || (loaded_report.rejected_count != report.rejected_count)
+             || (loaded_report.entries_per_form != report.entries_per_form) || (domains_of(loaded) != domains) )
+        {
+            failures << "DomainTree: the " << format.first << " copy of the database loads with error \"" << loaded_report.error
+                     << "\", " << loaded_report.rejected_count << " entries rejected, " << loaded_report.domains << " domains, expected \""
+                     << report.error << "\", " << report.rejected_count << ", " << report.domains << '\n';
+            ++mismatches;
+        }
+
+        auto size = compressed.size() - 1 - choices.next( uint32_t(last.size() - 1) );
+        if ( !write(compressed_path, compressed.data(), size) )
+        {
+            failures << "cannot write the truncated " << format.first << " copy of " << db_path << '\n';
+            ++mismatches;
+            continue;
+        }
+        DomainTree truncated( compressed_path, nullptr, public_suffixes );
+        if ( truncated.load_report().error.empty() )
+        {
+            failures << "DomainTree: the " << format.first << " copy of the database truncated to " << size << " of "
+                     << compressed.size() << " bytes loads without error\n";
+            ++mismatches;
+        }
+    }
+    unlink( compressed_path.c_str() );
+    return mismatches;
+}
+
+//! Look up the queries with a lookup engine and compare with the reference
+template <typename Engine>
+static size_t check_lookups( const char* engine_name, const Engine& engine, const ReferenceDb& reference,
+                             const std::vector<Query>& queries, std::ostream& failures )
+{
+    size_t mismatches = 0;
+    for ( const auto& query : queries )
+    {
+        auto expected = reference.classify_domain( query.domain, query.port, query.protocol );
+        auto category = engine.match_domain( query.domain, query.port, query.protocol );
+        auto result = engine.classify_domain( query.domain, query.port, query.protocol );
+        if ( (category == expected.category) && (result.category == expected.category) &&
+             (result.categories == expected.categories) && (result.depth == expected.depth) ) continue;
+
+        ++mismatches;
+        failures << engine_name << ": " << query << ": match_domain " << to_string( category ) << ", classify_domain "
+                 << result << ", expected " << expected << '\n';
+    }
+    return mismatches;
+}
+
+//! Look up the queries in one batch with DomainTree::match_domains and compare with the reference
+static size_t check_batch( const char* engine_name, const DomainTree& domain_tree, const ReferenceDb& reference,
+                           const std::vector<Query>& queries, std::ostream& failures )
+{
+    std::vector<DomainTree::Query> batch;
+    for ( const auto& query : queries ) batch.push_back( DomainTree::Query{ query.domain, query.port, query.protocol } );
+    std::vector<MultiConnectionType> categories( batch.size(), MultiConnectionType::undefined );
+    domain_tree.match_domains( batch.data(), batch.size(), categories.data() );
+
+    size_t mismatches = 0;
+    for ( size_t i = 0; i < queries.size(); ++i )
+    {
+        auto expected = reference.classify_domain( queries[i].domain, queries[i].port, queries[i].protocol ).category;
+        if ( categories[i] == expected ) continue;
+
+        ++mismatches;
+        failures << engine_name << ": " << queries[i] << ": " << to_string( categories[i] ) << ", expected " << to_string( expected ) << '\n';
+    }
+    return mismatches;
+}
+
+//! Classify the queries as a csv file with BulkClassifier, in small chunks on several threads, and compare
+//! the text output with the reference. Some lines are not records and must be copied unchanged.
+static size_t check_bulk_classifier( Choices& choices, const DomainTree& domain_tree, const ReferenceDb& reference,
+                                     const std::vector<Query>& queries, std::ostream& failures )
+{
+    static const char* const kProtocols[2][3] = { { "udp", "UDP", "17" }, { "tcp", "Tcp", "6" } };
+    static const char* const kInvalidLines[] = { "", "#domain,port,protocol", "a.b,80", "a.b,65536,tcp", "a.b,80,icmp", "a.b" };
+
+    std::string input;
+    std::string expected;
+    for ( const auto& query : queries )
+    {
+        if ( choices.chance(10) )
+        {
+            std::string line = pick( choices, kInvalidLines );
+            input += line + '\n';
+            expected += line + '\n';
+        }
+        // The fields are not quoted
+        if ( query.domain.find_first_of(",\t\r\n") != std::string::npos ) continue;
+
+        auto separator = choices.chance( 50 ) ? ',' : '\t';
+        auto line = query.domain + separator + std::to_string( query.port ) + separator + pick( choices, kProtocols[int(query.protocol)] );
+        auto category = reference.classify_domain( query.domain, query.port, query.protocol ).category;
+        input += line + (choices.chance( 10 ) ? "\r\n" : "\n");
+        expected += line + separator + std::string( to_string(category) ) + '\n';
+    }
+
+    BulkClassifier::Options options;
+    options.threads = 3;
+    options.chunk_bytes = 1 + choices.next( 200 );
+    options.chunks_in_flight = 1 + choices.next( 4 );
+    std::string output;
+    BulkClassifier( domain_tree, options ).run( input, BulkClassifier::format_text, [&]( const BulkClassifier::Chunk& chunk )
+    {
+        output += chunk.output;
+        return true;
+    }, nullptr );
+    if ( output == expected ) return 0;
+
+    failures << "BulkClassifier: chunks of " << options.chunk_bytes << " bytes, output:\n" << output << "expected:\n" << expected;
+    return 1;
+}
+
+//! Write the lookups and their categories with ArrowWriter in random batches, read them back with ArrowReader
+//! and compare the rows
+static size_t check_arrow_writer( Choices& choices, const ReferenceDb& reference, const std::vector<Query>& queries,
+                                  std::ostream& failures )
+{
+    std::vector<DomainTree::Query> rows;
+    std::vector<MultiConnectionType> categories;
+    std::vector<MultiConnectionSubtype> subtypes;
+    for ( const auto& query : queries )
+    {
+        rows.push_back( DomainTree::Query{ query.domain, query.port, query.protocol } );
+        categories.push_back( reference.classify_domain(query.domain, query.port, query.protocol).category );
+        subtypes.push_back( MultiConnectionSubtype(choices.next( 5 )) );
+    }
+    bool with_subtypes = choices.chance( 50 );
+
+    ArrowWriter writer;
+    std::string stream;
+    for ( size_t first = 0; first < rows.size() || choices.chance( 10 ); )
+    {
+        auto count = std::min<size_t>( choices.next(20), rows.size() - first );
+        writer.write_batch( &rows[first], &categories[first], with_subtypes ? &subtypes[first] : nullptr, count, &stream );
+        first += count;
+    }
+    writer.finish( &stream );
+
+    std::vector<ArrowReader::Column> columns;
+    std::string error;
+    if ( !ArrowReader::read(stream, &columns, &error) )
+    {
+        failures << "ArrowWriter: " << error << '\n';
+        return 1;
+    }
+    if ( (columns.size() != 5) || (columns[0].name != "domain") || (columns[4].name != "subtype") )
+    {
+        failures << "ArrowWriter: unexpected schema\n";
+        return 1;
+    }
+
+    size_t mismatches = 0;
+    std::set<std::string> domains;
+    for ( size_t i = 0; i < columns[0].values.size() || i < rows.size(); ++i )
+    {
+        std::vector<std::string> expected;
+        if ( i < rows.size() )
+        {
+            auto subtype = with_subtypes ? subtypes[i] : MultiConnectionSubtype::undefined;
+            expected = { queries[i].domain, std::to_string( queries[i].port ), (queries[i].protocol == ProtocolType::TCP) ? "tcp" : "udp",
+                         std::string( to_string(categories[i]) ), std::string( to_string(subtype) ) };
+            domains.insert( queries[i].domain );
+        }
+        std::vector<std::string> actual;
+        for ( const auto& column : columns )
+        {
+            if ( i < column.values.size() ) actual.push_back( column.values[i] );
+        }
+        if ( actual == expected ) continue;
+
+        failures << "ArrowWriter: row " << i << " is";
+        for ( const auto& value : actual ) failures << " '" << value << "'";
+        failures << ", expected";
+        for ( const auto& value : expected ) failures << " '" << value << "'";
+        failures << '\n';
+        ++mismatches;
+    }
+    if ( writer.domains() != domains.size() )
+    {
+        failures << "ArrowWriter: " << writer.domains() << " names in the dictionary, expected " << domains.size() << '\n';
+        ++mismatches;
+    }
+    return mismatches;
+}
+
+//! The C interface of domaindb.h as a lookup engine: match_domain through a batch of one
+class CInterfaceEngine
+{
+public:
+
+    explicit CInterfaceEngine( const domaindb* db ) : db_( db ) {}
+
+    MultiConnectionType match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+    {
+        domaindb_query query{ domain.data(), domain.size(), port, uint8_t(protocol_type) };
+        uint8_t category = 0;
+        domaindb_lookup_batch( db_, &query, 1, &category );
+        return MultiConnectionType( category );
+    }
+
+    MatchResult classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+    {
+        domaindb_result result{};
+        MatchResult match;
+        if ( domaindb_classify(db_, domain.data(), domain.size(), port, uint8_t(protocol_type), &result) != 0 ) return match;
+        match.category = MultiConnectionType( result.category );
+        match.depth = result.depth;
+        match.categories = result.categories;
+        return match;
+    }
+
+private:
+
+    const domaindb* db_;
+};
+
+//! Attach truncated and damaged copies of an image. A truncated image must be rejected; lookups in a damaged
+//! image that attach accepts must not read outside it, which the sanitizers and the fuzzer check.
+static size_t check_damaged_images( Choices& choices, const std::vector<char>& image, const std::vector<Query>& queries,
+                                    std::ostream& failures )
+{
+    // Header fields: domain_count is 32 bits at 12, then 64-bit sizes and offsets from image_size at 16 to the
+    // end of the 152-byte header
+    static const size_t kHeaderSize = 152;
+    static const size_t kDomainCount = 12;
+    static const size_t kSlotMask = 32;
+    static const size_t kEntriesOffset = 48;
+    static const uint64_t kValues[] = { 0, 1, 0xFFFFFFFF, uint64_t(1) << 32, (uint64_t(1) << 62) - 1, ~uint64_t(0) };
+
+    // Copies are 8-byte aligned, as attach requires
+    std::vector<uint64_t> buffer;
+    auto copy = [&]( size_t size ) -> char*
+    {
+        buffer.assign( (size + 7) / 8, 0 );
+        std::memcpy( buffer.data(), image.data(), size );
+        return reinterpret_cast<char*>( buffer.data() );
+    };
+    auto original = [&]( size_t offset )
+    {
+        uint64_t value;
+        std::memcpy( &value, image.data() + offset, 8 );
+        return value;
+    };
+    auto store = [&]( size_t offset, uint64_t value, size_t size )
+    {
+        std::memcpy( reinterpret_cast<char*>(buffer.data()) + offset, &value, size );
+    };
+
+    size_t mismatches = 0;
+    for ( int i = 0; i < 8; ++i )
+    {
+        auto size = choices.next( uint32_t(image.size()) );
+        CompiledDb compiled_db;
+        if ( compiled_db.attach(copy(size), size) )
+        {
+            failures << "CompiledDb: attached an image truncated to " << size << " of " << image.size() << " bytes\n";
+            ++mismatches;
+        }
+    }
+
+    // Counts whose products with the sizes of slots and entries wrap, so that the sums of the bounds checks
+    // would come out small
+    copy( image.size() );
+    store( kSlotMask, (uint64_t(1) << 62) - 1, 8 );
+    store( kDomainCount, 0xFFFFFFFF, 4 );
+    store( kEntriesOffset, original(kEntriesOffset) - 0xFFFFFFFFull * 40, 8 );
+    CompiledDb wrapped_db;
+    if ( wrapped_db.attach(buffer.data(), image.size()) )
+    {
+        failures << "CompiledDb: attached an image whose table sizes wrap\n";
+        ++mismatches;
+    }
+
+    for ( int i = 0; i < 32; ++i )
+    {
+        auto bytes = copy( image.size() );
+        for ( auto changes = 1 + choices.next(3); changes > 0; --changes )
+        {
+            if ( choices.chance(30) ) bytes[choices.next( uint32_t(image.size()) )] ^= char( 1 + choices.next(255) );
+            else
+            {
+                auto offset = choices.chance( 10 ) ? kDomainCount : 16 + 8 * choices.next( uint32_t(kHeaderSize - 16) / 8 );
+                auto value = choices.chance( 50 ) ? pick( choices, kValues ) : original( offset ) + choices.next( 64 ) - 32;
+                store( offset, value, (offset == kDomainCount) ? 4 : 8 );
+            }
+        }
+
+        CompiledDb compiled_db;
+        if ( !compiled_db.attach(buffer.data(), image.size()) ) continue;
+        for ( const auto& query : queries )
+        {
+            compiled_db.match_domain( query.domain, query.port, query.protocol );
+            compiled_db.classify_domain( query.domain, query.port, query.protocol );
+        }
+    }
+    return mismatches;
+}
+
+//! Open the database through the C interface, swap it to the image and compare with the reference
+static size_t check_c_interface( const std::vector<char>& image, const std::string& db_path, bool open_file,
+                                 const ReferenceDb& reference, const std::vector<Query>& queries, std::ostream& failures )
+{
+    char error[256] = "";
+    std::unique_ptr<domaindb, void (*)(domaindb*)> db( open_file ? domaindb_open_file( db_path.c_str(), error, sizeof error )
+                                                                 : domaindb_open_image( image.data(), image.size(), error, sizeof error ),
+                                                       domaindb_close );
+    if ( !db )
+    {
+        failures << "C interface: cannot open the database: " << error << '\n';
+        return 1;
+    }
+
+    size_t mismatches = 0;
+    if ( open_file ) mismatches += check_lookups( "C interface, json file", CInterfaceEngine(db.get()), reference, queries, failures );
+    if ( domaindb_swap_image(db.get(), image.data(), image.size(), error, sizeof error) != 0 )
+    {
+        failures << "C interface: cannot swap to the image: " << error << '\n';
+        return mismatches + 1;
+    }
+    mismatches += check_lookups( "C interface", CInterfaceEngine(db.get()), reference, queries, failures );
+
+    domaindb_stats stats{};
+    if ( (domaindb_get_stats(db.get(), &stats) != 0) || (stats.generation != 2) || (stats.image_size != image.size()) ||
+         (stats.lookups != 2 * queries.size() * (open_file ? 2 : 1)) )
+    {
+        failures << "C interface: wrong stats: generation " << stats.generation << ", image size " << stats.image_size << ", lookups "
+                 << stats.lookups << '\n';
+        ++mismatches;
+    }
+    return mismatches;
+}
+
+//! Look up the queries through a LookupServer, in two pipelined batches, and compare with the reference
+static size_t check_lookup_service( const DomainTree& domain_tree, const std::string& socket_path, const ReferenceDb& reference,
+                                    const std::vector<Query>& queries, std::ostream& failures )
+{
+    DomainLoader loader;
+    loader.set_current( DomainLoader::Snapshot(&domain_tree, []( const DomainTree* ) {}) );
+    LookupServer server( loader, LookupServer::Options() );
+    LookupClient client;
+    std::string error;
+    if ( !server.start(socket_path, &error) || !client.connect(socket_path, &error) )
+    {
+        failures << "LookupServer: " << error << '\n';
+        return 1;
+    }
+
+    // The protocol carries names of up to 255 bytes
+    std::vector<LookupClient::Query> client_queries;
+    for ( const auto& query : queries )
+    {
+        if ( query.domain.size() <= UINT8_MAX ) client_queries.push_back( LookupClient::Query{ query.domain, query.port, query.protocol } );
+    }
+    auto half = client_queries.size() / 2;
+    std::vector<MultiConnectionType> categories[2];
+    uint32_t ids[2] = {};
+    if ( !client.send(7, client_queries.data(), half, &error) ||
+         !client.send(8, client_queries.data() + half, client_queries.size() - half, &error) ||
+         !client.receive(&ids[0], &categories[0], &error) || !client.receive(&ids[1], &categories[1], &error) )
+    {
+        failures << "LookupServer: " << error << '\n';
+        return 1;
+    }
+    if ( (ids[0] != 7) || (ids[1] != 8) || (categories[0].size() != half) || (categories[1].size() != client_queries.size() - half) )
+    {
+        failures << "LookupServer: the responses do not match the requests\n";
+        return 1;
+    }
+
+    size_t mismatches = 0;
+    for ( size_t i = 0; i < client_queries.size(); ++i )
+    {
+        const auto& query = client_queries[i];
+        auto category = (i < half) ? categories[0][i] : categories[1][i - half];
+        auto expected = reference.classify_domain( query.domain, query.port, query.protocol_type ).category;
+        if ( category == expected ) continue;
+
+        ++mismatches;
+        failures << "LookupServer: " << Query{ std::string(query.domain), query.port, query.protocol_type } << ": " << to_string( category )
+                 << ", expected " << to_string( expected ) << '\n';
+    }
+    return mismatches;
+}
+
+//! Run the reverse queries of the index and compare with a scan of the reference
+static size_t check_index( const DomainIndex& domain_index, const ReferenceDb& reference, const std::vector<Query>& queries,
+                           std::ostream& failures )
+{
+    size_t mismatches = 0;
+    auto compare = [&]( const std::string& index_query, std::vector<std::string> names, const std::vector<std::string>& expected )
+    {
+        std::sort( names.begin(), names.end() );
+        if ( names == expected ) return;
+        ++mismatches;
+        failures << "DomainIndex: " << index_query << ": " << names << ", expected " << expected << '\n';
+    };
+
+    for ( size_t category = 1; category < MultiConnectionTypeString.size(); ++category )
+    {
+        std::vector<std::string> expected;
+        for ( const auto& domain : reference.domains() )
+        {
+            auto has_category = [&]( const PortRange& port_range ) { return size_t(port_range.category) == category; };
+            if ( (category != size_t(DomainTree::kUnclassified)) &&
+                 (std::any_of(domain.second.tcp.begin(), domain.second.tcp.end(), has_category) ||
+                  std::any_of(domain.second.udp.begin(), domain.second.udp.end(), has_category)) ) expected.push_back( domain.first );
+        }
+        auto type = MultiConnectionType( category );
+        compare( "category " + std::string(to_string(type)), domain_index.domains_of_category(type), expected );
+    }
+
+    for ( size_t i = 0; i < queries.size(); ++i )
+    {
+        const auto& query = queries[i];
+        bool include_all_ports = (i % 2) != 0;
+        std::vector<std::string> on_port;
+        for ( const auto& domain : reference.domains() )
+        {
+            const auto& port_ranges = (query.protocol == ProtocolType::TCP) ? domain.second.tcp : domain.second.udp;
+            if ( std::any_of(port_ranges.begin(), port_ranges.end(), [&]( const PortRange& port_range )
+                 {
+                     return port_range.in_range(query.port) && (port_range.category != DomainTree::kUnclassified) &&
+                            (include_all_ports || (port_range != PortRange(port_range.category)));
+                 }) ) on_port.push_back( domain.first );
+        }
+        compare( "port " + std::to_string(query.port) + (include_all_ports ? " all" : ""),
+                 domain_index.domains_on_port(query.port, query.protocol, include_all_ports), on_port );
+
+        std::vector<std::string> under;
+        std::vector<std::string> strictly_under;
+        for ( const auto& domain : reference.domains() )
+        {
+            const auto& name = domain.first;
+            bool below = (name.size() > query.domain.size()) &&
+                         (name.compare(name.size() - query.domain.size(), query.domain.size(), query.domain) == 0) &&
+                         (name[name.size() - query.domain.size() - 1] == '.');
+            if ( below || query.domain.empty() ) strictly_under.push_back( name );
+            if ( below || query.domain.empty() || (name == query.domain) ) under.push_back( name );
+        }
+        compare( "under \"" + query.domain + '"', domain_index.domains_under(query.domain), under );
+        if ( !query.domain.empty() ) compare( "under \"*." + query.domain + '"', domain_index.domains_under("*." + query.domain), strictly_under );
+    }
+    return mismatches;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Run one differential test case
+size_t run_differential_case( Choices& choices, const std::string& db_path, std::ostream& failures )
+{
+    std::vector<std::string> names;
+    auto db_text = random_db( choices, &names );
+    auto public_suffix_text = choices.chance( 40 ) ? random_public_suffixes( choices ) : std::string();
+    {
+        std::ofstream db_file( db_path, std::ios::binary | std::ios::trunc );
+        db_file << db_text;
+        if ( !db_file.flush() )
+        {
+            failures << "cannot write " << db_path << '\n';
+            return 1;
+        }
+    }
+
+    ReferenceDb reference;
+    std::string error;
+    std::shared_ptr<const PublicSuffixList> public_suffixes;
+    if ( !public_suffix_text.empty() )
+    {
+        reference.use_public_suffixes( public_suffix_text );
+        public_suffixes = PublicSuffixList::parse( public_suffix_text, &error );
+        if ( !public_suffixes )
+        {
+            failures << "PublicSuffixList: the generated list is not valid: " << error << '\n' << public_suffix_text;
+            return 1;
+        }
+    }
+    if ( !reference.load(db_text, &error) )
+    {
+        failures << "the generated database is not valid: " << error << '\n';
+        return 1;
+    }
+
+    size_t mismatches = 0;
+    DomainTree domain_tree( db_path, nullptr, public_suffixes );
+    const auto& report = domain_tree.load_report();
+    if ( !report.error.empty() || (report.rejected_count != reference.rejected_count()) )
+    {
+        failures << "DomainTree: load error \"" << report.error << "\", " << report.rejected_count << " entries rejected, expected "
+                 << reference.rejected_count() << '\n';
+        ++mismatches;
+    }
+    if ( choices.chance(25) ) mismatches += check_compressed( choices, db_text, db_path, public_suffixes, domain_tree, failures );
+
+    // Check the database as loaded, then after a few updates. The lookups of the first round are repeated after
+    // the updates, so that the negative cache entries they recorded are looked up against the new database.
+    std::vector<Query> queries;
+    for ( size_t round = 0; round < 2; ++round )
+    {
+        if ( round > 0 )
+        {
+            for ( auto updates = choices.next(24); updates > 0; --updates )
+            {
+                mismatches += random_update( choices, names, &reference, &domain_tree, failures );
+            }
+            mismatches += check_delta( db_path, public_suffixes, names, domain_tree, reference, failures );
+        }
+        mismatches += check_domains( reference, domain_tree, failures );
+
+        for ( size_t i = 0; i < kQueries; ++i ) queries.push_back( random_query(choices, names) );
+
+        // The lookup engines, each must give the results of the reference
+        mismatches += check_lookups( "DomainTree", domain_tree, reference, queries, failures );
+        domain_tree.use_negative_cache( false );
+        mismatches += check_lookups( "DomainTree without negative cache", domain_tree, reference, queries, failures );
+        domain_tree.use_negative_cache( true );
+        domain_tree.use_filter( false );
+        mismatches += check_lookups( "DomainTree without filter", domain_tree, reference, queries, failures );
+        mismatches += check_batch( "DomainTree batch without filter", domain_tree, reference, queries, failures );
+        domain_tree.use_filter( true );
+        mismatches += check_batch( "DomainTree batch", domain_tree, reference, queries, failures );
+        mismatches += check_bulk_classifier( choices, domain_tree, reference, queries, failures );
+        mismatches += check_arrow_writer( choices, reference, queries, failures );
+
+        auto image = CompiledDb::compile( domain_tree );
+        CompiledDb compiled_db;
+        if ( !compiled_db.attach(image.data(), image.size()) || (compiled_db.fingerprint() != domain_tree.fingerprint()) )
+        {
+            failures << "CompiledDb: the image is not valid or has another fingerprint\n";
+            ++mismatches;
+        }
+        else
+        {
+            mismatches += check_lookups( "CompiledDb", compiled_db, reference, queries, failures );
+            compiled_db.use_simd( false );
+            mismatches += check_lookups( "CompiledDb without SIMD", compiled_db, reference, queries, failures );
+        }
+        mismatches += check_damaged_images( choices, image, queries, failures );
+
+        ReplicatedDb::Options options;
+        options.replicate = true;
+        auto replicated_db = ReplicatedDb::create( std::string_view(image.data(), image.size()), options, &error );
+        if ( !replicated_db )
+        {
+            failures << "ReplicatedDb: " << error << '\n';
+            ++mismatches;
+        }
+        else mismatches += check_lookups( "ReplicatedDb", *replicated_db, reference, queries, failures );
+
+        // The json file is the database as loaded; the C interface compiles it without a public suffix list
+        mismatches += check_c_interface( image, db_path, (round == 0) && !public_suffixes, reference, queries, failures );
+        mismatches += check_lookup_service( domain_tree, db_path + ".socket", reference, queries, failures );
+
+        mismatches += check_index( DomainIndex(domain_tree), reference, queries, failures );
+    }
+
+    if ( mismatches != 0 ) failures << "database: " << db_text << '\n' << "public suffixes:\n" << public_suffix_text;
+    return mismatches;
+}
+
+//! Create an empty temporary file for the database files of the test cases
+std::string create_temporary_file()
+{
+    auto directory = std::getenv( "TMPDIR" );
+    std::string path = std::string( (directory != nullptr) ? directory : "/tmp" ) + "/domaindb-test-XXXXXX";
+    auto fd = mkstemp( &path[0] );
+    if ( fd < 0 ) return std::string();
+
+    close( fd );
+    return path;
+}
@@ -0,0 +1,85 @@
+#ifndef DOMAINDB_DIFFERENTIAL_H
+#define DOMAINDB_DIFFERENTIAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Source of the random choices of a differential test case
+class Choices
+{
+public:
+
+    virtual ~Choices() = default;
+
+    //! A number in [0, bound)
+    //!
+    //! \param bound - above 0
+    virtual uint32_t next( uint32_t bound ) = 0;
+
+    //! True with a probability of percent / 100
+    bool chance( uint32_t percent ) { return next( 100 ) < percent; }
+};
+
+//! Choices of a seeded generator, for the property test
+class SeededChoices : public Choices
+{
+public:
+
+    explicit SeededChoices( uint64_t seed ) : generator_(seed) {}
+
+    uint32_t next( uint32_t bound ) override { return uint32_t( generator_() % bound ); }
+
+private:
+
+    std::mt19937_64 generator_;
+};
+
+//! Choices read from a fuzzer input, zero once the input runs out
+class ByteChoices : public Choices
+{
+public:
+
+    ByteChoices( const uint8_t* data, size_t size ) : data_(data), size_(size) {}
+
+    uint32_t next( uint32_t bound ) override
+    {
+        uint32_t value = 0;
+        for ( uint32_t range = 1; (range < bound) && (size_ > 0); range <<= 8, ++data_, --size_ ) value = (value << 8) | *data_;
+        return value % bound;
+    }
+
+private:
+
+    const uint8_t*  data_;
+    size_t          size_;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Run one differential test case: generate a random database file, and sometimes a public suffix list, load
+//! them into ReferenceDb and DomainTree, look up random queries with the reference and with every lookup
+//! engine, apply random updates to both and look up again. The engines are DomainTree with and without its
+//! filter, CompiledDb with and without SIMD, ReplicatedDb and DomainIndex; a new lookup engine is added to
+//! the list in differential.cpp.
+//!
+//! \param choices  - source of the random choices
+//! \param db_path  - path of the temporary database file, overwritten
+//! \param failures - receives a description of every mismatch
+//! \return number of mismatches
+size_t run_differential_case( Choices& choices, const std::string& db_path, std::ostream& failures );
+
+//! Create an empty temporary file for the database files of the test cases
+//!
+//! \return its path, empty on failure
+std::string create_temporary_file();
+
+#endif //DOMAINDB_DIFFERENTIAL_H
@@ -0,0 +1,22 @@
+#include "differential.h"
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+//! libFuzzer target of the differential test: the input drives the generation of the database, the queries
+//! and the updates, and any mismatch between a lookup engine and the reference aborts. Build with clang and
+//! -DDOMAINDB_FUZZ=ON, then run e.g. domaindb-fuzz -max_total_time=600 corpus/
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size )
+{
+    static const std::string db_path = create_temporary_file();
+    if ( db_path.empty() ) std::abort();
+
+    ByteChoices choices( data, size );
+    std::ostringstream failures;
+    if ( run_differential_case(choices, db_path, failures) != 0 )
+    {
+        std::cerr << failures.str();
+        std::abort();
+    }
+    return 0;
+}
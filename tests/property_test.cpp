@@ -0,0 +1,38 @@
+#include "differential.h"
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+//! Differential property test of the lookup engines against the reference implementation, run by ctest:
+//!     domaindb-property-test [cases] [first_seed]
+//! Case n uses seed first_seed + n; a failing case is reproduced with domaindb-property-test 1 <its seed>.
+int main( int argc, char* argv[] )
+{
+    size_t cases = (argc > 1) ? std::stoul( argv[1] ) : 500;
+    uint64_t first_seed = (argc > 2) ? std::stoull( argv[2] ) : 1;
+
+    auto db_path = create_temporary_file();
+    if ( db_path.empty() )
+    {
+        std::cerr << "cannot create a temporary file" << std::endl;
+        return 2;
+    }
+
+    int result = 0;
+    for ( size_t i = 0; i < cases; ++i )
+    {
+        SeededChoices choices( first_seed + i );
+        std::ostringstream failures;
+        auto mismatches = run_differential_case( choices, db_path, failures );
+        if ( mismatches != 0 )
+        {
+            std::cerr << "seed " << (first_seed + i) << ": " << mismatches << " mismatches" << std::endl << failures.str();
+            result = 1;
+            break;
+        }
+    }
+    unlink( db_path.c_str() );
+
+    if ( result == 0 ) std::cout << cases << " cases passed" << std::endl;
+    return result;
+}
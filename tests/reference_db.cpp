@@ -0,0 +1,284 @@
+#include "reference_db.h"
+#include "idn.h"
+#include <algorithm>
+
+//! Category of a service name: a legacy name or the name of a MultiConnectionType value
+static MultiConnectionType service_type_of( const std::string& service_name )
+{
+    if ( (service_name == "streaming") || (service_name == "downloading or streaming") ) return MultiConnectionType::streaming_video;
+    if ( service_name == "live_streaming" ) return MultiConnectionType::live_streaming_udp;
+
+    MultiConnectionType type = DomainTree::kUnclassified;
+    from_string( service_name, &type );
+    return type;
+}
+
+//! The canonical form of a domain name, see Idn
+static std::string canonical( std::string_view domain_name )
+{
+    std::string ascii;
+    return Idn::to_ascii( domain_name, &ascii ) ? ascii : std::string( domain_name );
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Load a database in the format of the data file
+bool ReferenceDb::load( const std::string& text, std::string* error )
+{
+    auto db_json = json11::Json::parse( text, *error );
+    if ( !db_json.is_object() )
+    {
+        if ( error->empty() ) *error = "the database is not a json object";
+        return false;
+    }
+
+    for ( const auto& service : db_json.object_items() )
+    {
+        auto service_type = service_type_of( service.first );
+        if ( (service_type == DomainTree::kUnclassified) || !service.second.is_array() )
+        {
+            ++rejected_count_;
+            continue;
+        }
+        for ( const auto& entry_json : service.second.array_items() )
+        {
+            if ( !load_entry(entry_json, service_type) ) ++rejected_count_;
+        }
+    }
+    return true;
+}
+
+//! Load one domain entry of a service
+bool ReferenceDb::load_entry( const json11::Json& entry_json, MultiConnectionType service_type )
+{
+    const auto& items = entry_json.array_items();
+    if ( !entry_json.is_array() || ((items.size() != 1) && (items.size() != 2)) || !items[0].is_string() ) return false;
+    auto domain_name = canonical( items[0].string_value() );
+    if ( rejected_name(domain_name) ) return false;
+
+    // Forms (4), (5) and (6): all ports of both protocols, for a new domain only
+    auto ports_empty = [&]()
+    {
+        if ( items.size() == 1 ) return true;
+        const auto& ports = items[1].array_items();
+        return items[1].is_array() && (ports.empty() ||
+               ((ports.size() == 2) && ports[0].is_array() && ports[1].is_array() &&
+                ports[0].array_items().empty() && ports[1].array_items().empty()));
+    };
+    if ( ports_empty() ) return add_domain( domain_name, service_type );
+
+    // Forms (1), (2) and (3): one range per protocol appended to the domain, a protocol without a range
+    // gets a range of all ports without a category
+    const auto& ports = items[1].array_items();
+    if ( !items[1].is_array() || (ports.size() != 2) ) return false;
+
+    auto domain_ports = ports_of( domain_name );
+    for ( auto protocol_type : { ProtocolType::TCP, ProtocolType::UDP } )
+    {
+        const auto& range_json = ports[(protocol_type == ProtocolType::TCP) ? 0 : 1];
+        const auto& range = range_json.array_items();
+        auto port_range = PortRange( DomainTree::kUnclassified );
+        if ( !range_json.is_array() ) return false;
+        if ( !range.empty() )
+        {
+            if ( (range.size() != 2) || !range[0].is_number() || !range[1].is_number() ) return false;
+            port_range = PortRange( uint16_t(range[0].number_value()), uint16_t(range[1].number_value()), service_type );
+            if ( port_range.first_port > port_range.last_port ) return false;
+        }
+        ((protocol_type == ProtocolType::TCP) ? domain_ports.tcp : domain_ports.udp).push_back( port_range );
+    }
+    domains_[domain_name] = domain_ports;
+    return true;
+}
+
+//! Use a public suffix list
+void ReferenceDb::use_public_suffixes( std::string_view text )
+{
+    public_suffixes_ = true;
+    for ( size_t pos = 0; pos < text.size(); )
+    {
+        auto end = std::min( text.find('\n', pos), text.size() );
+        auto rule = text.substr( pos, end - pos );
+        pos = end + 1;
+
+        rule = rule.substr( 0, rule.find_first_of(" \t\r") );
+        if ( rule.empty() || (rule.substr(0, 2) == "//") ) continue;
+
+        if ( rule[0] == '!' ) exception_rules_.insert( canonical(rule.substr(1)) );
+        else if ( rule.substr(0, 2) == "*." ) wildcard_rules_.insert( canonical(rule.substr(2)) );
+        else rules_.insert( canonical(rule) );
+    }
+}
+
+//! The public suffix of a name: the prevailing rule is an exception, which gives the rule without its first
+//! label, otherwise the longest matching rule, otherwise the last label
+std::string_view ReferenceDb::public_suffix( std::string_view name ) const
+{
+    std::vector<std::string_view> suffixes; // Every suffix starting at a label, longest first
+    for ( size_t start = 0; ; )
+    {
+        suffixes.push_back( name.substr(start) );
+        auto dot = name.find( '.', start );
+        if ( dot == std::string_view::npos ) break;
+        start = dot + 1;
+    }
+
+    for ( size_t i = suffixes.size() - 1; i > 0; --i ) // The shortest exception, if there are several
+    {
+        if ( exception_rules_.count(std::string( suffixes[i - 1] )) != 0 ) return suffixes[i];
+    }
+    for ( size_t i = 0; i < suffixes.size(); ++i )
+    {
+        if ( rules_.count(std::string( suffixes[i] )) != 0 ) return suffixes[i];
+        if ( (i + 1 < suffixes.size()) && (wildcard_rules_.count(std::string( suffixes[i + 1] )) != 0) ) return suffixes[i];
+    }
+    return suffixes.back();
+}
+
+//! True if a name may not have an entry because it is a public suffix
+bool ReferenceDb::rejected_name( std::string_view domain_name ) const
+{
+    bool ip_address = !domain_name.empty() && (domain_name[0] >= '0') && (domain_name[0] <= '9');
+    return public_suffixes_ && !domain_name.empty() && !ip_address && (public_suffix(domain_name).size() == domain_name.size());
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! See DomainTree::match_domain
+MultiConnectionType ReferenceDb::match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const
+{
+    return classify_domain( domain, port, protocol_type ).category;
+}
+
+//! See DomainTree::classify_domain
+ReferenceDb::MatchResult ReferenceDb::classify_domain( std::string_view name, uint16_t port, ProtocolType protocol_type ) const
+{
+    MatchResult result;
+    auto canonical_name = canonical( name );
+    std::string_view domain = canonical_name;
+
+    // Every suffix of the name longer than its public suffix, or the name alone for an IP address
+    bool ip_address = !domain.empty() && (domain[0] >= '0') && (domain[0] <= '9');
+    size_t public_suffix_size = (public_suffixes_ && !ip_address) ? public_suffix( domain ).size() : 0;
+    uint8_t depth = 0;
+    for ( auto name = domain; !name.empty() && (name.size() > public_suffix_size); ++depth )
+    {
+        auto port_ranges = find_ports( name, protocol_type );
+        if ( port_ranges != nullptr )
+        {
+            for ( const auto& port_range : *port_ranges )
+            {
+                if ( port_range.category != DomainTree::kUnclassified ) result.categories |= MatchResult::mask_of( port_range.category );
+            }
+            auto category = find_port( *port_ranges, port );
+            if ( (category != DomainTree::kUnclassified) && (result.category == DomainTree::kUnclassified) )
+            {
+                result.category = category;
+                result.depth = depth;
+            }
+        }
+
+        auto dot = name.find( '.' );
+        if ( ip_address || (dot == std::string_view::npos) ) break;
+        name.remove_prefix( dot + 1 );
+    }
+
+    if ( result.category == DomainTree::kUnclassified )
+    {
+        auto port_ranges = find_ports( "", protocol_type );
+        if ( port_ranges != nullptr ) result.category = find_port( *port_ranges, port );
+        if ( result.category != DomainTree::kUnclassified ) result.categories |= MatchResult::mask_of( result.category );
+    }
+    return result;
+}
+
+//! The first port range of a list that contains a port and has a category
+MultiConnectionType ReferenceDb::find_port( const std::vector<PortRange>& port_ranges, uint16_t port )
+{
+    for ( const auto& port_range : port_ranges )
+    {
+        if ( port_range.in_range(port) && (port_range.category != DomainTree::kUnclassified) ) return port_range.category;
+    }
+    return DomainTree::kUnclassified;
+}
+
+//! The port ranges of a domain for a protocol
+const std::vector<ReferenceDb::PortRange>* ReferenceDb::find_ports( std::string_view domain_name, ProtocolType protocol_type ) const
+{
+    auto domain = domains_.find( Domain(domain_name) );
+    if ( domain == domains_.end() ) return nullptr;
+    return (protocol_type == ProtocolType::TCP) ? &domain->second.tcp : &domain->second.udp;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! See DomainTree::add_domain
+bool ReferenceDb::add_domain( const Domain& name, MultiConnectionType service_type )
+{
+    auto domain_name = canonical( name );
+    if ( rejected_name(domain_name) || (domains_.count(domain_name) != 0) ) return false;
+
+    PortRange full_range( service_type );
+    domains_[domain_name] = DomainPorts{ { full_range }, { full_range } };
+    return true;
+}
+
+//! See DomainTree::add_port_range
+bool ReferenceDb::add_port_range( const Domain& name, ProtocolType protocol_type, const PortRange& port_range )
+{
+    auto domain_name = canonical( name );
+    auto ports = ports_of( domain_name );
+    ((protocol_type == ProtocolType::TCP) ? ports.tcp : ports.udp).push_back( port_range );
+    return replace_domain( domain_name, ports );
+}
+
+//! See DomainTree::set_port_ranges
+bool ReferenceDb::set_port_ranges( const Domain& name, ProtocolType protocol_type, const std::vector<PortRange>& port_ranges )
+{
+    auto domain_name = canonical( name );
+    auto ports = ports_of( domain_name );
+    ((protocol_type == ProtocolType::TCP) ? ports.tcp : ports.udp) = port_ranges;
+    return replace_domain( domain_name, ports );
+}
+
+//! See DomainTree::remove_domain
+bool ReferenceDb::remove_domain( const Domain& name )
+{
+    auto domain_name = canonical( name );
+    return domains_.erase( domain_name ) != 0;
+}
+
+//! See DomainTree::replace_domain
+bool ReferenceDb::replace_domain( const Domain& name, const DomainPorts& ports )
+{
+    auto domain_name = canonical( name );
+    if ( rejected_name(domain_name) || !valid(ports.tcp) || !valid(ports.udp) ) return false;
+
+    // A domain without port ranges does not exist
+    if ( ports.tcp.empty() && ports.udp.empty() ) domains_.erase( domain_name );
+    else domains_[domain_name] = ports;
+    return true;
+}
+
+//! The port ranges of a domain, none if there is no such domain
+ReferenceDb::DomainPorts ReferenceDb::ports_of( const Domain& domain_name ) const
+{
+    auto domain = domains_.find( domain_name );
+    return (domain != domains_.end()) ? domain->second : DomainPorts();
+}
+
+//! True if all port ranges are valid
+bool ReferenceDb::valid( const std::vector<PortRange>& port_ranges )
+{
+    for ( const auto& port_range : port_ranges )
+    {
+        if ( port_range.first_port > port_range.last_port ) return false;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef DOMAINDB_REFERENCE_DB_H
+#define DOMAINDB_REFERENCE_DB_H
+
+#include "domain_tree.h"
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Frozen reference implementation of the database semantics, the oracle of the differential tests.
+//!
+//! It is written for obviousness, not speed: a sorted map of domains, lookups that probe every suffix and
+//! scan every port range. It captures the semantics of DomainTree as they were before the lookups were
+//! optimized:
+//!  - internationalized names are stored and looked up in their ASCII form, see Idn;
+//!  - a name starting with a digit is an IP address and is matched exactly;
+//!  - other names are matched by removing leading tokens until a domain entry gives a category, and with a
+//!    public suffix list only while the name is longer than its public suffix;
+//!  - with a public suffix list, entries for public suffixes are rejected;
+//!  - the first port range of an entry, in file order, that contains the port and is not kUnclassified wins;
+//!  - when no entry matches, the entry with the empty domain is looked up the same way.
+//! Do not change it to follow an optimization; change it only when the semantics change on purpose.
+class ReferenceDb
+{
+public:
+
+    using Domain = DomainTree::Domain;
+    using PortRange = DomainTree::PortRange;
+    using DomainPorts = DomainTree::DomainPorts;
+    using MatchResult = DomainTree::MatchResult;
+    using Domains = std::map<Domain, DomainPorts>;
+
+    //! Load a database in the format of the data file, see DomainTree. Invalid services and entries are
+    //! skipped and counted.
+    //!
+    //! \param text  - the json text of the database
+    //! \param error - receives the json parse error on failure
+    //! \return false if the text is not a json object
+    bool load( const std::string& text, std::string* error );
+
+    //! Use a public suffix list, see PublicSuffixList. Call before load().
+    //!
+    //! \param text - the list, one valid rule per line, "//" comments
+    void use_public_suffixes( std::string_view text );
+
+    //! Number of services and entries skipped by load()
+    size_t rejected_count() const { return rejected_count_; }
+
+    //! See DomainTree::match_domain
+    MultiConnectionType match_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! See DomainTree::classify_domain
+    MatchResult classify_domain( std::string_view domain, uint16_t port, ProtocolType protocol_type ) const;
+
+    //! See DomainTree::add_domain
+    bool add_domain( const Domain& domain_name, MultiConnectionType service_type );
+
+    //! See DomainTree::add_port_range
+    bool add_port_range( const Domain& domain_name, ProtocolType protocol_type, const PortRange& port_range );
+
+    //! See DomainTree::set_port_ranges
+    bool set_port_ranges( const Domain& domain_name, ProtocolType protocol_type, const std::vector<PortRange>& port_ranges );
+
+    //! See DomainTree::remove_domain
+    bool remove_domain( const Domain& domain_name );
+
+    //! See DomainTree::replace_domain
+    bool replace_domain( const Domain& domain_name, const DomainPorts& ports );
+
+    //! All domains with their port ranges
+    const Domains& domains() const { return domains_; }
+
+private:
+
+    Domains domains_;
+    size_t  rejected_count_ = 0;
+
+    bool                    public_suffixes_ = false;   //!< a public suffix list is used
+    std::set<std::string>   rules_;                     //!< rules of the public suffix list in ASCII form
+    std::set<std::string>   wildcard_rules_;            //!< "*." rules without the "*."
+    std::set<std::string>   exception_rules_;           //!< "!" rules without the "!"
+
+    //! The public suffix of a name, by the rules of publicsuffix.org
+    std::string_view public_suffix( std::string_view name ) const;
+
+    //! True if a name may not have an entry because it is a public suffix
+    bool rejected_name( std::string_view domain_name ) const;
+
+    //! Load one domain entry of a service
+    //!
+    //! \return false if the entry is invalid
+    bool load_entry( const json11::Json& entry_json, MultiConnectionType service_type );
+
+    //! The first port range of a list that contains a port and has a category
+    static MultiConnectionType find_port( const std::vector<PortRange>& port_ranges, uint16_t port );
+
+    //! The port ranges of a domain for a protocol, nullptr if there is no such domain
+    const std::vector<PortRange>* find_ports( std::string_view domain_name, ProtocolType protocol_type ) const;
+
+    //! The port ranges of a domain, none if there is no such domain
+    DomainPorts ports_of( const Domain& domain_name ) const;
+
+    //! True if all port ranges are valid
+    static bool valid( const std::vector<PortRange>& port_ranges );
+};
+
+#endif //DOMAINDB_REFERENCE_DB_H
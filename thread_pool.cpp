@@ -0,0 +1,38 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+//! Start the threads
+ThreadPool::ThreadPool( unsigned threads )
+{
+    if ( threads == 0 ) threads = std::max( 1u, std::thread::hardware_concurrency() );
+    threads_.reserve( threads );
+    for ( unsigned i = 0; i < threads; ++i ) threads_.emplace_back( [this]() { run(); } );
+}
+
+//! Finish the tasks already submitted and stop the threads
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for ( auto& thread : threads_ ) thread.join();
+}
+
+//! Body of the pool threads
+void ThreadPool::run()
+{
+    for ( ;; )
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+            wake_.wait( lock, [this]() { return stopping_ || !tasks_.empty(); } );
+            if ( tasks_.empty() ) return;
+            task = std::move( tasks_.front() );
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef DOMAINDB_THREAD_POOL_H
+#define DOMAINDB_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+//! Fixed set of threads running submitted tasks in submission order
+class ThreadPool
+{
+public:
+
+    //! Start the threads
+    //!
+    //! \param threads - number of threads, 0 for one per hardware thread
+    explicit ThreadPool( unsigned threads = 0 );
+
+    //! Finish the tasks already submitted and stop the threads
+    ~ThreadPool();
+
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    //! Run a task on a pool thread
+    //!
+    //! \param task - callable without arguments
+    //! \return future of the result of the task; it holds the exception if the task throws
+    template <typename Task>
+    auto submit( Task&& task ) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>( std::forward<Task>(task) );
+        auto future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            tasks_.emplace_back( [packaged]() { (*packaged)(); } );
+        }
+        wake_.notify_one();
+        return future;
+    }
+
+    //! Number of threads
+    size_t size() const { return threads_.size(); }
+
+private:
+
+    std::mutex                          mutex_;
+    std::condition_variable             wake_;
+    std::deque<std::function<void()>>   tasks_;
+    bool                                stopping_ = false;
+    std::vector<std::thread>            threads_;
+
+    //! Body of the pool threads
+    void run();
+};
+
+#endif //DOMAINDB_THREAD_POOL_H